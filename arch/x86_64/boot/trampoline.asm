@@ -0,0 +1,111 @@
+; M4KK1 x86_64 Architecture - AP Startup Trampoline
+; 应用处理器启动代码
+;
+; m4k_smp_init将m4k_trampoline_start到m4k_trampoline_end之间的代码复制到
+; 物理地址0x8000，应用处理器收到SIPI后从实模式在此开始执行：
+; 实模式 -> 32位保护模式 -> 长模式，然后切换到内核栈并调用m4k_ap_entry。
+; 页表使用引导处理器的PML4（必须位于4GB以下，低端恒等映射覆盖本页）。
+
+%define TRAMPOLINE_BASE 0x8000
+%define TRAMPOLINE(x)   (TRAMPOLINE_BASE + (x) - m4k_trampoline_start)
+
+%define CR0_PE          (1 << 0)
+%define CR0_PG          (1 << 31)
+%define CR4_PAE         (1 << 5)
+%define MSR_EFER        0xC0000080
+%define EFER_LME        (1 << 8)
+%define EFER_NXE        (1 << 11)
+
+; 启动GDT中的选择子
+%define TRAMPOLINE_CODE32   0x08
+%define TRAMPOLINE_DATA     0x10
+%define TRAMPOLINE_CODE64   0x18
+
+section .text
+global m4k_trampoline_start
+global m4k_trampoline_end
+global m4k_trampoline_cr3
+global m4k_trampoline_stack
+global m4k_trampoline_cpu
+global m4k_trampoline_entry
+
+BITS 16
+m4k_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    ; 进入32位保护模式
+    lgdt [TRAMPOLINE(trampoline_gdt_ptr)]
+    mov eax, cr0
+    or eax, CR0_PE
+    mov cr0, eax
+    jmp dword TRAMPOLINE_CODE32:TRAMPOLINE(trampoline_protected)
+
+BITS 32
+trampoline_protected:
+    mov ax, TRAMPOLINE_DATA
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    ; 启用PAE并加载内核页表
+    mov eax, cr4
+    or eax, CR4_PAE
+    mov cr4, eax
+    mov eax, [TRAMPOLINE(m4k_trampoline_cr3)]
+    mov cr3, eax
+
+    ; 启用长模式和不可执行位
+    mov ecx, MSR_EFER
+    rdmsr
+    or eax, EFER_LME | EFER_NXE
+    wrmsr
+
+    ; 启用分页，进入兼容模式后远跳转到64位代码段
+    mov eax, cr0
+    or eax, CR0_PG | CR0_PE
+    mov cr0, eax
+    jmp TRAMPOLINE_CODE64:TRAMPOLINE(trampoline_long)
+
+BITS 64
+trampoline_long:
+    mov ax, TRAMPOLINE_DATA
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    ; 切换到该处理器的内核栈并进入C代码（不返回）
+    mov rsp, [TRAMPOLINE(m4k_trampoline_stack)]
+    mov rdi, [TRAMPOLINE(m4k_trampoline_cpu)]
+    mov rax, [TRAMPOLINE(m4k_trampoline_entry)]
+    call rax
+
+trampoline_halt:
+    cli
+    hlt
+    jmp trampoline_halt
+
+align 8
+trampoline_gdt:
+    dq 0x0000000000000000           ; 空描述符
+    dq 0x00CF9A000000FFFF           ; 32位代码段
+    dq 0x00CF92000000FFFF           ; 数据段
+    dq 0x00AF9A000000FFFF           ; 64位代码段
+trampoline_gdt_end:
+
+trampoline_gdt_ptr:
+    dw trampoline_gdt_end - trampoline_gdt - 1
+    dd TRAMPOLINE(trampoline_gdt)
+
+; 启动参数，由m4k_smp_init填写
+align 8
+m4k_trampoline_cr3:     dq 0        ; 内核PML4物理地址
+m4k_trampoline_stack:   dq 0        ; 内核栈顶
+m4k_trampoline_cpu:     dq 0        ; 处理器编号
+m4k_trampoline_entry:   dq 0        ; m4k_ap_entry地址
+
+m4k_trampoline_end:
@@ -101,6 +101,16 @@ typedef uint64_t pml4e_t;
 #define MTRR_TYPE_WT            0x04    /* Write Through */
 #define MTRR_TYPE_WP            0x05    /* Write Protected */
 #define MTRR_TYPE_WB            0x06    /* Write Back */
+#define PAT_TYPE_UC_MINUS       0x07    /* Uncacheable, MTRR可覆盖为WC */
+
+/* 页属性表 */
+#define MSR_PAT                 0x277
+#define PAT_ENTRY(index, type)  ((uint64_t)(type) << ((index) * 8))
+
+/* 缓存控制 */
+#define M4K_CR0_NW              (1ULL << 29)
+#define M4K_CR0_CD              (1ULL << 30)
+#define M4K_CR4_PGE             (1ULL << 7)
 
 /* CPU特性标志 */
 #define CPUID_FEAT_ECX_SSE3     (1 << 0)
@@ -118,6 +128,7 @@ typedef uint64_t pml4e_t;
 #define CPUID_FEAT_ECX_CX16     (1 << 13)
 #define CPUID_FEAT_ECX_ETPRD    (1 << 14)
 #define CPUID_FEAT_ECX_PDCM     (1 << 15)
+#define CPUID_FEAT_ECX_PCID     (1 << 17)
 #define CPUID_FEAT_ECX_DCA      (1 << 18)
 #define CPUID_FEAT_ECX_SSE4_1   (1 << 19)
 #define CPUID_FEAT_ECX_SSE4_2   (1 << 20)
@@ -130,6 +141,49 @@ typedef uint64_t pml4e_t;
 #define CPUID_FEAT_ECX_AVX      (1 << 28)
 #define CPUID_FEAT_ECX_F16C     (1 << 29)
 #define CPUID_FEAT_ECX_RDRAND   (1 << 30)
+#define CPUID_FEAT_EDX_PAT      (1 << 16)
+#define CPUID_FEAT_EDX_SSE2     (1 << 26)
+#define CPUID_FEAT7_EBX_AVX2    (1 << 5)
+#define CPUID_FEAT7_EBX_INVPCID (1 << 10)
+
+/* 进程上下文标识符（PCID） */
+#define M4K_CR4_PCIDE           (1ULL << 17)
+#define M4K_CR3_PCID_MASK       0xFFFULL
+#define M4K_CR3_NOFLUSH         (1ULL << 63)    /* 加载CR3时保留该PCID的TLB条目 */
+#define M4K_INVPCID_ADDRESS     0               /* 单个地址 */
+#define M4K_INVPCID_CONTEXT     1               /* 单个PCID的全部非全局条目 */
+
+/* 扩展控制寄存器 */
+#define M4K_CR4_OSXSAVE         (1ULL << 18)
+
+/* 段基址 */
+#define MSR_FS_BASE             0xC0000100
+#define MSR_GS_BASE             0xC0000101
+
+/* 本地APIC */
+#define MSR_APIC_BASE           0x1B
+#define APIC_BASE_BSP           (1ULL << 8)
+#define APIC_BASE_ENABLE        (1ULL << 11)
+#define APIC_BASE_ADDR_MASK     0x000FFFFFFFFFF000ULL
+
+#define LAPIC_ID                0x020
+#define LAPIC_TPR               0x080
+#define LAPIC_EOI               0x0B0
+#define LAPIC_SVR               0x0F0
+#define LAPIC_ICR_LOW           0x300
+#define LAPIC_ICR_HIGH          0x310
+
+#define LAPIC_SVR_ENABLE        (1 << 8)
+#define LAPIC_ICR_INIT          (5 << 8)
+#define LAPIC_ICR_STARTUP       (6 << 8)
+#define LAPIC_ICR_PENDING       (1 << 12)
+#define LAPIC_ICR_ASSERT        (1 << 14)
+#define LAPIC_ICR_LEVEL         (1 << 15)
+
+/* 中断向量 */
+#define IPI_VECTOR_RESCHEDULE   0xF0
+#define IPI_VECTOR_TLB_SHOOTDOWN 0xF1
+#define LAPIC_SPURIOUS_VECTOR   0xFF
 
 /* 架构特定函数声明 */
 void m4k_arch_init(void);
@@ -147,6 +201,15 @@ static inline void m4k_cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32
     );
 }
 
+static inline void m4k_cpuid_count(uint32_t leaf, uint32_t subleaf, uint32_t *eax,
+                                   uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+    __asm__ volatile (
+        "cpuid"
+        : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+        : "a"(leaf), "c"(subleaf)
+    );
+}
+
 static inline uint64_t m4k_read_msr(uint32_t msr) {
     uint32_t low, high;
     __asm__ volatile (
@@ -212,6 +275,42 @@ static inline void m4k_write_cr4(uint64_t value) {
     __asm__ volatile ("movq %0, %%cr4" : : "r"(value));
 }
 
+static inline void m4k_invpcid(uint64_t type, uint64_t pcid, uint64_t address) {
+    struct { uint64_t pcid, address; } desc = { pcid, address };
+    __asm__ volatile ("invpcid %0, %1" : : "m"(desc), "r"(type) : "memory");
+}
+
+static inline void m4k_wbinvd(void) {
+    __asm__ volatile ("wbinvd" : : : "memory");
+}
+
+static inline uint64_t m4k_rdtsc(void) {
+    uint32_t low, high;
+    __asm__ volatile ("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline uint64_t m4k_xgetbv(uint32_t index) {
+    uint32_t low, high;
+    __asm__ volatile ("xgetbv" : "=a"(low), "=d"(high) : "c"(index));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void m4k_xsetbv(uint32_t index, uint64_t value) {
+    __asm__ volatile ("xsetbv" : : "a"((uint32_t)value), "d"((uint32_t)(value >> 32)), "c"(index));
+}
+
+/* 端口I/O */
+static inline void m4k_outb(uint16_t port, uint8_t value) {
+    __asm__ volatile ("outb %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint8_t m4k_inb(uint16_t port) {
+    uint8_t value;
+    __asm__ volatile ("inb %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
 /* 原子操作 */
 static inline uint32_t m4k_atomic_exchange(uint32_t *ptr, uint32_t value) {
     __asm__ volatile (
@@ -250,6 +349,84 @@ static inline uint32_t m4k_atomic_decrement(uint32_t *ptr) {
     return m4k_atomic_add(ptr, -1);
 }
 
+/* 中断状态保存与恢复 */
+#define M4K_RFLAGS_IF           (1ULL << 9)
+
+static inline uint64_t m4k_irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile ("pushfq; popq %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void m4k_irq_restore(uint64_t flags) {
+    if (flags & M4K_RFLAGS_IF) {
+        __asm__ volatile ("sti" : : : "memory");
+    }
+}
+
+/* 自旋锁 */
+typedef struct {
+    volatile uint32_t locked;
+} m4k_spinlock_t;
+
+#define M4K_SPINLOCK_INIT { 0 }
+
+static inline void m4k_spin_lock(m4k_spinlock_t *lock) {
+    while (m4k_atomic_exchange((uint32_t *)&lock->locked, 1)) {
+        while (lock->locked) {
+            m4k_pause();
+        }
+    }
+}
+
+static inline void m4k_spin_unlock(m4k_spinlock_t *lock) {
+    __asm__ volatile ("" : : : "memory");
+    lock->locked = 0;
+}
+
+/* 处理器数量上限 */
+#define M4K_MAX_CPUS            8
+
+/* 每处理器数据，GS基址指向本处理器的条目 */
+typedef struct m4k_percpu {
+    struct m4k_percpu *self;
+    uint32_t cpu_id;
+    uint32_t apic_id;
+    volatile uint32_t online;
+    uint32_t reserved;
+    uint64_t ipi_count;         /* 收到的重新调度中断数 */
+    uint64_t tlb_shootdowns;    /* 为其他处理器执行的TLB失效次数 */
+    volatile uint64_t space;    /* 当前加载的页表根（m4k_switch_address_space写入） */
+} m4k_percpu_t;
+
+extern m4k_percpu_t m4k_percpu[M4K_MAX_CPUS];
+
+/* 当前处理器编号（引导处理器在kmain开头调用m4k_smp_init_bsp设置GS基址） */
+static inline uint32_t m4k_cpu_id(void) {
+    uint32_t id;
+    __asm__ volatile ("movl %%gs:%c1, %0" : "=r"(id) : "i"(__builtin_offsetof(m4k_percpu_t, cpu_id)));
+    return id;
+}
+
+/* 当前处理器的每处理器数据 */
+static inline m4k_percpu_t *m4k_this_cpu(void) {
+    m4k_percpu_t *self;
+    __asm__ volatile ("movq %%gs:%c1, %0" : "=r"(self) : "i"(__builtin_offsetof(m4k_percpu_t, self)));
+    return self;
+}
+
+/* 多处理器启动 */
+void m4k_smp_init_bsp(void);
+void m4k_smp_init(void);
+uint32_t m4k_smp_cpu_count(void);
+void m4k_lapic_eoi(void);
+
+/* 在cpus位图中其他已上线的处理器上执行flush(arg)，全部完成后返回。
+ * 调用者不能持有其他处理器会关中断等待的锁，除非等待者在自旋时调用
+ * m4k_tlb_shootdown_poll */
+void m4k_tlb_shootdown(uint32_t cpus, void (*flush)(void *), void *arg);
+void m4k_tlb_shootdown_poll(void);
+
 /* 内存屏障 */
 static inline void m4k_memory_barrier(void) {
     __asm__ volatile ("mfence" : : : "memory");
@@ -34,6 +34,7 @@ endstruc
 %define M4K_KERNEL_DATA         0x10
 %define M4K_USER_CODE           0x18
 %define M4K_USER_DATA           0x20
+%define M4K_TSS_SLOTS           8           ; 与M4K_MAX_CPUS一致
 
 section .data
 align 16
@@ -74,6 +75,12 @@ m4k_gdt:
     db 0xCF                 ; 粒度4K，32位模式
     db 0x00                 ; 基地址高8位
 
+    ; 每个处理器一个任务状态段描述符（16字节，选择子0x28 + 16 * cpu），
+    ; 由smp.c在处理器启动时填写
+global m4k_gdt_tss
+m4k_gdt_tss:
+    times M4K_TSS_SLOTS * 16 db 0
+
 m4k_gdt_end:
 
 ; M4KK1独特的GDT指针
@@ -90,4 +90,39 @@ global m4k_register_interrupt
 m4k_register_interrupt:
     ; 参数：rdi = 中断号, rsi = 处理函数
     mov rax, 0              ; 成功
-    ret
\ No newline at end of file
+    ret
+
+; 本地APIC中断入口：保存调用者保存的寄存器后调用C处理函数
+; 处理器压入的5个字加上这里的9个寄存器共112字节，调用时栈保持16字节对齐
+%macro M4K_APIC_STUB 2
+global %1
+extern %2
+%1:
+    push rax
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    push r11
+
+    cld
+    call %2
+
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rax
+    iretq
+%endmacro
+
+M4K_APIC_STUB m4k_ipi_reschedule_entry, m4k_ipi_reschedule
+M4K_APIC_STUB m4k_ipi_tlb_shootdown_entry, m4k_ipi_tlb_shootdown
+M4K_APIC_STUB m4k_spurious_entry, m4k_spurious_interrupt
@@ -56,6 +56,7 @@
 #include "m4k_arch.h"
 #include "../../../sys/src/include/console.h"
 #include "../../../sys/src/include/memory.h"
+#include "../../../sys/src/include/string.h"
 #include "../../../sys/src/include/process.h"
 #include "../../../sys/src/include/syscall.h"
 
@@ -75,6 +76,9 @@ static struct {
  * 这是M4KK1内核的唯一入口点
  */
 void kmain(uint64_t magic, uint64_t multiboot_addr) {
+    /* 每处理器数据必须最先建立，之后的代码可能调用m4k_cpu_id() */
+    m4k_smp_init_bsp();
+
     /* 初始化控制台 */
     console_init();
 
@@ -105,7 +109,10 @@ void kmain(uint64_t magic, uint64_t multiboot_addr) {
     /* 1. 初始化CPU特性检测 */
     console_write("1. Detecting CPU features...\n");
     m4k_arch_detect_features();
-    console_write("   ✓ CPU features detected\n");
+    string_init();
+    console_write("   ✓ CPU features detected (string functions: ");
+    console_write(string_impl_name());
+    console_write(")\n");
 
     /* 2. 初始化内存管理 */
     console_write("2. Initializing Memory Management...\n");
@@ -127,6 +134,14 @@ void kmain(uint64_t magic, uint64_t multiboot_addr) {
     syscall_init();
     console_write("   ✓ System calls initialized\n");
 
+    /* 启动应用处理器（需要进程管理为其创建空闲进程） */
+    console_write("5a. Starting Application Processors...\n");
+    m4k_smp_init();
+    m4k_kernel_info.cpu_count = m4k_smp_cpu_count();
+    console_write("   ✓ ");
+    console_write_dec(m4k_kernel_info.cpu_count);
+    console_write(" CPU(s) online\n");
+
     /* 6. 初始化设备驱动 */
     console_write("6. Initializing Device Drivers...\n");
     /* TODO: 设备驱动初始化 */
@@ -144,7 +159,9 @@ void kmain(uint64_t magic, uint64_t multiboot_addr) {
     /* 显示系统统计信息 */
     console_write("System Statistics:\n");
     console_write("  Architecture: x86_64\n");
-    console_write("  CPU Cores: 1\n");
+    console_write("  CPU Cores: ");
+    console_write_dec(m4k_smp_cpu_count());
+    console_write("\n");
 
     uint64_t total_mem, free_mem, used_mem;
     total_mem = memory_get_total();
@@ -175,6 +192,8 @@ void kmain(uint64_t magic, uint64_t multiboot_addr) {
     /* 进入调度循环 */
     while (1) {
         process_schedule();
+        m4k_zero_pool_refill();
+        m4k_ksm_run();
         m4k_halt();
     }
 
@@ -223,7 +242,9 @@ void kernel_debug_dump(void) {
     console_write("\n=== M4KK1 x86_64 Kernel Debug Info ===\n");
     console_write("Version: v0.2.0-multarch\n");
     console_write("Architecture: x86_64\n");
-    console_write("CPU Count: 1\n");
+    console_write("CPU Count: ");
+    console_write_dec(m4k_smp_cpu_count());
+    console_write("\n");
 
     uint64_t total, free, used;
     total = memory_get_total();
@@ -0,0 +1,654 @@
+/**
+ * M4KK1 x86_64 Architecture - SMP Bring-up
+ * x86_64多处理器启动与处理器间中断
+ *
+ * 从ACPI MADT枚举本地APIC，用INIT-SIPI-SIPI序列启动应用处理器。
+ * 应用处理器经trampoline.asm从实模式进入长模式，加载内核GDT、页表
+ * 和缓存设置后进入空闲循环，由调度器通过重新调度中断分派进程。
+ *
+ * 每个处理器的GS基址指向m4k_percpu中自己的条目，m4k_cpu_id()据此
+ * 取得处理器编号；sys/src/include/smp.h中的调度器接口在这里实现。
+ */
+
+#include "m4k_arch.h"
+#include "../../../sys/src/include/console.h"
+#include "../../../sys/src/include/memory.h"
+#include "../../../sys/src/include/string.h"
+#include "../../../sys/src/include/process.h"
+#include "../../../sys/src/include/smp.h"
+#include "../../../sys/src/include/arch.h"
+
+/* 启动代码复制到的物理地址（SIPI向量 = 地址 >> 12） */
+#define SMP_TRAMPOLINE_BASE     0x8000
+#define SMP_AP_STACK_SIZE       16384
+
+/* 等待应用处理器上线的时间（微秒） */
+#define SMP_AP_TIMEOUT_US       100000
+
+/* 8254 PIT通道2，用于启动序列中的延时 */
+#define PIT_FREQUENCY           1193182
+#define PIT_CHANNEL2            0x42
+#define PIT_COMMAND             0x43
+#define PIT_GATE_PORT           0x61
+#define PIT_GATE_ENABLE         0x01
+#define PIT_SPEAKER             0x02
+#define PIT_OUT2                0x20
+
+/* ACPI表搜索范围 */
+#define ACPI_EBDA_PTR           0x40E
+#define ACPI_BIOS_START         0xE0000
+#define ACPI_BIOS_END           0x100000
+#define MADT_TYPE_LAPIC         0
+#define MADT_LAPIC_ENABLED      (1 << 0)
+#define MADT_LAPIC_ONLINE_CAP   (1 << 1)
+
+#define IDT_ENTRIES             256
+#define IDT_GATE_INTERRUPT      0x8E
+
+/**
+ * ACPI根系统描述指针
+ */
+typedef struct {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed)) acpi_rsdp_t;
+
+/**
+ * ACPI表头
+ */
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+/**
+ * MADT条目
+ */
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+    uint8_t acpi_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed)) madt_lapic_t;
+
+/**
+ * 64位任务状态段
+ */
+typedef struct {
+    uint32_t reserved0;
+    uint64_t rsp0;              /* 从用户态进入内核时的栈顶 */
+    uint64_t rsp1;
+    uint64_t rsp2;
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} __attribute__((packed)) m4k_tss_t;
+
+/**
+ * 64位中断门
+ */
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t ist;
+    uint8_t type_attr;
+    uint16_t offset_mid;
+    uint32_t offset_high;
+    uint32_t zero;
+} __attribute__((packed)) m4k_idt_gate_t;
+
+/* 启动代码及其参数（trampoline.asm） */
+extern uint8_t m4k_trampoline_start[];
+extern uint8_t m4k_trampoline_end[];
+extern uint64_t m4k_trampoline_cr3;
+extern uint64_t m4k_trampoline_stack;
+extern uint64_t m4k_trampoline_cpu;
+extern uint64_t m4k_trampoline_entry;
+
+/* 中断入口（interrupt.asm） */
+extern void m4k_ipi_reschedule_entry(void);
+extern void m4k_ipi_tlb_shootdown_entry(void);
+extern void m4k_spurious_entry(void);
+
+/* 内核GDT（gdt.asm），TSS描述符每个16字节 */
+extern void m4k_gdt_load(void);
+extern uint8_t m4k_gdt_tss[];
+#define SMP_TSS_SELECTOR        0x28
+#define SMP_TSS_TYPE_AVAILABLE  0x89
+
+m4k_percpu_t m4k_percpu[M4K_MAX_CPUS];
+
+static uint32_t smp_cpus = 1;                           /* 已上线的处理器数 */
+static uint64_t lapic_base = 0;                         /* 本地APIC寄存器虚拟地址 */
+static uint8_t smp_ap_stacks[M4K_MAX_CPUS][SMP_AP_STACK_SIZE] __attribute__((aligned(16)));
+static m4k_idt_gate_t smp_idt[IDT_ENTRIES] __attribute__((aligned(16)));
+static m4k_tss_t smp_tss[M4K_MAX_CPUS] __attribute__((aligned(16)));
+
+/* TLB失效请求：同一时间只有一个发起者，目标处理器完成后清除自己的位 */
+static m4k_spinlock_t tlb_shootdown_lock = M4K_SPINLOCK_INIT;
+static void (*volatile tlb_shootdown_func)(void *);
+static void *volatile tlb_shootdown_arg;
+static volatile uint32_t tlb_shootdown_pending;
+
+/* 引导处理器的控制寄存器，应用处理器照此设置 */
+static uint64_t bsp_cr0;
+static uint64_t bsp_cr4;
+static uint64_t bsp_xcr0;
+
+void m4k_ap_entry(uint64_t cpu);
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return *(volatile uint32_t *)(lapic_base + reg);
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    *(volatile uint32_t *)(lapic_base + reg) = value;
+}
+
+/**
+ * 忙等待指定微秒数（PIT通道2单次计数）
+ */
+static void smp_udelay(uint32_t us) {
+    while (us) {
+        uint32_t chunk = us > 50000 ? 50000 : us;
+        uint32_t count = (uint32_t)((uint64_t)PIT_FREQUENCY * chunk / 1000000);
+
+        if (count == 0) {
+            count = 1;
+        }
+
+        /* 打开通道2门控并关闭扬声器，模式0计数到0时OUT2变高 */
+        m4k_outb(PIT_GATE_PORT, (m4k_inb(PIT_GATE_PORT) & ~PIT_SPEAKER) | PIT_GATE_ENABLE);
+        m4k_outb(PIT_COMMAND, 0xB0);
+        m4k_outb(PIT_CHANNEL2, count & 0xFF);
+        m4k_outb(PIT_CHANNEL2, (count >> 8) & 0xFF);
+        while (!(m4k_inb(PIT_GATE_PORT) & PIT_OUT2)) {
+            m4k_pause();
+        }
+
+        us -= chunk;
+    }
+}
+
+/**
+ * 发送处理器间中断
+ */
+static void lapic_send_ipi(uint32_t apic_id, uint32_t command) {
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) {
+        m4k_pause();
+    }
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+}
+
+/**
+ * 启用本处理器的本地APIC
+ */
+static void lapic_enable(void) {
+    m4k_write_msr(MSR_APIC_BASE, m4k_read_msr(MSR_APIC_BASE) | APIC_BASE_ENABLE);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+/**
+ * 本地APIC中断结束
+ */
+void m4k_lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/**
+ * 设置中断门
+ */
+static void idt_set_gate(uint8_t vector, void (*handler)(void)) {
+    uint64_t offset = (uint64_t)handler;
+    m4k_idt_gate_t *gate = &smp_idt[vector];
+
+    gate->offset_low = offset & 0xFFFF;
+    gate->selector = KERNEL_CODE_SEGMENT;
+    gate->ist = 0;
+    gate->type_attr = IDT_GATE_INTERRUPT;
+    gate->offset_mid = (offset >> 16) & 0xFFFF;
+    gate->offset_high = (uint32_t)(offset >> 32);
+    gate->zero = 0;
+}
+
+/**
+ * 加载IDT（中断系统尚未建立，只包含处理器间中断和伪中断）
+ */
+static void smp_load_idt(void) {
+    struct {
+        uint16_t limit;
+        uint64_t base;
+    } __attribute__((packed)) idtr = { sizeof(smp_idt) - 1, (uint64_t)smp_idt };
+
+    __asm__ volatile ("lidt %0" : : "m"(idtr));
+}
+
+/**
+ * 填写本处理器的TSS描述符并加载任务寄存器
+ * 每个处理器有自己的TSS，rsp0随切换到的进程而变
+ */
+static void tss_setup(uint32_t cpu) {
+    m4k_tss_t *tss = &smp_tss[cpu];
+    uint32_t *desc = (uint32_t *)(m4k_gdt_tss + cpu * 16);
+    uint64_t base = (uint64_t)tss;
+    uint32_t limit = sizeof(m4k_tss_t) - 1;
+
+    memset(tss, 0, sizeof(m4k_tss_t));
+    tss->iomap_base = sizeof(m4k_tss_t);    /* 不提供I/O许可位图 */
+
+    desc[0] = (limit & 0xFFFF) | ((uint32_t)(base & 0xFFFF) << 16);
+    desc[1] = (uint32_t)((base >> 16) & 0xFF) | (SMP_TSS_TYPE_AVAILABLE << 8) |
+              (limit & 0xF0000) | (uint32_t)(base & 0xFF000000);
+    desc[2] = (uint32_t)(base >> 32);
+    desc[3] = 0;
+
+    __asm__ volatile ("ltr %w0" : : "r"((uint16_t)(SMP_TSS_SELECTOR + cpu * 16)));
+}
+
+/**
+ * 设置本处理器的每处理器数据和TSS
+ * 重载段寄存器会清零GS基址，因此必须在加载GDT之后
+ */
+static void percpu_setup(uint32_t cpu) {
+    m4k_percpu_t *percpu = &m4k_percpu[cpu];
+
+    percpu->self = percpu;
+    percpu->cpu_id = cpu;
+    m4k_write_msr(MSR_GS_BASE, (uint64_t)percpu);
+    tss_setup(cpu);
+}
+
+/**
+ * 校验ACPI结构
+ */
+static bool acpi_checksum(const void *data, uint32_t length) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint8_t sum = 0;
+
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+
+    return sum == 0;
+}
+
+/**
+ * 在物理地址范围内搜索RSDP（16字节对齐）
+ * @return RSDT的物理地址，没有找到返回0
+ */
+static uint32_t acpi_scan_rsdp(uint64_t start, uint64_t length) {
+    uint8_t *base = (uint8_t *)m4k_ioremap(start, length, M4K_CACHE_WB);
+    uint32_t rsdt_address = 0;
+
+    if (!base) {
+        return 0;
+    }
+
+    for (uint64_t offset = 0; offset + sizeof(acpi_rsdp_t) <= length; offset += 16) {
+        acpi_rsdp_t *rsdp = (acpi_rsdp_t *)(base + offset);
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 &&
+            acpi_checksum(rsdp, sizeof(acpi_rsdp_t))) {
+            rsdt_address = rsdp->rsdt_address;
+            break;
+        }
+    }
+
+    m4k_iounmap((uint64_t)base, length);
+    return rsdt_address;
+}
+
+/**
+ * 映射一个完整的ACPI表，用完后调用acpi_unmap_table
+ */
+static acpi_header_t *acpi_map_table(uint64_t physical_addr) {
+    acpi_header_t *header = (acpi_header_t *)m4k_ioremap(physical_addr, sizeof(acpi_header_t), M4K_CACHE_WB);
+    uint32_t length;
+
+    if (!header) {
+        return NULL;
+    }
+    length = header->length;
+    m4k_iounmap((uint64_t)header, sizeof(acpi_header_t));
+
+    if (length < sizeof(acpi_header_t)) {
+        return NULL;
+    }
+
+    header = (acpi_header_t *)m4k_ioremap(physical_addr, length, M4K_CACHE_WB);
+    if (header && !acpi_checksum(header, length)) {
+        m4k_iounmap((uint64_t)header, length);
+        return NULL;
+    }
+
+    return header;
+}
+
+/**
+ * 撤销acpi_map_table的映射
+ */
+static void acpi_unmap_table(acpi_header_t *table) {
+    m4k_iounmap((uint64_t)table, table->length);
+}
+
+/**
+ * 查找MADT
+ */
+static acpi_header_t *acpi_find_madt(void) {
+    uint16_t *ebda_ptr = (uint16_t *)m4k_ioremap(ACPI_EBDA_PTR, sizeof(uint16_t), M4K_CACHE_WB);
+    acpi_header_t *rsdt;
+    acpi_header_t *madt = NULL;
+    uint32_t rsdt_address = 0;
+    uint16_t ebda = 0;
+    uint32_t entries;
+
+    if (ebda_ptr) {
+        ebda = *ebda_ptr;
+        m4k_iounmap((uint64_t)ebda_ptr, sizeof(uint16_t));
+    }
+    if (ebda) {
+        rsdt_address = acpi_scan_rsdp((uint64_t)ebda << 4, 1024);
+    }
+    if (!rsdt_address) {
+        rsdt_address = acpi_scan_rsdp(ACPI_BIOS_START, ACPI_BIOS_END - ACPI_BIOS_START);
+    }
+    if (!rsdt_address) {
+        return NULL;
+    }
+
+    rsdt = acpi_map_table(rsdt_address);
+    if (!rsdt) {
+        return NULL;
+    }
+
+    entries = (rsdt->length - sizeof(acpi_header_t)) / sizeof(uint32_t);
+    for (uint32_t i = 0; i < entries && !madt; i++) {
+        uint32_t address = ((uint32_t *)(rsdt + 1))[i];
+        acpi_header_t *table = acpi_map_table(address);
+
+        if (table && memcmp(table->signature, "APIC", 4) == 0) {
+            madt = table;
+        } else if (table) {
+            acpi_unmap_table(table);
+        }
+    }
+
+    acpi_unmap_table(rsdt);
+    return madt;
+}
+
+/**
+ * 启动一个应用处理器，成功返回0
+ */
+static int32_t smp_boot_ap(uint32_t cpu, uint32_t apic_id) {
+    uint8_t *trampoline = (uint8_t *)SMP_TRAMPOLINE_BASE;
+    uint32_t sipi = LAPIC_ICR_STARTUP | (SMP_TRAMPOLINE_BASE >> 12);
+
+    /* 填写启动参数（位于复制后的启动代码中） */
+    *(uint64_t *)(trampoline + ((uint8_t *)&m4k_trampoline_stack - m4k_trampoline_start)) =
+        (uint64_t)&smp_ap_stacks[cpu][SMP_AP_STACK_SIZE];
+    *(uint64_t *)(trampoline + ((uint8_t *)&m4k_trampoline_cpu - m4k_trampoline_start)) = cpu;
+    m4k_memory_barrier();
+
+    m4k_percpu[cpu].apic_id = apic_id;
+    m4k_percpu[cpu].online = 0;
+
+    /* INIT-SIPI-SIPI */
+    lapic_send_ipi(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+    smp_udelay(10000);
+    lapic_send_ipi(apic_id, sipi);
+    smp_udelay(200);
+    if (!m4k_percpu[cpu].online) {
+        lapic_send_ipi(apic_id, sipi);
+    }
+
+    for (uint32_t waited = 0; waited < SMP_AP_TIMEOUT_US; waited += 100) {
+        if (m4k_percpu[cpu].online) {
+            return 0;
+        }
+        smp_udelay(100);
+    }
+
+    return -1;
+}
+
+/**
+ * 应用处理器的C入口（由trampoline.asm在长模式下跳转过来）
+ */
+void m4k_ap_entry(uint64_t cpu) {
+    /* 与引导处理器一致的分页、缓存和扩展状态设置 */
+    m4k_write_cr0(bsp_cr0);
+    m4k_write_cr4(bsp_cr4);
+    if (bsp_cr4 & M4K_CR4_OSXSAVE) {
+        m4k_xsetbv(0, bsp_xcr0);
+    }
+    m4k_pat_init();
+
+    m4k_gdt_load();
+    percpu_setup((uint32_t)cpu);
+    smp_load_idt();
+    lapic_enable();
+
+    process_init_cpu();
+
+    m4k_memory_barrier();
+    m4k_percpu[cpu].online = 1;
+
+    /* 空闲循环：被重新调度中断唤醒后选择进程运行 */
+    m4k_enable_interrupts();
+    while (1) {
+        process_schedule();
+        m4k_halt();
+    }
+}
+
+/**
+ * 重新调度中断处理
+ */
+void m4k_ipi_reschedule(void) {
+    m4k_this_cpu()->ipi_count++;
+    m4k_lapic_eoi();
+    process_schedule();
+}
+
+/**
+ * 执行发给本处理器的TLB失效请求
+ */
+static void tlb_shootdown_service(void) {
+    uint32_t bit = 1U << m4k_cpu_id();
+
+    if (tlb_shootdown_pending & bit) {
+        tlb_shootdown_func(tlb_shootdown_arg);
+        m4k_this_cpu()->tlb_shootdowns++;
+        __sync_fetch_and_and(&tlb_shootdown_pending, ~bit);
+    }
+}
+
+/**
+ * 关中断等锁时处理发给本处理器的TLB失效请求
+ */
+void m4k_tlb_shootdown_poll(void) {
+    tlb_shootdown_service();
+}
+
+/**
+ * TLB失效中断处理
+ */
+void m4k_ipi_tlb_shootdown(void) {
+    tlb_shootdown_service();
+    m4k_lapic_eoi();
+}
+
+/**
+ * 伪中断处理（不需要EOI）
+ */
+void m4k_spurious_interrupt(void) {
+}
+
+/**
+ * 引导处理器的早期初始化：加载内核GDT并设置GS基址
+ * 必须在任何调用m4k_cpu_id()的代码之前执行
+ */
+void m4k_smp_init_bsp(void) {
+    m4k_gdt_load();
+    percpu_setup(0);
+    m4k_percpu[0].online = 1;
+}
+
+/**
+ * 枚举并启动应用处理器
+ */
+void m4k_smp_init(void) {
+    acpi_header_t *madt;
+    uint8_t *entry;
+    uint8_t *end;
+    uint32_t bsp_apic_id;
+
+    /* 映射本地APIC（强不可缓存） */
+    lapic_base = m4k_ioremap(m4k_read_msr(MSR_APIC_BASE) & APIC_BASE_ADDR_MASK, PAGE_SIZE, M4K_CACHE_UC);
+    if (!lapic_base) {
+        console_write("SMP: failed to map local APIC\n");
+        return;
+    }
+
+    idt_set_gate(IPI_VECTOR_RESCHEDULE, m4k_ipi_reschedule_entry);
+    idt_set_gate(IPI_VECTOR_TLB_SHOOTDOWN, m4k_ipi_tlb_shootdown_entry);
+    idt_set_gate(LAPIC_SPURIOUS_VECTOR, m4k_spurious_entry);
+    smp_load_idt();
+    lapic_enable();
+
+    bsp_apic_id = lapic_read(LAPIC_ID) >> 24;
+    m4k_percpu[0].apic_id = bsp_apic_id;
+
+    madt = acpi_find_madt();
+    if (!madt) {
+        console_write("SMP: MADT not found, running on one CPU\n");
+        return;
+    }
+
+    /* 保存引导处理器的设置并复制启动代码 */
+    bsp_cr0 = m4k_read_cr0();
+    bsp_cr4 = m4k_read_cr4();
+    bsp_xcr0 = (bsp_cr4 & M4K_CR4_OSXSAVE) ? m4k_xgetbv(0) : 0;
+
+    m4k_trampoline_cr3 = m4k_read_cr3() & ~M4K_CR3_PCID_MASK;
+    m4k_trampoline_entry = (uint64_t)m4k_ap_entry;
+    memcpy((void *)SMP_TRAMPOLINE_BASE, m4k_trampoline_start,
+           m4k_trampoline_end - m4k_trampoline_start);
+
+    /* MADT表头之后是本地APIC地址和标志，再之后是变长条目 */
+    entry = (uint8_t *)(madt + 1) + 8;
+    end = (uint8_t *)madt + madt->length;
+    while (entry + 2 <= end && entry[1] >= 2) {
+        madt_lapic_t *lapic = (madt_lapic_t *)entry;
+
+        if (lapic->type == MADT_TYPE_LAPIC && lapic->apic_id != bsp_apic_id &&
+            (lapic->flags & (MADT_LAPIC_ENABLED | MADT_LAPIC_ONLINE_CAP))) {
+            if (smp_cpus >= M4K_MAX_CPUS) {
+                console_write("SMP: too many CPUs, ignoring the rest\n");
+                break;
+            }
+
+            if (smp_boot_ap(smp_cpus, lapic->apic_id) == 0) {
+                smp_cpus++;
+            } else {
+                console_write("SMP: APIC ");
+                console_write_dec(lapic->apic_id);
+                console_write(" did not start\n");
+            }
+        }
+
+        entry += entry[1];
+    }
+
+    acpi_unmap_table(madt);
+}
+
+/**
+ * 已上线的处理器数
+ */
+uint32_t m4k_smp_cpu_count(void) {
+    return smp_cpus;
+}
+
+/**
+ * 设置本处理器TSS中从用户态进入内核的栈顶
+ */
+void arch_set_kernel_stack(uintptr_t top) {
+    smp_tss[m4k_cpu_id()].rsp0 = top;
+}
+
+/**
+ * 调度器接口（覆盖sched.c中的单处理器默认实现）
+ */
+uint32_t smp_cpu_id(void) {
+    return m4k_cpu_id();
+}
+
+uint32_t smp_cpu_count(void) {
+    return smp_cpus;
+}
+
+void smp_send_reschedule(uint32_t cpu) {
+    if (cpu >= smp_cpus || cpu == m4k_cpu_id() || !m4k_percpu[cpu].online) {
+        return;
+    }
+
+    lapic_send_ipi(m4k_percpu[cpu].apic_id, LAPIC_ICR_ASSERT | IPI_VECTOR_RESCHEDULE);
+}
+
+/**
+ * 在其他处理器上执行TLB失效并等待完成
+ */
+void m4k_tlb_shootdown(uint32_t cpus, void (*flush)(void *), void *arg) {
+    uint64_t flags;
+
+    cpus &= ~(1U << m4k_cpu_id());
+    for (uint32_t cpu = 0; cpu < M4K_MAX_CPUS; cpu++) {
+        if (cpu >= smp_cpus || !m4k_percpu[cpu].online) {
+            cpus &= ~(1U << cpu);
+        }
+    }
+    if (!cpus) {
+        return;
+    }
+
+    flags = m4k_irq_save();
+
+    /* 等锁时处理其他发起者发来的请求，否则两个发起者会互相等待 */
+    while (m4k_atomic_exchange((uint32_t *)&tlb_shootdown_lock.locked, 1)) {
+        tlb_shootdown_service();
+        m4k_pause();
+    }
+
+    tlb_shootdown_func = flush;
+    tlb_shootdown_arg = arg;
+    m4k_memory_barrier();
+    tlb_shootdown_pending = cpus;
+
+    for (uint32_t cpu = 0; cpu < smp_cpus; cpu++) {
+        if (cpus & (1U << cpu)) {
+            lapic_send_ipi(m4k_percpu[cpu].apic_id, LAPIC_ICR_ASSERT | IPI_VECTOR_TLB_SHOOTDOWN);
+        }
+    }
+    while (tlb_shootdown_pending) {
+        m4k_pause();
+    }
+
+    m4k_spin_unlock(&tlb_shootdown_lock);
+    m4k_irq_restore(flags);
+}
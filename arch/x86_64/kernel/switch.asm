@@ -0,0 +1,69 @@
+; M4KK1 x86_64 Architecture - Context Switch
+; 进程内核栈切换和中断开关（sys/src/include/arch.h）
+
+BITS 64
+
+section .text
+
+; uint64_t arch_irq_save(void)
+global arch_irq_save
+arch_irq_save:
+    pushfq
+    pop rax
+    cli
+    ret
+
+; void arch_irq_restore(uint64_t flags)
+global arch_irq_restore
+arch_irq_restore:
+    test rdi, 0x200
+    jz .done
+    sti
+.done:
+    ret
+
+; 现场自低向高：RFLAGS、R15、R14、R13、R12、RBX、RBP、返回地址
+; uint64_t arch_init_stack(uint64_t top, void (*resume)(void), bool irq_on)
+global arch_init_stack
+arch_init_stack:
+    mov rax, rdi
+    mov ecx, 0x0002
+    test dl, dl
+    jz .flags
+    or ecx, 0x0200
+.flags:
+    sub rax, 64
+    mov [rax + 56], rsi
+    mov qword [rax + 48], 0     ; RBP
+    mov qword [rax + 40], 0     ; RBX
+    mov qword [rax + 32], 0     ; R12
+    mov qword [rax + 24], 0     ; R13
+    mov qword [rax + 16], 0     ; R14
+    mov qword [rax + 8], 0      ; R15
+    mov [rax], rcx
+    ret
+
+; 把被调用者保存的寄存器和RFLAGS压入当前进程的内核栈，RSP存入*prev_sp，
+; 再从next_sp弹出下一个进程的现场，返回到它上次调用这里的位置
+; void arch_switch_stack(uint64_t *prev_sp, uint64_t next_sp, volatile uint32_t *prev_on_cpu)
+global arch_switch_stack
+arch_switch_stack:
+    push rbp
+    push rbx
+    push r12
+    push r13
+    push r14
+    push r15
+    pushfq
+    mov [rdi], rsp
+
+    mov rsp, rsi
+    mov dword [rdx], 0          ; 旧栈已不再使用
+    popfq
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbx
+    pop rbp
+    ret
@@ -66,12 +66,73 @@ typedef uint64_t pt_t;
 #define PTE_DIRTY           (1ULL << 6)
 #define PTE_HUGE            (1ULL << 7)
 #define PTE_GLOBAL          (1ULL << 8)
+#define PTE_COW             (1ULL << 9)     /* 软件位：写时复制 */
 #define PTE_NX              (1ULL << 63)
+#define PTE_ADDR_MASK       0xFFFFFFFFFF000ULL
+#define PTE_PAT             (1ULL << 7)     /* 4KB页表项的PAT位 */
+#define PTE_HUGE_PAT        (1ULL << 12)    /* 大页表项的PAT位 */
+#define PTE_HUGE_ADDR_MASK  0xFFFFFFFE00000ULL
+
+/* 2MB大页 */
+#define HUGE_PAGE_SIZE      0x200000
+#define HUGE_PAGE_FRAMES    (HUGE_PAGE_SIZE / PAGE_SIZE)
+
+/* 1GB巨页（只查询，不由本文件建立） */
+#define GIANT_PAGE_SIZE     0x40000000ULL
+#define PTE_GIANT_ADDR_MASK 0xFFFFFC0000000ULL
+
+/* 物理内存直接映射区（PML4第256项起） */
+#ifndef MEM_BASE
+#define MEM_BASE            0xFFFF800000000000ULL
+#endif
+
+/* 设备内存映射窗口（PML4第384项，虚拟地址分配后不回收） */
+#define IOREMAP_BASE        0xFFFFC00000000000ULL
+#define IOREMAP_SIZE        0x1000000000ULL     /* 64GB */
+
+/* 页面错误码 */
+#define PF_ERR_PRESENT      (1ULL << 0)
+#define PF_ERR_WRITE        (1ULL << 1)
 
 /* 全局页表 */
 static pml4_t *kernel_pml4 = NULL;
 static uint64_t *physical_map = NULL;
 
+/* 访问物理内存的偏移：引导阶段为恒等映射，直接映射建立后为MEM_BASE */
+static uint64_t direct_map_offset = 0;
+
+/* 映射统计 */
+static uint64_t small_mappings = 0;     /* 4KB映射数 */
+static uint64_t huge_mappings = 0;      /* 2MB映射数 */
+
+void m4k_flush_tlb(void);
+uint64_t m4k_alloc_contiguous_pages(uint32_t count);
+void m4k_free_contiguous_pages(uint64_t address, uint32_t count);
+void m4k_copy_page(uint64_t dest, uint64_t src);
+void m4k_zero_page(uint64_t address);
+bool m4k_compare_pages(uint64_t page1, uint64_t page2);
+
+/**
+ * 页表项指向的下一级页表
+ */
+static inline uint64_t *pte_table(uint64_t entry) {
+    return (uint64_t *)((entry & PTE_ADDR_MASK) + direct_map_offset);
+}
+
+/**
+ * 物理地址在内核中的访问地址
+ */
+static inline uint64_t phys_to_virt(uint64_t physical_addr) {
+    return physical_addr + direct_map_offset;
+}
+
+/**
+ * 物理地址在内核中的访问地址（供其他模块访问用户页内容）
+ */
+uint64_t m4k_phys_to_virt(uint64_t physical_addr) {
+    return phys_to_virt(physical_addr);
+}
+
 /* 物理内存管理 */
 #define PHYSICAL_MEMORY_BASE    0x100000    /* 1MB */
 #define PHYSICAL_MEMORY_SIZE    0x40000000  /* 1GB */
@@ -81,6 +142,54 @@ static uint64_t *physical_map = NULL;
 static uint8_t *page_frames = NULL;
 static uint64_t total_pages = 0;
 static uint64_t free_pages = 0;
+static uint64_t page_frame_hint = 0;    /* 下一个可能空闲的页帧 */
+static m4k_spinlock_t page_frames_lock = M4K_SPINLOCK_INIT;
+
+/* 每CPU页帧缓存 */
+#define PCP_CAPACITY            64      /* 缓存容量 */
+#define PCP_HIGH                48      /* 超过此值时批量归还 */
+#define PCP_BATCH               16      /* 每次补充/归还的页数 */
+#define PAGE_FRAME_NONE         (~0ULL)
+
+typedef struct {
+    m4k_spinlock_t lock;            /* 本处理器访问时几乎无竞争，其他处理器归还时持有 */
+    uint64_t pages[PCP_CAPACITY];   /* 页号环形队列：尾部为热端，头部为冷端 */
+    uint32_t first;                 /* 冷端下标 */
+    uint32_t count;                 /* 缓存页数 */
+    uint64_t alloc_hits;            /* 直接从缓存分配的次数 */
+    uint64_t refills;               /* 批量补充次数 */
+    uint64_t drains;                /* 批量归还次数 */
+} m4k_pcp_t;
+
+static m4k_pcp_t pcp_caches[M4K_MAX_CPUS];
+
+/* 预清零页帧池（空闲时补充） */
+#define ZERO_POOL_CAPACITY      128
+#define ZERO_POOL_TARGET        64      /* 空闲时补充到的目标页数 */
+#define ZERO_POOL_BATCH         8       /* 每次空闲循环最多清零的页数 */
+
+static uint64_t zero_pool[ZERO_POOL_CAPACITY];  /* 已清零页的物理地址 */
+static uint32_t zero_pool_count = 0;
+static m4k_spinlock_t zero_pool_lock = M4K_SPINLOCK_INIT;
+static uint64_t zero_pool_hits = 0;
+static uint64_t zero_pool_misses = 0;
+
+/* 页帧描述符 */
+#define PAGE_FRAME_LOCKED       0x0001  /* 页面被锁定在内存中 */
+#define PAGE_FRAME_KSM          0x0002  /* 相同页合并的共享页帧（只读） */
+
+typedef struct {
+    uint32_t refcount;              /* 引用计数，0表示空闲或不受分配器管理 */
+    uint16_t mapcount;              /* 映射该页帧的页表项数 */
+    uint16_t flags;                 /* 页帧标志 */
+    uint32_t checksum;              /* 上次合并扫描时的内容校验和 */
+} m4k_page_frame_t;
+
+static m4k_page_frame_t page_frame_descs[PAGE_FRAME_COUNT];
+
+static void map_direct_memory(void);
+static void tlb_init(void);
+static uint64_t *pd_entry_alloc(pml4_t *pml4, uint64_t virtual_addr);
 
 /**
  * 初始化x86_64内存管理
@@ -92,14 +201,14 @@ void m4k_memory_init(uint64_t total_memory) {
     kernel_pml4 = (pml4_t *)PML4_BASE;
     memset(kernel_pml4, 0, PAGE_SIZE);
 
-    /* 映射内核空间 */
-    for (i = 0; i < 512; i++) {
-        uint64_t entry = (i * 0x80000000ULL) | PTE_PRESENT | PTE_WRITE | PTE_GLOBAL;
-        kernel_pml4[i] = entry;
-    }
+    /* 保留引导阶段的低端恒等映射，内核映像仍在其中运行 */
+    kernel_pml4[0] = ((uint64_t *)(m4k_read_cr3() & PTE_ADDR_MASK))[0];
 
     /* 初始化物理内存位图 */
     total_pages = total_memory / PAGE_SIZE;
+    if (total_pages > PAGE_FRAME_COUNT) {
+        total_pages = PAGE_FRAME_COUNT;
+    }
     page_frames = (uint8_t *)PAGE_FRAMES_BASE;
     memset(page_frames, 0, (total_pages + 7) / 8);
     free_pages = total_pages;
@@ -109,9 +218,24 @@ void m4k_memory_init(uint64_t total_memory) {
         page_frames[i / 8] |= (1 << (i % 8));
         free_pages--;
     }
+    page_frame_hint = PHYSICAL_MEMORY_BASE / PAGE_SIZE;
+
+    /* 初始化每CPU页帧缓存和页帧描述符 */
+    memset(pcp_caches, 0, sizeof(pcp_caches));
+    memset(page_frame_descs, 0, sizeof(page_frame_descs));
+
+    /* 用2MB大页建立物理内存直接映射 */
+    map_direct_memory();
+
+    /* 预先建立设备映射窗口的上层页表，之后创建的地址空间都共享它 */
+    pd_entry_alloc(kernel_pml4, IOREMAP_BASE);
 
     /* 加载页表 */
     __asm__ volatile ("movq %0, %%cr3" : : "r"(kernel_pml4));
+    direct_map_offset = MEM_BASE;
+
+    tlb_init();
+    m4k_pat_init();
 
     console_write("M4KK1 x86_64 memory management initialized\n");
     console_write("Total memory: ");
@@ -122,25 +246,143 @@ void m4k_memory_init(uint64_t total_memory) {
     console_write(" MB\n");
 }
 
+/**
+ * 从全局位图查找空闲页帧（从提示游标开始按64位字扫描）
+ */
+static uint64_t page_bitmap_find_free(void) {
+    uint64_t *words = (uint64_t *)page_frames;
+    uint64_t word_count = (total_pages + 63) / 64;
+    uint64_t start = page_frame_hint / 64;
+    uint64_t n;
+
+    for (n = 0; n < word_count; n++) {
+        uint64_t w = start + n;
+        if (w >= word_count) {
+            w -= word_count;
+        }
+
+        if (words[w] != ~0ULL) {
+            uint64_t page = w * 64 + __builtin_ctzll(~words[w]);
+            if (page < total_pages) {
+                return page;
+            }
+        }
+    }
+
+    return PAGE_FRAME_NONE;
+}
+
+/**
+ * 从全局位图批量分配页帧（调用者持有page_frames_lock）
+ */
+static uint32_t page_bitmap_alloc_batch(uint64_t *out, uint32_t count) {
+    uint32_t allocated = 0;
+
+    while (allocated < count) {
+        uint64_t page = page_bitmap_find_free();
+        if (page == PAGE_FRAME_NONE) {
+            break;
+        }
+
+        page_frames[page / 8] |= (1 << (page % 8));
+        free_pages--;
+        page_frame_hint = page + 1;
+        out[allocated++] = page;
+    }
+
+    return allocated;
+}
+
+/**
+ * 归还页帧到全局位图（调用者持有page_frames_lock）
+ */
+static void page_bitmap_free(uint64_t page) {
+    if (page >= total_pages || !(page_frames[page / 8] & (1 << (page % 8)))) {
+        return;
+    }
+
+    page_frames[page / 8] &= ~(1 << (page % 8));
+    free_pages++;
+
+    if (page < page_frame_hint) {
+        page_frame_hint = page;
+    }
+}
+
+/**
+ * 从全局位图补充每CPU缓存（调用者持有pcp->lock）
+ */
+static void pcp_refill(m4k_pcp_t *pcp) {
+    uint64_t batch[PCP_BATCH];
+    uint32_t count, i;
+
+    m4k_spin_lock(&page_frames_lock);
+    count = page_bitmap_alloc_batch(batch, PCP_BATCH);
+    m4k_spin_unlock(&page_frames_lock);
+
+    /* 按分配顺序的逆序入队，使最低页号最先被取出 */
+    for (i = count; i > 0; i--) {
+        pcp->pages[(pcp->first + pcp->count) % PCP_CAPACITY] = batch[i - 1];
+        pcp->count++;
+    }
+
+    pcp->refills++;
+}
+
+/**
+ * 从冷端批量归还页帧到全局位图（调用者持有pcp->lock）
+ */
+static void pcp_drain(m4k_pcp_t *pcp, uint32_t count) {
+    if (count > pcp->count) {
+        count = pcp->count;
+    }
+
+    m4k_spin_lock(&page_frames_lock);
+    while (count-- > 0) {
+        page_bitmap_free(pcp->pages[pcp->first]);
+        pcp->first = (pcp->first + 1) % PCP_CAPACITY;
+        pcp->count--;
+    }
+    m4k_spin_unlock(&page_frames_lock);
+
+    pcp->drains++;
+}
+
+static uint64_t zero_pool_pop(void);
+
 /**
  * 分配物理页面
  */
 uint64_t m4k_alloc_physical_page(void) {
-    uint64_t i, j;
-
-    for (i = 0; i < total_pages / 8; i++) {
-        if (page_frames[i] != 0xFF) {
-            for (j = 0; j < 8; j++) {
-                if (!(page_frames[i] & (1 << j))) {
-                    page_frames[i] |= (1 << j);
-                    free_pages--;
-                    return (i * 8 + j) * PAGE_SIZE;
-                }
-            }
+    uint64_t flags = m4k_irq_save();
+    m4k_pcp_t *pcp = &pcp_caches[m4k_cpu_id()];
+    uint64_t page;
+
+    m4k_spin_lock(&pcp->lock);
+    if (pcp->count == 0) {
+        pcp_refill(pcp);
+        if (pcp->count == 0) {
+            m4k_spin_unlock(&pcp->lock);
+            m4k_irq_restore(flags);
+            /* 内存不足时动用预清零池 */
+            return zero_pool_pop();
         }
+    } else {
+        pcp->alloc_hits++;
     }
 
-    return 0; /* 内存不足 */
+    /* 从热端取出最近释放的页，缓存中的数据更可能仍然有效 */
+    pcp->count--;
+    page = pcp->pages[(pcp->first + pcp->count) % PCP_CAPACITY];
+
+    m4k_spin_unlock(&pcp->lock);
+    m4k_irq_restore(flags);
+
+    page_frame_descs[page].refcount = 1;
+    page_frame_descs[page].mapcount = 0;
+    page_frame_descs[page].flags = 0;
+    page_frame_descs[page].checksum = 0;
+    return page * PAGE_SIZE;
 }
 
 /**
@@ -148,184 +390,2581 @@ uint64_t m4k_alloc_physical_page(void) {
  */
 void m4k_free_physical_page(uint64_t address) {
     uint64_t page_index = address / PAGE_SIZE;
+    uint64_t flags;
+    m4k_pcp_t *pcp;
+
+    if (page_index >= total_pages) {
+        return;
+    }
+
+    page_frame_descs[page_index].refcount = 0;
 
-    if (page_index < total_pages) {
-        uint64_t byte_index = page_index / 8;
-        uint64_t bit_index = page_index % 8;
+    flags = m4k_irq_save();
+    pcp = &pcp_caches[m4k_cpu_id()];
+    m4k_spin_lock(&pcp->lock);
 
-        page_frames[byte_index] &= ~(1 << bit_index);
-        free_pages++;
+    pcp->pages[(pcp->first + pcp->count) % PCP_CAPACITY] = page_index;
+    pcp->count++;
+
+    if (pcp->count > PCP_HIGH) {
+        pcp_drain(pcp, PCP_BATCH);
     }
+
+    m4k_spin_unlock(&pcp->lock);
+    m4k_irq_restore(flags);
 }
 
 /**
- * 映射虚拟地址到物理地址
+ * 释放冷页面（内容不会很快被再次访问，如DMA缓冲区）
  */
-void m4k_map_page(uint64_t virtual_addr, uint64_t physical_addr, uint64_t flags) {
-    uint64_t pml4_index = (virtual_addr >> 39) & 0x1FF;
-    uint64_t pdp_index = (virtual_addr >> 30) & 0x1FF;
-    uint64_t pd_index = (virtual_addr >> 21) & 0x1FF;
-    uint64_t pt_index = (virtual_addr >> 12) & 0x1FF;
+void m4k_free_physical_page_cold(uint64_t address) {
+    uint64_t page_index = address / PAGE_SIZE;
+    uint64_t flags;
+    m4k_pcp_t *pcp;
 
-    pml4_t *pml4 = kernel_pml4;
-    pdp_t *pdp;
-    pd_t *pd;
-    pt_t *pt;
+    if (page_index >= total_pages) {
+        return;
+    }
 
-    /* 检查PML4条目 */
-    if (!(pml4[pml4_index] & PTE_PRESENT)) {
-        /* 分配新的PDP */
-        uint64_t pdp_addr = m4k_alloc_physical_page();
-        if (!pdp_addr) return;
+    page_frame_descs[page_index].refcount = 0;
 
-        pml4[pml4_index] = pdp_addr | PTE_PRESENT | PTE_WRITE | PTE_USER;
-        pdp = (pdp_t *)pdp_addr;
-        memset(pdp, 0, PAGE_SIZE);
-    } else {
-        pdp = (pdp_t *)((pml4[pml4_index] & 0xFFFFFFFFFF000) + MEM_BASE);
+    flags = m4k_irq_save();
+    pcp = &pcp_caches[m4k_cpu_id()];
+    m4k_spin_lock(&pcp->lock);
+
+    /* 放在冷端，优先被归还给全局位图 */
+    pcp->first = (pcp->first + PCP_CAPACITY - 1) % PCP_CAPACITY;
+    pcp->pages[pcp->first] = page_index;
+    pcp->count++;
+
+    if (pcp->count > PCP_HIGH) {
+        pcp_drain(pcp, PCP_BATCH);
+    }
+
+    m4k_spin_unlock(&pcp->lock);
+    m4k_irq_restore(flags);
+}
+
+/**
+ * 将所有CPU缓存的页帧归还到全局位图（持有各缓存的锁，不与其所属处理器竞争）
+ */
+void m4k_drain_pcp_pages(void) {
+    uint64_t flags = m4k_irq_save();
+    uint32_t cpu;
+
+    for (cpu = 0; cpu < M4K_MAX_CPUS; cpu++) {
+        m4k_pcp_t *pcp = &pcp_caches[cpu];
+
+        m4k_spin_lock(&pcp->lock);
+        if (pcp->count > 0) {
+            pcp_drain(pcp, pcp->count);
+        }
+        m4k_spin_unlock(&pcp->lock);
     }
 
-    /* 检查PDP条目 */
-    if (!(pdp[pdp_index] & PTE_PRESENT)) {
-        /* 分配新的页目录 */
-        uint64_t pd_addr = m4k_alloc_physical_page();
-        if (!pd_addr) return;
+    m4k_irq_restore(flags);
+}
 
-        pdp[pdp_index] = pd_addr | PTE_PRESENT | PTE_WRITE | PTE_USER;
-        pd = (pd_t *)pd_addr;
-        memset(pd, 0, PAGE_SIZE);
-    } else {
-        pd = (pd_t *)((pdp[pdp_index] & 0xFFFFFFFFFF000) + MEM_BASE);
+/**
+ * 获取每CPU页帧缓存统计
+ */
+void m4k_get_pcp_stats(uint32_t cpu, uint32_t *cached, uint64_t *hits,
+                       uint64_t *refills, uint64_t *drains) {
+    if (cpu >= M4K_MAX_CPUS) {
+        if (cached) *cached = 0;
+        return;
     }
 
-    /* 检查页目录条目 */
-    if (!(pd[pd_index] & PTE_PRESENT)) {
-        /* 分配新的页表 */
-        uint64_t pt_addr = m4k_alloc_physical_page();
-        if (!pt_addr) return;
+    if (cached) *cached = pcp_caches[cpu].count;
+    if (hits) *hits = pcp_caches[cpu].alloc_hits;
+    if (refills) *refills = pcp_caches[cpu].refills;
+    if (drains) *drains = pcp_caches[cpu].drains;
+}
 
-        pd[pd_index] = pt_addr | PTE_PRESENT | PTE_WRITE | PTE_USER;
-        pt = (pt_t *)pt_addr;
-        memset(pt, 0, PAGE_SIZE);
-    } else {
-        pt = (pt_t *)((pd[pd_index] & 0xFFFFFFFFFF000) + MEM_BASE);
+/**
+ * 用非临时存储清零一段内存（size为32字节的倍数），绕过缓存以免挤出热数据
+ */
+static void zero_range_nontemporal(uint64_t address, uint64_t size) {
+    uint64_t *ptr = (uint64_t *)address;
+    uint64_t i;
+
+    for (i = 0; i < size / 8; i += 4) {
+        __asm__ volatile (
+            "movnti %1, 0(%0)\n"
+            "movnti %1, 8(%0)\n"
+            "movnti %1, 16(%0)\n"
+            "movnti %1, 24(%0)\n"
+            : : "r"(&ptr[i]), "r"(0ULL) : "memory"
+        );
     }
 
-    /* 设置页表条目 */
-    pt[pt_index] = physical_addr | flags | PTE_PRESENT;
+    /* 非临时存储是弱序的，发布前需要sfence */
+    m4k_write_barrier();
+}
 
-    /* 刷新TLB */
-    __asm__ volatile ("invlpg (%0)" : : "r"(virtual_addr));
+static void zero_page_nontemporal(uint64_t address) {
+    zero_range_nontemporal(address, PAGE_SIZE);
 }
 
 /**
- * 取消映射虚拟地址
+ * 从预清零池取出一页，池为空时返回0
  */
-void m4k_unmap_page(uint64_t virtual_addr) {
-    uint64_t pml4_index = (virtual_addr >> 39) & 0x1FF;
-    uint64_t pdp_index = (virtual_addr >> 30) & 0x1FF;
-    uint64_t pd_index = (virtual_addr >> 21) & 0x1FF;
-    uint64_t pt_index = (virtual_addr >> 12) & 0x1FF;
+static uint64_t zero_pool_pop(void) {
+    uint64_t flags = m4k_irq_save();
+    uint64_t page = 0;
 
-    pml4_t *pml4 = kernel_pml4;
-    pdp_t *pdp;
-    pd_t *pd;
-    pt_t *pt;
+    m4k_spin_lock(&zero_pool_lock);
+    if (zero_pool_count > 0) {
+        page = zero_pool[--zero_pool_count];
+    }
+    m4k_spin_unlock(&zero_pool_lock);
 
-    /* 遍历页表结构 */
-    if (!(pml4[pml4_index] & PTE_PRESENT)) return;
-    pdp = (pdp_t *)((pml4[pml4_index] & 0xFFFFFFFFFF000) + MEM_BASE);
+    m4k_irq_restore(flags);
+    return page;
+}
 
-    if (!(pdp[pdp_index] & PTE_PRESENT)) return;
-    pd = (pd_t *)((pdp[pdp_index] & 0xFFFFFFFFFF000) + MEM_BASE);
+/**
+ * 分配已清零的物理页面（优先使用预清零池）
+ */
+uint64_t m4k_alloc_zeroed_page(void) {
+    uint64_t page = zero_pool_pop();
 
-    if (!(pd[pd_index] & PTE_PRESENT)) return;
-    pt = (pt_t *)((pd[pd_index] & 0xFFFFFFFFFF000) + MEM_BASE);
+    if (page) {
+        zero_pool_hits++;
+        return page;
+    }
 
-    /* 释放物理页面 */
-    uint64_t physical_addr = pt[pt_index] & 0xFFFFFFFFFF000;
-    m4k_free_physical_page(physical_addr);
+    zero_pool_misses++;
+    page = m4k_alloc_physical_page();
+    if (page) {
+        m4k_zero_page(phys_to_virt(page));
+    }
 
-    /* 清除页表条目 */
-    pt[pt_index] = 0;
+    return page;
+}
 
-    /* 刷新TLB */
-    __asm__ volatile ("invlpg (%0)" : : "r"(virtual_addr));
+/**
+ * 补充预清零池（在空闲循环中调用，每次最多清零ZERO_POOL_BATCH页）
+ */
+void m4k_zero_pool_refill(void) {
+    uint32_t n;
+
+    for (n = 0; n < ZERO_POOL_BATCH && zero_pool_count < ZERO_POOL_TARGET; n++) {
+        uint64_t flags;
+        uint64_t page = m4k_alloc_physical_page();
+
+        if (!page) {
+            return;
+        }
+
+        /* 清零在锁外进行，不阻塞分配路径 */
+        zero_page_nontemporal(phys_to_virt(page));
+
+        flags = m4k_irq_save();
+        m4k_spin_lock(&zero_pool_lock);
+        if (zero_pool_count < ZERO_POOL_CAPACITY) {
+            zero_pool[zero_pool_count++] = page;
+            page = 0;
+        }
+        m4k_spin_unlock(&zero_pool_lock);
+        m4k_irq_restore(flags);
+
+        /* 非临时存储清零后内容不在缓存中，放在冷端 */
+        if (page) {
+            m4k_free_physical_page_cold(page);
+            return;
+        }
+    }
 }
 
 /**
- * 获取物理地址
+ * 获取预清零池统计
  */
-uint64_t m4k_get_physical_address(uint64_t virtual_addr) {
-    uint64_t pml4_index = (virtual_addr >> 39) & 0x1FF;
-    uint64_t pdp_index = (virtual_addr >> 30) & 0x1FF;
-    uint64_t pd_index = (virtual_addr >> 21) & 0x1FF;
-    uint64_t pt_index = (virtual_addr >> 12) & 0x1FF;
+void m4k_get_zero_pool_stats(uint32_t *pooled, uint64_t *hits, uint64_t *misses) {
+    if (pooled) *pooled = zero_pool_count;
+    if (hits) *hits = zero_pool_hits;
+    if (misses) *misses = zero_pool_misses;
+}
 
-    pml4_t *pml4 = kernel_pml4;
-    pdp_t *pdp;
-    pd_t *pd;
-    pt_t *pt;
+/**
+ * 获取页帧描述符（页帧不受分配器管理时返回NULL）
+ */
+static m4k_page_frame_t *page_frame_desc(uint64_t physical_addr) {
+    uint64_t page = physical_addr / PAGE_SIZE;
 
-    /* 遍历页表结构 */
-    if (!(pml4[pml4_index] & PTE_PRESENT)) return 0;
-    pdp = (pdp_t *)((pml4[pml4_index] & 0xFFFFFFFFFF000) + MEM_BASE);
+    if (page >= total_pages) {
+        return NULL;
+    }
 
-    if (!(pdp[pdp_index] & PTE_PRESENT)) return 0;
-    pd = (pd_t *)((pdp[pdp_index] & 0xFFFFFFFFFF000) + MEM_BASE);
+    return &page_frame_descs[page];
+}
+
+/**
+ * 增加页帧引用
+ */
+void m4k_page_get(uint64_t physical_addr) {
+    m4k_page_frame_t *desc = page_frame_desc(physical_addr);
+
+    if (desc) {
+        m4k_atomic_increment(&desc->refcount);
+    }
+}
+
+/**
+ * 释放页帧引用，最后一个引用释放时归还页帧
+ */
+void m4k_page_put(uint64_t physical_addr) {
+    m4k_page_frame_t *desc = page_frame_desc(physical_addr);
+
+    /* 未经分配器分配的页帧（如内核映像）不计数 */
+    if (!desc || desc->refcount == 0) {
+        return;
+    }
+
+    if (m4k_atomic_decrement(&desc->refcount) == 1) {
+        m4k_free_physical_page(physical_addr & PAGE_MASK);
+    }
+}
+
+/**
+ * 记录页表项对页帧的映射
+ */
+static void page_frame_map(uint64_t physical_addr) {
+    m4k_page_frame_t *desc = page_frame_desc(physical_addr);
+
+    if (desc) {
+        desc->mapcount++;
+    }
+}
+
+/**
+ * 撤销页表项对页帧的映射并释放其引用
+ */
+static void page_frame_unmap(uint64_t physical_addr) {
+    m4k_page_frame_t *desc = page_frame_desc(physical_addr);
+
+    if (desc && desc->mapcount > 0) {
+        desc->mapcount--;
+    }
+
+    m4k_page_put(physical_addr);
+}
+
+/* TLB管理：每个地址空间使用独立的PCID，切换时不必清空TLB */
+#define PCID_COUNT              4096    /* PCID 0保留给引导阶段的页表 */
+#define PCID_PROBE              8       /* 按页表根散列后的探测次数 */
+#define TLB_BATCH_INVLPG        32      /* 超过此页数时整体刷新而不逐页invlpg */
+#define TLB_BATCH_FRAMES        64      /* 等待TLB失效后释放的页帧数上限 */
+
+typedef struct {
+    uint64_t pml4;                  /* 所属地址空间，0表示空闲 */
+    uint32_t gen;                   /* cpus对应的内核映射世代 */
+    uint32_t cpus;                  /* 在gen世代清空过该PCID的处理器，此后可能缓存其条目 */
+} m4k_pcid_t;
+
+/* 一次失效请求，发起者执行后再交给其他处理器执行 */
+#define TLB_FLUSH_ALL           0xFFFFFFFF  /* 整体失效 */
+#define TLB_CPUS_ALL            0xFFFFFFFF
+
+typedef struct {
+    uint64_t pml4;                      /* 目标地址空间，0表示内核页表 */
+    uint32_t count;                     /* 页数 */
+    const uint64_t *addrs;
+} m4k_tlb_flush_t;
+
+/* 批量失效：收集撤销的映射，最后一次性失效，再释放页帧 */
+typedef struct {
+    uint64_t pml4;                      /* 目标地址空间，0表示内核页表 */
+    uint32_t count;                     /* 待失效的页数 */
+    uint32_t nr_frames;                 /* 待释放的页帧数 */
+    uint64_t addrs[TLB_BATCH_INVLPG];   /* 待失效的地址（超出部分改为整体刷新） */
+    uint64_t frames[TLB_BATCH_FRAMES];  /* 待释放的页帧 */
+} m4k_tlb_batch_t;
+
+static m4k_pcid_t pcid_table[PCID_COUNT];
+static bool pcid_enabled = false;
+static bool invpcid_supported = false;
+static uint32_t pcid_evict_next = 0;
+static m4k_spinlock_t pcid_lock = M4K_SPINLOCK_INIT;
+
+/* 内核页表修改后递增，各PCID在下次加载时发现世代落后即清空 */
+static volatile uint32_t tlb_kernel_gen = 1;
+
+static m4k_tlb_stats_t tlb_stats;
+
+/**
+ * 地址空间是否为本处理器当前加载的页表（其他处理器见tlb_space_cpus）
+ */
+static inline bool space_is_current(uint64_t pml4) {
+    return (m4k_read_cr3() & PTE_ADDR_MASK) == (pml4 & PTE_ADDR_MASK);
+}
+
+/**
+ * 页表根散列到1..PCID_COUNT-1
+ */
+static inline uint32_t pcid_slot(uint64_t pml4, uint32_t probe) {
+    uint32_t hash = (uint32_t)(pml4 >> 12) * 2654435761u;
+    return (hash + probe) % (PCID_COUNT - 1) + 1;
+}
+
+/**
+ * 查找地址空间的PCID（调用者持有pcid_lock），没有时返回0
+ */
+static uint32_t pcid_lookup(uint64_t pml4) {
+    uint32_t i;
+
+    for (i = 0; i < PCID_PROBE; i++) {
+        uint32_t pcid = pcid_slot(pml4, i);
+        if (pcid_table[pcid].pml4 == pml4) {
+            return pcid;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * 为地址空间分配PCID（调用者持有pcid_lock），探测范围内没有空闲项时轮流回收
+ */
+static uint32_t pcid_assign(uint64_t pml4) {
+    uint32_t pcid;
+    uint32_t i;
+
+    for (i = 0; i < PCID_PROBE; i++) {
+        pcid = pcid_slot(pml4, i);
+        if (pcid_table[pcid].pml4 == 0) {
+            break;
+        }
+    }
+
+    if (i == PCID_PROBE) {
+        pcid = pcid_slot(pml4, pcid_evict_next++ % PCID_PROBE);
+        tlb_stats.pcid_evictions++;
+    }
+
+    /* 没有处理器清空过，各处理器首次加载时都清空该PCID残留的条目 */
+    pcid_table[pcid].pml4 = pml4;
+    pcid_table[pcid].gen = 0;
+    pcid_table[pcid].cpus = 0;
+    return pcid;
+}
+
+/**
+ * 放弃地址空间的PCID，下次切换时重新分配并清空
+ */
+static void pcid_drop(uint64_t pml4) {
+    uint64_t flags;
+    uint32_t pcid;
+
+    if (!pcid_enabled) {
+        return;
+    }
+
+    flags = m4k_irq_save();
+    m4k_spin_lock(&pcid_lock);
+    pcid = pcid_lookup(pml4 & PTE_ADDR_MASK);
+    if (pcid) {
+        pcid_table[pcid].pml4 = 0;
+    }
+    m4k_spin_unlock(&pcid_lock);
+    m4k_irq_restore(flags);
+}
+
+/**
+ * 使某地址空间的页表项修改在本处理器上生效
+ * 未启用PCID时其他地址空间在切换CR3时整体刷新；启用后用INVPCID
+ * 精确失效，不支持时放弃其PCID
+ */
+static void tlb_flush_space_page(uint64_t pml4, uint64_t virtual_addr) {
+    uint64_t flags;
+    uint32_t pcid;
+
+    if (space_is_current(pml4)) {
+        __asm__ volatile ("invlpg (%0)" : : "r"(virtual_addr) : "memory");
+        tlb_stats.page_flushes++;
+        return;
+    }
+
+    if (!pcid_enabled) {
+        return;
+    }
+
+    flags = m4k_irq_save();
+    m4k_spin_lock(&pcid_lock);
+    pcid = pcid_lookup(pml4 & PTE_ADDR_MASK);
+    if (pcid && invpcid_supported) {
+        m4k_invpcid(M4K_INVPCID_ADDRESS, pcid, virtual_addr);
+        tlb_stats.page_flushes++;
+    } else if (pcid) {
+        pcid_table[pcid].pml4 = 0;
+    }
+    m4k_spin_unlock(&pcid_lock);
+    m4k_irq_restore(flags);
+}
+
+/**
+ * 使某地址空间的全部用户映射在本处理器上失效
+ */
+static void tlb_flush_space(uint64_t pml4) {
+    if (space_is_current(pml4)) {
+        m4k_flush_tlb();
+    } else {
+        pcid_drop(pml4);
+    }
+}
+
+/**
+ * 在本处理器上执行一次失效请求（也是发给其他处理器的处理函数）
+ * 内核页表的修改只失效当前PCID，其他PCID中的副本在下次加载时发现
+ * 内核映射世代落后而清空
+ */
+static void tlb_flush_local(void *arg) {
+    const m4k_tlb_flush_t *flush = (const m4k_tlb_flush_t *)arg;
+    uint32_t i;
+
+    if (flush->count > TLB_BATCH_INVLPG) {
+        if (flush->pml4 == 0) {
+            m4k_flush_tlb();
+        } else {
+            tlb_flush_space(flush->pml4);
+        }
+        return;
+    }
+
+    for (i = 0; i < flush->count; i++) {
+        if (flush->pml4 == 0) {
+            __asm__ volatile ("invlpg (%0)" : : "r"(flush->addrs[i]) : "memory");
+            tlb_stats.page_flushes++;
+        } else {
+            tlb_flush_space_page(flush->pml4, flush->addrs[i]);
+        }
+    }
+}
+
+/**
+ * 可能缓存了地址空间条目的处理器：当前加载着它的，以及它的PCID在
+ * 本世代清空过之后加载过它的（在页表项修改之后调用）
+ */
+static uint32_t tlb_space_cpus(uint64_t pml4) {
+    uint64_t flags;
+    uint32_t cpus = 0;
+    uint32_t pcid;
+    uint32_t cpu;
+
+    /* 与m4k_switch_address_space先写space再加载CR3配对：之后才加载的处理器看到新页表项 */
+    m4k_memory_barrier();
+    for (cpu = 0; cpu < M4K_MAX_CPUS; cpu++) {
+        if ((m4k_percpu[cpu].space & PTE_ADDR_MASK) == pml4) {
+            cpus |= 1U << cpu;
+        }
+    }
+
+    if (pcid_enabled) {
+        flags = m4k_irq_save();
+        m4k_spin_lock(&pcid_lock);
+        pcid = pcid_lookup(pml4);
+        if (pcid) {
+            cpus |= pcid_table[pcid].cpus;
+        }
+        m4k_spin_unlock(&pcid_lock);
+        m4k_irq_restore(flags);
+    }
+
+    return cpus;
+}
+
+/**
+ * 在相关处理器上使修改过的页表项生效，返回后旧的映射不再被任何处理器使用
+ * 内核页表的修改发给所有处理器，地址空间的修改只发给tlb_space_cpus
+ * @param pml4 目标地址空间，0表示内核页表
+ * @param count 页数，为TLB_FLUSH_ALL或超过TLB_BATCH_INVLPG时整体失效
+ */
+static void tlb_flush_cpus(uint64_t pml4, const uint64_t *addrs, uint32_t count) {
+    m4k_tlb_flush_t flush;
+    uint32_t cpus;
+
+    flush.pml4 = pml4 & PTE_ADDR_MASK;
+    flush.count = count;
+    flush.addrs = addrs;
+
+    /* 本地失效可能放弃PCID，先确定目标处理器 */
+    if (flush.pml4 == 0) {
+        tlb_kernel_gen++;
+        cpus = TLB_CPUS_ALL;
+    } else {
+        cpus = tlb_space_cpus(flush.pml4);
+    }
+
+    tlb_flush_local(&flush);
+    m4k_tlb_shootdown(cpus, tlb_flush_local, &flush);
+}
+
+/**
+ * 开始一批失效
+ * @param pml4 目标地址空间页表根物理地址，0表示内核页表
+ */
+static void tlb_batch_begin(m4k_tlb_batch_t *batch, uint64_t pml4) {
+    batch->pml4 = pml4 & PTE_ADDR_MASK;
+    batch->count = 0;
+    batch->nr_frames = 0;
+}
+
+/**
+ * 应用收集的失效，然后释放页帧
+ */
+static void tlb_batch_flush(m4k_tlb_batch_t *batch) {
+    uint32_t i;
+
+    if (batch->count > 0) {
+        tlb_flush_cpus(batch->pml4, batch->addrs, batch->count);
+        tlb_stats.batches++;
+        tlb_stats.batched_pages += batch->count;
+    }
+
+    /* 映射失效后页帧才能被重新分配 */
+    for (i = 0; i < batch->nr_frames; i++) {
+        page_frame_unmap(batch->frames[i]);
+    }
+
+    batch->count = 0;
+    batch->nr_frames = 0;
+}
+
+/**
+ * 记录一个已清除页表项的地址
+ */
+static void tlb_batch_add_page(m4k_tlb_batch_t *batch, uint64_t virtual_addr) {
+    if (batch->count < TLB_BATCH_INVLPG) {
+        batch->addrs[batch->count] = virtual_addr;
+    }
+    batch->count++;
+}
+
+/**
+ * 记录失效后要释放的页帧（先记录对应地址，缓冲区满时提前应用）
+ */
+static void tlb_batch_add_frame(m4k_tlb_batch_t *batch, uint64_t physical_addr) {
+    if (batch->nr_frames == TLB_BATCH_FRAMES) {
+        tlb_batch_flush(batch);
+    }
+    batch->frames[batch->nr_frames++] = physical_addr;
+}
+
+/**
+ * 检测并启用PCID（在加载内核页表之后调用，此时CR3低12位为0）
+ */
+static void tlb_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    memset(pcid_table, 0, sizeof(pcid_table));
+    memset(&tlb_stats, 0, sizeof(tlb_stats));
+
+    m4k_cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(ecx & CPUID_FEAT_ECX_PCID)) {
+        return;
+    }
+
+    m4k_cpuid(0, &eax, &ebx, &ecx, &edx);
+    if (eax >= 7) {
+        m4k_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+        invpcid_supported = (ebx & CPUID_FEAT7_EBX_INVPCID) != 0;
+    }
+
+    m4k_write_cr4(m4k_read_cr4() | M4K_CR4_PCIDE);
+    pcid_enabled = true;
+}
+
+/* 地址空间页表锁：缺页处理、相同页合并、fork、销毁、页面授予和区域表修改
+ * 都在所属地址空间的锁内进行。页表根按页帧号散列到锁表，不同地址空间
+ * 偶尔共用一把锁，同时持有两把时按下标顺序获取 */
+#define SPACE_LOCK_COUNT        64
+
+static m4k_spinlock_t space_locks[SPACE_LOCK_COUNT];
+
+static inline uint32_t space_lock_index(uint64_t pml4) {
+    return (uint32_t)((pml4 >> 12) % SPACE_LOCK_COUNT);
+}
+
+/**
+ * 获取下标为index的页表锁（关中断）
+ * 持锁者会发起TLB失效并等待，等锁时要处理发给本处理器的失效请求
+ */
+static void space_lock_acquire(uint32_t index) {
+    m4k_spinlock_t *lock = &space_locks[index];
+
+    while (m4k_atomic_exchange((uint32_t *)&lock->locked, 1)) {
+        m4k_tlb_shootdown_poll();
+        m4k_pause();
+    }
+}
+
+/**
+ * 锁定地址空间的页表
+ * @return 锁定前的中断状态，传给space_unlock
+ */
+static uint64_t space_lock(uint64_t pml4) {
+    uint64_t flags = m4k_irq_save();
+
+    space_lock_acquire(space_lock_index(pml4));
+    return flags;
+}
+
+static void space_unlock(uint64_t pml4, uint64_t flags) {
+    m4k_spin_unlock(&space_locks[space_lock_index(pml4)]);
+    m4k_irq_restore(flags);
+}
+
+/**
+ * 同时锁定两个地址空间的页表
+ */
+static uint64_t space_lock_pair(uint64_t first, uint64_t second) {
+    uint64_t flags = m4k_irq_save();
+    uint32_t a = space_lock_index(first);
+    uint32_t b = space_lock_index(second);
+
+    space_lock_acquire(a < b ? a : b);
+    if (a != b) {
+        space_lock_acquire(a < b ? b : a);
+    }
+    return flags;
+}
+
+static void space_unlock_pair(uint64_t first, uint64_t second, uint64_t flags) {
+    uint32_t a = space_lock_index(first);
+    uint32_t b = space_lock_index(second);
+
+    m4k_spin_unlock(&space_locks[a]);
+    if (a != b) {
+        m4k_spin_unlock(&space_locks[b]);
+    }
+    m4k_irq_restore(flags);
+}
+
+/**
+ * 分配并清零一个页表页
+ */
+static uint64_t page_table_alloc(void) {
+    return m4k_alloc_zeroed_page();
+}
+
+/**
+ * 查找虚拟地址对应的4KB页表项（未映射或为大页时返回NULL）
+ */
+static uint64_t *page_walk(pml4_t *pml4, uint64_t virtual_addr) {
+    uint64_t *pdp, *pd, *pt;
+
+    if (!(pml4[(virtual_addr >> 39) & 0x1FF] & PTE_PRESENT)) return NULL;
+    pdp = pte_table(pml4[(virtual_addr >> 39) & 0x1FF]);
+
+    if (!(pdp[(virtual_addr >> 30) & 0x1FF] & PTE_PRESENT)) return NULL;
+    if (pdp[(virtual_addr >> 30) & 0x1FF] & PTE_HUGE) return NULL;
+    pd = pte_table(pdp[(virtual_addr >> 30) & 0x1FF]);
+
+    if (!(pd[(virtual_addr >> 21) & 0x1FF] & PTE_PRESENT)) return NULL;
+    if (pd[(virtual_addr >> 21) & 0x1FF] & PTE_HUGE) return NULL;
+    pt = pte_table(pd[(virtual_addr >> 21) & 0x1FF]);
+
+    if (!(pt[(virtual_addr >> 12) & 0x1FF] & PTE_PRESENT)) return NULL;
+    return &pt[(virtual_addr >> 12) & 0x1FF];
+}
+
+/**
+ * 查找虚拟地址对应的页目录项（上级页表不存在时返回NULL）
+ */
+static uint64_t *pd_entry_lookup(pml4_t *pml4, uint64_t virtual_addr) {
+    uint64_t *pdp, *pd;
+
+    if (!(pml4[(virtual_addr >> 39) & 0x1FF] & PTE_PRESENT)) return NULL;
+    pdp = pte_table(pml4[(virtual_addr >> 39) & 0x1FF]);
+
+    if (!(pdp[(virtual_addr >> 30) & 0x1FF] & PTE_PRESENT)) return NULL;
+    if (pdp[(virtual_addr >> 30) & 0x1FF] & PTE_HUGE) return NULL;
+    pd = pte_table(pdp[(virtual_addr >> 30) & 0x1FF]);
+
+    return &pd[(virtual_addr >> 21) & 0x1FF];
+}
+
+/**
+ * 查找虚拟地址对应的页目录项，必要时分配PDP和页目录
+ */
+static uint64_t *pd_entry_alloc(pml4_t *pml4, uint64_t virtual_addr) {
+    uint64_t *entry = &pml4[(virtual_addr >> 39) & 0x1FF];
+    uint64_t table;
+
+    if (!(*entry & PTE_PRESENT)) {
+        table = page_table_alloc();
+        if (!table) return NULL;
+        *entry = table | PTE_PRESENT | PTE_WRITE | PTE_USER;
+    }
+
+    entry = &pte_table(*entry)[(virtual_addr >> 30) & 0x1FF];
+    if (!(*entry & PTE_PRESENT)) {
+        table = page_table_alloc();
+        if (!table) return NULL;
+        *entry = table | PTE_PRESENT | PTE_WRITE | PTE_USER;
+    } else if (*entry & PTE_HUGE) {
+        return NULL; /* 1GB大页不再细分 */
+    }
+
+    return &pte_table(*entry)[(virtual_addr >> 21) & 0x1FF];
+}
+
+/**
+ * 将2MB大页拆分为512个4KB页表项（各页帧的引用保持不变）
+ */
+static int32_t split_huge_pmd(uint64_t *pde, uint64_t virtual_addr) {
+    uint64_t entry = *pde;
+    uint64_t base = entry & PTE_HUGE_ADDR_MASK;
+    uint64_t flags = entry & ~(PTE_HUGE_ADDR_MASK | PTE_HUGE | PTE_HUGE_PAT);
+    uint64_t table;
+    uint64_t *pt;
+    uint32_t i;
+
+    table = page_table_alloc();
+    if (!table) {
+        return -1;
+    }
+
+    /* PAT位在两种表项中的位置不同 */
+    if (entry & PTE_HUGE_PAT) {
+        flags |= PTE_PAT;
+    }
+
+    pt = pte_table(table);
+    for (i = 0; i < HUGE_PAGE_FRAMES; i++) {
+        pt[i] = (base + i * PAGE_SIZE) | flags;
+    }
+
+    *pde = table | PTE_PRESENT | PTE_WRITE | (entry & PTE_USER);
+    huge_mappings--;
+    small_mappings += HUGE_PAGE_FRAMES;
+
+    __asm__ volatile ("invlpg (%0)" : : "r"(virtual_addr & ~(uint64_t)(HUGE_PAGE_SIZE - 1)));
+    return 0;
+}
+
+/**
+ * 建立物理内存直接映射（引导阶段调用，页表通过恒等映射访问）
+ */
+static void map_direct_memory(void) {
+    uint64_t size = total_pages * PAGE_SIZE;
+    uint64_t addr;
+
+    for (addr = 0; addr < size; addr += HUGE_PAGE_SIZE) {
+        uint64_t *pde = pd_entry_alloc(kernel_pml4, MEM_BASE + addr);
+        if (!pde) {
+            console_write("Failed to build direct map\n");
+            return;
+        }
+
+        /* 内核专用，不计入页帧映射数 */
+        *pde = addr | PTE_PRESENT | PTE_WRITE | PTE_HUGE | PTE_GLOBAL | PTE_NX;
+        huge_mappings++;
+    }
+}
+
+/**
+ * 映射虚拟地址到物理地址
+ */
+void m4k_map_page(uint64_t virtual_addr, uint64_t physical_addr, uint64_t flags) {
+    uint64_t *pde = pd_entry_alloc(kernel_pml4, virtual_addr);
+    uint64_t *pt;
+    uint64_t pt_index = (virtual_addr >> 12) & 0x1FF;
+    uint64_t old_entry;
+
+    if (!pde) return;
+
+    if (!(*pde & PTE_PRESENT)) {
+        /* 分配新的页表 */
+        uint64_t pt_addr = page_table_alloc();
+        if (!pt_addr) return;
+
+        *pde = pt_addr | PTE_PRESENT | PTE_WRITE | PTE_USER;
+    } else if (*pde & PTE_HUGE) {
+        /* 在大页内重新映射4KB页，先拆分 */
+        if (split_huge_pmd(pde, virtual_addr) != 0) return;
+    }
+
+    pt = pte_table(*pde);
+    old_entry = pt[pt_index];
+    if (!(old_entry & PTE_PRESENT)) {
+        small_mappings++;
+    }
+
+    /* 设置页表条目 */
+    pt[pt_index] = physical_addr | flags | PTE_PRESENT;
+    page_frame_map(physical_addr);
+
+    /* 刷新TLB（替换已有映射时其他处理器和其他PCID中的副本也要失效），
+     * 旧映射失效后才释放它对页帧的引用 */
+    if (old_entry & PTE_PRESENT) {
+        tlb_flush_cpus(0, &virtual_addr, 1);
+        page_frame_unmap(old_entry & PTE_ADDR_MASK);
+    } else {
+        __asm__ volatile ("invlpg (%0)" : : "r"(virtual_addr));
+    }
+}
+
+/**
+ * 在空的页目录项中建立2MB大页映射
+ * 大页映射持有其中每个页帧的引用，拆分后由各4KB页表项继承
+ */
+static void huge_leaf_install(uint64_t *pde, uint64_t physical_addr, uint64_t flags) {
+    uint32_t i;
+
+    /* PAT位在大页表项中位于bit 12 */
+    if (flags & PTE_PAT) {
+        flags = (flags & ~PTE_PAT) | PTE_HUGE_PAT;
+    }
+
+    *pde = physical_addr | flags | PTE_PRESENT | PTE_HUGE;
+    huge_mappings++;
+
+    for (i = 0; i < HUGE_PAGE_FRAMES; i++) {
+        page_frame_map(physical_addr + i * PAGE_SIZE);
+    }
+}
+
+/**
+ * 映射2MB大页（虚拟地址和物理地址都必须2MB对齐）
+ * @return 成功返回0，地址未对齐或该区域已有4KB映射返回-1
+ */
+int32_t m4k_map_huge_page(uint64_t virtual_addr, uint64_t physical_addr, uint64_t flags) {
+    uint64_t old_table = 0;
+    uint64_t *pde;
+    uint32_t i;
+
+    if ((virtual_addr | physical_addr) & (HUGE_PAGE_SIZE - 1)) {
+        return -1;
+    }
+
+    pde = pd_entry_alloc(kernel_pml4, virtual_addr);
+    if (!pde) {
+        return -1;
+    }
+
+    if (*pde & PTE_PRESENT) {
+        uint64_t *pt;
+
+        if (*pde & PTE_HUGE) {
+            return -1;
+        }
+
+        /* 仅回收空页表，不覆盖已有的4KB映射 */
+        pt = pte_table(*pde);
+        for (i = 0; i < 512; i++) {
+            if (pt[i] & PTE_PRESENT) {
+                return -1;
+            }
+        }
+        old_table = *pde & PTE_ADDR_MASK;
+    }
+
+    huge_leaf_install(pde, physical_addr, flags);
+
+    /* 其他处理器的分页结构缓存可能还指向旧页表，全部失效后才能释放它 */
+    if (old_table) {
+        tlb_flush_cpus(0, &virtual_addr, 1);
+        m4k_free_physical_page(old_table);
+    } else {
+        __asm__ volatile ("invlpg (%0)" : : "r"(virtual_addr));
+    }
+    return 0;
+}
+
+/**
+ * 映射一段连续物理内存，对齐的2MB区段使用大页
+ */
+void m4k_map_range(uint64_t virtual_addr, uint64_t physical_addr, uint64_t size,
+                   uint64_t flags) {
+    uint64_t offset = 0;
+
+    while (offset < size) {
+        uint64_t va = virtual_addr + offset;
+        uint64_t pa = physical_addr + offset;
+
+        if (size - offset >= HUGE_PAGE_SIZE &&
+            !((va | pa) & (HUGE_PAGE_SIZE - 1)) &&
+            m4k_map_huge_page(va, pa, flags) == 0) {
+            offset += HUGE_PAGE_SIZE;
+            continue;
+        }
+
+        m4k_map_page(va, pa, flags);
+        offset += PAGE_SIZE;
+    }
+}
+
+/**
+ * 撤销内核页表中的一个4KB映射，失效和页帧释放计入批次（位于大页内时先拆分）
+ */
+static void unmap_kernel_page(m4k_tlb_batch_t *batch, uint64_t virtual_addr) {
+    uint64_t *pde = pd_entry_lookup(kernel_pml4, virtual_addr);
+    uint64_t pt_index = (virtual_addr >> 12) & 0x1FF;
+    uint64_t *pt;
+    uint64_t physical_addr;
+
+    if (!pde || !(*pde & PTE_PRESENT)) return;
+
+    if ((*pde & PTE_HUGE) && split_huge_pmd(pde, virtual_addr) != 0) return;
+
+    pt = pte_table(*pde);
+    if (!(pt[pt_index] & PTE_PRESENT)) return;
+
+    /* 清除页表条目 */
+    physical_addr = pt[pt_index] & PTE_ADDR_MASK;
+    pt[pt_index] = 0;
+    small_mappings--;
+
+    /* TLB失效后释放物理页面（共享页在最后一个映射撤销时才释放） */
+    tlb_batch_add_page(batch, virtual_addr);
+    tlb_batch_add_frame(batch, physical_addr);
+}
+
+/**
+ * 取消映射虚拟地址（位于大页内时先拆分）
+ */
+void m4k_unmap_page(uint64_t virtual_addr) {
+    m4k_tlb_batch_t batch;
+
+    tlb_batch_begin(&batch, 0);
+    unmap_kernel_page(&batch, virtual_addr);
+    tlb_batch_flush(&batch);
+}
+
+/**
+ * 取消映射一段虚拟地址，完整覆盖的大页整体撤销而不拆分
+ */
+void m4k_unmap_range(uint64_t virtual_addr, uint64_t size) {
+    m4k_tlb_batch_t batch;
+    uint64_t offset = 0;
+
+    tlb_batch_begin(&batch, 0);
+
+    while (offset < size) {
+        uint64_t va = virtual_addr + offset;
+        uint64_t *pde = pd_entry_lookup(kernel_pml4, va);
+
+        if (pde && (*pde & PTE_PRESENT) && (*pde & PTE_HUGE) &&
+            !(va & (HUGE_PAGE_SIZE - 1)) && size - offset >= HUGE_PAGE_SIZE) {
+            uint64_t base = *pde & PTE_HUGE_ADDR_MASK;
+            uint32_t i;
+
+            *pde = 0;
+            huge_mappings--;
+
+            /* 一次失效覆盖整个大页，随后直接释放其中的页帧 */
+            tlb_batch_add_page(&batch, va);
+            tlb_batch_flush(&batch);
+            for (i = 0; i < HUGE_PAGE_FRAMES; i++) {
+                page_frame_unmap(base + i * PAGE_SIZE);
+            }
+
+            offset += HUGE_PAGE_SIZE;
+            continue;
+        }
+
+        unmap_kernel_page(&batch, va);
+        offset += PAGE_SIZE;
+    }
+
+    tlb_batch_flush(&batch);
+}
+
+/**
+ * 获取4KB和2MB映射数量
+ */
+void m4k_get_mapping_stats(uint64_t *small, uint64_t *huge) {
+    if (small) *small = small_mappings;
+    if (huge) *huge = huge_mappings;
+}
+
+/**
+ * 遍历页表求虚拟地址对应的物理地址（识别1GB和2MB叶子），未映射返回0
+ */
+static uint64_t page_translate(pml4_t *pml4, uint64_t virtual_addr) {
+    uint64_t entry = pml4[(virtual_addr >> 39) & 0x1FF];
+
+    if (!(entry & PTE_PRESENT)) return 0;
+    entry = pte_table(entry)[(virtual_addr >> 30) & 0x1FF];
+
+    if (!(entry & PTE_PRESENT)) return 0;
+    if (entry & PTE_HUGE) {
+        return (entry & PTE_GIANT_ADDR_MASK) + (virtual_addr & (GIANT_PAGE_SIZE - 1));
+    }
+    entry = pte_table(entry)[(virtual_addr >> 21) & 0x1FF];
+
+    if (!(entry & PTE_PRESENT)) return 0;
+    if (entry & PTE_HUGE) {
+        return (entry & PTE_HUGE_ADDR_MASK) + (virtual_addr & (HUGE_PAGE_SIZE - 1));
+    }
+    entry = pte_table(entry)[(virtual_addr >> 12) & 0x1FF];
+
+    if (!(entry & PTE_PRESENT)) return 0;
+    return (entry & PTE_ADDR_MASK) + (virtual_addr & (PAGE_SIZE - 1));
+}
+
+/**
+ * 获取物理地址
+ */
+uint64_t m4k_get_physical_address(uint64_t virtual_addr) {
+    return page_translate(kernel_pml4, virtual_addr);
+}
+
+/**
+ * 获取用户地址空间中虚拟地址对应的物理地址，未映射返回0
+ */
+uint64_t m4k_vm_translate(uint64_t pml4, uint64_t virtual_addr) {
+    uint64_t flags;
+    uint64_t physical_addr;
+
+    if (!pml4) {
+        return 0;
+    }
+
+    flags = space_lock(pml4);
+    physical_addr = page_translate((pml4_t *)pte_table(pml4), virtual_addr);
+    space_unlock(pml4, flags);
+    return physical_addr;
+}
+
+/**
+ * 获取内存统计信息
+ */
+void m4k_get_memory_stats(uint64_t *total, uint64_t *free, uint64_t *used) {
+    uint64_t free_total = free_pages;
+    uint32_t cpu;
+
+    /* 每CPU缓存和预清零池中的页帧同样可用 */
+    for (cpu = 0; cpu < M4K_MAX_CPUS; cpu++) {
+        free_total += pcp_caches[cpu].count;
+    }
+    free_total += zero_pool_count;
+
+    if (total) *total = total_pages * PAGE_SIZE;
+    if (free) *free = free_total * PAGE_SIZE;
+    if (used) *used = (total_pages - free_total) * PAGE_SIZE;
+}
+
+/* 按需分配的匿名内存区域 */
+#define VM_MAX_AREAS            256
+#define VM_DEFAULT_FAULT_AROUND 8       /* 缺页时一并映射的页数（2的幂） */
+
+typedef struct {
+    uint64_t pml4;                  /* 所属地址空间，0表示空闲 */
+    uint64_t start;                 /* 起始地址（页对齐） */
+    uint64_t end;                   /* 结束地址（不含） */
+    uint64_t flags;                 /* 页表项标志 */
+} m4k_vm_area_t;
+
+/* 区域的查找和修改由所属地址空间的页表锁保护，vm_area_lock只保护空闲槽位的分配 */
+static m4k_vm_area_t vm_areas[VM_MAX_AREAS];
+static m4k_spinlock_t vm_area_lock = M4K_SPINLOCK_INIT;
+static uint32_t fault_around_pages = VM_DEFAULT_FAULT_AROUND;
+static uint64_t demand_faults = 0;      /* 缺页分配次数 */
+static uint64_t huge_faults = 0;        /* 用大页满足的缺页次数 */
+static uint64_t fault_around_maps = 0;  /* 顺带映射的相邻页数 */
+
+/**
+ * 查找包含地址的区域
+ */
+static m4k_vm_area_t *vm_area_find(uint64_t pml4, uint64_t virtual_addr) {
+    uint32_t i;
+
+    for (i = 0; i < VM_MAX_AREAS; i++) {
+        if (vm_areas[i].pml4 == pml4 &&
+            virtual_addr >= vm_areas[i].start && virtual_addr < vm_areas[i].end) {
+            return &vm_areas[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * 添加区域（与相邻的同属性区域合并，如brk增长）
+ */
+static int32_t vm_area_insert(uint64_t pml4, uint64_t start, uint64_t end,
+                              uint64_t flags) {
+    m4k_vm_area_t *slot = NULL;
+    uint32_t i;
+
+    for (i = 0; i < VM_MAX_AREAS; i++) {
+        m4k_vm_area_t *area = &vm_areas[i];
+
+        if (area->pml4 == pml4 && area->flags == flags) {
+            if (area->end == start) {
+                area->end = end;
+                return 0;
+            }
+            if (area->start == end) {
+                area->start = start;
+                return 0;
+            }
+        }
+    }
+
+    /* 其他地址空间可能同时分配槽位 */
+    m4k_spin_lock(&vm_area_lock);
+    for (i = 0; i < VM_MAX_AREAS; i++) {
+        if (!vm_areas[i].pml4) {
+            slot = &vm_areas[i];
+            break;
+        }
+    }
+
+    if (slot) {
+        slot->start = start;
+        slot->end = end;
+        slot->flags = flags;
+        slot->pml4 = pml4;
+    }
+    m4k_spin_unlock(&vm_area_lock);
+
+    return slot ? 0 : -1;
+}
+
+/**
+ * 查找虚拟地址对应的4KB页表项，必要时分配各级页表（位于大页内时返回NULL）
+ */
+static uint64_t *pte_alloc(pml4_t *pml4, uint64_t virtual_addr) {
+    uint64_t *pde = pd_entry_alloc(pml4, virtual_addr);
+    uint64_t table;
+
+    if (!pde) {
+        return NULL;
+    }
+
+    if (!(*pde & PTE_PRESENT)) {
+        table = page_table_alloc();
+        if (!table) return NULL;
+        *pde = table | PTE_PRESENT | PTE_WRITE | PTE_USER;
+    } else if (*pde & PTE_HUGE) {
+        return NULL;
+    }
+
+    return &pte_table(*pde)[(virtual_addr >> 12) & 0x1FF];
+}
+
+/**
+ * 为区域内的一页分配清零的页帧并映射
+ * @return 新映射返回1，已映射返回0，失败返回-1
+ */
+static int32_t vm_populate(pml4_t *pml4, const m4k_vm_area_t *area,
+                           uint64_t virtual_addr) {
+    uint64_t *pte = pte_alloc(pml4, virtual_addr);
+    uint64_t page;
+
+    if (!pte) {
+        return -1;
+    }
+
+    if (*pte & PTE_PRESENT) {
+        return 0;
+    }
+
+    page = m4k_alloc_zeroed_page();
+    if (!page) {
+        return -1;
+    }
+
+    *pte = page | area->flags | PTE_PRESENT;
+    page_frame_map(page);
+    small_mappings++;
+    return 1;
+}
+
+/**
+ * 区域完整覆盖出错地址所在的2MB范围且其中尚无4KB页时，用一个清零的
+ * 大页映射整个范围
+ * @return 已映射返回0，不适用或没有对齐的连续页帧返回-1（改用4KB页）
+ */
+static int32_t vm_fault_huge(uint64_t pml4, const m4k_vm_area_t *area,
+                             uint64_t fault_addr) {
+    uint64_t start = fault_addr & ~(uint64_t)(HUGE_PAGE_SIZE - 1);
+    uint64_t *pde;
+    uint64_t block;
+
+    if (start < area->start || start + HUGE_PAGE_SIZE > area->end) {
+        return -1;
+    }
+
+    pde = pd_entry_alloc((pml4_t *)pte_table(pml4), start);
+    if (!pde || (*pde & PTE_PRESENT)) {
+        return -1;
+    }
+
+    block = m4k_alloc_contiguous_pages(HUGE_PAGE_FRAMES);
+    if (!block) {
+        return -1;
+    }
+    if (block & (HUGE_PAGE_SIZE - 1)) {
+        m4k_free_contiguous_pages(block, HUGE_PAGE_FRAMES);
+        return -1;
+    }
+
+    /* 预清零池只有4KB页，拼不出对齐的2MB块；与池的补充一样用非临时存储
+     * 清零，2MB的清零不把缓存中的热数据整体挤出 */
+    zero_range_nontemporal(phys_to_virt(block), HUGE_PAGE_SIZE);
+    zero_pool_misses++;
+
+    /* 页目录项原先不存在，没有需要失效的TLB条目 */
+    huge_leaf_install(pde, block, area->flags);
+    huge_faults++;
+    demand_faults++;
+    return 0;
+}
+
+/**
+ * 处理区域内的缺页：映射出错页及其所在窗口内的相邻页
+ */
+static int32_t vm_fault_around(uint64_t pml4, const m4k_vm_area_t *area,
+                               uint64_t fault_addr) {
+    pml4_t *root = (pml4_t *)pte_table(pml4);
+    uint64_t window = (uint64_t)fault_around_pages * PAGE_SIZE;
+    uint64_t start = fault_addr & ~(window - 1);
+    uint64_t end = start + window;
+    uint64_t va;
+
+    /* 大块匿名区域优先用2MB页，减少缺页次数和TLB占用 */
+    if (vm_fault_huge(pml4, area, fault_addr) == 0) {
+        return 0;
+    }
+
+    if (vm_populate(root, area, fault_addr & PAGE_MASK) < 0) {
+        return -1;
+    }
+    demand_faults++;
+
+    if (start < area->start) start = area->start;
+    if (end > area->end) end = area->end;
+
+    /* 相邻页尽力而为，内存紧张时只映射出错页 */
+    for (va = start; va < end; va += PAGE_SIZE) {
+        int32_t result = vm_populate(root, area, va);
+        if (result < 0) {
+            break;
+        }
+        fault_around_maps += result;
+    }
+
+    return 0;
+}
+
+/**
+ * 预留匿名内存区域，页面在首次访问时分配
+ * @param flags 页表项标志（如PTE_WRITE | PTE_USER）
+ * @return 成功返回0，区域表已满返回-1
+ */
+int32_t m4k_vm_reserve(uint64_t pml4, uint64_t start, uint64_t size, uint64_t flags) {
+    uint64_t end = (start + size + PAGE_SIZE - 1) & PAGE_MASK;
+    uint64_t irq;
+    int32_t result;
+
+    start &= PAGE_MASK;
+    if (!pml4 || end <= start) {
+        return -1;
+    }
+
+    irq = space_lock(pml4);
+    result = vm_area_insert(pml4, start, end, flags & ~(PTE_ADDR_MASK | PTE_PRESENT));
+    space_unlock(pml4, irq);
+    return result;
+}
+
+/**
+ * 释放匿名内存区域，撤销已分配页面的映射
+ */
+void m4k_vm_release(uint64_t pml4, uint64_t start, uint64_t size) {
+    pml4_t *root = (pml4_t *)pte_table(pml4);
+    uint64_t end = (start + size + PAGE_SIZE - 1) & PAGE_MASK;
+    m4k_tlb_batch_t batch;
+    uint64_t va, flags;
+    uint32_t i;
+
+    start &= PAGE_MASK;
+
+    flags = space_lock(pml4);
+    tlb_batch_begin(&batch, pml4);
+    for (va = start; va < end; va += PAGE_SIZE) {
+        uint64_t *pde = pd_entry_lookup(root, va);
+        uint64_t *pte;
+
+        if (pde && (*pde & PTE_PRESENT) && (*pde & PTE_HUGE)) {
+            if (!(va & (HUGE_PAGE_SIZE - 1)) && end - va >= HUGE_PAGE_SIZE) {
+                /* 完整覆盖的大页整体撤销，一次失效覆盖整个2MB */
+                uint64_t base = *pde & PTE_HUGE_ADDR_MASK;
+
+                *pde = 0;
+                huge_mappings--;
+                tlb_batch_add_page(&batch, va);
+                for (i = 0; i < HUGE_PAGE_FRAMES; i++) {
+                    tlb_batch_add_frame(&batch, base + i * PAGE_SIZE);
+                }
+                va += HUGE_PAGE_SIZE - PAGE_SIZE;
+                continue;
+            }
+
+            /* 只释放大页的一部分时先拆分，拆分失败则保留该页 */
+            if (split_huge_pmd(pde, va) != 0) {
+                continue;
+            }
+        }
+
+        pte = page_walk(root, va);
+        if (pte) {
+            uint64_t frame = *pte & PTE_ADDR_MASK;
+
+            *pte = 0;
+            small_mappings--;
+            tlb_batch_add_page(&batch, va);
+            tlb_batch_add_frame(&batch, frame);
+        }
+    }
+    tlb_batch_flush(&batch);
+
+    for (i = 0; i < VM_MAX_AREAS; i++) {
+        m4k_vm_area_t *area = &vm_areas[i];
+
+        if (area->pml4 != pml4 || area->end <= start || area->start >= end) {
+            continue;
+        }
+
+        if (area->start >= start && area->end <= end) {
+            area->pml4 = 0;
+        } else if (area->start < start && area->end > end) {
+            /* 从中间释放，拆成两个区域 */
+            uint64_t tail = area->end;
+            area->end = start;
+            vm_area_insert(pml4, end, tail, area->flags);
+        } else if (area->start < start) {
+            area->end = start;
+        } else {
+            area->start = end;
+        }
+    }
+    space_unlock(pml4, flags);
+}
+
+/**
+ * 设置缺页时一并映射的页数（向下取整为2的幂，1表示关闭）
+ */
+void m4k_set_fault_around(uint32_t pages) {
+    uint32_t window = 1;
+
+    while (window * 2 <= pages && window * 2 <= 512) {
+        window *= 2;
+    }
+
+    fault_around_pages = window;
+}
+
+/**
+ * 复制父进程的区域到子进程（持有父进程的页表锁，子进程尚未被其他代码使用）
+ */
+static void vm_area_fork(uint64_t parent, uint64_t child) {
+    uint32_t i;
+
+    for (i = 0; i < VM_MAX_AREAS; i++) {
+        if (vm_areas[i].pml4 == parent) {
+            vm_area_insert(child, vm_areas[i].start, vm_areas[i].end, vm_areas[i].flags);
+        }
+    }
+}
+
+/**
+ * 丢弃地址空间的全部区域
+ */
+static void vm_area_drop(uint64_t pml4) {
+    uint32_t i;
+
+    for (i = 0; i < VM_MAX_AREAS; i++) {
+        if (vm_areas[i].pml4 == pml4) {
+            vm_areas[i].pml4 = 0;
+        }
+    }
+}
+
+/**
+ * 按写时复制方式复制一级页表（level: 3=PDP, 2=PD, 1=PT）
+ * 新页表在填充前即挂入dest_entry，失败时可由m4k_destroy_address_space回收
+ */
+static int32_t cow_copy_table(uint64_t *dest_entry, uint64_t src_entry,
+                              uint32_t level) {
+    uint64_t *src = pte_table(src_entry);
+    uint64_t *dest;
+    uint64_t table;
+    uint32_t i;
+
+    table = page_table_alloc();
+    if (!table) {
+        return -1;
+    }
+
+    *dest_entry = table | (src_entry & ~PTE_ADDR_MASK);
+    dest = pte_table(table);
+
+    for (i = 0; i < 512; i++) {
+        uint64_t entry = src[i];
+
+        if (!(entry & PTE_PRESENT)) {
+            continue;
+        }
+
+        if (level == 1 || (entry & PTE_HUGE)) {
+            uint32_t frames = (level == 1) ? 1 : HUGE_PAGE_FRAMES;
+            uint64_t base = (level == 1) ? (entry & PTE_ADDR_MASK)
+                                         : (entry & PTE_HUGE_ADDR_MASK);
+            uint32_t j;
+
+            /* 内核映射（如引导恒等映射）直接共享 */
+            if (!(entry & PTE_USER)) {
+                dest[i] = entry;
+                continue;
+            }
+
+            /* 叶子页：父子双方都改为只读，首次写入时再复制 */
+            if (entry & PTE_WRITE) {
+                entry = (entry & ~PTE_WRITE) | PTE_COW;
+                src[i] = entry;
+            }
+
+            for (j = 0; j < frames; j++) {
+                m4k_page_get(base + j * PAGE_SIZE);
+                page_frame_map(base + j * PAGE_SIZE);
+            }
+            dest[i] = entry;
+        } else if (cow_copy_table(&dest[i], entry, level - 1) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * 复制页表（内核空间直接共享，用户页以写时复制方式共享）
+ * @return 成功返回0，页表分配失败返回-1
+ */
+int32_t m4k_copy_page_tables(pml4_t *dest_pml4, pml4_t *src_pml4) {
+    uint64_t i;
+
+    /* 复制内核空间映射 */
+    for (i = 256; i < 512; i++) {
+        dest_pml4[i] = src_pml4[i];
+    }
+
+    /* 复制用户空间页表，只复制页表结构，不复制页内容 */
+    for (i = 0; i < 256; i++) {
+        if (!(src_pml4[i] & PTE_PRESENT)) {
+            continue;
+        }
+
+        if (cow_copy_table(&dest_pml4[i], src_pml4[i], 3) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * 创建空的用户地址空间
+ * 内核空间直接共享；引导恒等映射（内核映像在其中运行）复制页表结构、
+ * 共享叶子，用户映射不会写进内核自己的页表
+ * @return 页表根物理地址，内存不足返回0
+ */
+uint64_t m4k_create_address_space(void) {
+    uint64_t pml4 = page_table_alloc();
+    pml4_t *root;
+    uint32_t i;
+
+    if (!pml4) {
+        return 0;
+    }
+
+    root = (pml4_t *)pte_table(pml4);
+    for (i = 256; i < 512; i++) {
+        root[i] = kernel_pml4[i];
+    }
+
+    if (kernel_pml4[0] & PTE_PRESENT) {
+        if (cow_copy_table(&root[0], kernel_pml4[0], 3) != 0) {
+            m4k_destroy_address_space(pml4);
+            return 0;
+        }
+        root[0] |= PTE_USER;
+    }
+
+    return pml4;
+}
+
+/**
+ * 释放一级用户页表及其映射的页帧
+ */
+static void release_table(uint64_t entry, uint32_t level) {
+    uint64_t *table = pte_table(entry);
+    uint32_t i;
+
+    for (i = 0; i < 512; i++) {
+        if (!(table[i] & PTE_PRESENT)) {
+            continue;
+        }
+
+        if ((level == 1 || (table[i] & PTE_HUGE)) && !(table[i] & PTE_USER)) {
+            continue; /* 共享的内核映射 */
+        }
+
+        if (level == 1) {
+            page_frame_unmap(table[i] & PTE_ADDR_MASK);
+        } else if (table[i] & PTE_HUGE) {
+            uint32_t j;
+            for (j = 0; j < HUGE_PAGE_FRAMES; j++) {
+                page_frame_unmap((table[i] & PTE_HUGE_ADDR_MASK) + j * PAGE_SIZE);
+            }
+        } else {
+            release_table(table[i], level - 1);
+        }
+    }
+
+    m4k_free_physical_page(entry & PTE_ADDR_MASK);
+}
+
+/**
+ * 复制地址空间（fork使用）
+ * @param pml4 父进程页表根物理地址
+ * @return 子进程页表根物理地址，失败返回0
+ */
+uint64_t m4k_fork_address_space(uint64_t pml4) {
+    uint64_t child;
+    uint64_t flags;
+    int32_t result;
+
+    if (!pml4) {
+        return 0;
+    }
+
+    child = page_table_alloc();
+    if (!child) {
+        return 0;
+    }
+
+    /* 复制过程中父进程的页表项被改为只读，不能与父进程自己的缺页处理交错 */
+    flags = space_lock(pml4);
+    result = m4k_copy_page_tables((pml4_t *)pte_table(child),
+                                  (pml4_t *)pte_table(pml4));
+
+    /* 父进程的可写页已改为只读，需要丢弃旧的TLB条目（失败时也可能已改了一部分） */
+    tlb_flush_cpus(pml4, NULL, TLB_FLUSH_ALL);
+
+    if (result == 0) {
+        vm_area_fork(pml4, child);
+    }
+    space_unlock(pml4, flags);
+
+    /* 子进程继承相同页合并的扫描设置，登记表已满时fork失败，而不是让子进程
+     * 悄悄退出扫描 */
+    if (result == 0 && m4k_ksm_is_registered(pml4) && m4k_ksm_register(child) != 0) {
+        result = -1;
+    }
+
+    if (result != 0) {
+        m4k_destroy_address_space(child);
+        return 0;
+    }
+
+    return child;
+}
+
+/**
+ * 销毁地址空间（释放用户页表和只被本地址空间引用的页帧）
+ */
+void m4k_destroy_address_space(uint64_t pml4) {
+    pml4_t *root;
+    uint64_t i, flags;
+
+    if (!pml4) {
+        return;
+    }
+
+    /* 持锁期间相同页合并不会扫描本地址空间，退出登记之后也不会再开始 */
+    flags = space_lock(pml4);
+    m4k_ksm_unregister(pml4);
+    vm_area_drop(pml4);
+
+    /* 页表根释放后可能被新的地址空间复用，不能继承旧的PCID */
+    pcid_drop(pml4);
+
+    root = (pml4_t *)pte_table(pml4);
+    for (i = 0; i < 256; i++) {
+        if (root[i] & PTE_PRESENT) {
+            release_table(root[i], 3);
+        }
+    }
+    space_unlock(pml4, flags);
+
+    m4k_free_physical_page(pml4 & PTE_ADDR_MASK);
+}
+
+/**
+ * 处理页面错误（持有地址空间的页表锁）
+ */
+static int32_t page_fault_locked(uint64_t pml4, uint64_t fault_addr,
+                                 uint64_t error_code) {
+    m4k_page_frame_t *desc;
+    uint64_t *pte;
+    uint64_t entry, physical_addr, copy;
+
+    /* 未映射的页：预留区域内按需分配。其他处理器可能在本处理器等锁时
+     * 已经处理了同一页 */
+    if (!(error_code & PF_ERR_PRESENT)) {
+        m4k_vm_area_t *area;
+
+        if (page_translate((pml4_t *)pte_table(pml4), fault_addr)) {
+            return 0;
+        }
+        area = vm_area_find(pml4, fault_addr);
+        return area ? vm_fault_around(pml4, area, fault_addr) : -1;
+    }
+
+    /* 其余只处理对已映射页的写错误 */
+    if ((error_code & (PF_ERR_PRESENT | PF_ERR_WRITE)) !=
+        (PF_ERR_PRESENT | PF_ERR_WRITE)) {
+        return -1;
+    }
+
+    /* 写时复制的大页先拆分，只复制被写入的4KB页 */
+    pte = pd_entry_lookup((pml4_t *)pte_table(pml4), fault_addr);
+    if (pte && (*pte & PTE_PRESENT) && (*pte & PTE_HUGE) && (*pte & PTE_COW)) {
+        if (split_huge_pmd(pte, fault_addr) != 0) {
+            return -1;
+        }
+    }
+
+    pte = page_walk((pml4_t *)pte_table(pml4), fault_addr);
+    if (pte && (*pte & PTE_PRESENT) && (*pte & PTE_WRITE)) {
+        return 0; /* 已由其他处理器复制 */
+    }
+    if (!pte || !(*pte & PTE_COW)) {
+        return -1;
+    }
+
+    entry = *pte;
+    physical_addr = entry & PTE_ADDR_MASK;
+    desc = page_frame_desc(physical_addr);
+
+    /* 合并页由共享页帧表持有一个引用，总是复制 */
+    if (desc && desc->refcount == 1) {
+        /* 其他共享者已经退出或复制，直接恢复写权限 */
+        *pte = (entry & ~PTE_COW) | PTE_WRITE;
+    } else {
+        copy = m4k_alloc_physical_page();
+        if (!copy) {
+            return -1;
+        }
+
+        m4k_copy_page(phys_to_virt(copy), phys_to_virt(physical_addr));
+        page_frame_map(copy);
+
+        *pte = copy | (entry & ~(PTE_ADDR_MASK | PTE_COW)) | PTE_WRITE;
+    }
+
+    /* 同一地址空间的其他处理器可能还缓存着旧页帧，失效之后才能释放 */
+    tlb_flush_cpus(pml4, &fault_addr, 1);
+    if ((*pte & PTE_ADDR_MASK) != physical_addr) {
+        page_frame_unmap(physical_addr);
+    }
+    return 0;
+}
+
+/**
+ * 处理页面错误
+ * 与相同页合并、fork和销毁在地址空间的页表锁上互斥：合并扫描写保护页面
+ * 之后、换上共享页帧之前，本函数不会看到引用计数为1而恢复写权限
+ * @param pml4 当前地址空间页表根物理地址
+ * @param fault_addr 触发错误的虚拟地址（CR2）
+ * @param error_code 硬件错误码
+ * @return 已处理返回0，否则返回-1
+ */
+int32_t m4k_handle_page_fault(uint64_t pml4, uint64_t fault_addr,
+                              uint64_t error_code) {
+    uint64_t flags;
+    int32_t result;
+
+    if (!pml4) {
+        return -1;
+    }
+
+    flags = space_lock(pml4);
+    result = page_fault_locked(pml4, fault_addr, error_code);
+    space_unlock(pml4, flags);
+    return result;
+}
+
+/* 相同页合并（KSM） */
+#define KSM_MAX_SPACES          32      /* 参与扫描的地址空间数上限 */
+#define KSM_HASH_BUCKETS        1024
+#define KSM_MAX_STABLE          4096    /* 共享页帧表容量 */
+#define KSM_DEFAULT_SCAN_RATE   64      /* 每轮扫描的页数 */
+#define USER_SPACE_END          0x0000800000000000ULL
+
+typedef struct ksm_stable_node {
+    uint64_t frame;                 /* 共享页帧物理地址 */
+    uint32_t checksum;              /* 页内容校验和 */
+    struct ksm_stable_node *next;
+} ksm_stable_node_t;
+
+/* 登记表和共享页帧表由ksm_lock保护（在地址空间页表锁之内获取）；
+ * 游标和统计只由持有ksm_scan_lock的扫描者修改 */
+static uint64_t ksm_spaces[KSM_MAX_SPACES];
+static ksm_stable_node_t ksm_nodes[KSM_MAX_STABLE];
+static ksm_stable_node_t *ksm_buckets[KSM_HASH_BUCKETS];
+static ksm_stable_node_t *ksm_free_nodes = NULL;
+static uint32_t ksm_node_used = 0;
+static m4k_spinlock_t ksm_lock = M4K_SPINLOCK_INIT;
+static m4k_spinlock_t ksm_scan_lock = M4K_SPINLOCK_INIT;
+static uint32_t ksm_space_cursor = 0;
+static uint64_t ksm_addr_cursor = 0;
+static uint32_t ksm_scan_rate = KSM_DEFAULT_SCAN_RATE;
+static bool ksm_enabled = true;         /* 只扫描经madvise登记的地址空间 */
+static uint64_t ksm_pages_scanned = 0;
+static uint64_t ksm_merges = 0;
+static uint64_t ksm_full_scans = 0;
+
+/**
+ * 计算页内容校验和
+ */
+static uint32_t ksm_checksum(uint64_t address) {
+    const uint64_t *words = (const uint64_t *)address;
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    uint32_t i;
+
+    for (i = 0; i < PAGE_SIZE / 8; i++) {
+        hash ^= words[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+/**
+ * 共享页帧是否仍被映射
+ * 共享页帧表自己持有每个页帧的一个引用，其他地址空间释放页帧时表中的
+ * 页帧不会被归还，只剩这个引用的页帧在查找时回收
+ */
+static bool ksm_node_valid(const ksm_stable_node_t *node) {
+    m4k_page_frame_t *desc = page_frame_desc(node->frame);
+
+    return desc && desc->refcount > 1 && (desc->flags & PAGE_FRAME_KSM);
+}
+
+/**
+ * 回收失效节点，放掉共享页帧表的引用（持有ksm_lock）
+ */
+static void ksm_node_release(ksm_stable_node_t *node) {
+    m4k_page_frame_t *desc = page_frame_desc(node->frame);
+
+    if (desc) {
+        desc->flags &= ~PAGE_FRAME_KSM;
+    }
+    m4k_page_put(node->frame);
+
+    node->next = ksm_free_nodes;
+    ksm_free_nodes = node;
+}
+
+/**
+ * 查找内容相同的共享页帧，顺带回收失效节点（持有ksm_lock）
+ */
+static ksm_stable_node_t *ksm_lookup(uint32_t checksum, uint64_t address) {
+    ksm_stable_node_t **link = &ksm_buckets[checksum % KSM_HASH_BUCKETS];
+
+    while (*link) {
+        ksm_stable_node_t *node = *link;
+
+        if (!ksm_node_valid(node)) {
+            *link = node->next;
+            ksm_node_release(node);
+            continue;
+        }
+
+        /* 校验和只用于筛选，必须逐字节确认 */
+        if (node->checksum == checksum &&
+            m4k_compare_pages(phys_to_virt(node->frame), address)) {
+            return node;
+        }
+
+        link = &node->next;
+    }
+
+    return NULL;
+}
+
+/**
+ * 回收全部失效节点（每轮完整扫描后调用，退出的地址空间留下的页帧不必
+ * 等到同一散列桶再次被查找才归还）
+ */
+static void ksm_prune(void) {
+    uint64_t flags = m4k_irq_save();
+    uint32_t i;
+
+    m4k_spin_lock(&ksm_lock);
+    for (i = 0; i < KSM_HASH_BUCKETS; i++) {
+        ksm_stable_node_t **link = &ksm_buckets[i];
+
+        while (*link) {
+            ksm_stable_node_t *node = *link;
+
+            if (ksm_node_valid(node)) {
+                link = &node->next;
+                continue;
+            }
+
+            *link = node->next;
+            ksm_node_release(node);
+        }
+    }
+    m4k_spin_unlock(&ksm_lock);
+    m4k_irq_restore(flags);
+}
+
+/**
+ * 分配共享页帧节点（持有ksm_lock）
+ */
+static ksm_stable_node_t *ksm_node_alloc(void) {
+    ksm_stable_node_t *node = ksm_free_nodes;
+
+    if (node) {
+        ksm_free_nodes = node->next;
+        return node;
+    }
+
+    if (ksm_node_used < KSM_MAX_STABLE) {
+        return &ksm_nodes[ksm_node_used++];
+    }
+
+    return NULL;
+}
+
+/**
+ * 扫描一个用户页，与已有共享页合并或登记为新的共享页（持有pml4的页表锁）
+ */
+static void ksm_scan_page(uint64_t pml4, uint64_t virtual_addr, uint64_t *pte) {
+    uint64_t entry = *pte;
+    uint64_t frame = entry & PTE_ADDR_MASK;
+    m4k_page_frame_t *desc = page_frame_desc(frame);
+    ksm_stable_node_t *node;
+    uint64_t shared = 0;
+    uint32_t checksum;
+
+    /* 只处理独占的普通用户页 */
+    if (!desc || !(entry & PTE_USER) || desc->refcount != 1 ||
+        (desc->flags & (PAGE_FRAME_LOCKED | PAGE_FRAME_KSM))) {
+        return;
+    }
+
+    /* 两次扫描之间内容变化的页写入频繁，合并后很快会被拆开 */
+    checksum = ksm_checksum(phys_to_virt(frame));
+    if (checksum != desc->checksum) {
+        desc->checksum = checksum;
+        return;
+    }
+
+    /* 先写保护再比较内容，避免比较之后的写入丢失 */
+    if (entry & PTE_WRITE) {
+        entry = (entry & ~PTE_WRITE) | PTE_COW;
+        *pte = entry;
+        tlb_flush_cpus(pml4, &virtual_addr, 1);
+    }
+
+    /* 找到的共享页帧先加引用，放开ksm_lock之后才能做TLB失效 */
+    m4k_spin_lock(&ksm_lock);
+    node = ksm_lookup(checksum, phys_to_virt(frame));
+    if (node) {
+        shared = node->frame;
+        m4k_page_get(shared);
+    } else {
+        /* 第一次出现的内容：保持只读，作为后续合并的目标 */
+        node = ksm_node_alloc();
+        if (node) {
+            m4k_page_get(frame);
+            desc->flags |= PAGE_FRAME_KSM;
+            node->frame = frame;
+            node->checksum = checksum;
+            node->next = ksm_buckets[checksum % KSM_HASH_BUCKETS];
+            ksm_buckets[checksum % KSM_HASH_BUCKETS] = node;
+        }
+    }
+    m4k_spin_unlock(&ksm_lock);
+
+    if (!shared) {
+        return;
+    }
+
+    /* 安装前确认页表项仍是写保护后的那一项（访问位可能被硬件置上），
+     * 没有被恢复写权限或换成副本 */
+    if ((*pte & ~PTE_ACCESSED) != (entry & ~PTE_ACCESSED)) {
+        m4k_page_put(shared);
+        return;
+    }
+
+    page_frame_map(shared);
+    *pte = shared | (entry & ~PTE_ADDR_MASK);
+    tlb_flush_cpus(pml4, &virtual_addr, 1);
+
+    page_frame_unmap(frame);
+    ksm_merges++;
+}
+
+/**
+ * 地址空间是否在登记表中（持有ksm_lock）
+ */
+static bool ksm_space_registered(uint64_t pml4) {
+    uint32_t i;
+
+    for (i = 0; i < KSM_MAX_SPACES; i++) {
+        if (pml4 && ksm_spaces[i] == pml4) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * 从游标处继续扫描一个地址空间
+ * 持有页表锁时地址空间仍在登记表中，说明还没有开始销毁
+ * @return 剩余扫描配额
+ */
+static uint32_t ksm_scan_space(uint64_t pml4, uint32_t budget) {
+    pml4_t *root = (pml4_t *)pte_table(pml4);
+    uint64_t flags = space_lock(pml4);
+    bool registered;
+
+    m4k_spin_lock(&ksm_lock);
+    registered = ksm_spaces[ksm_space_cursor] == pml4;
+    m4k_spin_unlock(&ksm_lock);
+
+    if (!registered) {
+        ksm_addr_cursor = USER_SPACE_END;
+    }
+
+    while (budget > 0 && ksm_addr_cursor < USER_SPACE_END) {
+        uint64_t va = ksm_addr_cursor;
+        uint64_t *pdp, *pd, *pt;
+
+        /* 逐级跳过不存在的页表 */
+        if (!(root[(va >> 39) & 0x1FF] & PTE_PRESENT)) {
+            ksm_addr_cursor = (va | ((1ULL << 39) - 1)) + 1;
+            continue;
+        }
+        pdp = pte_table(root[(va >> 39) & 0x1FF]);
+
+        if (!(pdp[(va >> 30) & 0x1FF] & PTE_PRESENT) || (pdp[(va >> 30) & 0x1FF] & PTE_HUGE)) {
+            ksm_addr_cursor = (va | ((1ULL << 30) - 1)) + 1;
+            continue;
+        }
+        pd = pte_table(pdp[(va >> 30) & 0x1FF]);
+
+        /* 大页不参与合并 */
+        if (!(pd[(va >> 21) & 0x1FF] & PTE_PRESENT) || (pd[(va >> 21) & 0x1FF] & PTE_HUGE)) {
+            ksm_addr_cursor = (va | (HUGE_PAGE_SIZE - 1)) + 1;
+            continue;
+        }
+        pt = pte_table(pd[(va >> 21) & 0x1FF]);
+
+        if (pt[(va >> 12) & 0x1FF] & PTE_PRESENT) {
+            ksm_scan_page(pml4, va, &pt[(va >> 12) & 0x1FF]);
+            ksm_pages_scanned++;
+            budget--;
+        }
+
+        ksm_addr_cursor = va + PAGE_SIZE;
+    }
+
+    space_unlock(pml4, flags);
+    return budget;
+}
+
+/**
+ * 执行一轮相同页合并扫描（在空闲循环中调用）
+ * 各处理器的空闲循环都会调用，同一时刻只有一个扫描者
+ */
+void m4k_ksm_run(void) {
+    uint32_t budget = ksm_scan_rate;
+    uint32_t visited = 0;
+    uint64_t flags;
+    uint64_t pml4;
+
+    if (!ksm_enabled || m4k_atomic_exchange((uint32_t *)&ksm_scan_lock.locked, 1)) {
+        return;
+    }
+
+    while (budget > 0 && visited < KSM_MAX_SPACES) {
+        flags = m4k_irq_save();
+        m4k_spin_lock(&ksm_lock);
+        pml4 = ksm_spaces[ksm_space_cursor];
+        m4k_spin_unlock(&ksm_lock);
+        m4k_irq_restore(flags);
+
+        /* 页表锁在ksm_lock之外获取，取到锁后再确认仍在登记表中 */
+        if (pml4) {
+            budget = ksm_scan_space(pml4, budget);
+            if (ksm_addr_cursor < USER_SPACE_END) {
+                break;
+            }
+        }
+
+        /* 当前地址空间扫描完毕，转到下一个 */
+        ksm_addr_cursor = 0;
+        ksm_space_cursor = (ksm_space_cursor + 1) % KSM_MAX_SPACES;
+        if (ksm_space_cursor == 0) {
+            ksm_full_scans++;
+            ksm_prune();
+        }
+        visited++;
+    }
+
+    m4k_spin_unlock(&ksm_scan_lock);
+}
+
+/**
+ * 将地址空间加入合并扫描
+ */
+int32_t m4k_ksm_register(uint64_t pml4) {
+    uint64_t flags;
+    int32_t result = -1;
+    uint32_t i;
+
+    if (!pml4) {
+        return 0;
+    }
+
+    flags = m4k_irq_save();
+    m4k_spin_lock(&ksm_lock);
+    if (ksm_space_registered(pml4)) {
+        result = 0;
+    } else {
+        for (i = 0; i < KSM_MAX_SPACES; i++) {
+            if (!ksm_spaces[i]) {
+                ksm_spaces[i] = pml4;
+                result = 0;
+                break;
+            }
+        }
+    }
+    m4k_spin_unlock(&ksm_lock);
+    m4k_irq_restore(flags);
+
+    return result;
+}
+
+/**
+ * 将地址空间移出合并扫描（已合并的页保持共享）
+ * 正在扫描它的扫描者在下一次取页表锁时发现它已不在登记表中
+ */
+void m4k_ksm_unregister(uint64_t pml4) {
+    uint64_t flags = m4k_irq_save();
+    uint32_t i;
+
+    m4k_spin_lock(&ksm_lock);
+    for (i = 0; i < KSM_MAX_SPACES; i++) {
+        if (ksm_spaces[i] == pml4) {
+            ksm_spaces[i] = 0;
+        }
+    }
+    m4k_spin_unlock(&ksm_lock);
+    m4k_irq_restore(flags);
+}
+
+/**
+ * 地址空间是否参与合并扫描
+ */
+bool m4k_ksm_is_registered(uint64_t pml4) {
+    uint64_t flags = m4k_irq_save();
+    bool registered;
+
+    m4k_spin_lock(&ksm_lock);
+    registered = ksm_space_registered(pml4);
+    m4k_spin_unlock(&ksm_lock);
+    m4k_irq_restore(flags);
+
+    return registered;
+}
+
+/**
+ * 启用或停止合并扫描
+ */
+void m4k_ksm_set_enabled(bool enabled) {
+    ksm_enabled = enabled;
+}
+
+/**
+ * 设置每轮扫描的页数
+ */
+void m4k_ksm_set_scan_rate(uint32_t pages) {
+    ksm_scan_rate = pages ? pages : 1;
+}
+
+/**
+ * 获取合并统计
+ */
+void m4k_ksm_get_stats(m4k_ksm_stats_t *stats) {
+    uint64_t flags;
+    uint32_t i;
+
+    if (!stats) {
+        return;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+
+    flags = m4k_irq_save();
+    m4k_spin_lock(&ksm_lock);
+    for (i = 0; i < ksm_node_used; i++) {
+        m4k_page_frame_t *desc;
+
+        if (!ksm_node_valid(&ksm_nodes[i])) {
+            continue;
+        }
+
+        desc = page_frame_desc(ksm_nodes[i].frame);
+        stats->pages_shared++;
+        if (desc->mapcount > 1) {
+            stats->pages_sharing += desc->mapcount - 1;
+        }
+    }
+    m4k_spin_unlock(&ksm_lock);
+    m4k_irq_restore(flags);
+
+    stats->pages_scanned = ksm_pages_scanned;
+    stats->merges = ksm_merges;
+    stats->full_scans = ksm_full_scans;
+    stats->scan_rate = ksm_scan_rate;
+    stats->merge_ratio = stats->pages_shared ?
+        (uint32_t)(stats->pages_sharing * 100 / stats->pages_shared) : 0;
+}
+
+/* 页面授予：IPC按页表传递大块缓冲区，不复制内容 */
+
+/**
+ * 准备授予的一页：发送方的大页先拆分，预留区域内尚未分配的页先分配
+ * （持有发送方的页表锁）
+ * @return 发送方页表项，页面不存在或不是用户页时返回NULL
+ */
+static uint64_t *grant_source_pte(uint64_t pml4, uint64_t virtual_addr) {
+    pml4_t *root = (pml4_t *)pte_table(pml4);
+    uint64_t *pde = pd_entry_lookup(root, virtual_addr);
+    uint64_t *pte;
+
+    if (pde && (*pde & PTE_PRESENT) && (*pde & PTE_HUGE)) {
+        if (!(*pde & PTE_USER) || split_huge_pmd(pde, virtual_addr) != 0) {
+            return NULL;
+        }
+    }
+
+    pte = page_walk(root, virtual_addr);
+    if (!pte) {
+        m4k_vm_area_t *area = vm_area_find(pml4, virtual_addr);
+
+        if (!area || vm_populate(root, area, virtual_addr) < 0) {
+            return NULL;
+        }
+        pte = page_walk(root, virtual_addr);
+    }
+
+    return (pte && (*pte & PTE_USER)) ? pte : NULL;
+}
+
+/**
+ * 把一段页面授予另一个地址空间
+ * 先检查双方并分配接收方的页表，全部成功后才修改页表项，失败时发送方
+ * 除了补齐按需分配的页以外不变
+ */
+int32_t m4k_vm_grant(uint64_t src_pml4, uint64_t src, uint64_t dst_pml4, uint64_t dst,
+                     uint64_t size, uint32_t mode) {
+    pml4_t *dst_root;
+    m4k_tlb_batch_t batch;
+    uint64_t offset, flags;
+    int32_t result = -1;
+
+    src_pml4 &= PTE_ADDR_MASK;
+    dst_pml4 &= PTE_ADDR_MASK;
+    size = (size + PAGE_SIZE - 1) & PAGE_MASK;
+
+    if (!src_pml4 || !dst_pml4 || src_pml4 == dst_pml4 || size == 0 ||
+        mode > M4K_GRANT_MOVE || ((src | dst) & (PAGE_SIZE - 1)) ||
+        src + size > USER_SPACE_END || src + size < src ||
+        dst + size > USER_SPACE_END || dst + size < dst) {
+        return -1;
+    }
+    dst_root = (pml4_t *)pte_table(dst_pml4);
+
+    flags = space_lock_pair(src_pml4, dst_pml4);
+    for (offset = 0; offset < size; offset += PAGE_SIZE) {
+        uint64_t *pde = pd_entry_lookup(dst_root, dst + offset);
+
+        if (!grant_source_pte(src_pml4, src + offset)) {
+            goto out;
+        }
+        if ((pde && (*pde & PTE_PRESENT) && (*pde & PTE_HUGE)) ||
+            page_walk(dst_root, dst + offset)) {
+            goto out;
+        }
+
+        /* 只分配页表，页表项在所有页都检查过后再写 */
+        if (!pte_alloc(dst_root, dst + offset)) {
+            goto out;
+        }
+    }
+
+    tlb_batch_begin(&batch, src_pml4);
+    for (offset = 0; offset < size; offset += PAGE_SIZE) {
+        uint64_t *spte = page_walk((pml4_t *)pte_table(src_pml4), src + offset);
+        uint64_t *dpte = pte_alloc(dst_root, dst + offset);
+        uint64_t entry = *spte;
+        uint64_t frame = entry & PTE_ADDR_MASK;
+
+        switch (mode) {
+        case M4K_GRANT_READ:
+            /* 共享同一页帧，接收方看到发送方之后的写入，自己不能写 */
+            *dpte = entry & ~(PTE_WRITE | PTE_COW | PTE_DIRTY | PTE_ACCESSED);
+            m4k_page_get(frame);
+            page_frame_map(frame);
+            small_mappings++;
+            break;
+
+        case M4K_GRANT_COW:
+            /* 与fork相同：双方只读共享，先写入的一方复制 */
+            if (entry & PTE_WRITE) {
+                entry = (entry & ~PTE_WRITE) | PTE_COW;
+                *spte = entry;
+                tlb_batch_add_page(&batch, src + offset);
+            }
+            *dpte = entry & ~(PTE_DIRTY | PTE_ACCESSED);
+            m4k_page_get(frame);
+            page_frame_map(frame);
+            small_mappings++;
+            break;
+
+        default:
+            /* 转移映射，页帧的引用和映射计数随之转移 */
+            *dpte = entry & ~PTE_ACCESSED;
+            *spte = 0;
+            tlb_batch_add_page(&batch, src + offset);
+            break;
+        }
+    }
+    tlb_batch_flush(&batch);
+    result = 0;
+
+out:
+    space_unlock_pair(src_pml4, dst_pml4, flags);
+    return result;
+}
+
+/**
+ * 切换地址空间
+ * 启用PCID时，地址空间仍持有自己的PCID且本处理器在当前内核映射世代清空过它，
+ * 则保留其TLB条目
+ * @param pml4 页表根物理地址
+ */
+void m4k_switch_address_space(uint64_t pml4) {
+    uint32_t cpu_bit = 1U << m4k_cpu_id();
+    uint64_t flags;
+    uint32_t pcid;
+
+    pml4 &= PTE_ADDR_MASK;
+    tlb_stats.switches++;
+
+    /* 先公布再加载（写CR3是串行化指令），修改页表的处理器据此决定是否发送失效请求 */
+    flags = m4k_irq_save();
+    m4k_this_cpu()->space = pml4;
+
+    if (!pcid_enabled) {
+        m4k_write_cr3(pml4);
+        tlb_stats.full_flushes++;
+        m4k_irq_restore(flags);
+        return;
+    }
+
+    m4k_spin_lock(&pcid_lock);
+
+    pcid = pcid_lookup(pml4);
+    if (!pcid) {
+        pcid = pcid_assign(pml4);
+    }
+
+    /* 内核映射世代落后时所有处理器都要重新清空 */
+    if (pcid_table[pcid].gen != tlb_kernel_gen) {
+        pcid_table[pcid].gen = tlb_kernel_gen;
+        pcid_table[pcid].cpus = 0;
+    }
+
+    if (pcid_table[pcid].cpus & cpu_bit) {
+        m4k_write_cr3(pml4 | pcid | M4K_CR3_NOFLUSH);
+        tlb_stats.preserved++;
+    } else {
+        pcid_table[pcid].cpus |= cpu_bit;
+        m4k_write_cr3(pml4 | pcid);
+        tlb_stats.full_flushes++;
+    }
+
+    m4k_spin_unlock(&pcid_lock);
+    m4k_irq_restore(flags);
+}
+
+/**
+ * 刷新TLB（启用PCID时只清空当前PCID的条目）
+ */
+void m4k_flush_tlb(void) {
+    __asm__ volatile ("movq %%cr3, %%rax; movq %%rax, %%cr3" : : : "rax", "memory");
+    tlb_stats.full_flushes++;
+}
+
+/**
+ * 刷新特定地址的TLB
+ */
+void m4k_flush_tlb_entry(uint64_t address) {
+    __asm__ volatile ("invlpg (%0)" : : "r"(address));
+}
+
+/**
+ * 启用或关闭PCID（用于对比测试）
+ * @return 成功返回0，处理器不支持PCID返回-1
+ */
+int32_t m4k_tlb_set_pcid(bool enabled) {
+    uint32_t eax, ebx, ecx, edx;
+    uint64_t flags;
+
+    m4k_cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(ecx & CPUID_FEAT_ECX_PCID)) {
+        return -1;
+    }
+
+    if (enabled == pcid_enabled) {
+        return 0;
+    }
+
+    /* 修改CR4.PCIDE要求当前PCID为0，清除时处理器清空全部TLB */
+    flags = m4k_irq_save();
+    m4k_spin_lock(&pcid_lock);
+
+    m4k_write_cr3(m4k_read_cr3() & PTE_ADDR_MASK);
+    if (enabled) {
+        memset(pcid_table, 0, sizeof(pcid_table));
+        m4k_write_cr4(m4k_read_cr4() | M4K_CR4_PCIDE);
+    } else {
+        m4k_write_cr4(m4k_read_cr4() & ~M4K_CR4_PCIDE);
+    }
+    pcid_enabled = enabled;
+
+    m4k_spin_unlock(&pcid_lock);
+    m4k_irq_restore(flags);
+    return 0;
+}
+
+/**
+ * 获取TLB统计
+ */
+void m4k_get_tlb_stats(m4k_tlb_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+
+    *stats = tlb_stats;
+    stats->pcid_enabled = pcid_enabled;
+    stats->invpcid_supported = invpcid_supported;
+}
+
+/* 切换路径测试使用的虚拟地址（PML4第1项，不与引导恒等映射重叠） */
+#define TLB_BENCH_BASE          0x0000008000000000ULL
+
+/**
+ * 建立测试用地址空间：共享当前页表的内核部分，映射pages个私有页
+ */
+static uint64_t tlb_bench_space(uint64_t current, uint32_t pages) {
+    uint64_t pml4 = page_table_alloc();
+    pml4_t *root;
+    uint32_t i;
+
+    if (!pml4) {
+        return 0;
+    }
+
+    root = (pml4_t *)pte_table(pml4);
+    root[0] = ((pml4_t *)pte_table(current))[0];
+    for (i = 256; i < 512; i++) {
+        root[i] = ((pml4_t *)pte_table(current))[i];
+    }
 
-    if (!(pd[pd_index] & PTE_PRESENT)) return 0;
-    pt = (pt_t *)((pd[pd_index] & 0xFFFFFFFFFF000) + MEM_BASE);
+    for (i = 0; i < pages; i++) {
+        uint64_t *pte = pte_alloc(root, TLB_BENCH_BASE + (uint64_t)i * PAGE_SIZE);
+        uint64_t page = m4k_alloc_zeroed_page();
 
-    if (!(pt[pt_index] & PTE_PRESENT)) return 0;
+        if (!pte || !page) {
+            if (page) {
+                m4k_free_physical_page(page);
+            }
+            root[0] = 0;
+            m4k_destroy_address_space(pml4);
+            return 0;
+        }
 
-    /* 计算物理地址 */
-    uint64_t offset = virtual_addr & 0xFFF;
-    uint64_t physical_base = pt[pt_index] & 0xFFFFFFFFFF000;
+        /* 标为用户页，销毁地址空间时随页表一起释放 */
+        page_frame_map(page);
+        *pte = page | PTE_PRESENT | PTE_WRITE | PTE_USER | PTE_NX;
+    }
 
-    return physical_base + offset;
+    return pml4;
 }
 
 /**
- * 获取内存统计信息
+ * 切换路径测试：在两个地址空间之间来回切换，每次切换后访问pages个页面
+ * 访问时间反映切换造成的TLB未命中（页表遍历）开销
+ * @return 成功返回0，失败返回-1
  */
-void m4k_get_memory_stats(uint64_t *total, uint64_t *free, uint64_t *used) {
-    if (total) *total = total_pages * PAGE_SIZE;
-    if (free) *free = free_pages * PAGE_SIZE;
-    if (used) *used = (total_pages - free_pages) * PAGE_SIZE;
-}
+int32_t m4k_tlb_benchmark(uint32_t rounds, uint32_t pages, m4k_tlb_bench_t *result) {
+    uint64_t current = m4k_read_cr3() & PTE_ADDR_MASK;
+    uint64_t spaces[2];
+    uint64_t start, touch_cycles = 0;
+    m4k_tlb_stats_t before;
+    uint32_t round, i, j;
+
+    if (!result || rounds == 0 || pages == 0) {
+        return -1;
+    }
 
-/**
- * 复制页表
- */
-void m4k_copy_page_tables(pml4_t *dest_pml4, pml4_t *src_pml4) {
-    uint64_t i;
+    spaces[0] = tlb_bench_space(current, pages);
+    spaces[1] = spaces[0] ? tlb_bench_space(current, pages) : 0;
+    if (!spaces[1]) {
+        if (spaces[0]) {
+            ((pml4_t *)pte_table(spaces[0]))[0] = 0;
+            m4k_destroy_address_space(spaces[0]);
+        }
+        return -1;
+    }
 
-    /* 复制内核空间映射 */
-    for (i = 256; i < 512; i++) {
-        dest_pml4[i] = src_pml4[i];
+    before = tlb_stats;
+    start = m4k_rdtsc();
+
+    for (round = 0; round < rounds; round++) {
+        for (j = 0; j < 2; j++) {
+            uint64_t begin;
+
+            m4k_switch_address_space(spaces[j]);
+
+            begin = m4k_rdtsc();
+            for (i = 0; i < pages; i++) {
+                (void)*(volatile uint64_t *)(TLB_BENCH_BASE + (uint64_t)i * PAGE_SIZE);
+            }
+            touch_cycles += m4k_rdtsc() - begin;
+        }
     }
-}
 
-/**
- * 切换地址空间
- */
-void m4k_switch_address_space(pml4_t *new_pml4) {
-    __asm__ volatile ("movq %0, %%cr3" : : "r"(new_pml4));
-}
+    result->total_cycles = m4k_rdtsc() - start;
+    m4k_switch_address_space(current);
 
-/**
- * 刷新TLB
- */
-void m4k_flush_tlb(void) {
-    __asm__ volatile ("movq %%cr3, %%rax; movq %%rax, %%cr3" : : : "rax");
+    result->switches = rounds * 2;
+    result->touch_cycles = touch_cycles;
+    result->cycles_per_switch = result->total_cycles / result->switches;
+    result->full_flushes = tlb_stats.full_flushes - before.full_flushes;
+    result->preserved = tlb_stats.preserved - before.preserved;
+    result->pcid_enabled = pcid_enabled;
+
+    /* 引导恒等映射是共享的，不能随测试地址空间释放 */
+    for (j = 0; j < 2; j++) {
+        ((pml4_t *)pte_table(spaces[j]))[0] = 0;
+        m4k_destroy_address_space(spaces[j]);
+    }
+
+    return 0;
 }
 
+/* 页面授予测试把缓冲区授予到接收方的这个地址（PML4第1项内，与测试页不重叠） */
+#define GRANT_BENCH_BASE        (TLB_BENCH_BASE + 0x40000000ULL)
+
 /**
- * 刷新特定地址的TLB
+ * 页面授予测试：对比逐页复制和授予pages个页面的开销，并检查授予后的
+ * 页帧共享、引用计数和写时复制标志
+ * @return 成功返回0，内存不足或检查失败返回-1
  */
-void m4k_flush_tlb_entry(uint64_t address) {
-    __asm__ volatile ("invlpg (%0)" : : "r"(address));
+int32_t m4k_grant_benchmark(uint32_t pages, m4k_grant_bench_t *result) {
+    uint64_t current = m4k_read_cr3() & PTE_ADDR_MASK;
+    uint64_t size = (uint64_t)pages * PAGE_SIZE;
+    uint64_t spaces[2];
+    pml4_t *roots[2];
+    uint64_t start;
+    int32_t status = 0;
+    uint32_t i, j;
+
+    if (!result || pages == 0) {
+        return -1;
+    }
+
+    spaces[0] = tlb_bench_space(current, pages);
+    spaces[1] = spaces[0] ? tlb_bench_space(current, pages) : 0;
+    if (!spaces[1]) {
+        if (spaces[0]) {
+            ((pml4_t *)pte_table(spaces[0]))[0] = 0;
+            m4k_destroy_address_space(spaces[0]);
+        }
+        return -1;
+    }
+    roots[0] = (pml4_t *)pte_table(spaces[0]);
+    roots[1] = (pml4_t *)pte_table(spaces[1]);
+
+    /* 通过消息传递缓冲区的做法：每页复制一次 */
+    start = m4k_rdtsc();
+    for (i = 0; i < pages; i++) {
+        uint64_t va = TLB_BENCH_BASE + (uint64_t)i * PAGE_SIZE;
+
+        m4k_copy_page(phys_to_virt(*page_walk(roots[1], va) & PTE_ADDR_MASK),
+                      phys_to_virt(*page_walk(roots[0], va) & PTE_ADDR_MASK));
+    }
+    result->copy_cycles = m4k_rdtsc() - start;
+
+    /* 写时复制授予：双方映射同一页帧，都不可写，引用计数为2 */
+    start = m4k_rdtsc();
+    status |= m4k_vm_grant(spaces[0], TLB_BENCH_BASE, spaces[1], GRANT_BENCH_BASE, size,
+                           M4K_GRANT_COW);
+    result->grant_cycles = m4k_rdtsc() - start;
+
+    for (i = 0; status == 0 && i < pages; i++) {
+        uint64_t *spte = page_walk(roots[0], TLB_BENCH_BASE + (uint64_t)i * PAGE_SIZE);
+        uint64_t *dpte = page_walk(roots[1], GRANT_BENCH_BASE + (uint64_t)i * PAGE_SIZE);
+
+        if (!spte || !dpte || (*spte & PTE_ADDR_MASK) != (*dpte & PTE_ADDR_MASK) ||
+            ((*spte | *dpte) & PTE_WRITE) || !(*dpte & PTE_COW) ||
+            page_frame_desc(*spte & PTE_ADDR_MASK)->refcount != 2) {
+            status = -1;
+        }
+    }
+    m4k_vm_release(spaces[1], GRANT_BENCH_BASE, size);
+
+    /* 转移授予：页帧换到接收方，发送方不再映射 */
+    start = m4k_rdtsc();
+    status |= m4k_vm_grant(spaces[0], TLB_BENCH_BASE, spaces[1], GRANT_BENCH_BASE, size,
+                           M4K_GRANT_MOVE);
+    result->move_cycles = m4k_rdtsc() - start;
+
+    for (i = 0; status == 0 && i < pages; i++) {
+        uint64_t *dpte = page_walk(roots[1], GRANT_BENCH_BASE + (uint64_t)i * PAGE_SIZE);
+
+        if (page_walk(roots[0], TLB_BENCH_BASE + (uint64_t)i * PAGE_SIZE) || !dpte ||
+            page_frame_desc(*dpte & PTE_ADDR_MASK)->refcount != 1) {
+            status = -1;
+        }
+    }
+
+    /* 已授予的页随接收方的地址空间释放 */
+    result->pages = pages;
+    for (j = 0; j < 2; j++) {
+        ((pml4_t *)pte_table(spaces[j]))[0] = 0;
+        m4k_destroy_address_space(spaces[j]);
+    }
+
+    return status;
 }
 
 /**
@@ -350,9 +2989,9 @@ uint64_t m4k_get_memory_size(void) {
 }
 
 /**
- * 分配连续的物理页面
+ * 在全局位图中查找并分配连续页帧（调用者持有page_frames_lock）
  */
-uint64_t m4k_alloc_contiguous_pages(uint32_t count) {
+static uint64_t page_bitmap_alloc_contiguous(uint32_t count) {
     uint64_t start_page = 0;
     uint64_t consecutive = 0;
     uint64_t i;
@@ -386,6 +3025,77 @@ uint64_t m4k_alloc_contiguous_pages(uint32_t count) {
     return 0; /* 分配失败 */
 }
 
+/**
+ * 在全局位图中查找并分配按align页对齐的连续页帧（调用者持有page_frames_lock）
+ */
+static uint64_t page_bitmap_alloc_aligned(uint32_t count, uint32_t align) {
+    uint64_t start = 0;
+    uint64_t i;
+
+    while (start + count <= total_pages) {
+        for (i = start; i < start + count; i++) {
+            if (page_frames[i / 8] & (1 << (i % 8))) {
+                break;
+            }
+        }
+
+        if (i == start + count) {
+            for (i = start; i < start + count; i++) {
+                page_frames[i / 8] |= (1 << (i % 8));
+            }
+            free_pages -= count;
+            return start * PAGE_SIZE;
+        }
+
+        /* 跳过冲突页所在的对齐块 */
+        start = (i / align + 1) * align;
+    }
+
+    return 0; /* 分配失败 */
+}
+
+/**
+ * 分配连续页帧，不少于一个大页的请求优先按2MB对齐以便使用大页映射
+ */
+static uint64_t page_bitmap_alloc_range(uint32_t count) {
+    uint64_t address = 0;
+
+    m4k_spin_lock(&page_frames_lock);
+    if (count >= HUGE_PAGE_FRAMES) {
+        address = page_bitmap_alloc_aligned(count, HUGE_PAGE_FRAMES);
+    }
+    if (!address) {
+        address = page_bitmap_alloc_contiguous(count);
+    }
+    m4k_spin_unlock(&page_frames_lock);
+
+    return address;
+}
+
+/**
+ * 分配连续的物理页面
+ */
+uint64_t m4k_alloc_contiguous_pages(uint32_t count) {
+    uint64_t address = page_bitmap_alloc_range(count);
+
+    /* 每CPU缓存可能持有碎片页，归还后重试一次 */
+    if (!address) {
+        m4k_drain_pcp_pages();
+        address = page_bitmap_alloc_range(count);
+    }
+
+    if (address) {
+        uint64_t i;
+        for (i = 0; i < count; i++) {
+            page_frame_descs[address / PAGE_SIZE + i].refcount = 1;
+            page_frame_descs[address / PAGE_SIZE + i].mapcount = 0;
+            page_frame_descs[address / PAGE_SIZE + i].flags = 0;
+        }
+    }
+
+    return address;
+}
+
 /**
  * 释放连续的物理页面
  */
@@ -393,13 +3103,12 @@ void m4k_free_contiguous_pages(uint64_t address, uint32_t count) {
     uint64_t start_page = address / PAGE_SIZE;
     uint64_t i;
 
-    for (i = start_page; i < start_page + count; i++) {
-        uint64_t byte_index = i / 8;
-        uint64_t bit_index = i % 8;
-        page_frames[byte_index] &= ~(1 << bit_index);
+    m4k_spin_lock(&page_frames_lock);
+    for (i = start_page; i < start_page + count && i < total_pages; i++) {
+        page_frame_descs[i].refcount = 0;
+        page_bitmap_free(i);
     }
-
-    free_pages += count;
+    m4k_spin_unlock(&page_frames_lock);
 }
 
 /**
@@ -424,6 +3133,7 @@ bool m4k_is_virtual_address_valid(uint64_t virtual_addr) {
     pd = (pd_t *)((pdp[pdp_index] & 0xFFFFFFFFFF000) + MEM_BASE);
 
     if (!(pd[pd_index] & PTE_PRESENT)) return false;
+    if (pd[pd_index] & PTE_HUGE) return true;
     pt = (pt_t *)((pd[pd_index] & 0xFFFFFFFFFF000) + MEM_BASE);
 
     return (pt[pt_index] & PTE_PRESENT) != 0;
@@ -485,7 +3195,7 @@ void m4k_set_page_flags(uint64_t virtual_addr, uint64_t flags) {
     pt[pt_index] = physical_addr | flags | PTE_PRESENT;
 
     /* 刷新TLB */
-    __asm__ volatile ("invlpg (%0)" : : "r"(virtual_addr));
+    tlb_flush_cpus(0, &virtual_addr, 1);
 }
 
 /**
@@ -505,7 +3215,13 @@ void m4k_copy_page(uint64_t dest, uint64_t src) {
  * 清零页面
  */
 void m4k_zero_page(uint64_t address) {
-    memset((void *)address, 0, PAGE_SIZE);
+    uint64_t count = PAGE_SIZE;
+
+    /* 同步清零的页马上会被使用，用rep stosb保留在缓存中 */
+    __asm__ volatile ("rep stosb"
+                      : "+D"(address), "+c"(count)
+                      : "a"(0)
+                      : "memory");
 }
 
 /**
@@ -529,44 +3245,68 @@ bool m4k_compare_pages(uint64_t page1, uint64_t page2) {
  * 获取页面引用计数
  */
 uint32_t m4k_get_page_refcount(uint64_t virtual_addr) {
-    /* 临时实现，实际应该维护引用计数 */
-    return 1;
+    m4k_page_frame_t *desc;
+    uint64_t physical_addr = m4k_get_physical_address(virtual_addr);
+
+    if (!physical_addr) {
+        return 0;
+    }
+
+    desc = page_frame_desc(physical_addr);
+    return desc ? desc->refcount : 1;
 }
 
 /**
  * 增加页面引用计数
  */
 void m4k_inc_page_refcount(uint64_t virtual_addr) {
-    /* 临时实现 */
+    uint64_t physical_addr = m4k_get_physical_address(virtual_addr);
+
+    if (physical_addr) {
+        m4k_page_get(physical_addr);
+    }
 }
 
 /**
  * 减少页面引用计数
  */
 void m4k_dec_page_refcount(uint64_t virtual_addr) {
-    /* 临时实现 */
+    uint64_t physical_addr = m4k_get_physical_address(virtual_addr);
+
+    if (physical_addr) {
+        m4k_page_put(physical_addr);
+    }
 }
 
 /**
  * 锁定页面到内存
  */
 void m4k_lock_page(uint64_t virtual_addr) {
-    /* 临时实现 */
+    m4k_page_frame_t *desc = page_frame_desc(m4k_get_physical_address(virtual_addr));
+
+    if (desc) {
+        desc->flags |= PAGE_FRAME_LOCKED;
+    }
 }
 
 /**
  * 解锁页面
  */
 void m4k_unlock_page(uint64_t virtual_addr) {
-    /* 临时实现 */
+    m4k_page_frame_t *desc = page_frame_desc(m4k_get_physical_address(virtual_addr));
+
+    if (desc) {
+        desc->flags &= ~PAGE_FRAME_LOCKED;
+    }
 }
 
 /**
  * 检查页面是否被锁定
  */
 bool m4k_is_page_locked(uint64_t virtual_addr) {
-    /* 临时实现 */
-    return false;
+    m4k_page_frame_t *desc = page_frame_desc(m4k_get_physical_address(virtual_addr));
+
+    return desc && (desc->flags & PAGE_FRAME_LOCKED);
 }
 
 /**
@@ -588,29 +3328,420 @@ void m4k_set_page_mtime(uint64_t virtual_addr, uint64_t mtime) {
  * 预取页面到缓存
  */
 void m4k_prefault_page(uint64_t virtual_addr) {
-    /* 临时实现 */
+    uint64_t pml4 = m4k_read_cr3() & PTE_ADDR_MASK;
+    m4k_vm_area_t *area = vm_area_find(pml4, virtual_addr);
+
+    /* 提示性操作：只为预留区域内尚未分配的页分配，失败时静默忽略 */
+    if (area) {
+        vm_populate((pml4_t *)pte_table(pml4), area, virtual_addr & PAGE_MASK);
+    }
+}
+
+/**
+ * 预取一段地址范围（madvise WILLNEED）
+ */
+void m4k_prefault_range(uint64_t virtual_addr, uint64_t size) {
+    uint64_t va;
+
+    for (va = virtual_addr & PAGE_MASK; va < virtual_addr + size; va += PAGE_SIZE) {
+        m4k_prefault_page(va);
+    }
 }
 
 /**
  * 刷新页面缓存
  */
 void m4k_flush_page_cache(uint64_t virtual_addr) {
-    /* 临时实现 */
+    uint64_t line;
+
+    if (!m4k_is_virtual_address_valid(virtual_addr)) {
+        return;
+    }
+
+    /* 按缓存行写回并失效整页 */
+    for (line = virtual_addr & PAGE_MASK; line < (virtual_addr & PAGE_MASK) + PAGE_SIZE; line += 64) {
+        __asm__ volatile ("clflush (%0)" : : "r"(line) : "memory");
+    }
+    m4k_memory_barrier();
+}
+
+/*
+ * 页属性表：页表项的PAT、PCD、PWT位组成3位索引。低4项保持上电默认值，
+ * 没有PAT时WB/WT/UC的编码含义不变；写合并使用第4项
+ */
+#define PAT_VALUE   (PAT_ENTRY(0, MTRR_TYPE_WB) | PAT_ENTRY(1, MTRR_TYPE_WT) | \
+                     PAT_ENTRY(2, PAT_TYPE_UC_MINUS) | PAT_ENTRY(3, MTRR_TYPE_UC) | \
+                     PAT_ENTRY(4, MTRR_TYPE_WC) | PAT_ENTRY(5, MTRR_TYPE_WT) | \
+                     PAT_ENTRY(6, PAT_TYPE_UC_MINUS) | PAT_ENTRY(7, MTRR_TYPE_UC))
+#define PAT_INDEX_UC        3
+#define PAT_INDEX_WC        4
+
+static const uint8_t cache_policy_index[] = {
+    [M4K_CACHE_WB] = 0,
+    [M4K_CACHE_WT] = 1,
+    [M4K_CACHE_UC] = PAT_INDEX_UC,
+    [M4K_CACHE_WC] = PAT_INDEX_WC,
+};
+
+static const uint32_t pat_index_policy[8] = {
+    M4K_CACHE_WB, M4K_CACHE_WT, M4K_CACHE_UC, M4K_CACHE_UC,
+    M4K_CACHE_WC, M4K_CACHE_WT, M4K_CACHE_UC, M4K_CACHE_UC,
+};
+
+static bool pat_enabled = false;
+
+/* 设备映射窗口中的空闲范围，按地址排序，相邻的范围合并 */
+#define IOREMAP_FREE_RANGES     64
+
+typedef struct {
+    uint64_t start;
+    uint64_t size;
+} m4k_io_range_t;
+
+static m4k_io_range_t ioremap_free[IOREMAP_FREE_RANGES] = {
+    { IOREMAP_BASE, IOREMAP_SIZE },
+};
+static uint32_t ioremap_nr_free = 1;
+static m4k_spinlock_t ioremap_lock = M4K_SPINLOCK_INIT;
+
+/**
+ * 缓存策略对应的页表项位
+ */
+static uint64_t cache_policy_bits(uint32_t policy, bool huge) {
+    uint32_t index = cache_policy_index[policy];
+    uint64_t bits = 0;
+
+    /* 没有PAT时写合并退化为不可缓存 */
+    if (index == PAT_INDEX_WC && !pat_enabled) {
+        index = PAT_INDEX_UC;
+    }
+
+    if (index & 1) bits |= PTE_PWT;
+    if (index & 2) bits |= PTE_PCD;
+    if (index & 4) bits |= huge ? PTE_HUGE_PAT : PTE_PAT;
+
+    return bits;
+}
+
+/**
+ * 页表项的缓存策略
+ */
+static uint32_t cache_policy_of(uint64_t entry, bool huge) {
+    uint32_t index = 0;
+
+    if (entry & PTE_PWT) index |= 1;
+    if (entry & PTE_PCD) index |= 2;
+    if (pat_enabled && (entry & (huge ? PTE_HUGE_PAT : PTE_PAT))) index |= 4;
+
+    return pat_index_policy[index];
+}
+
+/**
+ * 编程PAT（每个处理器启动时调用一次，按SDM要求在关闭缓存时修改）
+ */
+void m4k_pat_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    uint64_t flags, cr0, cr4;
+
+    m4k_cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEAT_EDX_PAT)) {
+        return;
+    }
+
+    flags = m4k_irq_save();
+    cr0 = m4k_read_cr0();
+    cr4 = m4k_read_cr4();
+
+    m4k_write_cr0((cr0 | M4K_CR0_CD) & ~M4K_CR0_NW);
+    m4k_wbinvd();
+
+    /* 清除CR4.PGE再恢复，连同全局条目一起刷新TLB */
+    m4k_write_cr4(cr4 & ~M4K_CR4_PGE);
+    m4k_write_msr(MSR_PAT, PAT_VALUE);
+    m4k_wbinvd();
+    m4k_write_cr4(cr4);
+
+    m4k_write_cr0(cr0);
+    m4k_irq_restore(flags);
+
+    pat_enabled = true;
 }
 
 /**
  * 获取页面缓存状态
+ * @return M4K_CACHE_*，未映射返回M4K_CACHE_INVALID
  */
 uint32_t m4k_get_page_cache_state(uint64_t virtual_addr) {
-    /* 临时实现 */
+    uint64_t *pde = pd_entry_lookup(kernel_pml4, virtual_addr);
+    uint64_t pte;
+
+    if (!pde || !(*pde & PTE_PRESENT)) {
+        return M4K_CACHE_INVALID;
+    }
+
+    if (*pde & PTE_HUGE) {
+        return cache_policy_of(*pde, true);
+    }
+
+    pte = pte_table(*pde)[(virtual_addr >> 12) & 0x1FF];
+    if (!(pte & PTE_PRESENT)) {
+        return M4K_CACHE_INVALID;
+    }
+
+    return cache_policy_of(pte, false);
+}
+
+/**
+ * 设置页面缓存策略（位于大页内时先拆分）
+ * @return 成功返回0，页面未映射或策略无效返回-1
+ */
+int32_t m4k_set_page_cache_policy(uint64_t virtual_addr, uint32_t policy) {
+    uint64_t *pde = pd_entry_lookup(kernel_pml4, virtual_addr);
+    uint64_t *pte;
+    uint32_t old_policy;
+
+    if (policy > M4K_CACHE_WC || !pde || !(*pde & PTE_PRESENT)) {
+        return -1;
+    }
+
+    if ((*pde & PTE_HUGE) && split_huge_pmd(pde, virtual_addr) != 0) {
+        return -1;
+    }
+
+    pte = &pte_table(*pde)[(virtual_addr >> 12) & 0x1FF];
+    if (!(*pte & PTE_PRESENT)) {
+        return -1;
+    }
+
+    old_policy = cache_policy_of(*pte, false);
+    if (old_policy == policy) {
+        return 0;
+    }
+
+    *pte = (*pte & ~(PTE_PWT | PTE_PCD | PTE_PAT)) | cache_policy_bits(policy, false);
+    tlb_flush_cpus(0, &virtual_addr, 1);
+
+    /* 回写策略下缓存的脏行不能留到不可缓存的访问之后 */
+    if (old_policy == M4K_CACHE_WB) {
+        m4k_flush_page_cache(virtual_addr);
+    }
+
     return 0;
 }
 
 /**
- * 设置页面缓存策略
+ * 从窗口中分配length字节的虚拟地址（调用者持有ioremap_lock）
+ * @param offset 不为0xFFFFFFFF时要求地址在2MB内的偏移为offset，中间部分可用大页
+ * @return 虚拟地址，窗口中没有足够大的空闲范围返回0
  */
-void m4k_set_page_cache_policy(uint64_t virtual_addr, uint32_t policy) {
-    /* 临时实现 */
+static uint64_t ioremap_alloc_va(uint64_t length, uint64_t offset) {
+    uint32_t i;
+
+    for (i = 0; i < ioremap_nr_free; i++) {
+        m4k_io_range_t *range = &ioremap_free[i];
+        uint64_t va = range->start;
+        uint64_t end = range->start + range->size;
+
+        if (offset != 0xFFFFFFFF) {
+            va += (offset - va) & (HUGE_PAGE_SIZE - 1);
+        }
+        if (va + length > end) {
+            continue;
+        }
+
+        /* 前后都有剩余时拆成两段，表满时换下一个范围 */
+        if (va > range->start && va + length < end) {
+            if (ioremap_nr_free == IOREMAP_FREE_RANGES) {
+                continue;
+            }
+            memmove(&ioremap_free[i + 2], &ioremap_free[i + 1],
+                    (ioremap_nr_free - i - 1) * sizeof(m4k_io_range_t));
+            ioremap_free[i + 1].start = va + length;
+            ioremap_free[i + 1].size = end - va - length;
+            ioremap_nr_free++;
+            range->size = va - range->start;
+        } else if (va > range->start) {
+            range->size = va - range->start;
+        } else if (va + length < end) {
+            range->start = va + length;
+            range->size = end - va - length;
+        } else {
+            memmove(range, range + 1, (ioremap_nr_free - i - 1) * sizeof(m4k_io_range_t));
+            ioremap_nr_free--;
+        }
+
+        return va;
+    }
+
+    return 0;
+}
+
+/**
+ * 把虚拟地址范围还给窗口（调用者持有ioremap_lock），与前后的空闲范围合并；
+ * 无法合并且表已满时这段地址不再使用
+ */
+static void ioremap_free_va(uint64_t va, uint64_t length) {
+    uint32_t i;
+    bool merge_prev, merge_next;
+
+    for (i = 0; i < ioremap_nr_free && ioremap_free[i].start < va; i++) {
+    }
+
+    merge_prev = i > 0 && ioremap_free[i - 1].start + ioremap_free[i - 1].size == va;
+    merge_next = i < ioremap_nr_free && va + length == ioremap_free[i].start;
+
+    if (merge_prev && merge_next) {
+        ioremap_free[i - 1].size += length + ioremap_free[i].size;
+        memmove(&ioremap_free[i], &ioremap_free[i + 1],
+                (ioremap_nr_free - i - 1) * sizeof(m4k_io_range_t));
+        ioremap_nr_free--;
+    } else if (merge_prev) {
+        ioremap_free[i - 1].size += length;
+    } else if (merge_next) {
+        ioremap_free[i].start = va;
+        ioremap_free[i].size += length;
+    } else if (ioremap_nr_free < IOREMAP_FREE_RANGES) {
+        memmove(&ioremap_free[i + 1], &ioremap_free[i],
+                (ioremap_nr_free - i) * sizeof(m4k_io_range_t));
+        ioremap_free[i].start = va;
+        ioremap_free[i].size = length;
+        ioremap_nr_free++;
+    }
+}
+
+/**
+ * 清除设备映射窗口中[va, end)的页表项
+ */
+static void ioremap_clear(uint64_t va, uint64_t end) {
+    m4k_tlb_batch_t batch;
+
+    /* 设备内存不属于页帧分配器，只清除页表项 */
+    tlb_batch_begin(&batch, 0);
+    while (va < end) {
+        uint64_t *pde = pd_entry_lookup(kernel_pml4, va);
+        uint64_t *pte;
+
+        if (pde && (*pde & PTE_HUGE) && !(va & (HUGE_PAGE_SIZE - 1)) &&
+            end - va >= HUGE_PAGE_SIZE) {
+            *pde = 0;
+            tlb_batch_add_page(&batch, va);
+            va += HUGE_PAGE_SIZE;
+            continue;
+        }
+
+        pte = page_walk(kernel_pml4, va);
+        if (pte) {
+            *pte = 0;
+            tlb_batch_add_page(&batch, va);
+        }
+        va += PAGE_SIZE;
+    }
+    tlb_batch_flush(&batch);
+}
+
+/**
+ * 页表中是否没有任何页表项
+ */
+static bool ioremap_table_empty(const uint64_t *table) {
+    uint32_t i;
+
+    for (i = 0; i < 512; i++) {
+        if (table[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * 撤销设备内存映射，虚拟地址在所有处理器失效之后还给窗口
+ * @param virtual_addr、size与m4k_ioremap的返回值和参数相同
+ */
+void m4k_iounmap(uint64_t virtual_addr, uint64_t size) {
+    uint64_t end = (virtual_addr + size + PAGE_SIZE - 1) & PAGE_MASK;
+    uint64_t va = virtual_addr & PAGE_MASK;
+
+    if (size == 0 || va < IOREMAP_BASE || end > IOREMAP_BASE + IOREMAP_SIZE) {
+        return;
+    }
+
+    ioremap_clear(va, end);
+
+    m4k_spin_lock(&ioremap_lock);
+    ioremap_free_va(va, end - va);
+    m4k_spin_unlock(&ioremap_lock);
+}
+
+/**
+ * 映射设备内存（MMIO寄存器、帧缓冲）
+ * 对齐的部分用2MB大页映射；帧缓冲和可预取BAR适合M4K_CACHE_WC，
+ * 寄存器使用M4K_CACHE_UC
+ * @return 对应physical_addr的内核虚拟地址，失败返回0
+ */
+uint64_t m4k_ioremap(uint64_t physical_addr, uint64_t size, uint32_t policy) {
+    uint64_t base = physical_addr & PAGE_MASK;
+    uint64_t length = (physical_addr + size + PAGE_SIZE - 1 - base) & PAGE_MASK;
+    uint64_t va, mapped = 0;
+
+    if (size == 0 || policy > M4K_CACHE_WC) {
+        return 0;
+    }
+
+    /* 虚拟地址与物理地址在2MB内的偏移一致，中间部分才能用大页 */
+    m4k_spin_lock(&ioremap_lock);
+    va = ioremap_alloc_va(length, length >= HUGE_PAGE_SIZE ?
+                          (base & (HUGE_PAGE_SIZE - 1)) : 0xFFFFFFFF);
+    m4k_spin_unlock(&ioremap_lock);
+    if (!va) {
+        return 0;
+    }
+
+    while (mapped < length) {
+        uint64_t virt = va + mapped;
+        uint64_t phys = base + mapped;
+
+        if (!(virt & (HUGE_PAGE_SIZE - 1)) && length - mapped >= HUGE_PAGE_SIZE) {
+            uint64_t *pde = pd_entry_alloc(kernel_pml4, virt);
+            uint64_t old;
+
+            if (!pde) break;
+
+            /* 窗口中先前的4KB映射撤销后留下的页表：整个2MB已分配给本次映射，
+             * 其中不应还有页表项，否则放弃 */
+            old = *pde;
+            if ((old & PTE_PRESENT) && !(old & PTE_HUGE) &&
+                !ioremap_table_empty(pte_table(old))) {
+                break;
+            }
+
+            *pde = phys | PTE_PRESENT | PTE_WRITE | PTE_HUGE | PTE_NX |
+                   cache_policy_bits(policy, true);
+
+            /* 处理器可能还缓存着经由旧页表的转换，失效之后才能释放页表 */
+            if ((old & PTE_PRESENT) && !(old & PTE_HUGE)) {
+                tlb_flush_cpus(0, &virt, 1);
+                m4k_free_physical_page(old & PTE_ADDR_MASK);
+            }
+            mapped += HUGE_PAGE_SIZE;
+        } else {
+            uint64_t *pte = pte_alloc(kernel_pml4, virt);
+
+            if (!pte) break;
+            *pte = phys | PTE_PRESENT | PTE_WRITE | PTE_NX | cache_policy_bits(policy, false);
+            mapped += PAGE_SIZE;
+        }
+    }
+
+    if (mapped < length) {
+        ioremap_clear(va, va + mapped);
+        m4k_spin_lock(&ioremap_lock);
+        ioremap_free_va(va, length);
+        m4k_spin_unlock(&ioremap_lock);
+        return 0;
+    }
+
+    return va + (physical_addr & (PAGE_SIZE - 1));
 }
 
 /**
@@ -634,6 +3765,51 @@ void m4k_memory_statistics(void) {
     console_write("Usage: ");
     console_write_dec((used * 100) / total);
     console_write("%\n");
+    console_write("Mappings: ");
+    console_write_dec(small_mappings);
+    console_write(" x 4KB, ");
+    console_write_dec(huge_mappings);
+    console_write(" x 2MB\n");
+    console_write("Zero pool: ");
+    console_write_dec(zero_pool_count);
+    console_write(" pages, ");
+    console_write_dec(zero_pool_hits);
+    console_write(" hits, ");
+    console_write_dec(zero_pool_misses);
+    console_write(" misses\n");
+    console_write("Demand faults: ");
+    console_write_dec(demand_faults);
+    console_write(", fault-around pages: ");
+    console_write_dec(fault_around_maps);
+    console_write(", 2MB faults: ");
+    console_write_dec(huge_faults);
+    console_write("\n");
+    console_write("TLB: PCID ");
+    console_write(pcid_enabled ? "on" : "off");
+    console_write(", ");
+    console_write_dec(tlb_stats.switches);
+    console_write(" switches (");
+    console_write_dec(tlb_stats.preserved);
+    console_write(" preserved), ");
+    console_write_dec(tlb_stats.full_flushes);
+    console_write(" full flushes, ");
+    console_write_dec(tlb_stats.batched_pages);
+    console_write(" pages in ");
+    console_write_dec(tlb_stats.batches);
+    console_write(" batches\n");
+
+    if (ksm_enabled) {
+        m4k_ksm_stats_t ksm;
+
+        m4k_ksm_get_stats(&ksm);
+        console_write("KSM: ");
+        console_write_dec(ksm.pages_shared);
+        console_write(" shared, ");
+        console_write_dec(ksm.pages_sharing);
+        console_write(" sharing, ratio ");
+        console_write_dec(ksm.merge_ratio);
+        console_write("%\n");
+    }
     console_write("=====================================\n");
 }
 
@@ -0,0 +1,70 @@
+/**
+ * M4KK1 x86_64 Architecture - Address Space Interface
+ * sys/src/include/vm.h的x86_64实现
+ *
+ * 页表、写时复制、相同页合并和TLB失效都在memory.c中，这里只做类型
+ * 转换，让共享的内核代码不依赖x86_64的m4k_*接口。
+ */
+
+#include "../../../sys/src/include/vm.h"
+#include "../../../sys/src/include/memory.h"
+
+/**
+ * 分页在引导时已启用，直接映射由m4k_memory_init建立
+ */
+void vm_init(void) {
+}
+
+uintptr_t vm_space_create(void) {
+    return m4k_create_address_space();
+}
+
+uintptr_t vm_space_fork(uintptr_t space) {
+    return m4k_fork_address_space(space);
+}
+
+void vm_space_destroy(uintptr_t space) {
+    m4k_destroy_address_space(space);
+}
+
+/**
+ * 内核线程沿用当前地址空间，内核部分各地址空间共享
+ */
+void vm_space_switch(uintptr_t space) {
+    if (space) {
+        m4k_switch_address_space(space);
+    }
+}
+
+int32_t vm_reserve(uintptr_t space, uintptr_t start, uintptr_t size, uint32_t flags) {
+    return m4k_vm_reserve(space, start, size, flags);
+}
+
+void vm_release(uintptr_t space, uintptr_t start, uintptr_t size) {
+    m4k_vm_release(space, start, size);
+}
+
+uintptr_t vm_translate(uintptr_t space, uintptr_t virtual_addr) {
+    return m4k_vm_translate(space, virtual_addr);
+}
+
+void *vm_phys_to_virt(uintptr_t physical_addr) {
+    return (void *)m4k_phys_to_virt(physical_addr);
+}
+
+int32_t vm_handle_fault(uintptr_t space, uintptr_t fault_addr, uint32_t error_code) {
+    return m4k_handle_page_fault(space, fault_addr, error_code);
+}
+
+int32_t vm_grant(uintptr_t src_space, uintptr_t src, uintptr_t dst_space, uintptr_t dst,
+                 uintptr_t size, uint32_t mode) {
+    return m4k_vm_grant(src_space, src, dst_space, dst, size, mode);
+}
+
+int32_t vm_ksm_register(uintptr_t space) {
+    return m4k_ksm_register(space);
+}
+
+void vm_ksm_unregister(uintptr_t space) {
+    m4k_ksm_unregister(space);
+}
@@ -0,0 +1,451 @@
+/**
+ * M4KK1 FPU/SIMD Context Implementation
+ * 进程扩展状态的延迟切换实现
+ *
+ * 每个处理器记录寄存器中装的是哪个进程的状态（fpu_owner）。切入时置
+ * CR0.TS；进程第一次使用FPU/SIMD触发#NM，若寄存器中已是它的状态只需
+ * 清TS，否则从保存区装入。切出时TS已清除才写回，所以寄存器中的状态
+ * 在TS置位时总是已经保存过，#NM里不需要先写回上一个进程。
+ * 保存总在切出时完成，进程迁移到其他处理器后保存区就是最新的。
+ */
+
+#include "../../include/fpu.h"
+#include "../../include/process.h"
+#include "../../include/slab.h"
+#include "../../include/smp.h"
+#include "../../include/idt.h"
+#include "../../include/gdt.h"
+#include "../../include/console.h"
+#include "../../include/kernel.h"
+#include "../../include/stdint.h"
+
+#define CPUID_FEAT_EDX_FXSR     (1 << 24)
+#ifndef CPUID_FEAT_EDX_SSE2
+#define CPUID_FEAT_EDX_SSE2     (1 << 26)
+#endif
+#ifndef CPUID_FEAT_ECX_XSAVE
+#define CPUID_FEAT_ECX_XSAVE    (1 << 26)
+#define CPUID_FEAT_ECX_AVX      (1 << 28)
+#endif
+#define CPUID_XSAVE_EAX_XSAVEOPT (1 << 0)
+
+#define FPU_CR0_MP              (1UL << 1)
+#define FPU_CR0_EM              (1UL << 2)
+#define FPU_CR0_TS              (1UL << 3)
+#define FPU_CR0_NE              (1UL << 5)
+#define FPU_CR4_OSFXSR          (1UL << 9)
+#define FPU_CR4_OSXMMEXCPT      (1UL << 10)
+#define FPU_CR4_OSXSAVE         (1UL << 18)
+
+extern void isr_device_not_available(void);
+
+static uint32_t fpu_mode = FPU_MODE_NONE;
+static uint32_t fpu_xcr0 = 0;
+static uint32_t fpu_state_size = FPU_FXSAVE_SIZE;
+static bool fpu_sse2 = false;              /* 基准测试用movd读写xmm0 */
+static kmem_cache_t *fpu_cache = NULL;
+static fpu_stats_t fpu_stats;
+
+/* 每个处理器：寄存器中状态的所属进程、正在运行的进程、内核SIMD区间 */
+static struct process *fpu_owner[SMP_MAX_CPUS];
+static struct process *fpu_current[SMP_MAX_CPUS];
+static uint32_t fpu_kernel_active[SMP_MAX_CPUS];
+static uint32_t fpu_kernel_flags[SMP_MAX_CPUS];
+
+static inline void fpu_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx,
+                             uint32_t *ecx, uint32_t *edx) {
+    __asm__ volatile ("cpuid"
+                      : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                      : "a"(leaf), "c"(subleaf));
+}
+
+static inline uint32_t fpu_read_cr0(void) {
+    uint32_t cr0;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline void fpu_set_ts(void) {
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(fpu_read_cr0() | FPU_CR0_TS) : "memory");
+}
+
+static inline void fpu_clear_ts(void) {
+    __asm__ volatile ("clts" : : : "memory");
+}
+
+static inline uint32_t fpu_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void fpu_irq_restore(uint32_t flags) {
+    if (flags & 0x200) {
+        __asm__ volatile ("sti" : : : "memory");
+    }
+}
+
+static inline uint64_t fpu_rdtsc(void) {
+    uint64_t value;
+    __asm__ volatile ("rdtsc" : "=A"(value));
+    return value;
+}
+
+/**
+ * 把寄存器中的状态写回进程的保存区（TS必须已清除）
+ */
+static void fpu_save(struct process *process) {
+    void *area = process->fpu_state;
+
+    switch (fpu_mode) {
+    case FPU_MODE_XSAVEOPT:
+        __asm__ volatile ("xsaveopt (%0)" : : "r"(area), "a"(fpu_xcr0), "d"(0) : "memory");
+        break;
+    case FPU_MODE_XSAVE:
+        __asm__ volatile ("xsave (%0)" : : "r"(area), "a"(fpu_xcr0), "d"(0) : "memory");
+        break;
+    default:
+        __asm__ volatile ("fxsave (%0)" : : "r"(area) : "memory");
+        break;
+    }
+    fpu_stats.saves++;
+}
+
+/**
+ * 从进程的保存区装入状态（TS必须已清除）
+ */
+static void fpu_restore(struct process *process) {
+    void *area = process->fpu_state;
+
+    if (fpu_mode == FPU_MODE_FXSAVE) {
+        __asm__ volatile ("fxrstor (%0)" : : "r"(area) : "memory");
+    } else {
+        __asm__ volatile ("xrstor (%0)" : : "r"(area), "a"(fpu_xcr0), "d"(0) : "memory");
+    }
+    fpu_stats.restores++;
+}
+
+/**
+ * 按字复制保存区（不能用memcpy：它的SIMD版本会改写向量寄存器）
+ */
+static void fpu_copy_area(void *dst, const void *src) {
+    uint32_t *d = (uint32_t *)dst;
+    const uint32_t *s = (const uint32_t *)src;
+
+    for (uint32_t i = 0; i < fpu_state_size / sizeof(uint32_t); i++) {
+        d[i] = s[i];
+    }
+}
+
+/**
+ * 初始化FPU/SIMD
+ */
+void fpu_init(void) {
+    uint32_t max_leaf, eax, ebx, ecx, edx;
+    uint32_t cr0, cr4;
+    uint32_t mode = FPU_MODE_FXSAVE;
+
+    fpu_cpuid(0, 0, &max_leaf, &ebx, &ecx, &edx);
+    fpu_cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+
+    if (!(edx & CPUID_FEAT_EDX_FXSR)) {
+        KLOG_WARN("No FXSAVE support, FPU state is not switched");
+        return;
+    }
+
+    /* 使用原生x87异常报告，WAIT/FWAIT也检查TS */
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 & ~(FPU_CR0_EM | FPU_CR0_TS)) | FPU_CR0_MP | FPU_CR0_NE;
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(cr0));
+
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= FPU_CR4_OSFXSR | FPU_CR4_OSXMMEXCPT;
+    if ((ecx & CPUID_FEAT_ECX_XSAVE) && max_leaf >= 0xD) {
+        cr4 |= FPU_CR4_OSXSAVE;
+    }
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4));
+    __asm__ volatile ("fninit");
+
+    fpu_sse2 = (edx & CPUID_FEAT_EDX_SSE2) != 0;
+    fpu_state_size = FPU_FXSAVE_SIZE;
+    fpu_xcr0 = FPU_XCR0_X87 | FPU_XCR0_SSE;
+    if (cr4 & FPU_CR4_OSXSAVE) {
+        if (ecx & CPUID_FEAT_ECX_AVX) {
+            fpu_xcr0 |= FPU_XCR0_AVX;
+        }
+        __asm__ volatile ("xsetbv" : : "a"(fpu_xcr0), "d"(0), "c"(0));
+
+        /* 子叶0的EBX是XCR0当前启用的组件需要的保存区大小 */
+        fpu_cpuid(0xD, 0, &eax, &ebx, &ecx, &edx);
+        fpu_state_size = ebx;
+        fpu_cpuid(0xD, 1, &eax, &ebx, &ecx, &edx);
+        mode = (eax & CPUID_XSAVE_EAX_XSAVEOPT) ? FPU_MODE_XSAVEOPT : FPU_MODE_XSAVE;
+    }
+
+    fpu_cache = kmem_cache_create("fpu_state", fpu_state_size, FPU_STATE_ALIGN, NULL);
+    if (!fpu_cache) {
+        KLOG_WARN("Failed to create FPU state cache, FPU state is not switched");
+        return;
+    }
+
+    idt_set_gate(IDT_DEVICE_NOT_AVAILABLE, (uint32_t)isr_device_not_available, GDT_KERNEL_CODE,
+                 IDT_PRESENT | IDT_DPL_0 | IDT_GATE_32BIT | IDT_INTERRUPT_GATE);
+
+    fpu_stats.state_size = fpu_state_size;
+    fpu_stats.xcr0 = fpu_xcr0;
+    fpu_mode = mode;
+
+    KLOG_INFO("FPU context switching: ");
+    console_write(mode == FPU_MODE_XSAVEOPT ? "xsaveopt" :
+                  mode == FPU_MODE_XSAVE ? "xsave" : "fxsave");
+    console_write(", ");
+    console_write_dec(fpu_state_size);
+    console_write(" bytes/process\n");
+}
+
+/**
+ * 是否在管理扩展状态
+ */
+bool fpu_enabled(void) {
+    return fpu_mode != FPU_MODE_NONE;
+}
+
+/**
+ * 分配保存区并填入初始状态
+ */
+int32_t fpu_alloc_state(struct process *process) {
+    uint32_t *area;
+
+    process->fpu_state = NULL;
+    process->fpu_cpu = SMP_MAX_CPUS;
+    if (fpu_mode == FPU_MODE_NONE) {
+        return 0;
+    }
+
+    area = (uint32_t *)kmem_cache_alloc(fpu_cache);
+    if (!area) {
+        return -1;
+    }
+
+    /* XSAVE头全0表示所有组件为初始状态，只需填好FCW和MXCSR */
+    for (uint32_t i = 0; i < fpu_state_size / sizeof(uint32_t); i++) {
+        area[i] = 0;
+    }
+    *(uint16_t *)((uint8_t *)area + FPU_FCW_OFFSET) = FPU_FCW_DEFAULT;
+    *(uint32_t *)((uint8_t *)area + FPU_MXCSR_OFFSET) = FPU_MXCSR_DEFAULT;
+
+    process->fpu_state = area;
+    return 0;
+}
+
+/**
+ * 释放保存区
+ */
+void fpu_free_state(struct process *process) {
+    uint32_t flags;
+
+    if (!process->fpu_state) {
+        return;
+    }
+
+    flags = fpu_irq_save();
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if (fpu_owner[cpu] == process) {
+            fpu_owner[cpu] = NULL;
+        }
+    }
+    fpu_irq_restore(flags);
+
+    kmem_cache_free(fpu_cache, process->fpu_state);
+    process->fpu_state = NULL;
+}
+
+/**
+ * 复制扩展状态
+ */
+void fpu_copy_state(struct process *dst, struct process *src) {
+    uint32_t flags;
+
+    if (!dst->fpu_state || !src->fpu_state) {
+        return;
+    }
+
+    /* 寄存器中的状态比保存区新：先写回 */
+    flags = fpu_irq_save();
+    if (!(fpu_read_cr0() & FPU_CR0_TS) && fpu_owner[smp_cpu_id()] == src) {
+        fpu_save(src);
+    }
+    fpu_copy_area(dst->fpu_state, src->fpu_state);
+    fpu_irq_restore(flags);
+}
+
+/**
+ * 进程切换
+ */
+void fpu_switch(struct process *prev, struct process *next) {
+    uint32_t cpu = smp_cpu_id();
+    struct process *owner = fpu_owner[cpu];
+
+    (void)prev;
+
+    if (fpu_mode == FPU_MODE_NONE) {
+        return;
+    }
+
+    /* TS已清除说明寄存器在本时间片被使用过，属于正在切出的进程 */
+    if (!(fpu_read_cr0() & FPU_CR0_TS)) {
+        if (owner && owner->fpu_state) {
+            fpu_save(owner);
+        }
+    } else {
+        fpu_stats.skipped_saves++;
+    }
+
+    fpu_current[cpu] = next;
+    fpu_set_ts();
+}
+
+/**
+ * #NM：当前进程在本时间片第一次使用FPU/SIMD
+ */
+void fpu_handle_nm(void) {
+    uint32_t cpu = smp_cpu_id();
+    struct process *process = fpu_current[cpu];
+
+    fpu_clear_ts();
+    fpu_stats.traps++;
+
+    if (!process || !process->fpu_state) {
+        fpu_owner[cpu] = NULL;
+        return;
+    }
+
+    /* 寄存器中仍是它上次在本处理器上的状态 */
+    if (fpu_owner[cpu] == process && process->fpu_cpu == cpu) {
+        return;
+    }
+
+    fpu_restore(process);
+    fpu_owner[cpu] = process;
+    process->fpu_cpu = cpu;
+}
+
+/**
+ * 内核开始使用向量寄存器
+ * 区间内关中断，避免被切换到其他进程时内核的向量寄存器内容丢失
+ */
+bool fpu_kernel_begin(void) {
+    uint32_t flags;
+    uint32_t cpu;
+
+    if (fpu_mode == FPU_MODE_NONE) {
+        return true;
+    }
+
+    flags = fpu_irq_save();
+    cpu = smp_cpu_id();
+    if (fpu_kernel_active[cpu]) {
+        fpu_irq_restore(flags);
+        return false;
+    }
+
+    if (!(fpu_read_cr0() & FPU_CR0_TS)) {
+        if (fpu_owner[cpu] && fpu_owner[cpu]->fpu_state) {
+            fpu_save(fpu_owner[cpu]);
+        }
+    } else {
+        fpu_clear_ts();
+    }
+
+    /* 内核会改写寄存器，之后进程再使用时必须从保存区装入 */
+    fpu_owner[cpu] = NULL;
+    fpu_kernel_active[cpu] = 1;
+    fpu_kernel_flags[cpu] = flags;
+    return true;
+}
+
+/**
+ * 内核结束使用向量寄存器
+ */
+void fpu_kernel_end(void) {
+    uint32_t cpu;
+
+    if (fpu_mode == FPU_MODE_NONE) {
+        return;
+    }
+
+    cpu = smp_cpu_id();
+    fpu_set_ts();
+    fpu_kernel_active[cpu] = 0;
+    fpu_irq_restore(fpu_kernel_flags[cpu]);
+}
+
+/**
+ * 获取统计信息
+ */
+void fpu_get_stats(fpu_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+
+    *stats = fpu_stats;
+    stats->mode = fpu_mode;
+}
+
+/**
+ * 切换开销基准测试
+ */
+int32_t fpu_benchmark(uint32_t switches, fpu_bench_t *bench) {
+    static process_t procs[2];
+    uint32_t cpu = smp_cpu_id();
+    struct process *self = fpu_current[cpu];
+    int32_t result = 0;
+    uint64_t start;
+    uint32_t flags;
+    uint32_t i;
+
+    if (!bench || fpu_mode == FPU_MODE_NONE || !fpu_sse2 || switches < 2) {
+        return -1;
+    }
+
+    if (fpu_alloc_state(&procs[0]) < 0) {
+        return -1;
+    }
+    if (fpu_alloc_state(&procs[1]) < 0) {
+        fpu_free_state(&procs[0]);
+        return -1;
+    }
+
+    flags = fpu_irq_save();
+    fpu_switch(self, &procs[0]);
+
+    /* 只有整数运算：切换只需置TS */
+    start = fpu_rdtsc();
+    for (i = 1; i <= switches; i++) {
+        fpu_switch(&procs[(i - 1) & 1], &procs[i & 1]);
+    }
+    bench->int_cycles = fpu_rdtsc() - start;
+
+    /* 每个时间片读写xmm0：#NM、装入，切出时写回；读到的必须是自己上次写的值 */
+    start = fpu_rdtsc();
+    for (i = 1; i <= switches; i++) {
+        uint32_t tag = 0x5A5A0000 | (i & 1);
+        uint32_t value;
+
+        fpu_switch(&procs[(i - 1) & 1], &procs[i & 1]);
+        __asm__ volatile ("movd %%xmm0, %0" : "=r"(value));
+        if (i > 2 && value != tag) {
+            result = -1;
+        }
+        __asm__ volatile ("movd %0, %%xmm0" : : "r"(tag));
+    }
+    bench->vector_cycles = fpu_rdtsc() - start;
+    bench->switches = switches;
+
+    fpu_switch(&procs[switches & 1], self);
+    fpu_irq_restore(flags);
+
+    fpu_free_state(&procs[0]);
+    fpu_free_state(&procs[1]);
+    return result;
+}
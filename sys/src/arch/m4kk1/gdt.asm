@@ -133,13 +133,10 @@ gdt_set_tss_base:
     ; 更新TSS段基址 (基址低16位)
     mov word [gdt + TSS_SEG + 2], ax
 
-    ; 更新TSS段基址 (基址中8位)
-    mov byte [gdt + TSS_SEG + 4], ah
-
-    ; 更新TSS段基址 (基址高8位)
+    ; 更新TSS段基址 (基址中8位和高8位)
     shr eax, 16
-    mov byte [gdt + TSS_SEG + 7], al
-    mov byte [gdt + TSS_SEG + 8], ah
+    mov byte [gdt + TSS_SEG + 4], al
+    mov byte [gdt + TSS_SEG + 7], ah
 
     ret
 
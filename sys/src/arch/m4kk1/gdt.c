@@ -6,6 +6,7 @@
 #include "../../include/gdt.h"
 #include "../../include/stdint.h"
 #include "../../include/string.h"
+#include "../../include/arch.h"
 
 // 外部汇编函数声明
 extern void gdt_load(void);
@@ -103,6 +104,10 @@ void gdt_flush(void) {
  * 加载TSS
  */
 void tss_flush(void) {
+    // 从用户态进入内核时使用ss0:esp0，不提供I/O许可位图
+    tss_entry.ss0 = GDT_KERNEL_DATA;
+    tss_entry.iomap_base = sizeof(tss_entry_t);
+
     // 使用汇编函数设置TSS基址和限制
     gdt_set_tss_base((uint32_t)&tss_entry);
     gdt_set_tss_limit(sizeof(tss_entry_t) - 1);
@@ -124,4 +129,11 @@ void set_kernel_stack(uint32_t stack) {
     // 更新TSS中的内核栈
     tss_entry.ss0 = GDT_KERNEL_DATA;
     tss_entry.esp0 = stack;
-}
\ No newline at end of file
+}
+
+/**
+ * 切换进程时设置从用户态进入内核使用的栈（i386只有一个处理器，一个TSS）
+ */
+void arch_set_kernel_stack(uintptr_t top) {
+    set_kernel_stack((uint32_t)top);
+}
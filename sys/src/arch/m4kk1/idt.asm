@@ -325,13 +325,43 @@ GLOBAL irq_timer
 irq_timer:
     pusha
 
+    ; 先发送EOI到主PIC：定时器回调可能切换到别的进程，很久以后才返回这里
+    mov al, 0x20
+    out 0x20, al
+
     ; 调用C语言定时器处理函数
     call timer_handler
 
-    ; 发送EOI到主PIC
-    mov al, 0x20
-    out 0x20, al
+    popa
+    iret
+
+; 设备不可用异常（#NM）：CR0.TS置位时首次使用FPU/SIMD指令，
+; 由fpu_handle_nm装入当前进程的扩展状态后重新执行该指令
+GLOBAL isr_device_not_available
+isr_device_not_available:
+    pusha
+    cld
+
+    call fpu_handle_nm
+
+    popa
+    iret
+
+; 系统调用入口（int 0x80）：按syscall_frame_t的布局保存寄存器，
+; syscall_handler把返回值写入帧中的EAX
+GLOBAL isr_syscall
+isr_syscall:
+    pusha
+    cld
+
+    push esp
+    call syscall_handler
+    add esp, 4
 
+; fork出的子进程和新建的用户进程第一次被切换到时也从这里返回，
+; 栈顶是为它准备的syscall_frame_t
+GLOBAL syscall_return
+syscall_return:
     popa
     iret
 
@@ -413,6 +443,8 @@ idt_limit_msg   db "  Limit: 0x", 0
 extern print_string
 extern print_hex
 extern timer_handler
+extern fpu_handle_nm
+extern syscall_handler
 
 
 ; 获取IDT信息
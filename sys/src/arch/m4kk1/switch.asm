@@ -0,0 +1,68 @@
+; M4KK1 Architecture - Context Switch
+; 进程内核栈切换和中断开关（sys/src/include/arch.h）
+
+BITS 32
+
+SECTION .text
+
+; uint32_t arch_irq_save(void)
+GLOBAL arch_irq_save
+arch_irq_save:
+    pushfd
+    pop eax
+    cli
+    ret
+
+; void arch_irq_restore(uint32_t flags)
+GLOBAL arch_irq_restore
+arch_irq_restore:
+    test dword [esp + 4], 0x200
+    jz .done
+    sti
+.done:
+    ret
+
+; 现场自低向高：EFLAGS、EDI、ESI、EBX、EBP、返回地址
+; uint32_t arch_init_stack(uint32_t top, void (*resume)(void), bool irq_on)
+GLOBAL arch_init_stack
+arch_init_stack:
+    mov eax, [esp + 4]          ; top
+    mov edx, [esp + 8]          ; resume
+    mov ecx, 0x0002
+    cmp byte [esp + 12], 0
+    je .flags
+    or ecx, 0x0200
+.flags:
+    sub eax, 24
+    mov [eax + 20], edx
+    mov dword [eax + 16], 0     ; EBP
+    mov dword [eax + 12], 0     ; EBX
+    mov dword [eax + 8], 0      ; ESI
+    mov dword [eax + 4], 0      ; EDI
+    mov [eax], ecx
+    ret
+
+; 把被调用者保存的寄存器和EFLAGS压入当前进程的内核栈，ESP存入*prev_sp，
+; 再从next_sp弹出下一个进程的现场，返回到它上次调用这里的位置
+; void arch_switch_stack(uint32_t *prev_sp, uint32_t next_sp, volatile uint32_t *prev_on_cpu)
+GLOBAL arch_switch_stack
+arch_switch_stack:
+    mov eax, [esp + 4]          ; prev_sp
+    mov edx, [esp + 8]          ; next_sp
+    mov ecx, [esp + 12]         ; prev_on_cpu
+
+    push ebp
+    push ebx
+    push esi
+    push edi
+    pushfd
+    mov [eax], esp
+
+    mov esp, edx
+    mov dword [ecx], 0          ; 旧栈已不再使用
+    popfd
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
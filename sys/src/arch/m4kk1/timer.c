@@ -1,6 +1,17 @@
 /**
  * M4KK1 Timer Implementation
  * 高精度定时器系统实现
+ *
+ * 闹钟放在分级时间轮中：插入和取消都是O(1)，每个滴答只检查一个槽位，
+ * 第一级转完一圈时把上一级的一个槽位下放。闹钟结构来自静态池，句柄
+ * 带世代号，池索引复用后旧句柄失效。
+ *
+ * 动态时钟：空闲时按时间轮中最早的到期时间把PIT改为单次模式（模式0），
+ * 到期中断一次补上睡眠期间的全部滴答，然后恢复周期模式。被其他中断
+ * 提前唤醒时读取PIT剩余计数换算已经过的滴答。
+ *
+ * 时钟源：启动时用PIT通道2的单次计数测量TSC频率（不依赖时钟中断），
+ * CPU支持不变TSC时纳秒时间戳改为rdtsc乘移位换算，分辨率不再受滴答限制。
  */
 
 #include "../../include/timer.h"
@@ -9,6 +20,12 @@
 #include "../../include/console.h"
 #include "../../include/kernel.h"
 #include "../../include/string.h"
+#include <stdbool.h>
+
+#ifndef CPUID_FEAT_EDX_TSC
+#define CPUID_FEAT_EDX_TSC      (1 << 4)
+#endif
+#define CPUID_APM_EDX_INVARIANT_TSC (1 << 8)
 
 /* I/O端口操作函数 */
 static inline void outb(uint16_t port, uint8_t value) {
@@ -24,18 +41,479 @@ static inline uint8_t inb(uint16_t port) {
 /* 定时器全局变量 */
 static uint32_t timer_ticks = 0;           /* 时钟滴答计数 */
 static uint32_t timer_frequency = 1000;    /* 定时器频率（Hz） */
-static uint64_t timer_nanoseconds = 0;     /* 纳秒级时间戳 */
+static volatile uint64_t timer_nanoseconds = 0; /* 按滴答累加的纳秒时间戳 */
+static uint32_t timer_divisor = TIMER_FREQUENCY / 1000; /* 每个滴答的PIT计数 */
+static uint32_t timer_tick_ns = 1000000;   /* 每个滴答的纳秒数 */
 static void (*timer_callback)(void) = NULL; /* 定时器中断处理函数 */
 
 /* 闹钟系统变量 */
-#define MAX_ALARMS 256
-static timer_alarm_t alarms[MAX_ALARMS];   /* 闹钟数组 */
-static uint32_t next_alarm_id = 1;         /* 下一个闹钟ID */
+#define TIMER_ALARM_INDEX_MASK  (TIMER_MAX_ALARMS - 1)
+static timer_alarm_t alarms[TIMER_MAX_ALARMS]; /* 闹钟池 */
+static timer_alarm_t *free_alarms = NULL;  /* 空闲闹钟链表 */
+static uint32_t alarm_generation[TIMER_MAX_ALARMS]; /* 每个池槽位的世代号 */
+static timer_wheel_t timer_wheel;          /* 闹钟时间轮 */
 static uint32_t active_alarms = 0;         /* 活跃闹钟数量 */
 
+/* 动态时钟 */
+#define TIMER_ONESHOT_MAX_COUNT 0xFFFF     /* PIT单次计数上限 */
+static uint8_t timer_dynamic = 1;          /* 是否启用动态时钟 */
+static volatile uint32_t timer_oneshot_ticks = 0; /* 非0时PIT处于单次模式，到期中断代表这么多滴答 */
+static timer_stats_t timer_stats;
+
 /* CPU频率（用于高精度计时） */
 static uint32_t cpu_frequency_mhz = 0;
 
+/* 时钟源 */
+#define CLOCK_CALIBRATE_SPINS   10000000   /* 等待PIT通道2输出的轮询上限 */
+static uint32_t clock_source = CLOCK_SOURCE_TICK;
+static uint32_t clock_tsc_khz = 0;
+static uint64_t clock_base_tsc = 0;        /* 切换到TSC时的TSC读数 */
+static uint64_t clock_base_ns = 0;         /* 切换到TSC时的纳秒时间戳 */
+static uint32_t clock_mult = 0;
+static uint32_t clock_shift = 0;
+
+static inline uint64_t timer_rdtsc(void) {
+    uint64_t value;
+    __asm__ volatile ("rdtsc" : "=A"(value));
+    return value;
+}
+
+static inline void timer_cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx,
+                               uint32_t *ecx, uint32_t *edx) {
+    __asm__ volatile ("cpuid"
+                      : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                      : "a"(leaf), "c"(0));
+}
+
+/**
+ * 关中断并返回原EFLAGS
+ */
+static inline uint32_t timer_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+/**
+ * 恢复中断状态
+ */
+static inline void timer_irq_restore(uint32_t flags) {
+    if (flags & 0x200) {
+        __asm__ volatile ("sti" : : : "memory");
+    }
+}
+
+/**
+ * 插入槽位链表头
+ */
+static inline void wheel_link(timer_alarm_t **slot, timer_alarm_t *alarm) {
+    alarm->next = *slot;
+    if (*slot) {
+        (*slot)->pprev = &alarm->next;
+    }
+    *slot = alarm;
+    alarm->pprev = slot;
+}
+
+/**
+ * 从槽位链表摘除
+ */
+static inline void wheel_unlink(timer_alarm_t *alarm) {
+    *alarm->pprev = alarm->next;
+    if (alarm->next) {
+        alarm->next->pprev = alarm->pprev;
+    }
+    alarm->next = NULL;
+    alarm->pprev = NULL;
+}
+
+/**
+ * 按距base的滴答数选择槽位
+ */
+static void wheel_insert(timer_wheel_t *wheel, timer_alarm_t *alarm) {
+    uint32_t expires = alarm->expires;
+    uint32_t delta = expires - wheel->base;
+    timer_alarm_t **slot;
+
+    if ((int32_t)delta < 0) {
+        /* 已过期：放入当前槽位，下一次推进时到期 */
+        slot = &wheel->root[wheel->base & (TIMER_WHEEL_ROOT_SIZE - 1)];
+    } else if (delta < TIMER_WHEEL_ROOT_SIZE) {
+        slot = &wheel->root[expires & (TIMER_WHEEL_ROOT_SIZE - 1)];
+    } else {
+        uint32_t level = 0;
+        uint32_t shift = TIMER_WHEEL_ROOT_BITS;
+
+        while (level < TIMER_WHEEL_LEVELS - 1 &&
+               delta >= (1U << (shift + TIMER_WHEEL_LEVEL_BITS))) {
+            level++;
+            shift += TIMER_WHEEL_LEVEL_BITS;
+        }
+        slot = &wheel->levels[level][(expires >> shift) & (TIMER_WHEEL_LEVEL_SIZE - 1)];
+    }
+
+    wheel_link(slot, alarm);
+}
+
+/**
+ * 把上一级的一个槽位下放到更低的级别
+ * @return 槽位索引（为0时说明该级也转完一圈，需要继续下放上一级）
+ */
+static uint32_t wheel_cascade(timer_wheel_t *wheel, uint32_t level) {
+    uint32_t shift = TIMER_WHEEL_ROOT_BITS + level * TIMER_WHEEL_LEVEL_BITS;
+    uint32_t index = (wheel->base >> shift) & (TIMER_WHEEL_LEVEL_SIZE - 1);
+    timer_alarm_t *alarm = wheel->levels[level][index];
+
+    wheel->levels[level][index] = NULL;
+    while (alarm) {
+        timer_alarm_t *next = alarm->next;
+        wheel_insert(wheel, alarm);
+        alarm = next;
+    }
+
+    return index;
+}
+
+/**
+ * 距下一次需要推进时间轮的滴答数
+ */
+uint32_t timer_wheel_next_expiry(const timer_wheel_t *wheel, uint32_t limit) {
+    uint32_t base = wheel->base;
+    uint32_t result = limit;
+    uint32_t shift = TIMER_WHEEL_ROOT_BITS;
+
+    /* 第一级每个槽位正好对应[base, base + 256)中的一个滴答 */
+    for (uint32_t delta = 0; delta < TIMER_WHEEL_ROOT_SIZE && delta < limit; delta++) {
+        if (wheel->root[(base + delta) & (TIMER_WHEEL_ROOT_SIZE - 1)]) {
+            return delta;
+        }
+    }
+
+    /* 更高级的槽位在其起始时刻下放，槽位中的闹钟不会早于这个时刻到期 */
+    for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; level++, shift += TIMER_WHEEL_LEVEL_BITS) {
+        uint32_t index = (base >> shift) & (TIMER_WHEEL_LEVEL_SIZE - 1);
+
+        for (uint32_t k = 1; k <= TIMER_WHEEL_LEVEL_SIZE; k++) {
+            if (wheel->levels[level][(index + k) & (TIMER_WHEEL_LEVEL_SIZE - 1)]) {
+                uint32_t delta = (((base >> shift) + k) << shift) - base;
+                if (delta < result) {
+                    result = delta;
+                }
+                break;
+            }
+        }
+    }
+
+    return result;
+}
+
+/**
+ * 初始化时间轮
+ */
+void timer_wheel_init(timer_wheel_t *wheel, uint32_t now) {
+    memset(wheel, 0, sizeof(timer_wheel_t));
+    wheel->base = now;
+}
+
+/**
+ * 放入时间轮
+ */
+void timer_wheel_add(timer_wheel_t *wheel, timer_alarm_t *alarm) {
+    wheel_insert(wheel, alarm);
+    alarm->state = TIMER_ALARM_PENDING;
+    wheel->count++;
+}
+
+/**
+ * 从时间轮中移除
+ */
+void timer_wheel_del(timer_wheel_t *wheel, timer_alarm_t *alarm) {
+    if (alarm->state != TIMER_ALARM_PENDING) {
+        return;
+    }
+
+    wheel_unlink(alarm);
+    alarm->state = TIMER_ALARM_FREE;
+    wheel->count--;
+}
+
+/**
+ * 推进时间轮并取出一个到期的闹钟
+ */
+timer_alarm_t *timer_wheel_expire(timer_wheel_t *wheel, uint32_t now) {
+    while ((int32_t)(now - wheel->base) >= 0) {
+        timer_alarm_t *alarm = wheel->root[wheel->base & (TIMER_WHEEL_ROOT_SIZE - 1)];
+
+        if (alarm) {
+            wheel_unlink(alarm);
+            alarm->state = TIMER_ALARM_FREE;
+            wheel->count--;
+            return alarm;
+        }
+
+        /* 当前槽位已空，前进一个滴答；第一级转完一圈时逐级下放 */
+        wheel->base++;
+        if (!(wheel->base & (TIMER_WHEEL_ROOT_SIZE - 1))) {
+            uint32_t level = 0;
+
+            while (level < TIMER_WHEEL_LEVELS && wheel_cascade(wheel, level) == 0) {
+                level++;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * 毫秒换算为时钟滴答（向上取整，至少1个滴答）
+ */
+uint32_t timer_ms_to_ticks(uint32_t milliseconds) {
+    uint32_t ticks = milliseconds / 1000 * timer_frequency +
+                     (milliseconds % 1000 * timer_frequency + 999) / 1000;
+
+    return ticks ? ticks : 1;
+}
+
+/**
+ * 释放闹钟到池中，世代号递增使旧句柄失效
+ */
+static void alarm_free(timer_alarm_t *alarm) {
+    uint32_t index = alarm - alarms;
+
+    alarm_generation[index]++;
+    alarm->id = 0;
+    alarm->state = TIMER_ALARM_FREE;
+    alarm->callback = NULL;
+    alarm->handler = NULL;
+    alarm->next = free_alarms;
+    free_alarms = alarm;
+    active_alarms--;
+}
+
+/**
+ * 从池中分配闹钟并放入时间轮（delay和interval以滴答为单位）
+ */
+static uint32_t alarm_create(uint32_t delay, uint32_t interval, void (*callback)(void),
+                             void (*handler)(void *), void *data) {
+    timer_alarm_t *alarm;
+    uint32_t generation;
+    uint32_t flags;
+    uint32_t index;
+
+    flags = timer_irq_save();
+    alarm = free_alarms;
+    if (!alarm) {
+        timer_irq_restore(flags);
+        return 0;
+    }
+    free_alarms = alarm->next;
+
+    index = alarm - alarms;
+    generation = alarm_generation[index] & ((1U << (32 - TIMER_ALARM_INDEX_BITS)) - 1);
+    if (generation == 0) {
+        /* 句柄不能为0 */
+        generation = alarm_generation[index] = 1;
+    }
+
+    alarm->id = (generation << TIMER_ALARM_INDEX_BITS) | index;
+    alarm->expires = timer_ticks + delay;
+    alarm->interval = interval;
+    alarm->callback = callback;
+    alarm->handler = handler;
+    alarm->data = data;
+    timer_wheel_add(&timer_wheel, alarm);
+    active_alarms++;
+    timer_irq_restore(flags);
+
+    return alarm->id;
+}
+
+/**
+ * 设置PIT通道0的模式和计数
+ */
+static void pit_program(uint8_t mode, uint32_t count) {
+    outb(PIT_COMMAND, PIT_SELECT_0 | PIT_BOTH | mode | PIT_BINARY);
+    outb(PIT_CHANNEL_0, count & 0xFF);
+    outb(PIT_CHANNEL_0, (count >> 8) & 0xFF);
+}
+
+/**
+ * 锁存并读取PIT通道0的当前计数
+ */
+static uint32_t pit_read_count(void) {
+    uint32_t low, high;
+
+    outb(PIT_COMMAND, PIT_SELECT_0 | PIT_LATCH);
+    low = inb(PIT_CHANNEL_0);
+    high = inb(PIT_CHANNEL_0);
+
+    return low | (high << 8);
+}
+
+/**
+ * 以指定频率启动周期时钟
+ */
+static void timer_program_rate(uint32_t frequency) {
+    timer_frequency = frequency;
+    timer_divisor = TIMER_FREQUENCY / frequency;
+    timer_tick_ns = 1000000000U / frequency;
+    pit_program(PIT_MODE_3, timer_divisor);
+}
+
+/**
+ * 推进时钟并处理到期的闹钟（已关中断）
+ */
+static void timer_advance(uint32_t elapsed) {
+    timer_alarm_t *alarm;
+
+    timer_ticks += elapsed;
+    timer_nanoseconds += (uint64_t)elapsed * timer_tick_ns;
+
+    while ((alarm = timer_wheel_expire(&timer_wheel, timer_ticks)) != NULL) {
+        /* 周期性闹钟先重新入轮，回调中可以取消自己 */
+        if (alarm->interval) {
+            alarm->expires += alarm->interval;
+            timer_wheel_add(&timer_wheel, alarm);
+        } else {
+            alarm->state = TIMER_ALARM_FIRING;
+        }
+
+        if (alarm->handler) {
+            alarm->handler(alarm->data);
+        } else if (alarm->callback) {
+            alarm->callback();
+        }
+
+        if (alarm->state == TIMER_ALARM_FIRING) {
+            alarm_free(alarm);
+        }
+    }
+}
+
+/**
+ * 睡到deadline滴答、下一个闹钟到期或其他中断到来（调用者已关中断，返回时已开中断）
+ */
+static void timer_sleep_until(uint32_t deadline) {
+    uint32_t ticks = TIMER_ONESHOT_MAX_COUNT / timer_divisor;
+    uint32_t next;
+
+    if ((int32_t)(deadline - timer_ticks) <= 0) {
+        ticks = 0;
+    } else if (deadline - timer_ticks < ticks) {
+        ticks = deadline - timer_ticks;
+    }
+
+    /* 时间轮的base是下一个要处理的滴答，即timer_ticks + 1 */
+    next = timer_wheel_next_expiry(&timer_wheel, ticks) + 1;
+    if (next < ticks) {
+        ticks = next;
+    }
+
+    if (!timer_dynamic || ticks <= 1) {
+        __asm__ volatile ("sti; hlt" : : : "memory");
+        return;
+    }
+
+    timer_oneshot_ticks = ticks;
+    timer_stats.oneshots++;
+    pit_program(PIT_MODE_0, ticks * timer_divisor);
+    __asm__ volatile ("sti; hlt; cli" : : : "memory");
+
+    /* 被其他中断提前唤醒：按已计数的部分补上滴答并恢复周期时钟 */
+    if (timer_oneshot_ticks) {
+        uint32_t total = ticks * timer_divisor;
+        uint32_t remaining = pit_read_count();
+        uint32_t elapsed = remaining > total ? ticks : (total - remaining) / timer_divisor;
+
+        timer_oneshot_ticks = 0;
+        pit_program(PIT_MODE_3, timer_divisor);
+        timer_stats.skipped_ticks += elapsed;
+        timer_advance(elapsed);
+    }
+
+    __asm__ volatile ("sti" : : : "memory");
+}
+
+/**
+ * 64位除以32位（没有libgcc，用divl分两步）
+ */
+static uint64_t clock_div64(uint64_t dividend, uint32_t divisor) {
+    uint32_t high = (uint32_t)(dividend >> 32);
+    uint32_t low = (uint32_t)dividend;
+    uint32_t quot_high = high / divisor;
+    uint32_t rem = high % divisor;
+    uint32_t quot_low;
+
+    __asm__ ("divl %4" : "=a"(quot_low), "=d"(rem) : "a"(low), "d"(rem), "rm"(divisor));
+    return ((uint64_t)quot_high << 32) | quot_low;
+}
+
+/**
+ * 用PIT通道2的单次计数测量count个PIT周期内的TSC增量，PIT无响应返回0
+ */
+static uint64_t clock_pit_measure(uint32_t count) {
+    uint8_t gate = inb(PIT_GATE);
+    uint32_t spins = 0;
+    uint64_t start, end;
+
+    /* 关扬声器和门控，装入计数后打开门控开始计数，计到0时输出变高 */
+    outb(PIT_GATE, gate & ~0x03);
+    outb(PIT_COMMAND, PIT_SELECT_2 | PIT_BOTH | PIT_MODE_0 | PIT_BINARY);
+    outb(PIT_CHANNEL_2, count & 0xFF);
+    outb(PIT_CHANNEL_2, (count >> 8) & 0xFF);
+    outb(PIT_GATE, (gate & ~0x02) | 0x01);
+
+    start = timer_rdtsc();
+    while (!(inb(PIT_GATE) & 0x20)) {
+        if (++spins > CLOCK_CALIBRATE_SPINS) {
+            outb(PIT_GATE, gate);
+            return 0;
+        }
+    }
+    end = timer_rdtsc();
+
+    outb(PIT_GATE, gate);
+    return end - start;
+}
+
+/**
+ * 是否有不变TSC（频率恒定，不随降频和C状态停止）
+ */
+static bool clock_tsc_invariant(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    timer_cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000007) {
+        return false;
+    }
+
+    timer_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_APM_EDX_INVARIANT_TSC) != 0;
+}
+
+/**
+ * 切换到TSC时钟源，从当前的滴答时间戳继续
+ */
+static void clock_use_tsc(uint32_t khz) {
+    uint32_t shift = 32;
+    uint64_t mult;
+    uint32_t flags;
+
+    /* ns = cycles * 10^6 / khz，shift尽量大以保留精度，mult放得下32位即可 */
+    while ((mult = clock_div64(1000000ULL << shift, khz)) >> 32) {
+        shift--;
+    }
+
+    flags = timer_irq_save();
+    clock_mult = (uint32_t)mult;
+    clock_shift = shift;
+    clock_base_ns = timer_nanoseconds;
+    clock_base_tsc = timer_rdtsc();
+    clock_source = CLOCK_SOURCE_TSC;
+    timer_irq_restore(flags);
+}
+
 /**
  * 读取CMOS RTC时间
  */
@@ -118,24 +596,24 @@ void timer_set_rtc(time_t *time) {
  * 初始化定时器系统
  */
 void timer_init(uint32_t frequency) {
-    uint32_t divisor;
     uint8_t status_b;
 
     KLOG_INFO("Initializing timer system...");
 
-    /* 初始化闹钟数组 */
+    /* 初始化闹钟池和时间轮 */
     memset(alarms, 0, sizeof(alarms));
+    free_alarms = NULL;
+    for (uint32_t i = TIMER_MAX_ALARMS; i > 0; i--) {
+        alarms[i - 1].next = free_alarms;
+        free_alarms = &alarms[i - 1];
+    }
+    active_alarms = 0;
+    timer_wheel_init(&timer_wheel, timer_ticks + 1);
 
-    /* 设置定时器频率 */
-    timer_frequency = frequency;
-    divisor = TIMER_FREQUENCY / frequency;
-
-    /* 初始化PIT */
-    outb(PIT_COMMAND, PIT_CHANNEL_0 | PIT_LOW | PIT_HIGH | PIT_MODE_3 | PIT_BINARY);
-
-    /* 设置除数 */
-    outb(PIT_CHANNEL_0, divisor & 0xFF);
-    outb(PIT_CHANNEL_0, (divisor >> 8) & 0xFF);
+    /* 设置定时器频率并初始化PIT */
+    memset(&timer_stats, 0, sizeof(timer_stats));
+    timer_oneshot_ticks = 0;
+    timer_program_rate(frequency);
 
     /* 读取RTC时间作为基准 */
     time_t rtc_time;
@@ -161,15 +639,12 @@ void timer_init(uint32_t frequency) {
  * 设置PIT频率
  */
 void timer_set_frequency(uint32_t frequency) {
-    uint32_t divisor;
-
-    timer_frequency = frequency;
-    divisor = TIMER_FREQUENCY / frequency;
+    uint32_t flags = timer_irq_save();
 
     /* 设置新的除数 */
-    outb(PIT_COMMAND, PIT_CHANNEL_0 | PIT_LOW | PIT_HIGH | PIT_MODE_3 | PIT_BINARY);
-    outb(PIT_CHANNEL_0, divisor & 0xFF);
-    outb(PIT_CHANNEL_0, (divisor >> 8) & 0xFF);
+    timer_oneshot_ticks = 0;
+    timer_program_rate(frequency);
+    timer_irq_restore(flags);
 
     KLOG_INFO("Timer frequency set to: ");
     console_write_dec(frequency);
@@ -191,8 +666,8 @@ void timer_wait(uint32_t milliseconds) {
     uint32_t ticks_to_wait = milliseconds * timer_frequency / 1000;
 
     while ((timer_ticks - start_ticks) < ticks_to_wait) {
-        /* 忙等待 */
-        asm volatile("hlt");
+        __asm__ volatile ("cli");
+        timer_sleep_until(start_ticks + ticks_to_wait);
     }
 }
 
@@ -207,33 +682,21 @@ uint32_t timer_get_uptime(void) {
  * 定时器中断处理函数
  */
 void timer_handler(void) {
-    uint32_t i;
-
-    /* 增加时钟滴答计数 */
-    timer_ticks++;
-    timer_nanoseconds += (1000000000ULL / timer_frequency);
-
-    /* 处理闹钟 */
-    for (i = 0; i < MAX_ALARMS; i++) {
-        if (alarms[i].active && alarms[i].callback) {
-            alarms[i].remaining_ms--;
-
-            if (alarms[i].remaining_ms == 0) {
-                /* 触发闹钟 */
-                alarms[i].callback();
-
-                /* 如果是周期性闹钟，重置计数器 */
-                if (alarms[i].interval_ms > 0) {
-                    alarms[i].remaining_ms = alarms[i].interval_ms;
-                } else {
-                    /* 单次闹钟，标记为非活跃 */
-                    alarms[i].active = 0;
-                    active_alarms--;
-                }
-            }
-        }
+    uint32_t elapsed = 1;
+
+    timer_stats.interrupts++;
+
+    /* 单次截止时间到期：补上睡眠期间的滴答并恢复周期时钟 */
+    if (timer_oneshot_ticks) {
+        elapsed = timer_oneshot_ticks;
+        timer_oneshot_ticks = 0;
+        pit_program(PIT_MODE_3, timer_divisor);
+        timer_stats.skipped_ticks += elapsed - 1;
     }
 
+    /* 增加时钟滴答计数并处理到期的闹钟（中断上下文，已关中断） */
+    timer_advance(elapsed);
+
     /* 调用用户注册的中断处理函数 */
     if (timer_callback) {
         timer_callback();
@@ -244,12 +707,7 @@ void timer_handler(void) {
  * 睡眠指定微秒数
  */
 void timer_usleep(uint32_t microseconds) {
-    uint64_t start_ns = timer_nanoseconds;
-    uint64_t nanoseconds_to_wait = (uint64_t)microseconds * 1000;
-
-    while ((timer_nanoseconds - start_ns) < nanoseconds_to_wait) {
-        asm volatile("hlt");
-    }
+    timer_nsleep((uint64_t)microseconds * 1000);
 }
 
 /**
@@ -274,50 +732,51 @@ uint32_t timer_get_frequency(void) {
 }
 
 /**
- * 校准定时器（测量CPU频率）
+ * 校准定时器（测量TSC频率并选择时钟源）
  */
 void timer_calibrate(void) {
-    uint32_t start_ticks, end_ticks;
-    uint64_t start_tsc, end_tsc;
+    uint32_t count = TIMER_FREQUENCY / 1000 * CLOCK_CALIBRATE_MS;
+    uint32_t eax, ebx, ecx, edx;
+    uint64_t best = 0;
 
-    KLOG_INFO("Calibrating timer...");
+    KLOG_INFO("Calibrating TSC against PIT channel 2...");
 
-    /* 使用时间戳计数器（TSC）校准 */
-    start_ticks = timer_get_ticks();
-
-    /* 读取TSC */
-    asm volatile("rdtsc" : "=A" (start_tsc));
-
-    /* 等待一段时间 */
-    timer_wait(100); /* 等待100毫秒 */
-
-    end_ticks = timer_get_ticks();
-    asm volatile("rdtsc" : "=A" (end_tsc));
-
-    /* 计算CPU频率 */
-    uint64_t tsc_diff = end_tsc - start_tsc;
-    uint32_t ticks_diff = end_ticks - start_ticks;
-    uint32_t time_ms = ticks_diff * 1000 / timer_frequency;
+    timer_cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEAT_EDX_TSC)) {
+        KLOG_WARN("No TSC, using tick clocksource");
+        cpu_frequency_mhz = 1000; /* 默认值 */
+        return;
+    }
 
-    if (time_ms > 0) {
-        /* 避免64位除法，使用移位运算 */
-        /* 计算频率：(TSC差值 * 1000) / (时间毫秒数 * 1000) */
-        /* 简化为：TSC差值 / 时间毫秒数 */
-        uint32_t time_ms_32 = time_ms;
-        uint32_t tsc_diff_32 = (uint32_t)tsc_diff;
+    /* 被中断或SMI打断的测量只会偏大，取各轮最小值 */
+    for (uint32_t i = 0; i < CLOCK_CALIBRATE_ROUNDS; i++) {
+        uint64_t cycles = clock_pit_measure(count);
 
-        if (time_ms_32 > 0 && tsc_diff_32 > 0) {
-            cpu_frequency_mhz = tsc_diff_32 / time_ms_32;
-        } else {
-            cpu_frequency_mhz = 1000; /* 默认值 */
+        if (cycles && (best == 0 || cycles < best)) {
+            best = cycles;
         }
-    } else {
+    }
+
+    if (best == 0 || (best >> 32)) {
+        KLOG_WARN("TSC calibration failed, using tick clocksource");
         cpu_frequency_mhz = 1000; /* 默认值 */
+        return;
     }
 
+    /* kHz = cycles / (count / TIMER_FREQUENCY秒) / 1000 */
+    clock_tsc_khz = (uint32_t)clock_div64(best * TIMER_FREQUENCY, count * 1000);
+    cpu_frequency_mhz = clock_tsc_khz / 1000;
+
     KLOG_INFO("CPU frequency calibrated: ");
     console_write_dec(cpu_frequency_mhz);
     console_write(" MHz\n");
+
+    if (clock_tsc_khz && clock_tsc_invariant()) {
+        clock_use_tsc(clock_tsc_khz);
+        KLOG_INFO("Clocksource: invariant TSC");
+    } else {
+        KLOG_INFO("Clocksource: tick (TSC not invariant)");
+    }
 }
 
 /**
@@ -340,77 +799,161 @@ void timer_register_handler(void (*handler)(void)) {
  * 创建定时器闹钟
  */
 uint32_t timer_create_alarm(uint32_t interval_ms, void (*callback)(void)) {
-    uint32_t i;
+    uint32_t id;
 
     if (!callback || interval_ms == 0) {
         return 0;
     }
 
-    /* 寻找空闲槽位 */
-    for (i = 0; i < MAX_ALARMS; i++) {
-        if (!alarms[i].active) {
-            alarms[i].id = next_alarm_id++;
-            alarms[i].interval_ms = interval_ms;
-            alarms[i].remaining_ms = interval_ms;
-            alarms[i].active = 1;
-            alarms[i].callback = callback;
-            active_alarms++;
+    id = alarm_create(timer_ms_to_ticks(interval_ms), timer_ms_to_ticks(interval_ms),
+                      callback, NULL, NULL);
+    if (!id) {
+        KLOG_WARN("Maximum alarms reached, cannot create more alarms");
+    }
 
-            KLOG_INFO("Alarm created: ID=");
-            console_write_dec(alarms[i].id);
-            console_write(", Interval=");
-            console_write_dec(interval_ms);
-            console_write("ms\n");
+    return id;
+}
 
-            return alarms[i].id;
-        }
+/**
+ * 创建带参数的定时器闹钟
+ */
+uint32_t timer_add(uint32_t delay_ms, uint32_t interval_ms, void (*handler)(void *), void *data) {
+    if (!handler) {
+        return 0;
     }
 
-    KLOG_WARN("Maximum alarms reached, cannot create more alarms");
-    return 0;
+    return alarm_create(timer_ms_to_ticks(delay_ms), interval_ms ? timer_ms_to_ticks(interval_ms) : 0,
+                        NULL, handler, data);
 }
 
 /**
- * 销毁定时器闹钟
+ * 在指定滴答创建单次闹钟
  */
-int32_t timer_destroy_alarm(uint32_t alarm_id) {
-    uint32_t i;
+uint32_t timer_add_at(uint32_t deadline, void (*handler)(void *), void *data) {
+    uint32_t flags;
+    uint32_t id;
 
-    for (i = 0; i < MAX_ALARMS; i++) {
-        if (alarms[i].active && alarms[i].id == alarm_id) {
-            alarms[i].active = 0;
-            alarms[i].callback = NULL;
-            active_alarms--;
+    if (!handler) {
+        return 0;
+    }
 
-            KLOG_INFO("Alarm destroyed: ID=");
-            console_write_dec(alarm_id);
-            console_write("\n");
+    /* 关中断后再读滴答计数，expires恰好等于deadline（已过去时下一个滴答到期） */
+    flags = timer_irq_save();
+    id = alarm_create(deadline - timer_ticks, 0, NULL, handler, data);
+    timer_irq_restore(flags);
 
-            return 0;
+    return id;
+}
+
+/**
+ * 销毁定时器闹钟
+ */
+int32_t timer_destroy_alarm(uint32_t alarm_id) {
+    timer_alarm_t *alarm = &alarms[alarm_id & TIMER_ALARM_INDEX_MASK];
+    int32_t result = -1;
+    uint32_t flags;
+
+    flags = timer_irq_save();
+    if (alarm_id != 0 && alarm->id == alarm_id) {
+        if (alarm->state == TIMER_ALARM_PENDING) {
+            timer_wheel_del(&timer_wheel, alarm);
+            alarm_free(alarm);
         }
+        /* 正在执行回调的单次闹钟回调返回后自动释放 */
+        result = 0;
     }
+    timer_irq_restore(flags);
 
-    KLOG_WARN("Alarm not found: ID=");
-    console_write_dec(alarm_id);
-    console_write("\n");
-
-    return -1;
+    return result;
 }
 
 /**
  * 获取纳秒级时间戳
  */
 uint64_t timer_get_nanoseconds(void) {
-    return timer_nanoseconds;
+    return clock_now_ns();
+}
+
+/**
+ * 读取单调纳秒时间戳
+ */
+uint64_t clock_now_ns(void) {
+    uint64_t ns;
+
+    if (clock_source == CLOCK_SOURCE_TSC) {
+        return clock_base_ns + clock_mul_shift(timer_rdtsc() - clock_base_tsc, clock_mult, clock_shift);
+    }
+
+    /* 32位下64位读取不是原子的，两次读数一致才返回 */
+    do {
+        ns = timer_nanoseconds;
+    } while (ns != timer_nanoseconds);
+
+    return ns;
+}
+
+/**
+ * 当前时钟源
+ */
+uint32_t clock_get_source(void) {
+    return clock_source;
+}
+
+/**
+ * 校准得到的TSC频率（kHz）
+ */
+uint32_t clock_get_tsc_khz(void) {
+    return clock_tsc_khz;
 }
 
 /**
  * 纳秒级睡眠
  */
 void timer_nsleep(uint64_t nanoseconds) {
-    uint64_t start_ns = timer_nanoseconds;
+    uint64_t start_ns = clock_now_ns();
+    uint64_t elapsed;
+
+    while ((elapsed = clock_now_ns() - start_ns) < nanoseconds) {
+        uint64_t remaining = nanoseconds - elapsed;
+        uint32_t ticks;
+
+        /* 剩余时间换算为滴答（向上取整，避免64位除法） */
+        if (remaining >> 32) {
+            ticks = 0xFFFFFFFF / timer_tick_ns;
+        } else {
+            ticks = (uint32_t)remaining / timer_tick_ns;
+            if ((uint32_t)remaining % timer_tick_ns) {
+                ticks++;
+            }
+        }
 
-    while ((timer_nanoseconds - start_ns) < nanoseconds) {
-        asm volatile("hlt");
+        __asm__ volatile ("cli");
+        timer_sleep_until(timer_ticks + ticks);
     }
+}
+
+/**
+ * 启用或关闭动态时钟
+ */
+void timer_set_dynamic(uint8_t enable) {
+    timer_dynamic = enable ? 1 : 0;
+}
+
+/**
+ * 空闲等待
+ */
+void timer_idle(void) {
+    timer_sleep_until(timer_ticks + 0x7FFFFFFF);
+}
+
+/**
+ * 获取定时器统计
+ */
+void timer_get_stats(timer_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+
+    *stats = timer_stats;
+    stats->dynamic = timer_dynamic;
 }
\ No newline at end of file
@@ -0,0 +1,531 @@
+/**
+ * M4KK1 Address Space Implementation (i386)
+ * i386用户地址空间：两级页表、按需分配和写时复制
+ *
+ * 内核用4MB页恒等映射物理内存低1GB（页分配器只管理这一段），以及
+ * 3GB以上的设备地址（不缓存）；两者在所有页目录中共享，仅内核可访问。
+ * 1GB到3GB是用户空间，每个地址空间有自己的页表。
+ *
+ * 预留而未分配的页用不存在的页表项记录（VM_PTE_RESERVED加上页面标志），
+ * 首次访问时分配清零页。fork把可写页改为只读并标记VM_PTE_COW，写入时
+ * 页帧只剩一个映射就恢复可写，否则复制。用户页帧的描述符带有
+ * BUDDY_PAGE_USER标志，private_data为映射计数。
+ *
+ * i386内核只有一个处理器，页表由一把关中断的锁保护，只需失效本地TLB。
+ */
+
+#include "../../include/vm.h"
+#include "../../include/memory.h"
+#include "../../include/buddy.h"
+#include "../../include/process.h"
+#include "../../include/arch.h"
+#include "../../include/string.h"
+#include "../../include/stdint.h"
+
+#define VM_ENTRIES              1024
+#define VM_PDE_SHIFT            22
+#define VM_PDE_INDEX(va)        ((va) >> VM_PDE_SHIFT)
+#define VM_PTE_INDEX(va)        (((va) >> 12) & (VM_ENTRIES - 1))
+
+#define VM_DIRECT_PDES          256                 /* 恒等映射低1GB */
+#define VM_DEVICE_PDE           768                 /* 3GB以上为设备地址 */
+
+#define VM_PAGE_PWT             0x008
+#define VM_PAGE_PCD             0x010
+#define VM_PAGE_LARGE           0x080               /* 页目录项的PS位，4MB页 */
+#define VM_PTE_RESERVED         0x200               /* 软件位：已预留，首次访问时分配 */
+#define VM_PTE_COW              0x400               /* 软件位：写时复制 */
+#define VM_PTE_FLAGS            (PAGE_READWRITE | PAGE_USER)
+
+#define VM_CR0_WP               (1u << 16)          /* 内核写只读用户页也触发缺页 */
+#define VM_CR0_PG               (1u << 31)
+#define VM_CR4_PSE              (1u << 4)
+
+/* 内核页目录，没有用户地址空间时使用，也是新页目录内核部分的模板 */
+static uint32_t vm_kernel_pd[VM_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+
+static volatile uint32_t vm_lock = 0;
+
+static inline uintptr_t vm_lock_acquire(void) {
+    uintptr_t flags = arch_irq_save();
+
+    while (__sync_lock_test_and_set(&vm_lock, 1)) {
+        while (vm_lock) {
+            __asm__ volatile ("pause");
+        }
+    }
+    return flags;
+}
+
+static inline void vm_lock_release(uintptr_t flags) {
+    __sync_lock_release(&vm_lock);
+    arch_irq_restore(flags);
+}
+
+static inline uint32_t vm_read_cr3(void) {
+    uint32_t cr3;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+    return cr3;
+}
+
+static inline void vm_write_cr3(uint32_t cr3) {
+    __asm__ volatile ("mov %0, %%cr3" : : "r"(cr3) : "memory");
+}
+
+/**
+ * 失效一页的TLB条目（只有当前地址空间的条目可能在TLB中）
+ */
+static inline void vm_flush_page(uint32_t space, uint32_t va) {
+    if (space == vm_read_cr3()) {
+        __asm__ volatile ("invlpg (%0)" : : "r"(va) : "memory");
+    }
+}
+
+static inline bool vm_user_range(uint32_t start, uint32_t end) {
+    return start >= PROCESS_USER_BASE && end <= PROCESS_USER_STACK_TOP && start < end;
+}
+
+/**
+ * 分配一个清零的用户页帧，映射计数为1
+ */
+static uint32_t vm_frame_alloc(void) {
+    void *page = memory_alloc_page(1);
+    buddy_page_t *desc;
+
+    if (!page) {
+        return 0;
+    }
+    memset(page, 0, PAGE_SIZE);
+
+    desc = memory_page_desc(page);
+    desc->flags |= BUDDY_PAGE_USER;
+    desc->private_data = 1;
+    return (uint32_t)page;
+}
+
+static inline void vm_frame_get(uint32_t frame) {
+    memory_page_desc((void *)frame)->private_data++;
+}
+
+static inline uint32_t vm_frame_count(uint32_t frame) {
+    return memory_page_desc((void *)frame)->private_data;
+}
+
+/**
+ * 去掉页帧的一个映射，最后一个映射撤销时释放
+ */
+static void vm_frame_put(uint32_t frame) {
+    buddy_page_t *desc = memory_page_desc((void *)frame);
+
+    if (--desc->private_data == 0) {
+        desc->flags &= ~BUDDY_PAGE_USER;
+        memory_free_page((void *)frame, 1);
+    }
+}
+
+/**
+ * 查找页表项，create为true时按需分配页表
+ * @return 页表项地址，页表不存在且不分配或内存不足返回NULL
+ */
+static uint32_t *vm_pte(uint32_t space, uint32_t va, bool create) {
+    uint32_t *pde = &((uint32_t *)space)[VM_PDE_INDEX(va)];
+
+    if (!(*pde & PAGE_PRESENT)) {
+        void *table;
+
+        if (!create || !(table = memory_alloc_page(1))) {
+            return NULL;
+        }
+        memset(table, 0, PAGE_SIZE);
+        *pde = (uint32_t)table | PAGE_PRESENT | PAGE_READWRITE | PAGE_USER;
+    }
+
+    return (uint32_t *)(*pde & PAGE_MASK) + VM_PTE_INDEX(va);
+}
+
+/**
+ * 处理缺页（持有vm_lock）
+ */
+static int32_t vm_fault_locked(uint32_t space, uint32_t va, uint32_t error_code) {
+    uint32_t *pte = vm_pte(space, va, false);
+    uint32_t entry, frame, copy;
+
+    if (!pte) {
+        return -1;
+    }
+    entry = *pte;
+
+    /* 预留区域的第一次访问：分配清零页 */
+    if (!(entry & PAGE_PRESENT)) {
+        if (!(entry & VM_PTE_RESERVED) ||
+            ((error_code & VM_FAULT_WRITE) && !(entry & PAGE_READWRITE))) {
+            return -1;
+        }
+        frame = vm_frame_alloc();
+        if (!frame) {
+            return -1;
+        }
+        *pte = frame | PAGE_PRESENT | (entry & VM_PTE_FLAGS);
+        return 0;
+    }
+
+    if ((error_code & VM_FAULT_USER) && !(entry & PAGE_USER)) {
+        return -1;
+    }
+    if (!(error_code & VM_FAULT_WRITE) || (entry & PAGE_READWRITE)) {
+        /* 已经映射（另一条路径先处理了，或调用者只是要求分配） */
+        vm_flush_page(space, va);
+        return 0;
+    }
+    if (!(entry & VM_PTE_COW)) {
+        return -1;
+    }
+
+    /* 写时复制：只剩这一个映射时直接恢复可写 */
+    frame = entry & PAGE_MASK;
+    if (vm_frame_count(frame) == 1) {
+        *pte = (entry & ~VM_PTE_COW) | PAGE_READWRITE;
+    } else {
+        copy = vm_frame_alloc();
+        if (!copy) {
+            return -1;
+        }
+        memcpy((void *)copy, (const void *)frame, PAGE_SIZE);
+        *pte = copy | PAGE_PRESENT | PAGE_READWRITE | (entry & PAGE_USER);
+        vm_frame_put(frame);
+    }
+    vm_flush_page(space, va);
+    return 0;
+}
+
+/**
+ * 启用分页
+ */
+void vm_init(void) {
+    uint32_t cr0, cr4, i;
+
+    for (i = 0; i < VM_ENTRIES; i++) {
+        if (i < VM_DIRECT_PDES) {
+            vm_kernel_pd[i] = (i << VM_PDE_SHIFT) | PAGE_PRESENT | PAGE_READWRITE | VM_PAGE_LARGE;
+        } else if (i >= VM_DEVICE_PDE) {
+            vm_kernel_pd[i] = (i << VM_PDE_SHIFT) | PAGE_PRESENT | PAGE_READWRITE | VM_PAGE_LARGE |
+                              VM_PAGE_PCD | VM_PAGE_PWT;
+        } else {
+            vm_kernel_pd[i] = 0;
+        }
+    }
+
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4 | VM_CR4_PSE));
+    vm_write_cr3((uint32_t)vm_kernel_pd);
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(cr0 | VM_CR0_PG | VM_CR0_WP) : "memory");
+}
+
+/**
+ * 创建空的用户地址空间
+ */
+uintptr_t vm_space_create(void) {
+    uint32_t *pd = (uint32_t *)memory_alloc_page(1);
+
+    if (!pd) {
+        return 0;
+    }
+
+    /* 内核部分的页目录项不再改变，复制一次即可 */
+    memcpy(pd, vm_kernel_pd, PAGE_SIZE);
+    return (uintptr_t)pd;
+}
+
+/**
+ * 复制用户地址空间（写时复制）
+ */
+uintptr_t vm_space_fork(uintptr_t space) {
+    uint32_t *parent = (uint32_t *)space;
+    uint32_t *child;
+    uintptr_t flags;
+    uint32_t i, j;
+
+    if (!space) {
+        return 0;
+    }
+    child = (uint32_t *)vm_space_create();
+    if (!child) {
+        return 0;
+    }
+
+    flags = vm_lock_acquire();
+    for (i = VM_PDE_INDEX(PROCESS_USER_BASE); i < VM_PDE_INDEX(PROCESS_USER_STACK_TOP); i++) {
+        uint32_t *src, *dst;
+
+        if (!(parent[i] & PAGE_PRESENT)) {
+            continue;
+        }
+        dst = (uint32_t *)memory_alloc_page(1);
+        if (!dst) {
+            vm_lock_release(flags);
+            vm_space_destroy((uintptr_t)child);
+            return 0;
+        }
+        src = (uint32_t *)(parent[i] & PAGE_MASK);
+
+        for (j = 0; j < VM_ENTRIES; j++) {
+            uint32_t entry = src[j];
+
+            if (entry & PAGE_PRESENT) {
+                /* 可写页改为双方只读，先写入的一方复制 */
+                if (entry & PAGE_READWRITE) {
+                    entry = (entry & ~PAGE_READWRITE) | VM_PTE_COW;
+                    src[j] = entry;
+                }
+                vm_frame_get(entry & PAGE_MASK);
+            }
+            dst[j] = entry;
+        }
+        child[i] = (uint32_t)dst | (parent[i] & ~PAGE_MASK);
+    }
+
+    /* 父进程的可写页刚变为只读，它的TLB条目必须失效 */
+    if (space == vm_read_cr3()) {
+        vm_write_cr3(space);
+    }
+    vm_lock_release(flags);
+
+    return (uintptr_t)child;
+}
+
+/**
+ * 销毁用户地址空间
+ */
+void vm_space_destroy(uintptr_t space) {
+    uint32_t *pd = (uint32_t *)space;
+    uintptr_t flags;
+    uint32_t i, j;
+
+    if (!space) {
+        return;
+    }
+
+    flags = vm_lock_acquire();
+    if (space == vm_read_cr3()) {
+        vm_write_cr3((uint32_t)vm_kernel_pd);
+    }
+
+    for (i = VM_PDE_INDEX(PROCESS_USER_BASE); i < VM_PDE_INDEX(PROCESS_USER_STACK_TOP); i++) {
+        uint32_t *table;
+
+        if (!(pd[i] & PAGE_PRESENT)) {
+            continue;
+        }
+        table = (uint32_t *)(pd[i] & PAGE_MASK);
+        for (j = 0; j < VM_ENTRIES; j++) {
+            if (table[j] & PAGE_PRESENT) {
+                vm_frame_put(table[j] & PAGE_MASK);
+            }
+        }
+        memory_free_page(table, 1);
+    }
+    vm_lock_release(flags);
+
+    memory_free_page(pd, 1);
+}
+
+/**
+ * 切换地址空间
+ */
+void vm_space_switch(uintptr_t space) {
+    uint32_t cr3 = space ? (uint32_t)space : (uint32_t)vm_kernel_pd;
+
+    if (cr3 != vm_read_cr3()) {
+        vm_write_cr3(cr3);
+    }
+}
+
+/**
+ * 预留匿名内存区域
+ */
+int32_t vm_reserve(uintptr_t space, uintptr_t start, uintptr_t size, uint32_t flags) {
+    uint32_t end = (start + size + PAGE_SIZE - 1) & PAGE_MASK;
+    uint32_t entry = VM_PTE_RESERVED | (flags & VM_PTE_FLAGS) | PAGE_USER;
+    uintptr_t irq;
+    uint32_t va;
+
+    start &= PAGE_MASK;
+    if (!space || !vm_user_range(start, end)) {
+        return -1;
+    }
+
+    /* 先分配页表并确认范围空闲，再写页表项，失败时区域不变 */
+    irq = vm_lock_acquire();
+    for (va = start; va < end; va += PAGE_SIZE) {
+        uint32_t *pte = vm_pte(space, va, true);
+
+        if (!pte || *pte) {
+            vm_lock_release(irq);
+            return -1;
+        }
+    }
+    for (va = start; va < end; va += PAGE_SIZE) {
+        *vm_pte(space, va, false) = entry;
+    }
+    vm_lock_release(irq);
+
+    return 0;
+}
+
+/**
+ * 释放匿名内存区域
+ */
+void vm_release(uintptr_t space, uintptr_t start, uintptr_t size) {
+    uint32_t end = (start + size + PAGE_SIZE - 1) & PAGE_MASK;
+    uintptr_t flags;
+    uint32_t va;
+
+    start &= PAGE_MASK;
+    if (!space || !vm_user_range(start, end)) {
+        return;
+    }
+
+    flags = vm_lock_acquire();
+    for (va = start; va < end; va += PAGE_SIZE) {
+        uint32_t *pte = vm_pte(space, va, false);
+
+        if (!pte) {
+            /* 整个页表不存在，跳到下一个4MB */
+            va = (va | ((1u << VM_PDE_SHIFT) - 1)) - PAGE_SIZE + 1;
+            continue;
+        }
+        if (*pte & PAGE_PRESENT) {
+            vm_frame_put(*pte & PAGE_MASK);
+            vm_flush_page(space, va);
+        }
+        *pte = 0;
+    }
+    vm_lock_release(flags);
+}
+
+/**
+ * 虚拟地址对应的物理地址
+ */
+uintptr_t vm_translate(uintptr_t space, uintptr_t virtual_addr) {
+    uint32_t *pte;
+    uintptr_t flags;
+    uint32_t phys = 0;
+
+    if (!space || !vm_user_range(virtual_addr, virtual_addr + 1)) {
+        return 0;
+    }
+
+    flags = vm_lock_acquire();
+    pte = vm_pte(space, virtual_addr, false);
+    if (pte && (*pte & PAGE_PRESENT)) {
+        phys = (*pte & PAGE_MASK) | (virtual_addr & (PAGE_SIZE - 1));
+    }
+    vm_lock_release(flags);
+
+    return phys;
+}
+
+/**
+ * 物理地址在内核中的访问地址（恒等映射）
+ */
+void *vm_phys_to_virt(uintptr_t physical_addr) {
+    return (void *)physical_addr;
+}
+
+/**
+ * 处理缺页
+ */
+int32_t vm_handle_fault(uintptr_t space, uintptr_t fault_addr, uint32_t error_code) {
+    uintptr_t flags;
+    int32_t result;
+
+    if (!space || !vm_user_range(fault_addr, fault_addr + 1)) {
+        return -1;
+    }
+
+    flags = vm_lock_acquire();
+    result = vm_fault_locked(space, fault_addr & PAGE_MASK, error_code);
+    vm_lock_release(flags);
+
+    return result;
+}
+
+/**
+ * 页面授予
+ */
+int32_t vm_grant(uintptr_t src_space, uintptr_t src, uintptr_t dst_space, uintptr_t dst,
+                 uintptr_t size, uint32_t mode) {
+    uint32_t offset;
+    uintptr_t flags;
+
+    size = (size + PAGE_SIZE - 1) & PAGE_MASK;
+    if (!src_space || !dst_space || src_space == dst_space || size == 0 ||
+        mode > VM_GRANT_MOVE || ((src | dst) & (PAGE_SIZE - 1)) ||
+        !vm_user_range(src, src + size) || !vm_user_range(dst, dst + size)) {
+        return -1;
+    }
+
+    /* 第一遍：分配发送方尚未分配的页和接收方的页表，确认目标范围空闲 */
+    flags = vm_lock_acquire();
+    for (offset = 0; offset < size; offset += PAGE_SIZE) {
+        uint32_t *dpte;
+
+        if (vm_fault_locked(src_space, src + offset, 0) != 0) {
+            vm_lock_release(flags);
+            return -1;
+        }
+        dpte = vm_pte(dst_space, dst + offset, true);
+        if (!dpte || *dpte) {
+            vm_lock_release(flags);
+            return -1;
+        }
+    }
+
+    /* 第二遍：写接收方页表项 */
+    for (offset = 0; offset < size; offset += PAGE_SIZE) {
+        uint32_t *spte = vm_pte(src_space, src + offset, false);
+        uint32_t *dpte = vm_pte(dst_space, dst + offset, false);
+        uint32_t entry = *spte;
+
+        switch (mode) {
+        case VM_GRANT_READ:
+            *dpte = entry & ~(PAGE_READWRITE | VM_PTE_COW | PAGE_DIRTY | PAGE_ACCESSED);
+            vm_frame_get(entry & PAGE_MASK);
+            break;
+
+        case VM_GRANT_COW:
+            if (entry & PAGE_READWRITE) {
+                entry = (entry & ~PAGE_READWRITE) | VM_PTE_COW;
+                *spte = entry;
+                vm_flush_page(src_space, src + offset);
+            }
+            *dpte = entry & ~(PAGE_DIRTY | PAGE_ACCESSED);
+            vm_frame_get(entry & PAGE_MASK);
+            break;
+
+        default:
+            /* 页帧转给接收方，发送方的区域仍然预留，再访问时得到新的清零页 */
+            *dpte = entry & ~PAGE_ACCESSED;
+            *spte = VM_PTE_RESERVED | PAGE_USER |
+                    ((entry & VM_PTE_COW) ? PAGE_READWRITE : (entry & PAGE_READWRITE));
+            vm_flush_page(src_space, src + offset);
+            break;
+        }
+    }
+    vm_lock_release(flags);
+
+    return 0;
+}
+
+/**
+ * i386不做相同页合并
+ */
+int32_t vm_ksm_register(uintptr_t space) {
+    (void)space;
+    return -1;
+}
+
+void vm_ksm_unregister(uintptr_t space) {
+    (void)space;
+}
@@ -33,6 +33,13 @@
 #define PCI_INTERRUPT_LINE    0x3C
 #define PCI_INTERRUPT_PIN     0x3D
 
+/* BAR字段 */
+#define PCI_BAR_IO            0x01
+#define PCI_BAR_TYPE_MASK     0x06
+#define PCI_BAR_TYPE_64       0x04
+#define PCI_BAR_MEM_MASK      0xFFFFFFF0
+#define PCI_COMMAND_MEMORY    0x0002
+
 /* PCI设备类型 */
 #define PCI_CLASS_BRIDGE      0x06
 #define PCI_SUBCLASS_HOST_BRIDGE  0x00
@@ -242,6 +249,47 @@ uint32_t pci_get_bar(pci_device_t *dev, int bar_index) {
     return dev->bars[bar_index];
 }
 
+/* 探测内存BAR的大小（写全1后读回，期间关闭内存译码） */
+uint64_t pci_get_bar_size(pci_device_t *dev, int bar_index) {
+    uint32_t command, low, high = 0xFFFFFFFF;
+    uint32_t bar;
+    uint8_t offset;
+    bool is_64;
+
+    if (!dev || bar_index < 0 || bar_index > 5) {
+        return 0;
+    }
+
+    offset = PCI_BAR0 + bar_index * 4;
+    bar = pci_get_bar(dev, bar_index);
+    is_64 = (bar & PCI_BAR_TYPE_MASK) == PCI_BAR_TYPE_64;
+    if ((bar & PCI_BAR_IO) || (is_64 && bar_index == 5)) {
+        return 0;
+    }
+
+    command = pci_read_config(dev->bus, dev->device, dev->function, PCI_COMMAND);
+    pci_write_config(dev->bus, dev->device, dev->function, PCI_COMMAND,
+                     command & ~PCI_COMMAND_MEMORY);
+
+    pci_write_config(dev->bus, dev->device, dev->function, offset, 0xFFFFFFFF);
+    low = pci_read_config(dev->bus, dev->device, dev->function, offset);
+    pci_write_config(dev->bus, dev->device, dev->function, offset, bar);
+
+    if (is_64) {
+        pci_write_config(dev->bus, dev->device, dev->function, offset + 4, 0xFFFFFFFF);
+        high = pci_read_config(dev->bus, dev->device, dev->function, offset + 4);
+        pci_write_config(dev->bus, dev->device, dev->function, offset + 4, dev->bars[bar_index + 1]);
+    }
+
+    pci_write_config(dev->bus, dev->device, dev->function, PCI_COMMAND, command);
+
+    if ((low & PCI_BAR_MEM_MASK) == 0) {
+        return 0;
+    }
+
+    return ~((((uint64_t)high) << 32) | (low & PCI_BAR_MEM_MASK)) + 1;
+}
+
 /* 获取设备是否为桥接器 */
 bool pci_is_bridge(pci_device_t *dev) {
     return (dev->class_code == PCI_CLASS_BRIDGE);
@@ -164,6 +164,7 @@ pci_device_t* pci_find_device_by_class(uint8_t class_code, uint8_t subclass);
 
 /* PCI设备操作 */
 uint32_t pci_get_bar(pci_device_t *dev, int bar_index);
+uint64_t pci_get_bar_size(pci_device_t *dev, int bar_index);
 bool pci_is_bridge(pci_device_t *dev);
 bool pci_is_host_bridge(pci_device_t *dev);
 bool pci_is_pci_bridge(pci_device_t *dev);
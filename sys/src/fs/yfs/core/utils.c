@@ -153,56 +153,28 @@ uint64_t yfs_time_current(void) {
  * 内存复制函数
  */
 void *yfs_memcpy(void *dest, const void *src, size_t n) {
-    uint8_t *d = (uint8_t *)dest;
-    const uint8_t *s = (const uint8_t *)src;
-
-    for (size_t i = 0; i < n; i++) {
-        d[i] = s[i];
-    }
-
-    return dest;
+    return memcpy(dest, src, n);
 }
 
 /**
  * 内存设置函数
  */
 void *yfs_memset(void *dest, int value, size_t n) {
-    uint8_t *d = (uint8_t *)dest;
-
-    for (size_t i = 0; i < n; i++) {
-        d[i] = (uint8_t)value;
-    }
-
-    return dest;
+    return memset(dest, value, n);
 }
 
 /**
  * 内存比较函数
  */
 int yfs_memcmp(const void *s1, const void *s2, size_t n) {
-    const uint8_t *a = (const uint8_t *)s1;
-    const uint8_t *b = (const uint8_t *)s2;
-
-    for (size_t i = 0; i < n; i++) {
-        if (a[i] != b[i]) {
-            return a[i] - b[i];
-        }
-    }
-
-    return 0;
+    return memcmp(s1, s2, n);
 }
 
 /**
  * 字符串长度函数
  */
 size_t yfs_strlen(const char *str) {
-    size_t len = 0;
-
-    while (str && str[len]) {
-        len++;
-    }
-
-    return len;
+    return str ? strlen(str) : 0;
 }
 
 /**
@@ -224,16 +196,11 @@ char *yfs_strcpy(char *dest, const char *src) {
  * 字符串比较函数
  */
 int yfs_strcmp(const char *s1, const char *s2) {
-    while (s1 && s2 && *s1 && *s2 && *s1 == *s2) {
-        s1++;
-        s2++;
-    }
-
     if (!s1 && !s2) return 0;
     if (!s1) return -1;
     if (!s2) return 1;
 
-    return *s1 - *s2;
+    return strcmp(s1, s2);
 }
 
 /**
@@ -16,6 +16,7 @@ extern void *kmalloc(size_t size);
 extern void kfree(void *ptr);
 extern void *memset(void *s, int c, size_t n);
 extern void *memcpy(void *dest, const void *src, size_t n);
+extern int memcmp(const void *s1, const void *s2, size_t n);
 extern size_t strlen(const char *s);
 extern int strcmp(const char *s1, const char *s2);
 extern char *strcpy(char *dest, const char *src);
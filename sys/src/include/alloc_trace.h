@@ -0,0 +1,89 @@
+/**
+ * M4KK1 Allocation Tracer Header
+ * 内核分配跟踪与按调用点统计
+ *
+ * 仅在定义CONFIG_ALLOC_TRACE时编译（make CONFIG_ALLOC_TRACE=y），
+ * 否则ALLOC_TRACE宏展开为空语句，参数不求值。
+ */
+
+#ifndef __ALLOC_TRACE_H__
+#define __ALLOC_TRACE_H__
+
+#include <stdint.h>
+
+/**
+ * 事件类型
+ */
+#define ALLOC_TRACE_KMALLOC     1
+#define ALLOC_TRACE_KFREE       2
+#define ALLOC_TRACE_PAGE_ALLOC  3
+#define ALLOC_TRACE_PAGE_FREE   4
+
+#ifdef CONFIG_ALLOC_TRACE
+
+/**
+ * 事件环形缓冲区大小（必须为2的幂）
+ */
+#define ALLOC_TRACE_EVENTS      4096
+
+/**
+ * 调用点表和存活对象表大小（必须为2的幂）
+ */
+#define ALLOC_TRACE_SITES       512
+#define ALLOC_TRACE_LIVE        8192
+
+/**
+ * 跟踪事件
+ */
+typedef struct alloc_trace_event {
+    uintptr_t site;         /* 调用点（返回地址） */
+    uintptr_t ptr;          /* 对象或页地址 */
+    uint32_t size;          /* 字节数，释放事件为分配时的大小 */
+    uint32_t timestamp;     /* 时钟滴答 */
+    uint32_t type;          /* ALLOC_TRACE_* */
+    uint32_t seq;           /* 全局序号，用于识别被覆盖的槽位 */
+} alloc_trace_event_t;
+
+/**
+ * 按调用点汇总的统计
+ */
+typedef struct alloc_trace_site {
+    uintptr_t site;         /* 调用点（返回地址） */
+    uint32_t live_bytes;    /* 当前存活字节数 */
+    uint32_t live_count;    /* 当前存活对象数 */
+    uint32_t total_allocs;  /* 累计分配次数 */
+    uint32_t total_bytes;   /* 累计分配字节数 */
+} alloc_trace_site_t;
+
+/**
+ * 记录一次分配或释放事件
+ */
+void alloc_trace_record(uint32_t type, uintptr_t site, const void *ptr, uint32_t size);
+
+/**
+ * 按存活字节数从大到小复制调用点统计
+ * @return 复制的条目数
+ */
+uint32_t alloc_trace_get_sites(alloc_trace_site_t *sites, uint32_t max);
+
+/**
+ * 从序号seq开始复制事件（已被覆盖的部分跳过）
+ * @return 复制的事件数
+ */
+uint32_t alloc_trace_get_events(alloc_trace_event_t *events, uint32_t seq, uint32_t max);
+
+/**
+ * 打印存活字节数最多的调用点
+ */
+void alloc_trace_dump(void);
+
+#define ALLOC_TRACE(type, ptr, size) \
+    alloc_trace_record((type), (uintptr_t)__builtin_return_address(0), (ptr), (size))
+
+#else
+
+#define ALLOC_TRACE(type, ptr, size) do { } while (0)
+
+#endif /* CONFIG_ALLOC_TRACE */
+
+#endif /* __ALLOC_TRACE_H__ */
@@ -0,0 +1,47 @@
+/**
+ * M4KK1 Architecture Interface
+ * 进程管理、调度器和IPC使用的处理器相关操作
+ *
+ * 由架构层用汇编实现（i386见arch/m4kk1/switch.asm，x86_64见
+ * arch/x86_64/kernel/switch.asm），内核栈上切换现场的布局只有架构层知道。
+ * 任务状态段由各架构的GDT代码维护（arch/m4kk1/gdt.c、arch/x86_64/kernel/smp.c）。
+ */
+
+#ifndef __ARCH_H__
+#define __ARCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * 关中断并返回原标志寄存器
+ */
+uintptr_t arch_irq_save(void);
+
+/**
+ * 恢复arch_irq_save之前的中断状态
+ */
+void arch_irq_restore(uintptr_t flags);
+
+/**
+ * 在内核栈top下方构造一份切换现场，第一次切换过来时返回到resume，
+ * 这时栈指针等于top（resume是C函数时top处应留一个字作它的返回地址）
+ * @param irq_on 进入resume时是否开中断
+ * @return 保存的栈指针
+ */
+uintptr_t arch_init_stack(uintptr_t top, void (*resume)(void), bool irq_on);
+
+/**
+ * 把被调用者保存的寄存器压入当前内核栈，栈指针存入*prev_sp，再换到
+ * next_sp并弹出那里的现场。离开旧栈之后才清零*prev_on_cpu，此后其他
+ * 处理器可以切换到刚换下的进程
+ */
+void arch_switch_stack(uintptr_t *prev_sp, uintptr_t next_sp, volatile uint32_t *prev_on_cpu);
+
+/**
+ * 设置本处理器从用户态进入内核时使用的栈顶（TSS中的esp0/rsp0），
+ * 切换到进程之前调用
+ */
+void arch_set_kernel_stack(uintptr_t top);
+
+#endif /* __ARCH_H__ */
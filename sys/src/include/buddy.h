@@ -0,0 +1,129 @@
+/**
+ * M4KK1 Buddy Page Allocator Header
+ * 伙伴系统物理页分配器定义
+ */
+
+#ifndef __BUDDY_H__
+#define __BUDDY_H__
+
+#include <stdint.h>
+
+/**
+ * 最大阶数（2^10 = 1024页 = 4MB），更大的请求由相邻的最大阶块拼成
+ */
+#define BUDDY_MAX_ORDER     10
+#define BUDDY_ORDER_COUNT   (BUDDY_MAX_ORDER + 1)
+
+/**
+ * 无效页号（空链表/分配失败）
+ */
+#define BUDDY_NONE          0xFFFFFFFF
+
+/**
+ * 页描述符标志
+ */
+#define BUDDY_PAGE_FREE     0x01    /* 空闲块的首页 */
+#define BUDDY_PAGE_SLAB     0x02    /* slab页，private_data为slab头部地址 */
+#define BUDDY_PAGE_LARGE    0x04    /* 大块kmalloc首页，private_data为页数 */
+#define BUDDY_PAGE_USER     0x08    /* 用户页帧，private_data为映射计数 */
+
+/**
+ * 页描述符（每个物理页一个）
+ */
+typedef struct buddy_page {
+    uint32_t next;      /* 空闲链表后继（区内页索引） */
+    uint32_t prev;      /* 空闲链表前驱（区内页索引） */
+    uint8_t order;      /* 块阶数（仅块首页有效） */
+    uint8_t flags;      /* 页标志 */
+    uint16_t reserved;
+    uint32_t private_data; /* 页所有者的私有数据 */
+} buddy_page_t;
+
+/**
+ * 每阶统计信息
+ */
+typedef struct buddy_order_stats {
+    uint32_t free_blocks;   /* 当前空闲块数 */
+    uint32_t alloc_count;   /* 分配次数 */
+    uint32_t free_count;    /* 释放次数 */
+    uint32_t split_count;   /* 高阶块拆分到本阶的次数 */
+    uint32_t merge_count;   /* 本阶块合并到高一阶的次数 */
+} buddy_order_stats_t;
+
+/**
+ * 空闲区（每阶一个双向链表）
+ */
+typedef struct buddy_free_area {
+    uint32_t head;
+    uint32_t count;
+} buddy_free_area_t;
+
+/**
+ * 伙伴区域：管理一段连续的物理页
+ */
+typedef struct buddy_zone {
+    volatile uint32_t lock; /* 自旋锁，保护空闲链表、页描述符和统计 */
+    uint32_t base_pfn;      /* 起始物理页号 */
+    uint32_t nr_pages;      /* 区内页数 */
+    uint32_t free_pages;    /* 空闲页数 */
+    buddy_page_t *pages;    /* 页描述符数组 */
+    buddy_free_area_t free_area[BUDDY_ORDER_COUNT];
+    buddy_order_stats_t stats[BUDDY_ORDER_COUNT];
+} buddy_zone_t;
+
+/**
+ * 初始化伙伴区域（所有页初始为已用）
+ */
+void buddy_zone_init(buddy_zone_t *zone, uint32_t base_pfn, uint32_t nr_pages,
+                     buddy_page_t *pages);
+
+/**
+ * 将一段页加入空闲链表（按最大对齐块拆分，用于初始化）
+ */
+void buddy_free_range(buddy_zone_t *zone, uint32_t pfn, uint32_t count);
+
+/**
+ * 分配2^order个连续页，返回物理页号，失败返回BUDDY_NONE
+ */
+uint32_t buddy_alloc(buddy_zone_t *zone, uint32_t order);
+
+/**
+ * 释放2^order个连续页并与伙伴合并
+ */
+void buddy_free(buddy_zone_t *zone, uint32_t pfn, uint32_t order);
+
+/**
+ * 分配任意页数（多余的尾部页立即归还），超过2^BUDDY_MAX_ORDER页时
+ * 需要区内有足够多物理上相邻的最大阶空闲块
+ */
+uint32_t buddy_alloc_pages(buddy_zone_t *zone, uint32_t pages);
+
+/**
+ * 释放由buddy_alloc_pages分配的页
+ */
+void buddy_free_pages(buddy_zone_t *zone, uint32_t pfn, uint32_t pages);
+
+/**
+ * 计算容纳指定页数所需的最小阶数，超过最大阶时返回BUDDY_MAX_ORDER + 1
+ */
+uint32_t buddy_order_for_pages(uint32_t pages);
+
+/**
+ * 检查物理页号是否属于该区域
+ */
+static inline int buddy_zone_contains(const buddy_zone_t *zone, uint32_t pfn) {
+    return pfn >= zone->base_pfn && pfn - zone->base_pfn < zone->nr_pages;
+}
+
+/**
+ * 获取指定阶的统计信息
+ */
+void buddy_get_order_stats(const buddy_zone_t *zone, uint32_t order,
+                           buddy_order_stats_t *stats);
+
+/**
+ * 打印各阶统计信息（碎片情况）
+ */
+void buddy_dump_stats(const buddy_zone_t *zone);
+
+#endif /* __BUDDY_H__ */
@@ -0,0 +1,125 @@
+/**
+ * M4KK1 FPU/SIMD Context Header
+ * 进程扩展状态（x87/SSE/AVX）的延迟切换
+ *
+ * 切换进程时只置CR0.TS，进程在时间片内第一次使用FPU/SIMD指令触发#NM
+ * 时才装入它的状态；切出时TS仍置位说明本时间片没有用过，跳过保存。
+ * 支持XSAVE时用XSAVEOPT/XRSTOR（只写回修改过的状态组件），否则用
+ * FXSAVE/FXRSTOR。
+ */
+
+#ifndef __FPU_H__
+#define __FPU_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct process;
+
+/**
+ * 保存方式
+ */
+#define FPU_MODE_NONE           0   /* 不管理扩展状态（未初始化或不支持FXSR） */
+#define FPU_MODE_FXSAVE         1
+#define FPU_MODE_XSAVE          2
+#define FPU_MODE_XSAVEOPT       3
+
+/**
+ * XCR0状态组件
+ */
+#define FPU_XCR0_X87            (1 << 0)
+#define FPU_XCR0_SSE            (1 << 1)
+#define FPU_XCR0_AVX            (1 << 2)
+
+/**
+ * 保存区布局（XSAVE要求64字节对齐，前512字节与FXSAVE相同）
+ */
+#define FPU_STATE_ALIGN         64
+#define FPU_FXSAVE_SIZE         512
+#define FPU_FCW_OFFSET          0
+#define FPU_MXCSR_OFFSET        24
+#define FPU_FCW_DEFAULT         0x037F  /* 屏蔽所有x87异常，64位精度 */
+#define FPU_MXCSR_DEFAULT       0x1F80  /* 屏蔽所有SIMD异常 */
+
+/**
+ * 统计信息
+ */
+typedef struct fpu_stats {
+    uint32_t mode;              /* FPU_MODE_* */
+    uint32_t state_size;        /* 每个进程保存区的大小 */
+    uint32_t xcr0;              /* 启用的XSAVE状态组件 */
+    uint32_t traps;             /* #NM次数 */
+    uint32_t restores;          /* 从保存区装入的次数 */
+    uint32_t saves;             /* 写回保存区的次数 */
+    uint32_t skipped_saves;     /* 时间片内未使用而跳过保存的次数 */
+} fpu_stats_t;
+
+/**
+ * 切换开销基准测试结果
+ */
+typedef struct fpu_bench {
+    uint32_t switches;
+    uint64_t int_cycles;        /* 进程不使用向量寄存器时的总周期数 */
+    uint64_t vector_cycles;     /* 每个时间片都使用向量寄存器时的总周期数（含#NM、装入和保存） */
+} fpu_bench_t;
+
+/**
+ * 检测CPU特性，启用SSE/AVX状态并安装#NM处理函数
+ */
+void fpu_init(void);
+
+/**
+ * 是否在管理进程的扩展状态
+ */
+bool fpu_enabled(void);
+
+/**
+ * 为进程分配初始状态的保存区（未启用时不分配）
+ * @return 成功返回0，内存不足返回-1
+ */
+int32_t fpu_alloc_state(struct process *process);
+
+/**
+ * 释放进程的保存区
+ */
+void fpu_free_state(struct process *process);
+
+/**
+ * 复制src的扩展状态到dst（fork），src是当前进程时先写回寄存器中的状态
+ */
+void fpu_copy_state(struct process *dst, struct process *src);
+
+/**
+ * 进程切换：写回本时间片用过的状态并置TS
+ */
+void fpu_switch(struct process *prev, struct process *next);
+
+/**
+ * #NM处理函数（idt.asm中的isr_device_not_available调用）
+ */
+void fpu_handle_nm(void);
+
+/**
+ * 内核开始使用向量寄存器：写回当前进程的状态并关中断
+ * @return 可以使用返回true；嵌套（如异常打断了另一段SIMD代码）时返回false
+ */
+bool fpu_kernel_begin(void);
+
+/**
+ * 内核结束使用向量寄存器，恢复中断状态
+ */
+void fpu_kernel_end(void);
+
+/**
+ * 获取统计信息
+ */
+void fpu_get_stats(fpu_stats_t *stats);
+
+/**
+ * 在两个测试进程之间切换switches次，分别测量不用和使用向量寄存器时
+ * 的开销，并检查每个进程的xmm0在切换后保持不变
+ * @return 成功返回0，未启用、内存不足或状态被破坏返回-1
+ */
+int32_t fpu_benchmark(uint32_t switches, fpu_bench_t *bench);
+
+#endif /* __FPU_H__ */
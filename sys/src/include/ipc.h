@@ -0,0 +1,204 @@
+/**
+ * M4KK1 IPC Header
+ * 进程间消息传递
+ *
+ * 每个进程有自己的邮箱，消息槽按到达顺序串成一条链表，同时按type
+ * 哈希挂入子队列。按type接收直接取子队列队首，不接收指定type时取
+ * 最早到达的消息，都不需要扫描其他进程或其他type的消息。邮箱为空时
+ * 接收者阻塞，发送者投递匹配的消息时直接把它放回运行队列。
+ *
+ * 同步调用（ipc_call/ipc_reply_wait）发送后阻塞等待回复。接收者正阻塞
+ * 在同一处理器上时不经过运行队列，直接切换过去并把剩余时间片让给它；
+ * 不超过IPC_FAST_SIZE的消息放在邮箱的几个字里直接交给接收者，不占用
+ * 消息槽。
+ *
+ * 大块数据用页面授予（ipc_grant）传递：发送方的页面通过页表映射进接收方
+ * 地址空间的授予窗口，只把位置通过一条ipc_grant_t消息告诉接收方，内容
+ * 不复制。
+ */
+
+#ifndef __IPC_H__
+#define __IPC_H__
+
+#include <stdint.h>
+
+struct process;
+
+/**
+ * 消息和邮箱大小
+ */
+#define IPC_MESSAGE_SIZE        256
+#define IPC_MAILBOX_SLOTS       12      /* 邮箱放在一个slab对象里（不超过一页） */
+#define IPC_TYPE_QUEUES         8       /* 按type哈希的子队列数（2的幂） */
+#define IPC_SLOT_NONE           0xFF
+#define IPC_FAST_WORDS          8       /* 快速路径消息的字数 */
+#define IPC_FAST_SIZE           (IPC_FAST_WORDS * sizeof(uint32_t))
+
+/**
+ * 接收方地址空间中存放授予页面的窗口（位于用户栈以下）
+ */
+#define IPC_GRANT_BASE          0x80000000
+#define IPC_GRANT_SIZE          0x20000000      /* 512MB */
+#define IPC_MAX_GRANTS          16              /* 每个进程同时持有的授予数 */
+
+/**
+ * 特殊的接收者和类型
+ */
+#define IPC_PID_BROADCAST       0       /* 投递到除发送者外所有进程的邮箱 */
+#define IPC_TYPE_ANY            0       /* 接收时不限类型 */
+#define IPC_TYPE_REPLY          0xFFFFFFFF  /* ipc_reply_wait发送的回复 */
+
+/**
+ * 消息槽
+ */
+typedef struct ipc_message {
+    uint32_t sender_pid;
+    uint32_t type;
+    uint32_t size;
+    uint32_t seq;               /* 到达序号，与快速路径消息比较先后 */
+    uint8_t next;               /* 到达顺序链表，空闲时串成空闲链表 */
+    uint8_t prev;
+    uint8_t type_next;          /* 同一子队列的链表 */
+    uint8_t type_prev;
+    uint8_t data[IPC_MESSAGE_SIZE];
+} ipc_message_t;
+
+/**
+ * 页面授予消息的内容
+ */
+typedef struct ipc_grant {
+    uint32_t addr;              /* 接收方地址空间中的起始地址 */
+    uint32_t size;              /* 字节数（按页对齐） */
+    uint32_t mode;              /* VM_GRANT_* */
+} ipc_grant_t;
+
+/**
+ * 邮箱
+ */
+typedef struct ipc_mailbox {
+    volatile uint32_t lock;                 /* 自旋锁 */
+    uint32_t count;                         /* 邮箱中的消息数 */
+    uint32_t wait_type;                     /* 阻塞的接收者等待的type */
+    uint8_t waiting;                        /* 接收者是否阻塞在邮箱上 */
+    uint8_t head;                           /* 最早到达的消息 */
+    uint8_t tail;                           /* 最晚到达的消息 */
+    uint8_t free;                           /* 空闲槽链表 */
+    uint8_t type_head[IPC_TYPE_QUEUES];
+    uint8_t type_tail[IPC_TYPE_QUEUES];
+    uint32_t seq;                           /* 下一条消息的到达序号 */
+    uint32_t fast_full;                     /* 快速路径消息有效 */
+    uint32_t fast_sender;
+    uint32_t fast_type;
+    uint32_t fast_size;
+    uint32_t fast_seq;
+    uint32_t fast_data[IPC_FAST_WORDS];     /* 交给阻塞接收者的小消息 */
+    uint32_t grant_addr[IPC_MAX_GRANTS];    /* 授予窗口中已占用的范围 */
+    uint32_t grant_size[IPC_MAX_GRANTS];    /* 0表示空闲 */
+    volatile uint32_t grant_busy;           /* 锁外修改页表中的授予数 */
+    ipc_message_t slots[IPC_MAILBOX_SLOTS];
+} ipc_mailbox_t;
+
+/**
+ * 统计信息
+ */
+typedef struct ipc_stats {
+    uint32_t queued;            /* 放入消息槽的消息数 */
+    uint32_t fast;              /* 通过快速路径交给阻塞接收者的消息数 */
+    uint32_t handoffs;          /* 直接切换到接收者的次数 */
+    uint32_t wakeups;           /* 经运行队列唤醒接收者的次数 */
+    uint32_t grants;            /* 页面授予次数 */
+    uint32_t granted_pages;     /* 授予的页数 */
+} ipc_stats_t;
+
+/**
+ * 往返延迟基准测试结果
+ */
+typedef struct ipc_bench {
+    uint32_t rounds;
+    uint64_t queued_cycles;     /* 请求和回复都经过消息槽的总周期数 */
+    uint64_t fast_cycles;       /* 对方阻塞等待时走快速路径的总周期数 */
+    uint32_t switch_rounds;     /* 与服务线程完成的同步调用次数（调度器未启动时为0） */
+    uint64_t switch_cycles;     /* 含两次进程切换的同步调用总周期数 */
+} ipc_bench_t;
+
+/**
+ * 初始化IPC（创建邮箱缓存）
+ */
+void ipc_init(void);
+
+/**
+ * 为进程分配空邮箱
+ * @return 成功返回0，内存不足返回-1
+ */
+int32_t ipc_mailbox_alloc(struct process *process);
+
+/**
+ * 释放进程的邮箱（进程已从PID表中移除后调用）
+ */
+void ipc_mailbox_free(struct process *process);
+
+/**
+ * 发送消息，receiver_pid为IPC_PID_BROADCAST时投递到所有其他进程
+ * IPC_TYPE_REPLY只能由ipc_reply_wait发送
+ * @return 成功返回0，参数无效、接收者不存在或邮箱已满返回-1
+ */
+int32_t ipc_send(uint32_t receiver_pid, void *data, uint32_t size, uint32_t type);
+
+/**
+ * 接收消息，邮箱中没有匹配的消息时阻塞直到有发送者投递
+ * @param size 输入缓冲区大小，输出复制的字节数
+ * @return 成功返回0，参数无效或调度器未启动无法阻塞返回-1
+ */
+int32_t ipc_receive(uint32_t *sender_pid, void *data, uint32_t *size, uint32_t type);
+
+/**
+ * 接收消息，没有匹配的消息时立即返回-1
+ */
+int32_t ipc_try_receive(uint32_t *sender_pid, void *data, uint32_t *size, uint32_t type);
+
+/**
+ * 同步调用：发送请求并阻塞等待server_pid的回复（IPC_TYPE_REPLY）
+ * @param reply_size 输入回复缓冲区大小，输出复制的字节数
+ * @return 成功返回0，参数无效、服务进程不存在、邮箱已满或无法阻塞返回-1
+ */
+int32_t ipc_call(uint32_t server_pid, void *data, uint32_t size, uint32_t type,
+                 void *reply, uint32_t *reply_size);
+
+/**
+ * 服务进程回复client_pid（为0时不回复）并阻塞等待下一个type类型的请求
+ * @return 成功返回0，回复失败或无法阻塞返回-1
+ */
+int32_t ipc_reply_wait(uint32_t client_pid, void *reply, uint32_t reply_size,
+                       uint32_t *sender_pid, void *data, uint32_t *size, uint32_t type);
+
+/**
+ * 把当前进程[addr, addr+size)的页面授予receiver_pid，接收方收到一条
+ * type类型、内容为ipc_grant_t的消息
+ * @param mode VM_GRANT_READ只读共享，VM_GRANT_COW写时复制，
+ *             VM_GRANT_MOVE转移（发送方不再映射）
+ * @return 成功返回0，地址未对齐、type为IPC_TYPE_REPLY、双方不是用户进程、授予窗口或邮箱已满、
+ *         页面不存在返回-1
+ */
+int32_t ipc_grant(uint32_t receiver_pid, void *addr, uint32_t size, uint32_t mode,
+                  uint32_t type);
+
+/**
+ * 撤销当前进程授予窗口中从addr开始的一段授予
+ * @return 成功返回0，addr不是授予的起始地址返回-1
+ */
+int32_t ipc_grant_release(uint32_t addr);
+
+/**
+ * 获取统计信息
+ */
+void ipc_get_stats(ipc_stats_t *stats);
+
+/**
+ * 在两个测试邮箱之间往返rounds次小消息，分别测量经过消息槽和走快速
+ * 路径的数据通路开销；再对一个服务线程做rounds次ipc_call，测量包括
+ * 两次进程切换在内的完整往返
+ * @return 成功返回0，内存不足或消息内容出错返回-1
+ */
+int32_t ipc_benchmark(uint32_t rounds, ipc_bench_t *bench);
+
+#endif /* __IPC_H__ */
@@ -175,6 +175,7 @@ typedef struct {
 
 /* 库加载和卸载 */
 int m4ll_load_library(const char *filename, m4ll_library_t **lib);
+void *m4ll_read_file(const char *filename, size_t *size);
 int m4ll_unload_library(m4ll_library_t *lib);
 
 /* 符号解析 */
@@ -8,7 +8,10 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include "multiboot.h"
+#include "buddy.h"
+#include "slab.h"
 
 /**
  * 内存区域类型
@@ -23,22 +26,12 @@
  * 内存区域结构
  */
 typedef struct memory_region {
-    uint32_t start;
-    uint32_t size;
+    uint64_t start;
+    uint64_t size;
     uint32_t type;
     struct memory_region *next;
 } memory_region_t;
 
-/**
- * 内存块结构
- */
-typedef struct memory_block {
-    uint32_t start;
-    uint32_t size;
-    uint8_t used;
-    struct memory_block *next;
-} memory_block_t;
-
 /**
  * 页面大小
  */
@@ -67,20 +60,30 @@ typedef struct memory_block {
 void memory_init(multiboot_info_t *mb_info);
 
 /**
- * 获取总内存大小（字节）
+ * 获取总内存大小（字节，超过4GB时饱和）
  */
 uint32_t memory_get_total(void);
 
 /**
- * 获取可用内存大小（字节）
+ * 获取可用内存大小（字节，超过4GB时饱和）
  */
 uint32_t memory_get_free(void);
 
 /**
- * 获取已用内存大小（字节）
+ * 获取已用内存大小（字节，超过4GB时饱和）
  */
 uint32_t memory_get_used(void);
 
+/**
+ * 获取总内存页数
+ */
+uint32_t memory_get_total_pages(void);
+
+/**
+ * 获取空闲页数
+ */
+uint32_t memory_get_free_pages(void);
+
 /**
  * 分配内存
  */
@@ -101,6 +104,295 @@ void *memory_alloc_page(size_t pages);
  */
 void memory_free_page(void *ptr, size_t pages);
 
+/**
+ * 获取页面描述符（地址不受页分配器管理时返回NULL）
+ */
+buddy_page_t *memory_page_desc(const void *ptr);
+
+/**
+ * 获取指定阶的页面分配统计
+ */
+void memory_get_page_order_stats(uint32_t order, buddy_order_stats_t *stats);
+
+/**
+ * 打印页面分配器碎片信息（各阶空闲块数）
+ */
+void memory_dump_page_orders(void);
+
+/**
+ * 分配/释放物理页帧（经本处理器的页帧缓存，由架构层实现）
+ * @return 物理地址，失败返回0
+ */
+uint64_t m4k_alloc_physical_page(void);
+void m4k_free_physical_page(uint64_t address);
+
+/**
+ * 释放冷页面（放在本处理器页帧缓存的冷端，优先归还给全局位图）
+ */
+void m4k_free_physical_page_cold(uint64_t address);
+
+/**
+ * 将所有处理器页帧缓存中的页帧归还到全局位图
+ */
+void m4k_drain_pcp_pages(void);
+
+/**
+ * 获取处理器页帧缓存的页数和命中/补充/归还次数
+ */
+void m4k_get_pcp_stats(uint32_t cpu, uint32_t *cached, uint64_t *hits,
+                       uint64_t *refills, uint64_t *drains);
+
+/**
+ * 分配已清零的物理页面（优先取自预清零池）
+ * @return 物理地址，失败返回0
+ */
+uint64_t m4k_alloc_zeroed_page(void);
+
+/**
+ * 补充预清零池（由空闲循环调用）
+ */
+void m4k_zero_pool_refill(void);
+
+/**
+ * 获取预清零池的页数和命中/未命中次数
+ */
+void m4k_get_zero_pool_stats(uint32_t *pooled, uint64_t *hits, uint64_t *misses);
+
+/**
+ * 在内核页表中映射4KB页/2MB大页（大页的虚拟和物理地址都必须2MB对齐）
+ * @return 成功返回0，地址未对齐或该区域已有4KB映射返回-1
+ */
+void m4k_map_page(uint64_t virtual_addr, uint64_t physical_addr, uint64_t flags);
+int32_t m4k_map_huge_page(uint64_t virtual_addr, uint64_t physical_addr, uint64_t flags);
+
+/**
+ * 映射一段连续物理内存，对齐的2MB区段使用大页
+ */
+void m4k_map_range(uint64_t virtual_addr, uint64_t physical_addr, uint64_t size,
+                   uint64_t flags);
+
+/**
+ * 撤销内核页表中的映射，完整覆盖的大页整体撤销
+ */
+void m4k_unmap_page(uint64_t virtual_addr);
+void m4k_unmap_range(uint64_t virtual_addr, uint64_t size);
+
+/**
+ * 获取4KB和2MB映射数量
+ */
+void m4k_get_mapping_stats(uint64_t *small, uint64_t *huge);
+
+/**
+ * 内核虚拟地址对应的物理地址（识别2MB和1GB页），未映射返回0
+ */
+uint64_t m4k_get_physical_address(uint64_t virtual_addr);
+
+/**
+ * 物理地址在内核中的访问地址（经直接映射）
+ */
+uint64_t m4k_phys_to_virt(uint64_t physical_addr);
+
+/**
+ * 创建空的用户地址空间（共享内核映射）
+ * @return 页表根物理地址，内存不足返回0
+ */
+uint64_t m4k_create_address_space(void);
+
+/**
+ * 复制用户地址空间（写时复制，由架构层实现）
+ * @param pml4 父进程页表根物理地址
+ * @return 子进程页表根物理地址，内存不足或父进程参与相同页合并而登记表已满
+ *         （子进程无法继承）时返回0
+ */
+uint64_t m4k_fork_address_space(uint64_t pml4);
+
+/**
+ * 销毁用户地址空间，释放页表和不再共享的页帧
+ */
+void m4k_destroy_address_space(uint64_t pml4);
+
+/**
+ * 处理页面错误（写时复制）
+ * @return 已处理返回0，否则返回-1
+ */
+int32_t m4k_handle_page_fault(uint64_t pml4, uint64_t fault_addr,
+                              uint64_t error_code);
+
+/**
+ * 预留按需分配的匿名内存区域（页面在首次访问时由缺页处理分配，
+ * 完整覆盖的2MB对齐范围用大页）
+ * @param flags 页面标志（PAGE_READWRITE、PAGE_USER）
+ * @return 成功返回0，失败返回-1
+ */
+int32_t m4k_vm_reserve(uint64_t pml4, uint64_t start, uint64_t size, uint64_t flags);
+
+/**
+ * 释放匿名内存区域并撤销已分配页面的映射
+ */
+void m4k_vm_release(uint64_t pml4, uint64_t start, uint64_t size);
+
+/**
+ * 用户地址空间中虚拟地址对应的物理地址，未映射返回0
+ */
+uint64_t m4k_vm_translate(uint64_t pml4, uint64_t virtual_addr);
+
+/**
+ * 设置缺页时一并映射的相邻页数
+ */
+void m4k_set_fault_around(uint32_t pages);
+
+/**
+ * 页面授予方式
+ */
+#define M4K_GRANT_READ          0   /* 接收方只读映射同一页帧，发送方不变 */
+#define M4K_GRANT_COW           1   /* 双方写时复制，效果同复制但不复制内容 */
+#define M4K_GRANT_MOVE          2   /* 页帧转给接收方，发送方撤销映射 */
+
+/**
+ * 把src_pml4中[src, src+size)的页面映射到dst_pml4的dst处（零拷贝IPC）
+ * 发送方预留区域内尚未分配的页先分配，接收方的目标范围必须未映射；
+ * 接收方用m4k_vm_release撤销映射
+ * @return 成功返回0，地址未对齐、发送方页面不存在、接收方已映射或内存不足返回-1
+ */
+int32_t m4k_vm_grant(uint64_t src_pml4, uint64_t src, uint64_t dst_pml4, uint64_t dst,
+                     uint64_t size, uint32_t mode);
+
+/**
+ * 相同页合并统计
+ */
+typedef struct m4k_ksm_stats {
+    uint64_t pages_scanned;     /* 累计扫描页数 */
+    uint64_t merges;            /* 累计合并次数 */
+    uint64_t full_scans;        /* 完整扫描轮数 */
+    uint32_t pages_shared;      /* 被共享的页帧数 */
+    uint32_t pages_sharing;     /* 合并节省的页帧数 */
+    uint32_t merge_ratio;       /* pages_sharing / pages_shared（百分数） */
+    uint32_t scan_rate;         /* 每轮扫描页数 */
+} m4k_ksm_stats_t;
+
+/**
+ * 将地址空间加入/移出相同页合并扫描（madvise登记，fork时子进程继承）
+ * @return 成功返回0，登记表已满返回-1
+ */
+int32_t m4k_ksm_register(uint64_t pml4);
+void m4k_ksm_unregister(uint64_t pml4);
+bool m4k_ksm_is_registered(uint64_t pml4);
+
+/**
+ * 执行一轮相同页合并扫描（由空闲循环调用）
+ */
+void m4k_ksm_run(void);
+
+/**
+ * 启用/停止扫描（默认启用），设置每轮扫描页数
+ */
+void m4k_ksm_set_enabled(bool enabled);
+void m4k_ksm_set_scan_rate(uint32_t pages);
+
+/**
+ * 获取相同页合并统计
+ */
+void m4k_ksm_get_stats(m4k_ksm_stats_t *stats);
+
+/**
+ * 页面缓存策略（通过PAT实现）
+ */
+#define M4K_CACHE_WB            0           /* 回写（默认） */
+#define M4K_CACHE_WT            1           /* 写透 */
+#define M4K_CACHE_UC            2           /* 不可缓存，用于MMIO寄存器 */
+#define M4K_CACHE_WC            3           /* 写合并，用于帧缓冲 */
+#define M4K_CACHE_INVALID       0xFFFFFFFF  /* 页面未映射 */
+
+/**
+ * 编程PAT（每个处理器启动时调用）
+ */
+void m4k_pat_init(void);
+
+/**
+ * 设置/获取内核页面的缓存策略（M4K_CACHE_*）
+ * @return 设置成功返回0，页面未映射或策略无效返回-1
+ */
+int32_t m4k_set_page_cache_policy(uint64_t virtual_addr, uint32_t policy);
+uint32_t m4k_get_page_cache_state(uint64_t virtual_addr);
+
+/**
+ * 以指定缓存策略映射设备内存
+ * @return 内核虚拟地址，失败返回0
+ */
+uint64_t m4k_ioremap(uint64_t physical_addr, uint64_t size, uint32_t policy);
+
+/**
+ * 撤销设备内存映射
+ */
+void m4k_iounmap(uint64_t virtual_addr, uint64_t size);
+
+/**
+ * 切换到地址空间（启用PCID时保留其TLB条目）
+ * @param pml4 页表根物理地址
+ */
+void m4k_switch_address_space(uint64_t pml4);
+
+/**
+ * TLB统计
+ */
+typedef struct m4k_tlb_stats {
+    uint64_t switches;          /* 地址空间切换次数 */
+    uint64_t preserved;         /* 保留TLB条目的切换次数 */
+    uint64_t full_flushes;      /* 整体清空TLB的次数（含切换） */
+    uint64_t page_flushes;      /* 单页失效次数 */
+    uint64_t batches;           /* 批量失效次数 */
+    uint64_t batched_pages;     /* 批量失效覆盖的页数 */
+    uint64_t pcid_evictions;    /* PCID不足时回收的次数 */
+    bool pcid_enabled;
+    bool invpcid_supported;
+} m4k_tlb_stats_t;
+
+/**
+ * 切换路径测试结果
+ */
+typedef struct m4k_tlb_bench {
+    uint64_t total_cycles;      /* 总周期数 */
+    uint64_t touch_cycles;      /* 切换后访问页面的周期数 */
+    uint64_t cycles_per_switch; /* 平均每次切换（含访问）的周期数 */
+    uint64_t full_flushes;      /* 测试期间整体清空TLB的次数 */
+    uint64_t preserved;         /* 测试期间保留TLB条目的切换次数 */
+    uint32_t switches;          /* 切换次数 */
+    bool pcid_enabled;
+} m4k_tlb_bench_t;
+
+/**
+ * 启用或关闭PCID
+ * @return 成功返回0，处理器不支持返回-1
+ */
+int32_t m4k_tlb_set_pcid(bool enabled);
+
+/**
+ * 获取TLB统计
+ */
+void m4k_get_tlb_stats(m4k_tlb_stats_t *stats);
+
+/**
+ * 切换路径测试：在两个地址空间间切换rounds轮，每次切换后访问pages个页面
+ * @return 成功返回0，失败返回-1
+ */
+int32_t m4k_tlb_benchmark(uint32_t rounds, uint32_t pages, m4k_tlb_bench_t *result);
+
+/**
+ * 页面授予测试结果
+ */
+typedef struct m4k_grant_bench {
+    uint32_t pages;
+    uint64_t copy_cycles;       /* 逐页复制的总周期数 */
+    uint64_t grant_cycles;      /* 写时复制授予的总周期数 */
+    uint64_t move_cycles;       /* 转移授予的总周期数 */
+} m4k_grant_bench_t;
+
+/**
+ * 页面授予测试：对比在两个地址空间之间复制和授予pages个页面的开销
+ * @return 成功返回0，失败返回-1
+ */
+int32_t m4k_grant_benchmark(uint32_t pages, m4k_grant_bench_t *result);
+
 /**
  * 分配内核内存
  */
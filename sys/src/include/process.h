@@ -7,6 +7,9 @@
 #define __PROCESS_H__
 
 #include <stdint.h>
+#include "rbtree.h"
+
+struct syscall_frame;
 
 /**
  * 进程状态
@@ -17,11 +20,33 @@
 #define PROCESS_STATE_TERMINATED 3
 
 /**
- * 进程优先级
+ * 进程优先级（数值越小优先级越高）
+ */
+#define PROCESS_PRIORITY_LEVELS 32
+#define PROCESS_PRIORITY_HIGH   8
+#define PROCESS_PRIORITY_NORMAL 16
+#define PROCESS_PRIORITY_LOW    24
+#define PROCESS_PRIORITY_IDLE   (PROCESS_PRIORITY_LEVELS - 1)
+
+/**
+ * 调度策略
+ * 实时进程按优先级严格抢占、同级轮转；公平进程按加权虚拟运行时间
+ * 分享CPU，优先级映射为nice值（PROCESS_PRIORITY_NORMAL对应nice 0）
+ */
+#define PROCESS_POLICY_RT       0
+#define PROCESS_POLICY_FAIR     1
+#define PROCESS_POLICY_IDLE     2   /* 处理器空闲进程，不进入运行队列 */
+
+/**
+ * 用户空间起始（低端1GB是引导恒等映射，内核映像在其中运行）
+ */
+#define PROCESS_USER_BASE       0x40000000
+
+/**
+ * 用户栈（只预留地址范围，按需分配）
  */
-#define PROCESS_PRIORITY_HIGH   0
-#define PROCESS_PRIORITY_NORMAL 1
-#define PROCESS_PRIORITY_LOW    2
+#define PROCESS_USER_STACK_TOP  0xC0000000  /* 用户空间顶端 */
+#define PROCESS_USER_STACK_SIZE 0x00800000  /* 8MB */
 
 /**
  * 进程结构
@@ -31,7 +56,7 @@ typedef struct process {
     uint32_t ppid;
     uint32_t state;
     uint32_t priority;
-    uint32_t esp;
+    uintptr_t esp;              /* 切出时保存的内核栈指针 */
     uint32_t ebp;
     uint32_t eip;
     uint32_t eax;
@@ -41,10 +66,32 @@ typedef struct process {
     uint32_t esi;
     uint32_t edi;
     uint32_t flags;
-    uint32_t cr3;
-    uint32_t sleep_ticks;
+    uintptr_t cr3;              /* 用户地址空间页表根（vm.h），0表示内核线程 */
+    uintptr_t kstack;           /* 内核栈起始地址，0表示沿用启动栈 */
+    void (*entry)(void);        /* 内核线程入口 */
+    uint32_t wake_tick;         /* 睡眠到期的时钟滴答 */
+    uint32_t heap_start;        /* 堆起始地址 */
+    uint32_t brk;               /* 当前程序中断点 */
     char name[32];
     struct process *next;
+    struct process *rq_next;    /* 运行队列链表 */
+    struct process *rq_prev;
+    uint32_t on_rq;             /* 是否在运行队列中 */
+    volatile uint32_t on_cpu;   /* 正在某个处理器上运行或尚未完全切出 */
+    uint32_t cpu;               /* 所属处理器，SCHED_CPU_NONE表示尚未分配 */
+    uint32_t policy;            /* PROCESS_POLICY_* */
+    uint32_t weight;            /* 公平调度权重 */
+    uint64_t vruntime;          /* 加权虚拟运行时间 */
+    uint64_t exec_start;        /* 上次记账的时间戳（ns） */
+    uint64_t sum_exec_ns;       /* 累计运行时间（ns） */
+    rb_node_t rb_node;          /* 公平调度树节点 */
+    rb_node_t sleep_node;       /* 睡眠队列节点 */
+    uint32_t on_sleep;          /* 是否在睡眠队列中 */
+    void *fpu_state;            /* FPU/SIMD扩展状态保存区 */
+    uint32_t fpu_cpu;           /* 扩展状态最近一次装入的处理器 */
+    struct process *pid_next;   /* PID哈希表链表 */
+    struct ipc_mailbox *mailbox; /* IPC邮箱 */
+    struct syscall_frame *frame; /* 正在处理的系统调用的现场 */
 } process_t;
 
 /**
@@ -68,16 +115,62 @@ void process_init(void);
  */
 void process_create_init(void);
 
+/**
+ * 为调用它的处理器创建空闲进程并设为当前进程（应用处理器启动时调用）
+ */
+void process_init_cpu(void);
+
 /**
  * 创建新进程
  */
 process_t *process_create(const char *name, uint32_t priority);
 
+/**
+ * 创建从entry开始执行的内核线程，entry返回后线程退出
+ */
+process_t *process_spawn(const char *name, uint32_t priority, void (*entry)(void));
+
+/**
+ * 从内存中的M4LL程序映像创建用户进程，段按vaddr装入新的地址空间，
+ * 从entry_point开始执行。进程创建后处于阻塞状态，由调用者process_wakeup
+ * @return 成功返回进程，映像无效或内存不足返回NULL
+ */
+process_t *process_create_user(const char *name, uint32_t priority,
+                               const void *image, uint32_t size);
+
+/**
+ * 复制正在执行系统调用的用户进程：子进程与父进程写时复制地共享用户页，
+ * 从父进程系统调用现场的副本返回用户态，返回值为0
+ * @return 成功返回子进程，不是用户进程或内存不足返回NULL
+ */
+process_t *process_fork(process_t *parent);
+
+/**
+ * 用程序映像替换正在执行系统调用的用户进程的地址空间，系统调用返回时
+ * 从新映像的入口开始执行
+ * @return 成功返回0，映像无效或内存不足返回-1（原地址空间不变）
+ */
+int32_t process_exec(process_t *process, const void *image, uint32_t size);
+
 /**
  * 销毁进程
  */
 void process_destroy(process_t *process);
 
+/**
+ * 建立用户栈和堆（只预留地址范围，首次访问时分配页面），装入程序映像
+ * 后由process_create_user和execve调用
+ * @return 成功返回0，失败返回-1
+ */
+int32_t process_setup_user_memory(process_t *process, uint32_t heap_start);
+
+/**
+ * 把进程的程序中断点移到addr，增长的部分只预留，首次访问时分配
+ * @return 新的中断点；addr不在堆和用户栈之间或预留失败时返回原中断点，
+ *         进程没有用户堆时返回0
+ */
+uint32_t process_brk(process_t *process, uint32_t addr);
+
 /**
  * 获取当前进程
  */
@@ -108,6 +201,14 @@ void process_block(void);
  */
 void process_wakeup(process_t *process);
 
+/**
+ * 当前进程已阻塞，不经过运行队列直接切换到被唤醒的process，剩余时间片
+ * 留给它（调用者关中断）
+ * @return 切换过并已被唤醒返回0；调度器未启动或不能直接切换返回-1，
+ *         此时process没有入队
+ */
+int32_t process_handoff(process_t *process);
+
 /**
  * 睡眠指定毫秒数
  */
@@ -129,10 +230,16 @@ uint32_t process_get_pid(void);
 uint32_t process_get_ppid(void);
 
 /**
- * 设置进程优先级
+ * 设置进程优先级（公平进程的优先级换算为nice权重）
  */
 void process_set_priority(uint32_t priority);
 
+/**
+ * 设置当前进程的调度策略
+ * @return 成功返回0，策略无效返回-1
+ */
+int32_t process_set_policy(uint32_t policy);
+
 /**
  * 获取进程优先级
  */
@@ -159,24 +266,24 @@ uint32_t process_get_count(void);
 void process_switch(void);
 
 /**
- * 保存进程上下文
+ * 锁住PID表（调用者负责关中断）
  */
-void process_save_context(process_t *process);
+void process_table_lock(void);
 
 /**
- * 恢复进程上下文
+ * 解锁PID表
  */
-void process_restore_context(process_t *process);
+void process_table_unlock(void);
 
 /**
- * 进程间通信 - 发送消息
+ * 按PID查找进程（持有PID表锁），不存在返回NULL
  */
-int32_t ipc_send(uint32_t receiver_pid, void *data, uint32_t size, uint32_t type);
+process_t *process_find(uint32_t pid);
 
 /**
- * 进程间通信 - 接收消息
+ * 遍历PID表中的进程（持有PID表锁），process为NULL时返回第一个
  */
-int32_t ipc_receive(uint32_t *sender_pid, void *data, uint32_t *size, uint32_t type);
+process_t *process_next(process_t *process);
 
 /**
  * 切换到指定进程（内部函数）
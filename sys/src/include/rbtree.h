@@ -0,0 +1,75 @@
+/**
+ * M4KK1 Red-Black Tree Header
+ * 侵入式红黑树：节点嵌入在宿主结构中，不分配内存
+ *
+ * 插入时由调用者按自己的键从根向下查找插入位置，再调用rb_insert
+ * 链接并重新着色；根结构缓存最左节点，取最小元素为O(1)。
+ */
+
+#ifndef __RBTREE_H__
+#define __RBTREE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define RB_RED                  0
+#define RB_BLACK                1
+
+/**
+ * 树节点
+ */
+typedef struct rb_node {
+    struct rb_node *parent;
+    struct rb_node *left;
+    struct rb_node *right;
+    uint32_t color;
+} rb_node_t;
+
+/**
+ * 树根
+ */
+typedef struct rb_root {
+    rb_node_t *node;            /* 根节点 */
+    rb_node_t *leftmost;        /* 最小节点 */
+} rb_root_t;
+
+/**
+ * 由节点取得宿主结构
+ */
+#define rb_entry(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+/**
+ * 初始化空树
+ */
+static inline void rb_root_init(rb_root_t *root) {
+    root->node = NULL;
+    root->leftmost = NULL;
+}
+
+/**
+ * 最小节点，空树返回NULL
+ */
+static inline rb_node_t *rb_first(const rb_root_t *root) {
+    return root->leftmost;
+}
+
+/**
+ * 将节点链接到parent的link位置（*link必须为NULL）并重新平衡
+ * @param leftmost 查找路径一直向左时为true
+ */
+void rb_insert(rb_root_t *root, rb_node_t *node, rb_node_t *parent,
+               rb_node_t **link, bool leftmost);
+
+/**
+ * 删除节点
+ */
+void rb_erase(rb_root_t *root, rb_node_t *node);
+
+/**
+ * 中序后继，没有时返回NULL
+ */
+rb_node_t *rb_next(const rb_node_t *node);
+
+#endif /* __RBTREE_H__ */
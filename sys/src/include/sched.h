@@ -0,0 +1,196 @@
+/**
+ * M4KK1 Scheduler Header
+ * 调度器有两个调度类：
+ * - 实时类：每个优先级一条FIFO链表，非空优先级记录在位图中，O(1)选取
+ * - 公平类：按加权虚拟运行时间排序的红黑树，总是运行最落后的进程
+ * 实时进程总是先于公平进程运行。每个处理器一个运行队列，空闲的处理器
+ * 从最忙的队列窃取进程。
+ */
+
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "process.h"
+#include "smp.h"
+
+/**
+ * 进程尚未分配处理器
+ */
+#define SCHED_CPU_NONE          0xFFFFFFFF
+
+/**
+ * 运行队列记录的当前进程优先级：公平进程和空闲排在所有实时优先级之后
+ */
+#define SCHED_PRIORITY_FAIR     PROCESS_PRIORITY_LEVELS
+#define SCHED_PRIORITY_IDLE     (PROCESS_PRIORITY_LEVELS + 1)
+
+/**
+ * nice值范围及nice 0的权重
+ */
+#define SCHED_NICE_MIN          (-20)
+#define SCHED_NICE_MAX          19
+#define SCHED_NICE_0_WEIGHT     1024
+
+/**
+ * 虚拟运行时间单位：纳秒。nice 0进程运行1ns增加1，其他进程按
+ * SCHED_NICE_0_WEIGHT / weight缩放（定点数，小数部分SCHED_WEIGHT_SHIFT位）
+ */
+#define SCHED_WEIGHT_SHIFT      16
+
+/**
+ * 公平类参数（纳秒）
+ * 粒度：当前进程领先最落后的就绪进程超过该值才被抢占，避免频繁切换
+ * 睡眠补偿：唤醒的进程最多落后min_vruntime这么多，既能尽快运行又不能
+ * 靠长时间睡眠积攒CPU时间
+ */
+#define SCHED_FAIR_GRANULARITY  2000000ULL
+#define SCHED_FAIR_SLEEPER_CREDIT 3000000ULL
+
+/**
+ * 运行队列
+ * 实时进程通过process_t中的rq_next/rq_prev链入所在优先级的链表，
+ * 公平进程通过rb_node挂入红黑树，入队、出队和选取都不需要遍历
+ */
+typedef struct run_queue {
+    volatile uint32_t lock;                         /* 自旋锁 */
+    uint32_t bitmap;                                /* bit i置位表示优先级i非空 */
+    uint32_t nr_ready;                              /* 就绪进程数 */
+    uint32_t curr_priority;                         /* 正在运行进程的优先级（SCHED_PRIORITY_*） */
+    uint32_t steals;                                /* 从其他队列窃取的次数 */
+    process_t *head[PROCESS_PRIORITY_LEVELS];       /* 实时类队首（最先入队） */
+    process_t *tail[PROCESS_PRIORITY_LEVELS];       /* 实时类队尾 */
+    rb_root_t fair;                                 /* 公平类，按vruntime排序 */
+    uint32_t nr_fair;                               /* 公平类就绪进程数 */
+    uint64_t min_vruntime;                          /* 公平类虚拟时钟（单调不减） */
+} run_queue_t;
+
+/**
+ * 初始化运行队列
+ */
+void run_queue_init(run_queue_t *rq);
+
+/**
+ * 将进程加入其调度类（实时进程放到其优先级的队尾，公平进程按
+ * vruntime插入树中），已在队列中时忽略
+ */
+void run_queue_enqueue(run_queue_t *rq, process_t *process);
+
+/**
+ * 将进程从队列中移除（不在队列中时忽略）
+ */
+void run_queue_dequeue(run_queue_t *rq, process_t *process);
+
+/**
+ * 取出下一个进程：最高优先级的实时进程，没有时取vruntime最小的公平
+ * 进程；队列为空返回NULL
+ */
+process_t *run_queue_pick(run_queue_t *rq);
+
+/**
+ * 从from中取出一个可以迁移到to的进程：跳过还没离开原处理器内核栈
+ * （on_cpu置位）的进程，实时类优先，公平类取vruntime最小的，vruntime
+ * 换算到to的虚拟时钟。调用者持有from的锁
+ * @return 取出的进程，没有可迁移的进程返回NULL
+ */
+process_t *run_queue_steal(run_queue_t *from, run_queue_t *to);
+
+/**
+ * 队列中是否有比priority（SCHED_PRIORITY_*或实时优先级）更高优先级的进程
+ */
+bool run_queue_preempts(const run_queue_t *rq, uint32_t priority);
+
+/**
+ * 优先级对应的公平调度权重（优先级减PROCESS_PRIORITY_NORMAL为nice值）
+ */
+uint32_t sched_priority_weight(uint32_t priority);
+
+/**
+ * 为公平进程记delta_ns纳秒实际运行时间对应的虚拟运行时间
+ */
+void sched_charge(process_t *process, uint64_t delta_ns);
+
+/**
+ * 初始化所有处理器的运行队列
+ */
+void sched_init(void);
+
+/**
+ * 将进程加入其所属处理器的运行队列（新进程放到最空闲的处理器），
+ * 目标处理器需要抢占时发送重新调度中断
+ */
+void sched_enqueue(process_t *process);
+
+/**
+ * 批量加入运行队列，list是通过rq_next串起的不在队列中的进程
+ */
+void sched_enqueue_list(process_t *list);
+
+/**
+ * 准备把当前处理器直接交给阻塞在本处理器上的进程（不经过运行队列）：
+ * 公平进程按入队规则限制睡眠补偿，并记录为本处理器的当前优先级
+ * @return 可以切换返回true；进程属于其他处理器或队列中有更高优先级的
+ *         进程时返回false，调用者应改用sched_enqueue
+ */
+bool sched_handoff(process_t *process);
+
+/**
+ * 将进程移出运行队列
+ */
+void sched_dequeue(process_t *process);
+
+/**
+ * 取出当前处理器的下一个进程，本地队列为空时从最忙的队列窃取
+ */
+process_t *sched_pick_next(void);
+
+/**
+ * 当前处理器上是否有应当抢占该进程的就绪进程：实时进程比较优先级，
+ * 公平进程比较vruntime
+ */
+bool sched_should_preempt(const process_t *process);
+
+/**
+ * 所有处理器的就绪进程数
+ */
+uint32_t sched_nr_ready(void);
+
+/**
+ * 获取处理器的运行队列
+ */
+run_queue_t *sched_cpu_rq(uint32_t cpu);
+
+/**
+ * 修改进程优先级，在队列中的进程移到新优先级的队尾
+ */
+void sched_set_priority(process_t *process, uint32_t priority);
+
+/**
+ * 修改进程调度策略（PROCESS_POLICY_RT或PROCESS_POLICY_FAIR）
+ * @return 成功返回0，策略无效返回-1
+ */
+int32_t sched_set_policy(process_t *process, uint32_t policy);
+
+/**
+ * 睡眠队列：按唤醒滴答排序的红黑树（滴答按32位回绕比较），进程通过
+ * sleep_node挂入，on_sleep标记是否在队列中。调用者负责加锁
+ */
+
+/**
+ * 按process->wake_tick插入，相同滴答排在已有进程之后
+ */
+void sleep_queue_add(rb_root_t *queue, process_t *process);
+
+/**
+ * 将进程移出睡眠队列（不在队列中时忽略）
+ */
+void sleep_queue_del(rb_root_t *queue, process_t *process);
+
+/**
+ * 取出所有唤醒滴答不晚于now的进程并设为就绪
+ * @return 按唤醒顺序通过rq_next串起的进程，没有到期的返回NULL
+ */
+process_t *sleep_queue_pop_expired(rb_root_t *queue, uint32_t now);
+
+#endif /* __SCHED_H__ */
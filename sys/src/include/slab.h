@@ -0,0 +1,141 @@
+/**
+ * M4KK1 Slab Allocator Header
+ * 按尺寸分级的slab分配器定义
+ */
+
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * kmalloc尺寸范围，超过半页的请求按页分配，保证整页大小的分配页对齐
+ */
+#define SLAB_MIN_SIZE       16
+#define SLAB_MAX_SIZE       2048
+#define SLAB_ALIGN          8
+
+/**
+ * 单个slab的最大阶数（2^3 = 8页）
+ */
+#define SLAB_MAX_ORDER      3
+
+/**
+ * 每个slab期望容纳的最少对象数
+ */
+#define SLAB_MIN_OBJECTS    8
+
+struct kmem_cache;
+
+/**
+ * slab头部（位于slab首页起始处）
+ */
+typedef struct slab {
+    struct kmem_cache *cache;   /* 所属缓存 */
+    struct slab *next;
+    struct slab *prev;
+    void *freelist;             /* 空闲对象单链表 */
+    uint32_t inuse;             /* 已分配对象数 */
+    uint32_t pages;             /* slab占用页数 */
+} slab_t;
+
+/**
+ * 对象构造函数（slab创建时对每个对象调用一次）
+ */
+typedef void (*kmem_ctor_t)(void *object);
+
+/**
+ * 对象缓存
+ */
+typedef struct kmem_cache {
+    volatile uint32_t lock;     /* 自旋锁，保护slab链表和统计 */
+    const char *name;
+    uint32_t object_size;       /* 对象跨度（已对齐） */
+    uint32_t align;             /* 对象对齐 */
+    uint32_t free_offset;       /* 空闲链表指针在对象内的偏移 */
+    uint32_t slab_pages;        /* 每个slab的页数 */
+    uint32_t objects_per_slab;  /* 每个slab的对象数 */
+    uint32_t offset;            /* 首个对象相对slab起始的偏移 */
+    kmem_ctor_t ctor;           /* 可选构造函数 */
+    slab_t *partial;            /* 部分使用的slab */
+    slab_t *full;               /* 已满的slab */
+    slab_t *empty;              /* 空闲的slab（最多保留一个） */
+    uint32_t slab_count;        /* slab总数 */
+    uint32_t active_objects;    /* 已分配对象数 */
+    uint32_t alloc_hits;        /* 无需新建slab的分配次数 */
+    uint32_t alloc_misses;      /* 需要新建slab的分配次数 */
+    struct kmem_cache *next;    /* 全局缓存链表 */
+} kmem_cache_t;
+
+/**
+ * 缓存统计信息
+ */
+typedef struct kmem_cache_stats {
+    uint32_t active_objects;    /* 已分配对象数 */
+    uint32_t total_objects;     /* 所有slab的对象容量 */
+    uint32_t slabs;             /* slab数量 */
+    uint32_t pages;             /* 占用页数 */
+    uint32_t alloc_hits;
+    uint32_t alloc_misses;
+    uint32_t hit_rate;          /* 命中率（百分比） */
+} kmem_cache_stats_t;
+
+/**
+ * 初始化slab分配器和kmalloc尺寸缓存
+ */
+void slab_init(void);
+
+/**
+ * 创建命名对象缓存
+ * @param name 缓存名称（需保持有效）
+ * @param size 对象大小
+ * @param align 对齐要求（0表示默认8字节，必须为2的幂）
+ * @param ctor 可选构造函数，对象释放时应保持已构造状态
+ * @return 缓存指针，失败返回NULL
+ */
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align,
+                                kmem_ctor_t ctor);
+
+/**
+ * 销毁对象缓存（所有对象必须已释放）
+ * @return 成功返回0，仍有活跃对象返回-1
+ */
+int32_t kmem_cache_destroy(kmem_cache_t *cache);
+
+/**
+ * 获取缓存统计信息
+ */
+void kmem_cache_get_stats(const kmem_cache_t *cache, kmem_cache_stats_t *stats);
+
+/**
+ * 从缓存分配一个对象
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache);
+
+/**
+ * 释放对象到缓存（对象必须来自cache，否则panic）
+ */
+void kmem_cache_free(kmem_cache_t *cache, void *object);
+
+/**
+ * 按尺寸分配内核内存（供kmalloc使用）
+ */
+void *slab_kmalloc(size_t size);
+
+/**
+ * 释放slab_kmalloc分配的内存，O(1)定位所属slab
+ */
+void slab_kfree(void *ptr);
+
+/**
+ * 获取slab_kmalloc分配块的可用大小
+ */
+size_t slab_ksize(const void *ptr);
+
+/**
+ * 打印所有缓存的使用情况
+ */
+void slab_dump_stats(void);
+
+#endif /* __SLAB_H__ */
@@ -0,0 +1,34 @@
+/**
+ * M4KK1 SMP Interface
+ * 调度器使用的多处理器接口
+ *
+ * 由架构层实现（x86_64见arch/x86_64/kernel/smp.c）。没有多处理器
+ * 支持的架构使用sched.c中的弱定义：只有0号处理器，不发送处理器间中断。
+ */
+
+#ifndef __SMP_H__
+#define __SMP_H__
+
+#include <stdint.h>
+
+/**
+ * 处理器数量上限（与架构层M4K_MAX_CPUS一致）
+ */
+#define SMP_MAX_CPUS            8
+
+/**
+ * 当前处理器编号
+ */
+uint32_t smp_cpu_id(void);
+
+/**
+ * 已上线的处理器数量
+ */
+uint32_t smp_cpu_count(void);
+
+/**
+ * 请求处理器重新调度（处理器间中断）
+ */
+void smp_send_reschedule(uint32_t cpu);
+
+#endif /* __SMP_H__ */
@@ -10,8 +10,8 @@
 #define NULL ((void *)0)
 
 /* 尺寸类型 */
-typedef unsigned int size_t;
-typedef int ptrdiff_t;
+typedef __SIZE_TYPE__ size_t;
+typedef __PTRDIFF_TYPE__ ptrdiff_t;
 typedef int wchar_t;
 
 /* 偏移量宏 */
@@ -17,9 +17,9 @@ typedef signed short int16_t;
 typedef signed int int32_t;
 typedef signed long long int64_t;
 
-/* 指针类型 */
-typedef uint32_t uintptr_t;
-typedef int32_t intptr_t;
+/* 指针类型（与目标架构的指针等宽） */
+typedef __UINTPTR_TYPE__ uintptr_t;
+typedef __INTPTR_TYPE__ intptr_t;
 
 /* 最小宽度整数类型 */
 typedef uint8_t uint_least8_t;
@@ -83,4 +83,14 @@ char *strstr(const char *haystack, const char *needle);
  */
 char *strdup(const char *s);
 
+/**
+ * 根据CPUID选择内存和字符串函数的实现（按字/SSE2/AVX2）
+ */
+void string_init(void);
+
+/**
+ * 获取当前字符串函数实现名称
+ */
+const char *string_impl_name(void);
+
 #endif /* __STRING_H__ */
\ No newline at end of file
@@ -145,21 +145,53 @@
 #define SYSCALL_DL_FIND_SYMBOL    0x82
 #define SYSCALL_DL_GET_ERROR      0x83
 
+/* 调试相关系统调用 */
+#define SYSCALL_ALLOC_TRACE       0x84
+
+/* 内存建议 */
+#define SYSCALL_MADVISE           0x85
+
+/**
+ * madvise建议
+ */
+#define MADV_NORMAL         0
+#define MADV_MERGEABLE      12      /* 参与相同页合并扫描 */
+#define MADV_UNMERGEABLE    13      /* 退出相同页合并扫描（已合并的页保持共享） */
+
 /**
  * 系统调用返回值
  */
 #define SYSCALL_SUCCESS 0
 #define SYSCALL_ERROR   (-1)
 
+/**
+ * 系统调用现场（isr_syscall按此布局压栈，返回时从这里恢复）
+ */
+typedef struct syscall_frame {
+    uint32_t edi;
+    uint32_t esi;
+    uint32_t ebp;
+    uint32_t esp_dummy;         /* pusha压入的ESP，popa忽略 */
+    uint32_t ebx;               /* 参数1 */
+    uint32_t edx;               /* 参数3 */
+    uint32_t ecx;               /* 参数2 */
+    uint32_t eax;               /* 系统调用号，返回时为返回值 */
+    uint32_t eip;
+    uint32_t cs;
+    uint32_t eflags;
+    uint32_t user_esp;          /* 以下两项只在从用户态进入时存在 */
+    uint32_t user_ss;
+} syscall_frame_t;
+
 /**
  * 初始化系统调用
  */
 void syscall_init(void);
 
 /**
- * 系统调用处理函数
+ * 系统调用处理函数（由isr_syscall调用），返回值写入frame->eax
  */
-void syscall_handler(void);
+void syscall_handler(syscall_frame_t *frame);
 
 /**
  * 注册系统调用处理函数
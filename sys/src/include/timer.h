@@ -24,6 +24,9 @@
 /**
  * PIT命令标志
  */
+#define PIT_SELECT_0    0x00    /* 命令字节的通道选择位 */
+#define PIT_SELECT_2    0x80
+#define PIT_GATE        0x61    /* 系统控制端口B：bit0通道2门控，bit1扬声器，bit5通道2输出 */
 #define PIT_BINARY      0x00
 #define PIT_BCD         0x01
 #define PIT_MODE_0      0x00
@@ -134,21 +137,128 @@ void timer_sleep(uint32_t seconds);
 uint32_t timer_get_cpu_frequency(void);
 
 /**
- * 校准定时器
+ * 校准定时器：用PIT通道2测量TSC频率，TSC不变时切换到TSC时钟源
  */
 void timer_calibrate(void);
 
+/**
+ * 时钟源
+ * CPU支持不变TSC（CPUID 0x80000007 EDX bit 8）时，纳秒时间戳直接由
+ * rdtsc换算：ns = base_ns + ((tsc - base_tsc) * mult) >> shift；
+ * 否则退回按时钟滴答累加，精度为一个滴答
+ */
+#define CLOCK_SOURCE_TICK       0
+#define CLOCK_SOURCE_TSC        1
+
+/**
+ * 校准参数
+ */
+#define CLOCK_CALIBRATE_MS      20      /* 每轮测量时长 */
+#define CLOCK_CALIBRATE_ROUNDS  5       /* 测量轮数，取最小值排除SMI等干扰 */
+
+/**
+ * 64位乘32位再右移shift位（shift <= 32），不需要64位除法
+ */
+static inline uint64_t clock_mul_shift(uint64_t value, uint32_t mult, uint32_t shift) {
+    uint64_t result = ((uint64_t)(uint32_t)value * mult) >> shift;
+    uint32_t high = (uint32_t)(value >> 32);
+
+    if (high) {
+        result += ((uint64_t)high * mult) << (32 - shift);
+    }
+    return result;
+}
+
+/**
+ * 读取单调纳秒时间戳（TSC时钟源下为一次rdtsc加一次乘移位）
+ */
+uint64_t clock_now_ns(void);
+
+/**
+ * 当前时钟源（CLOCK_SOURCE_*）
+ */
+uint32_t clock_get_source(void);
+
+/**
+ * 校准得到的TSC频率（kHz），未校准返回0
+ */
+uint32_t clock_get_tsc_khz(void);
+
+/**
+ * 闹钟数量上限（句柄低位为池索引，必须为2的幂）
+ */
+#define TIMER_MAX_ALARMS        4096
+#define TIMER_ALARM_INDEX_BITS  12
+
+/**
+ * 时间轮：第一级256个槽位每槽一个滴答，之后四级每级64个槽位，
+ * 每级一个槽位覆盖上一级一整圈，共覆盖2^32个滴答
+ */
+#define TIMER_WHEEL_ROOT_BITS   8
+#define TIMER_WHEEL_ROOT_SIZE   (1 << TIMER_WHEEL_ROOT_BITS)
+#define TIMER_WHEEL_LEVEL_BITS  6
+#define TIMER_WHEEL_LEVEL_SIZE  (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_LEVELS      4
+
+/**
+ * 闹钟状态
+ */
+#define TIMER_ALARM_FREE        0
+#define TIMER_ALARM_PENDING     1   /* 在时间轮中等待到期 */
+#define TIMER_ALARM_FIRING      2   /* 单次闹钟正在执行回调 */
+
 /**
  * 定时器闹钟结构
  */
-typedef struct {
-    uint32_t id;              /* 闹钟ID */
-    uint32_t interval_ms;     /* 闹钟间隔（毫秒） */
-    uint32_t remaining_ms;    /* 剩余时间（毫秒） */
-    uint8_t active;           /* 是否激活 */
-    void (*callback)(void);   /* 闹钟回调函数 */
+typedef struct timer_alarm {
+    struct timer_alarm *next;       /* 槽位链表 */
+    struct timer_alarm **pprev;     /* 指向前驱的next（或槽位头），O(1)删除 */
+    uint32_t id;                    /* 句柄：世代号 << TIMER_ALARM_INDEX_BITS | 池索引 */
+    uint32_t expires;               /* 到期时钟滴答 */
+    uint32_t interval;              /* 周期（滴答），0为单次 */
+    uint32_t state;                 /* TIMER_ALARM_* */
+    void (*callback)(void);         /* 无参数回调 */
+    void (*handler)(void *);        /* 带参数回调（优先） */
+    void *data;                     /* handler的参数 */
 } timer_alarm_t;
 
+/**
+ * 分级时间轮
+ */
+typedef struct timer_wheel {
+    uint32_t base;                  /* 下一个要处理的滴答 */
+    uint32_t count;                 /* 轮中的闹钟数 */
+    timer_alarm_t *root[TIMER_WHEEL_ROOT_SIZE];
+    timer_alarm_t *levels[TIMER_WHEEL_LEVELS][TIMER_WHEEL_LEVEL_SIZE];
+} timer_wheel_t;
+
+/**
+ * 初始化时间轮，now为当前滴答
+ */
+void timer_wheel_init(timer_wheel_t *wheel, uint32_t now);
+
+/**
+ * 按alarm->expires放入时间轮（已过期的在下一次推进时到期）
+ */
+void timer_wheel_add(timer_wheel_t *wheel, timer_alarm_t *alarm);
+
+/**
+ * 从时间轮中移除
+ */
+void timer_wheel_del(timer_wheel_t *wheel, timer_alarm_t *alarm);
+
+/**
+ * 距下一次需要推进时间轮还有多少滴答（从base算起，最多limit）
+ * 高级槽位按其下放时刻计算，结果不晚于最早的到期时间
+ */
+uint32_t timer_wheel_next_expiry(const timer_wheel_t *wheel, uint32_t limit);
+
+/**
+ * 推进到now并取出一个已到期的闹钟，没有时返回NULL
+ * 逐个取出，回调中增删闹钟不影响后续推进；跨越一圈时逐级下放
+ */
+timer_alarm_t *timer_wheel_expire(timer_wheel_t *wheel, uint32_t now);
+
 /**
  * 注册定时器中断处理函数
  * @param handler 中断处理函数指针
@@ -156,7 +266,7 @@ typedef struct {
 void timer_register_handler(void (*handler)(void));
 
 /**
- * 创建定时器闹钟
+ * 创建周期性定时器闹钟
  * @param interval_ms 闹钟间隔（毫秒）
  * @param callback 闹钟回调函数
  * @return 闹钟ID，失败返回0
@@ -164,14 +274,61 @@ void timer_register_handler(void (*handler)(void));
 uint32_t timer_create_alarm(uint32_t interval_ms, void (*callback)(void));
 
 /**
- * 销毁定时器闹钟
+ * 创建带参数的定时器闹钟（在时钟中断中回调）
+ * @param delay_ms 首次到期时间（毫秒）
+ * @param interval_ms 周期（毫秒），0为单次
+ * @param handler 回调函数
+ * @param data 回调参数
+ * @return 闹钟ID，失败返回0
+ */
+uint32_t timer_add(uint32_t delay_ms, uint32_t interval_ms, void (*handler)(void *), void *data);
+
+/**
+ * 创建在deadline滴答到期的单次闹钟（deadline已过去时在下一个滴答到期）
+ * @return 闹钟ID，失败返回0
+ */
+uint32_t timer_add_at(uint32_t deadline, void (*handler)(void *), void *data);
+
+/**
+ * 毫秒换算为时钟滴答（向上取整，至少1个滴答）
+ */
+uint32_t timer_ms_to_ticks(uint32_t milliseconds);
+
+/**
+ * 销毁定时器闹钟（O(1)，过期或已被复用的句柄返回-1）
  * @param alarm_id 闹钟ID
  * @return 成功返回0，失败返回-1
  */
 int32_t timer_destroy_alarm(uint32_t alarm_id);
 
 /**
- * 获取纳秒级时间戳
+ * 定时器统计
+ */
+typedef struct timer_stats {
+    uint32_t interrupts;      /* 时钟中断次数 */
+    uint32_t oneshots;        /* 空闲时改用单次截止时间的次数 */
+    uint32_t skipped_ticks;   /* 空闲期间省掉的时钟中断数 */
+    uint8_t dynamic;          /* 是否启用动态时钟 */
+} timer_stats_t;
+
+/**
+ * 启用或关闭动态时钟（空闲时停止周期时钟，按下一个闹钟设置单次截止时间）
+ */
+void timer_set_dynamic(uint8_t enable);
+
+/**
+ * 空闲等待：调用者已关中断，返回时中断已打开
+ * 动态时钟模式下睡到下一个闹钟到期或其他中断到来
+ */
+void timer_idle(void);
+
+/**
+ * 获取定时器统计
+ */
+void timer_get_stats(timer_stats_t *stats);
+
+/**
+ * 获取纳秒级时间戳（同clock_now_ns）
  * @return 当前纳秒级时间戳
  */
 uint64_t timer_get_nanoseconds(void);
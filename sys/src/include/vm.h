@@ -0,0 +1,104 @@
+/**
+ * M4KK1 Address Space Interface
+ * 进程管理、系统调用和IPC使用的用户地址空间操作
+ *
+ * 地址空间用页表根的物理地址表示，0表示没有用户地址空间（内核线程）。
+ * 由架构层实现：i386见arch/m4kk1/vm.c（两级页表，内核恒等映射低1GB），
+ * x86_64见arch/x86_64/mm/vm.c（转到mm/memory.c中的m4k_*实现）。
+ * 共享的内核代码只通过这里访问用户地址空间，不直接调用某个架构的页表函数。
+ */
+
+#ifndef __VM_H__
+#define __VM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * 缺页错误码（两种架构的硬件错误码相同）
+ */
+#define VM_FAULT_PRESENT        0x01    /* 页面存在（保护错误） */
+#define VM_FAULT_WRITE          0x02    /* 写访问 */
+#define VM_FAULT_USER           0x04    /* 用户态访问 */
+
+/**
+ * 页面授予方式（与M4K_GRANT_*一致）
+ */
+#define VM_GRANT_READ           0       /* 接收方只读映射同一页帧，发送方不变 */
+#define VM_GRANT_COW            1       /* 双方写时复制 */
+#define VM_GRANT_MOVE           2       /* 页帧转给接收方，发送方撤销映射 */
+
+/**
+ * 启用分页并建立内核映射（i386在memory_init之后调用；x86_64引导时已启用）
+ */
+void vm_init(void);
+
+/**
+ * 创建空的用户地址空间（共享内核映射）
+ * @return 页表根物理地址，内存不足返回0
+ */
+uintptr_t vm_space_create(void);
+
+/**
+ * 复制用户地址空间，可写页改为双方写时复制，子地址空间继承相同页合并登记
+ * @return 子地址空间，内存不足或相同页合并登记已满时返回0
+ */
+uintptr_t vm_space_fork(uintptr_t space);
+
+/**
+ * 销毁用户地址空间，释放页表和不再共享的页帧
+ */
+void vm_space_destroy(uintptr_t space);
+
+/**
+ * 切换到地址空间，0表示只有内核映射
+ */
+void vm_space_switch(uintptr_t space);
+
+/**
+ * 预留按需分配的匿名内存区域，页面在首次访问时分配并清零
+ * @param flags 页面标志（PAGE_READWRITE、PAGE_USER）
+ * @return 成功返回0，地址未对齐、越出用户空间或与已有区域重叠返回-1
+ */
+int32_t vm_reserve(uintptr_t space, uintptr_t start, uintptr_t size, uint32_t flags);
+
+/**
+ * 释放匿名内存区域并撤销已分配页面的映射
+ */
+void vm_release(uintptr_t space, uintptr_t start, uintptr_t size);
+
+/**
+ * 虚拟地址对应的物理地址（含页内偏移），未映射返回0
+ */
+uintptr_t vm_translate(uintptr_t space, uintptr_t virtual_addr);
+
+/**
+ * 物理页帧在内核中的访问地址
+ */
+void *vm_phys_to_virt(uintptr_t physical_addr);
+
+/**
+ * 处理缺页（按需分配、写时复制）
+ * @param error_code VM_FAULT_*
+ * @return 已处理返回0，否则返回-1
+ */
+int32_t vm_handle_fault(uintptr_t space, uintptr_t fault_addr, uint32_t error_code);
+
+/**
+ * 把src_space中[src, src+size)的页面映射到dst_space的dst处（零拷贝IPC）
+ * 发送方预留区域内尚未分配的页先分配，接收方的目标范围必须未映射；
+ * 接收方用vm_release撤销映射
+ * @param mode VM_GRANT_*
+ * @return 成功返回0，失败返回-1（两个地址空间都不变）
+ */
+int32_t vm_grant(uintptr_t src_space, uintptr_t src, uintptr_t dst_space, uintptr_t dst,
+                 uintptr_t size, uint32_t mode);
+
+/**
+ * 将地址空间加入/移出相同页合并扫描
+ * @return 成功返回0，架构不支持或登记已满返回-1
+ */
+int32_t vm_ksm_register(uintptr_t space);
+void vm_ksm_unregister(uintptr_t space);
+
+#endif /* __VM_H__ */
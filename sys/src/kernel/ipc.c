@@ -0,0 +1,894 @@
+/**
+ * M4KK1 IPC Implementation
+ * 进程邮箱实现
+ *
+ * 邮箱的消息槽是固定数组，用单字节下标串成三种链表：空闲链表、按到达
+ * 顺序的双向链表、按type哈希的子队列双向链表。同一type的消息在子队列
+ * 中保持到达顺序，所以最早到达的消息也是它所在子队列的队首，两种取法
+ * 都是O(1)；只有哈希冲突的不同type才会在子队列中越过几条消息。
+ *
+ * 锁顺序：PID表锁 -> 邮箱锁 -> 运行队列锁。发送者在PID表锁下找到接收者
+ * 并锁住邮箱后就释放PID表锁，复制消息时不阻塞其他进程的发送。销毁进程
+ * 先从PID表中移除再获取一次邮箱锁，确保已经找到它的发送者都已离开。
+ * 唤醒接收者在释放邮箱锁之后进行。
+ *
+ * 同步调用先在自己的邮箱上登记等待回复，再投递请求。服务进程正阻塞在
+ * 本处理器上时直接切换过去，它回复时调用者同样在等待，于是一次往返只
+ * 有两次进程切换，不经过运行队列，也不用等时钟滴答。只在同一处理器上
+ * 直接切换：阻塞在其他处理器上的进程可能还没有切出。
+ *
+ * 页面授予在接收方邮箱锁下预留一个消息槽和授予窗口中的一段，释放锁后
+ * 再修改页表（可能要等其他处理器确认TLB失效），最后加锁投递ipc_grant_t。
+ * 销毁进程释放邮箱时等待这样的授予结束，之后才销毁地址空间；授予窗口的
+ * 占用记录在邮箱中，随邮箱一起释放。
+ */
+
+#include "ipc.h"
+#include "process.h"
+#include "sched.h"
+#include "slab.h"
+#include "memory.h"
+#include "vm.h"
+#include "kernel.h"
+#include "arch.h"
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 邮箱对象缓存 */
+static kmem_cache_t *ipc_cache = NULL;
+static ipc_stats_t ipc_stats;
+
+static inline void ipc_lock(ipc_mailbox_t *mailbox) {
+    while (__sync_lock_test_and_set(&mailbox->lock, 1)) {
+        while (mailbox->lock) {
+            __asm__ volatile ("pause");
+        }
+    }
+}
+
+static inline void ipc_unlock(ipc_mailbox_t *mailbox) {
+    __sync_lock_release(&mailbox->lock);
+}
+
+static inline uint64_t ipc_rdtsc(void) {
+    uint32_t low, high;
+    __asm__ volatile ("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline uint32_t ipc_type_queue(uint32_t type) {
+    return type & (IPC_TYPE_QUEUES - 1);
+}
+
+/**
+ * 清空邮箱：所有槽放入空闲链表
+ */
+static void ipc_mailbox_reset(ipc_mailbox_t *mailbox) {
+    uint32_t i;
+
+    mailbox->lock = 0;
+    mailbox->count = 0;
+    mailbox->waiting = 0;
+    mailbox->wait_type = IPC_TYPE_ANY;
+    mailbox->seq = 0;
+    mailbox->fast_full = 0;
+    memset(mailbox->grant_size, 0, sizeof(mailbox->grant_size));
+    mailbox->grant_busy = 0;
+    mailbox->head = IPC_SLOT_NONE;
+    mailbox->tail = IPC_SLOT_NONE;
+    for (i = 0; i < IPC_TYPE_QUEUES; i++) {
+        mailbox->type_head[i] = IPC_SLOT_NONE;
+        mailbox->type_tail[i] = IPC_SLOT_NONE;
+    }
+    for (i = 0; i < IPC_MAILBOX_SLOTS; i++) {
+        mailbox->slots[i].next = (i + 1 < IPC_MAILBOX_SLOTS) ? (uint8_t)(i + 1) : IPC_SLOT_NONE;
+    }
+    mailbox->free = 0;
+}
+
+/**
+ * 查找匹配type的最早消息，返回槽下标（持有邮箱锁）
+ */
+static uint8_t ipc_mailbox_find(ipc_mailbox_t *mailbox, uint32_t type) {
+    uint8_t index;
+
+    if (type == IPC_TYPE_ANY) {
+        return mailbox->head;
+    }
+
+    index = mailbox->type_head[ipc_type_queue(type)];
+    while (index != IPC_SLOT_NONE && mailbox->slots[index].type != type) {
+        index = mailbox->slots[index].type_next;
+    }
+    return index;
+}
+
+/**
+ * 从两条链表中摘下消息并放回空闲链表（持有邮箱锁）
+ */
+static void ipc_mailbox_remove(ipc_mailbox_t *mailbox, uint8_t index) {
+    ipc_message_t *message = &mailbox->slots[index];
+    uint32_t queue = ipc_type_queue(message->type);
+
+    if (message->prev != IPC_SLOT_NONE) {
+        mailbox->slots[message->prev].next = message->next;
+    } else {
+        mailbox->head = message->next;
+    }
+    if (message->next != IPC_SLOT_NONE) {
+        mailbox->slots[message->next].prev = message->prev;
+    } else {
+        mailbox->tail = message->prev;
+    }
+
+    if (message->type_prev != IPC_SLOT_NONE) {
+        mailbox->slots[message->type_prev].type_next = message->type_next;
+    } else {
+        mailbox->type_head[queue] = message->type_next;
+    }
+    if (message->type_next != IPC_SLOT_NONE) {
+        mailbox->slots[message->type_next].type_prev = message->type_prev;
+    } else {
+        mailbox->type_tail[queue] = message->type_prev;
+    }
+
+    message->next = mailbox->free;
+    mailbox->free = index;
+    mailbox->count--;
+}
+
+/**
+ * 取出匹配type的最早消息（持有邮箱锁）
+ * @return 成功返回0，没有匹配的消息返回-1
+ */
+static int32_t ipc_mailbox_take(ipc_mailbox_t *mailbox, uint32_t type, uint32_t *sender_pid,
+                                void *data, uint32_t *size) {
+    ipc_message_t *message;
+    uint8_t index;
+
+    index = ipc_mailbox_find(mailbox, type);
+
+    /* 接收者等待某个type时，其他type的消息可能早于快速路径消息到达，按序号比较 */
+    if (mailbox->fast_full && (type == IPC_TYPE_ANY || mailbox->fast_type == type) &&
+        (index == IPC_SLOT_NONE ||
+         (int32_t)(mailbox->fast_seq - mailbox->slots[index].seq) < 0)) {
+        if (sender_pid) *sender_pid = mailbox->fast_sender;
+        *size = (mailbox->fast_size < *size) ? mailbox->fast_size : *size;
+        memcpy(data, mailbox->fast_data, *size);
+        mailbox->fast_full = 0;
+        return 0;
+    }
+
+    if (index == IPC_SLOT_NONE) {
+        return -1;
+    }
+
+    message = &mailbox->slots[index];
+    if (sender_pid) *sender_pid = message->sender_pid;
+    *size = (message->size < *size) ? message->size : *size;
+    memcpy(data, message->data, *size);
+    ipc_mailbox_remove(mailbox, index);
+    return 0;
+}
+
+/**
+ * ipc_deliver能否放下一条size字节、type类型的消息（持有邮箱锁）
+ */
+static bool ipc_mailbox_has_room(ipc_mailbox_t *mailbox, uint32_t size, uint32_t type) {
+    bool wanted = mailbox->waiting &&
+                  (mailbox->wait_type == IPC_TYPE_ANY || mailbox->wait_type == type);
+
+    return mailbox->free != IPC_SLOT_NONE ||
+           (wanted && size <= IPC_FAST_SIZE && !mailbox->fast_full);
+}
+
+/**
+ * 把消息放入receiver的邮箱（持有邮箱锁）。接收者在等待匹配的type时
+ * 标记为就绪并通过wake返回，由调用者释放锁后唤醒或直接切换过去；
+ * 这时不超过IPC_FAST_SIZE的消息不占用消息槽
+ * @return 成功返回0，邮箱已满返回-1
+ */
+static int32_t ipc_deliver(process_t *receiver, uint32_t sender_pid, const void *data,
+                           uint32_t size, uint32_t type, process_t **wake) {
+    ipc_mailbox_t *mailbox = receiver->mailbox;
+    ipc_message_t *message;
+    uint32_t queue = ipc_type_queue(type);
+    bool wanted = mailbox->waiting &&
+                  (mailbox->wait_type == IPC_TYPE_ANY || mailbox->wait_type == type);
+    uint8_t index;
+
+    *wake = NULL;
+
+    if (wanted && size <= IPC_FAST_SIZE && !mailbox->fast_full) {
+        mailbox->fast_sender = sender_pid;
+        mailbox->fast_type = type;
+        mailbox->fast_size = size;
+        mailbox->fast_seq = mailbox->seq++;
+        memcpy(mailbox->fast_data, data, size);
+        mailbox->fast_full = 1;
+        ipc_stats.fast++;
+    } else {
+        index = mailbox->free;
+        if (index == IPC_SLOT_NONE) {
+            return -1;
+        }
+
+        message = &mailbox->slots[index];
+        mailbox->free = message->next;
+        message->sender_pid = sender_pid;
+        message->type = type;
+        message->size = size;
+        message->seq = mailbox->seq++;
+        memcpy(message->data, data, size);
+
+        message->next = IPC_SLOT_NONE;
+        message->prev = mailbox->tail;
+        if (mailbox->tail != IPC_SLOT_NONE) {
+            mailbox->slots[mailbox->tail].next = index;
+        } else {
+            mailbox->head = index;
+        }
+        mailbox->tail = index;
+
+        message->type_next = IPC_SLOT_NONE;
+        message->type_prev = mailbox->type_tail[queue];
+        if (mailbox->type_tail[queue] != IPC_SLOT_NONE) {
+            mailbox->slots[mailbox->type_tail[queue]].type_next = index;
+        } else {
+            mailbox->type_head[queue] = index;
+        }
+        mailbox->type_tail[queue] = index;
+        mailbox->count++;
+        ipc_stats.queued++;
+    }
+
+    if (wanted) {
+        mailbox->waiting = 0;
+        if (receiver->state == PROCESS_STATE_BLOCKED) {
+            receiver->state = PROCESS_STATE_READY;
+            *wake = receiver;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * 经运行队列唤醒ipc_deliver标记为就绪的接收者
+ */
+static void ipc_wake(process_t *process) {
+    if (process) {
+        sched_enqueue(process);
+        ipc_stats.wakeups++;
+    }
+}
+
+/**
+ * 初始化IPC
+ */
+void ipc_init(void) {
+    if (!ipc_cache) {
+        ipc_cache = kmem_cache_create("ipc_mailbox", sizeof(ipc_mailbox_t), 0, NULL);
+        if (!ipc_cache) {
+            panic("Failed to create IPC mailbox cache");
+        }
+    }
+}
+
+/**
+ * 为进程分配邮箱
+ */
+int32_t ipc_mailbox_alloc(process_t *process) {
+    ipc_mailbox_t *mailbox;
+
+    if (!process || !ipc_cache) {
+        return -1;
+    }
+
+    mailbox = (ipc_mailbox_t *)kmem_cache_alloc(ipc_cache);
+    if (!mailbox) {
+        return -1;
+    }
+
+    ipc_mailbox_reset(mailbox);
+    process->mailbox = mailbox;
+    return 0;
+}
+
+/**
+ * 释放进程的邮箱
+ */
+void ipc_mailbox_free(process_t *process) {
+    ipc_mailbox_t *mailbox;
+    uintptr_t flags;
+
+    if (!process || !process->mailbox) {
+        return;
+    }
+
+    /* 等待在PID表移除之前找到该进程的发送者投递完成 */
+    mailbox = process->mailbox;
+    flags = arch_irq_save();
+    ipc_lock(mailbox);
+    process->mailbox = NULL;
+    ipc_unlock(mailbox);
+    arch_irq_restore(flags);
+
+    /* 已经占用授予窗口的授予还在修改这个地址空间，等它们撤销或投递完成 */
+    while (mailbox->grant_busy) {
+        __asm__ volatile ("pause");
+    }
+
+    kmem_cache_free(ipc_cache, mailbox);
+}
+
+/**
+ * 发送消息
+ */
+int32_t ipc_send(uint32_t receiver_pid, void *data, uint32_t size, uint32_t type) {
+    process_t *sender = process_get_current();
+    uint32_t sender_pid = sender ? sender->pid : 0;
+    process_t *receiver, *wake;
+    uintptr_t flags;
+    int32_t result = -1;
+
+    /* 回复只能经ipc_reply_wait发出，否则可以冒充服务进程结束别人的ipc_call */
+    if (size > IPC_MESSAGE_SIZE || !data || type == IPC_TYPE_REPLY) {
+        return -1;
+    }
+
+    flags = arch_irq_save();
+    process_table_lock();
+
+    if (receiver_pid == IPC_PID_BROADCAST) {
+        /* 广播：每个邮箱各有一份，任意一个投递成功即算成功 */
+        for (receiver = process_next(NULL); receiver; receiver = process_next(receiver)) {
+            if (receiver == sender || !receiver->mailbox) {
+                continue;
+            }
+            ipc_lock(receiver->mailbox);
+            if (ipc_deliver(receiver, sender_pid, data, size, type, &wake) == 0) {
+                result = 0;
+            }
+            ipc_unlock(receiver->mailbox);
+            ipc_wake(wake);
+        }
+        process_table_unlock();
+        arch_irq_restore(flags);
+        return result;
+    }
+
+    receiver = process_find(receiver_pid);
+    if (!receiver || !receiver->mailbox) {
+        process_table_unlock();
+        arch_irq_restore(flags);
+        return -1;
+    }
+
+    ipc_lock(receiver->mailbox);
+    process_table_unlock();
+    result = ipc_deliver(receiver, sender_pid, data, size, type, &wake);
+    ipc_unlock(receiver->mailbox);
+    ipc_wake(wake);
+    arch_irq_restore(flags);
+
+    return result;
+}
+
+/**
+ * 撤销当前进程在邮箱上的等待（没有被唤醒时）
+ */
+static void ipc_cancel_wait(process_t *process) {
+    uintptr_t flags = arch_irq_save();
+
+    ipc_lock(process->mailbox);
+    if (process->mailbox->waiting) {
+        process->mailbox->waiting = 0;
+        process->state = PROCESS_STATE_RUNNING;
+    }
+    ipc_unlock(process->mailbox);
+    arch_irq_restore(flags);
+}
+
+/**
+ * 先登记等待wait_type的消息，再把消息投递给receiver_pid；接收者正阻塞
+ * 在本处理器上时直接切换过去。返回时消息可能已经到达，也可能还要由
+ * ipc_receive_common阻塞等待
+ * @return 投递成功返回0，失败返回-1（已撤销等待）
+ */
+static int32_t ipc_send_wait(uint32_t receiver_pid, void *data, uint32_t size, uint32_t type,
+                             uint32_t wait_type) {
+    process_t *self = process_get_current();
+    ipc_mailbox_t *mailbox = self->mailbox;
+    process_t *receiver, *wake = NULL;
+    uintptr_t flags;
+    int32_t result = -1;
+
+    flags = arch_irq_save();
+
+    ipc_lock(mailbox);
+    if (!(mailbox->fast_full && mailbox->fast_type == wait_type) &&
+        ipc_mailbox_find(mailbox, wait_type) == IPC_SLOT_NONE) {
+        mailbox->waiting = 1;
+        mailbox->wait_type = wait_type;
+        self->state = PROCESS_STATE_BLOCKED;
+    }
+    ipc_unlock(mailbox);
+
+    process_table_lock();
+    receiver = process_find(receiver_pid);
+    if (receiver && receiver != self && receiver->mailbox) {
+        ipc_lock(receiver->mailbox);
+        process_table_unlock();
+        result = ipc_deliver(receiver, self->pid, data, size, type, &wake);
+        ipc_unlock(receiver->mailbox);
+    } else {
+        process_table_unlock();
+    }
+
+    if (result != 0) {
+        arch_irq_restore(flags);
+        ipc_cancel_wait(self);
+        return -1;
+    }
+
+    /* 保持关中断直到切换，否则时钟中断可能先切走，已标记就绪的接收者无人入队 */
+    if (wake) {
+        if (process_handoff(wake) == 0) {
+            ipc_stats.handoffs++;
+        } else {
+            ipc_wake(wake);
+        }
+    }
+
+    arch_irq_restore(flags);
+    return 0;
+}
+
+/**
+ * 从当前进程的邮箱取出匹配的消息，block为true时没有消息就阻塞
+ */
+static int32_t ipc_receive_common(uint32_t *sender_pid, void *data, uint32_t *size,
+                                  uint32_t type, bool block) {
+    process_t *process = process_get_current();
+    ipc_mailbox_t *mailbox;
+    uintptr_t flags;
+
+    if (!data || !size || !process || !process->mailbox) {
+        return -1;
+    }
+    mailbox = process->mailbox;
+
+    while (1) {
+        flags = arch_irq_save();
+        ipc_lock(mailbox);
+
+        if (ipc_mailbox_take(mailbox, type, sender_pid, data, size) == 0) {
+            ipc_unlock(mailbox);
+            arch_irq_restore(flags);
+            return 0;
+        }
+
+        if (!block) {
+            ipc_unlock(mailbox);
+            arch_irq_restore(flags);
+            return -1;
+        }
+
+        /* 阻塞的接收者不进入阻塞队列，由发送者直接放回运行队列 */
+        mailbox->waiting = 1;
+        mailbox->wait_type = type;
+        process->state = PROCESS_STATE_BLOCKED;
+        ipc_unlock(mailbox);
+        arch_irq_restore(flags);
+
+        process_schedule();
+
+        /* 调度器未启动时process_schedule直接返回，无法等待 */
+        if (process->state == PROCESS_STATE_BLOCKED) {
+            ipc_cancel_wait(process);
+            return -1;
+        }
+    }
+}
+
+/**
+ * 接收消息（阻塞）
+ */
+int32_t ipc_receive(uint32_t *sender_pid, void *data, uint32_t *size, uint32_t type) {
+    return ipc_receive_common(sender_pid, data, size, type, true);
+}
+
+/**
+ * 接收消息（不阻塞）
+ */
+int32_t ipc_try_receive(uint32_t *sender_pid, void *data, uint32_t *size, uint32_t type) {
+    return ipc_receive_common(sender_pid, data, size, type, false);
+}
+
+/**
+ * 同步调用
+ */
+int32_t ipc_call(uint32_t server_pid, void *data, uint32_t size, uint32_t type,
+                 void *reply, uint32_t *reply_size) {
+    process_t *process = process_get_current();
+
+    if (!data || size > IPC_MESSAGE_SIZE || !reply || !reply_size ||
+        type == IPC_TYPE_REPLY || !process || !process->mailbox) {
+        return -1;
+    }
+
+    if (ipc_send_wait(server_pid, data, size, type, IPC_TYPE_REPLY) != 0) {
+        return -1;
+    }
+    return ipc_receive_common(NULL, reply, reply_size, IPC_TYPE_REPLY, true);
+}
+
+/**
+ * 回复并等待下一个请求
+ */
+int32_t ipc_reply_wait(uint32_t client_pid, void *reply, uint32_t reply_size,
+                       uint32_t *sender_pid, void *data, uint32_t *size, uint32_t type) {
+    process_t *process = process_get_current();
+
+    if (!data || !size || !process || !process->mailbox) {
+        return -1;
+    }
+
+    if (client_pid) {
+        if (!reply || reply_size > IPC_MESSAGE_SIZE ||
+            ipc_send_wait(client_pid, reply, reply_size, IPC_TYPE_REPLY, type) != 0) {
+            return -1;
+        }
+    }
+    return ipc_receive_common(sender_pid, data, size, type, true);
+}
+
+/**
+ * 在授予窗口中找一段size字节的空闲范围并记录（持有邮箱锁）
+ * @return 起始地址，窗口或记录已满返回0
+ */
+static uint32_t ipc_grant_reserve(ipc_mailbox_t *mailbox, uint32_t size) {
+    uint32_t addr = IPC_GRANT_BASE;
+    uint32_t slot = IPC_MAX_GRANTS;
+    bool moved = true;
+    uint32_t i;
+
+    for (i = 0; i < IPC_MAX_GRANTS; i++) {
+        if (!mailbox->grant_size[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot == IPC_MAX_GRANTS) {
+        return 0;
+    }
+
+    /* 首次适配：与已占用范围重叠就移到它后面，直到不再移动 */
+    while (moved) {
+        moved = false;
+        if (size > IPC_GRANT_SIZE || addr - IPC_GRANT_BASE > IPC_GRANT_SIZE - size) {
+            return 0;
+        }
+        for (i = 0; i < IPC_MAX_GRANTS; i++) {
+            if (mailbox->grant_size[i] &&
+                addr < mailbox->grant_addr[i] + mailbox->grant_size[i] &&
+                mailbox->grant_addr[i] < addr + size) {
+                addr = mailbox->grant_addr[i] + mailbox->grant_size[i];
+                moved = true;
+            }
+        }
+    }
+
+    mailbox->grant_addr[slot] = addr;
+    mailbox->grant_size[slot] = size;
+    return addr;
+}
+
+/**
+ * 授予窗口中从addr开始的记录（持有邮箱锁）
+ * @return 记录的下标，没有找到返回IPC_MAX_GRANTS
+ */
+static uint32_t ipc_grant_find(ipc_mailbox_t *mailbox, uint32_t addr) {
+    uint32_t i;
+
+    for (i = 0; i < IPC_MAX_GRANTS; i++) {
+        if (mailbox->grant_size[i] && mailbox->grant_addr[i] == addr) {
+            break;
+        }
+    }
+    return i;
+}
+
+/**
+ * 释放授予窗口中从addr开始的记录（持有邮箱锁）
+ */
+static void ipc_grant_unreserve(ipc_mailbox_t *mailbox, uint32_t addr) {
+    uint32_t i = ipc_grant_find(mailbox, addr);
+
+    if (i < IPC_MAX_GRANTS) {
+        mailbox->grant_size[i] = 0;
+    }
+}
+
+/**
+ * 页面授予
+ */
+int32_t ipc_grant(uint32_t receiver_pid, void *addr, uint32_t size, uint32_t mode,
+                  uint32_t type) {
+    process_t *sender = process_get_current();
+    process_t *receiver, *wake = NULL;
+    ipc_mailbox_t *mailbox;
+    ipc_grant_t grant;
+    uintptr_t flags, space;
+    uint32_t offset;
+    uint8_t slot;
+    int32_t result = -1;
+    bool mapped;
+
+    size = (size + PAGE_SIZE - 1) & PAGE_MASK;
+    if (!sender || !sender->cr3 || size == 0 || size > IPC_GRANT_SIZE ||
+        ((uintptr_t)addr & (PAGE_SIZE - 1)) || (uintptr_t)addr + size < (uintptr_t)addr ||
+        mode > VM_GRANT_MOVE || type == IPC_TYPE_REPLY) {
+        return -1;
+    }
+
+    /* 按需分配的页在加锁之前补齐，分配和清零不在关中断时进行 */
+    for (offset = 0; offset < size; offset += PAGE_SIZE) {
+        if (!vm_translate(sender->cr3, (uintptr_t)addr + offset) &&
+            vm_handle_fault(sender->cr3, (uintptr_t)addr + offset, 0) != 0) {
+            return -1;
+        }
+    }
+
+    flags = arch_irq_save();
+    process_table_lock();
+    receiver = process_find(receiver_pid);
+    if (!receiver || receiver == sender || !receiver->mailbox ||
+        !receiver->cr3 || receiver->cr3 == sender->cr3) {
+        process_table_unlock();
+        arch_irq_restore(flags);
+        return -1;
+    }
+    mailbox = receiver->mailbox;
+    space = receiver->cr3;
+    ipc_lock(mailbox);
+    process_table_unlock();
+
+    /* 先占用一个消息槽和授予窗口中的一段，映射之后通知消息一定放得下，
+     * 转移的页面不会因为邮箱满了而丢失 */
+    slot = mailbox->free;
+    grant.addr = (slot != IPC_SLOT_NONE) ? ipc_grant_reserve(mailbox, size) : 0;
+    grant.size = size;
+    grant.mode = mode;
+    if (!grant.addr) {
+        ipc_unlock(mailbox);
+        arch_irq_restore(flags);
+        return -1;
+    }
+    mailbox->free = mailbox->slots[slot].next;
+    __sync_fetch_and_add(&mailbox->grant_busy, 1);
+    ipc_unlock(mailbox);
+
+    /* 修改页表和TLB失效不持有邮箱锁，其他发送者不用等待 */
+    mapped = vm_grant(sender->cr3, (uintptr_t)addr, space, grant.addr, size, mode) == 0;
+
+    ipc_lock(mailbox);
+    mailbox->slots[slot].next = mailbox->free;
+    mailbox->free = slot;
+    if (mapped && receiver->mailbox == mailbox &&
+        ipc_deliver(receiver, sender->pid, &grant, sizeof(grant), type, &wake) == 0) {
+        ipc_stats.grants++;
+        ipc_stats.granted_pages += size / PAGE_SIZE;
+        result = 0;
+    }
+    ipc_unlock(mailbox);
+
+    if (result != 0) {
+        /* 映射失败或接收方正在销毁：撤销映射后再让出授予窗口 */
+        if (mapped) {
+            vm_release(space, grant.addr, size);
+        }
+        ipc_lock(mailbox);
+        ipc_grant_unreserve(mailbox, grant.addr);
+        ipc_unlock(mailbox);
+    }
+
+    ipc_wake(wake);
+    __sync_fetch_and_sub(&mailbox->grant_busy, 1);
+    arch_irq_restore(flags);
+    return result;
+}
+
+/**
+ * 撤销授予
+ */
+int32_t ipc_grant_release(uint32_t addr) {
+    process_t *process = process_get_current();
+    uintptr_t flags;
+    uint32_t size = 0;
+    uint32_t i;
+
+    if (!process || !process->mailbox || !process->cr3) {
+        return -1;
+    }
+
+    flags = arch_irq_save();
+    ipc_lock(process->mailbox);
+    i = ipc_grant_find(process->mailbox, addr);
+    if (i < IPC_MAX_GRANTS) {
+        size = process->mailbox->grant_size[i];
+    }
+    ipc_unlock(process->mailbox);
+
+    /* 先撤销映射再让出窗口，新的授予不会落在还没撤销的范围上 */
+    if (size) {
+        vm_release(process->cr3, addr, size);
+        ipc_lock(process->mailbox);
+        ipc_grant_unreserve(process->mailbox, addr);
+        ipc_unlock(process->mailbox);
+    }
+    arch_irq_restore(flags);
+
+    return size ? 0 : -1;
+}
+
+/**
+ * 获取统计信息
+ */
+void ipc_get_stats(ipc_stats_t *stats) {
+    if (stats) {
+        *stats = ipc_stats;
+    }
+}
+
+/**
+ * 一次往返：client把请求投递给server，server取出后回复，client取出回复。
+ * fast为true时投递前对方已在等待，走快速路径
+ */
+static int32_t ipc_bench_round(process_t *client, process_t *server, uint32_t round, bool fast) {
+    uint32_t message[4] = { round, 0, 0, 0 };
+    uint32_t buffer[4];
+    uint32_t size;
+    process_t *wake;
+    int32_t result;
+
+    if (fast) {
+        server->mailbox->waiting = 1;
+        server->mailbox->wait_type = 1;
+        server->state = PROCESS_STATE_BLOCKED;
+    }
+    ipc_lock(server->mailbox);
+    result = ipc_deliver(server, client->pid, message, sizeof(message), 1, &wake);
+    ipc_unlock(server->mailbox);
+
+    size = sizeof(buffer);
+    ipc_lock(server->mailbox);
+    result |= ipc_mailbox_take(server->mailbox, 1, NULL, buffer, &size);
+    ipc_unlock(server->mailbox);
+    if (result != 0 || buffer[0] != round || (fast && wake != server)) {
+        return -1;
+    }
+
+    message[0] = ~round;
+    if (fast) {
+        client->mailbox->waiting = 1;
+        client->mailbox->wait_type = IPC_TYPE_REPLY;
+        client->state = PROCESS_STATE_BLOCKED;
+    }
+    ipc_lock(client->mailbox);
+    result = ipc_deliver(client, server->pid, message, sizeof(message), IPC_TYPE_REPLY, &wake);
+    ipc_unlock(client->mailbox);
+
+    size = sizeof(buffer);
+    ipc_lock(client->mailbox);
+    result |= ipc_mailbox_take(client->mailbox, IPC_TYPE_REPLY, NULL, buffer, &size);
+    ipc_unlock(client->mailbox);
+    if (result != 0 || buffer[0] != ~round || (fast && wake != client)) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * 基准测试的服务线程：把每个请求的第一个字取反后回复，由ipc_benchmark销毁
+ */
+static void ipc_bench_server(void) {
+    uint32_t buffer[4];
+    uint32_t client = 0, reply_size = 0, size;
+
+    while (1) {
+        size = sizeof(buffer);
+        if (ipc_reply_wait(client, buffer, reply_size, &client, buffer, &size, 1) != 0) {
+            return;
+        }
+        buffer[0] = ~buffer[0];
+        reply_size = size;
+    }
+}
+
+/**
+ * 对服务线程做rounds次同步调用，每次往返切换到服务线程再切换回来
+ * @return 完成的调用次数，调度器未启动时为0
+ */
+static uint32_t ipc_bench_switch(uint32_t rounds, uint64_t *cycles) {
+    process_t *server;
+    uint32_t message[4] = { 0, 0, 0, 0 };
+    uint32_t buffer[4];
+    uint32_t size;
+    uint64_t start;
+    uint32_t i;
+
+    server = process_spawn("ipc_bench", PROCESS_PRIORITY_NORMAL, ipc_bench_server);
+    if (!server) {
+        return 0;
+    }
+
+    start = ipc_rdtsc();
+    for (i = 0; i < rounds; i++) {
+        message[0] = i;
+        size = sizeof(buffer);
+        if (ipc_call(server->pid, message, sizeof(message), 1, buffer, &size) != 0 ||
+            buffer[0] != ~i) {
+            break;
+        }
+    }
+    *cycles = ipc_rdtsc() - start;
+
+    /* 服务线程已阻塞在邮箱上等待下一个请求 */
+    process_destroy(server);
+    return i;
+}
+
+/**
+ * 往返延迟基准测试
+ */
+int32_t ipc_benchmark(uint32_t rounds, ipc_bench_t *bench) {
+    static process_t procs[2];
+    ipc_stats_t saved = ipc_stats;
+    int32_t result = 0;
+    uint64_t start;
+    uintptr_t flags;
+    uint32_t i;
+
+    if (!bench || rounds == 0) {
+        return -1;
+    }
+
+    if (ipc_mailbox_alloc(&procs[0]) < 0) {
+        return -1;
+    }
+    if (ipc_mailbox_alloc(&procs[1]) < 0) {
+        ipc_mailbox_free(&procs[0]);
+        return -1;
+    }
+    procs[0].pid = 0xFFFFFFFE;
+    procs[1].pid = 0xFFFFFFFF;
+
+    flags = arch_irq_save();
+
+    start = ipc_rdtsc();
+    for (i = 0; i < rounds; i++) {
+        result |= ipc_bench_round(&procs[0], &procs[1], i, false);
+    }
+    bench->queued_cycles = ipc_rdtsc() - start;
+
+    start = ipc_rdtsc();
+    for (i = 0; i < rounds; i++) {
+        result |= ipc_bench_round(&procs[0], &procs[1], i, true);
+    }
+    bench->fast_cycles = ipc_rdtsc() - start;
+    bench->rounds = rounds;
+
+    /* 测试进程没有入队，不计入统计 */
+    ipc_stats = saved;
+    arch_irq_restore(flags);
+
+    ipc_mailbox_free(&procs[0]);
+    ipc_mailbox_free(&procs[1]);
+
+    bench->switch_cycles = 0;
+    bench->switch_rounds = ipc_bench_switch(rounds, &bench->switch_cycles);
+    return result;
+}
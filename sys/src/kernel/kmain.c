@@ -10,10 +10,15 @@
 #include "multiboot.h"
 #include "console.h"
 #include "memory.h"
+#include "vm.h"
+#include "string.h"
 #include "gdt.h"
 #include "idt.h"
 #include "timer.h"
+#include "fpu.h"
 #include "process.h"
+#include "sched.h"
+#include "syscall.h"
 #include "m4k_syscall.h"
 #include "ldso.h"
 #include "../drivers/keyboard/keyboard.h"
@@ -83,6 +88,12 @@ void kmain(multiboot_info_t *mb_info, uint32_t magic) {
     console_write("Initializing System Components...\n");
     console_write("=====================================\n");
 
+    // 0. 按CPU特性选择内存/字符串函数实现
+    string_init();
+    console_write("String functions: ");
+    console_write(string_impl_name());
+    console_write("\n");
+
     // 1. 初始化内存管理系统
     console_write("1. Initializing Memory Management...\n");
     if (mb_info == NULL) {
@@ -91,27 +102,34 @@ void kmain(multiboot_info_t *mb_info, uint32_t magic) {
     }
 
     memory_init(mb_info);
-    uint32_t total_mem = memory_get_total();
-    uint32_t free_mem = memory_get_free();
+    vm_init();
+    uint32_t total_mem = memory_get_total_pages();
+    uint32_t free_mem = memory_get_free_pages();
 
     console_write("   ✓ Memory management initialized.\n");
     console_write("   Total memory: ");
-    console_write_dec(total_mem / 1024);
+    console_write_dec(total_mem * (PAGE_SIZE / 1024));
     console_write(" KB\n");
     console_write("   Free memory: ");
-    console_write_dec(free_mem / 1024);
+    console_write_dec(free_mem * (PAGE_SIZE / 1024));
     console_write(" KB\n");
 
     // 2. 初始化GDT系统
     console_write("2. Initializing GDT...\n");
     gdt_init();
-    console_write("   ✓ GDT initialized.\n");
+    tss_flush();
+    console_write("   ✓ GDT and TSS initialized.\n");
 
     // 3. 初始化IDT系统和中断处理
     console_write("3. Initializing IDT and Interrupts...\n");
     idt_init();
     console_write("   ✓ IDT initialized.\n");
 
+    // 3a. 初始化FPU/SIMD上下文切换（#NM处理函数和扩展状态保存区）
+    console_write("3a. Initializing FPU/SIMD Context...\n");
+    fpu_init();
+    console_write("   ✓ FPU/SIMD context initialized.\n");
+
     // 4. 初始化定时器系统
     console_write("4. Initializing Timer System...\n");
     timer_init(1000); // 1ms tick
@@ -124,6 +142,7 @@ void kmain(multiboot_info_t *mb_info, uint32_t magic) {
 
     // 6. 初始化M4KK1独特系统调用系统
     console_write("6. Initializing M4KK1 System Calls...\n");
+    syscall_init();
     m4k_syscall_init();
     console_write("   ✓ M4KK1 system calls initialized.\n");
 
@@ -152,19 +171,19 @@ void kmain(multiboot_info_t *mb_info, uint32_t magic) {
     console_write("=====================================\n");
 
     // 显示最终内存状态
-    total_mem = memory_get_total();
-    free_mem = memory_get_free();
+    total_mem = memory_get_total_pages();
+    free_mem = memory_get_free_pages();
     uint32_t used_mem = total_mem - free_mem;
 
     console_write("Final Memory Status:\n");
     console_write("   Total: ");
-    console_write_dec(total_mem / 1024);
+    console_write_dec(total_mem * (PAGE_SIZE / 1024));
     console_write(" KB\n");
     console_write("   Used:  ");
-    console_write_dec(used_mem / 1024);
+    console_write_dec(used_mem * (PAGE_SIZE / 1024));
     console_write(" KB\n");
     console_write("   Free:  ");
-    console_write_dec(free_mem / 1024);
+    console_write_dec(free_mem * (PAGE_SIZE / 1024));
     console_write(" KB\n");
 
     // 创建初始进程
@@ -185,10 +204,16 @@ void kmain(multiboot_info_t *mb_info, uint32_t magic) {
     // 启动调度器
     scheduler_start();
 
-    // 如果调度器返回，显示错误并进入无限循环
-    console_write("ERROR: Scheduler returned unexpectedly!\n");
-    console_write("This indicates a critical system failure.\n");
-    panic("Scheduler returned unexpectedly");
+    // 初始进程此后作为空闲循环：没有就绪进程时停止周期时钟，
+    // 睡到下一个闹钟到期或其他中断到来
+    while (1) {
+        __asm__ volatile ("cli");
+        if (sched_nr_ready() == 0) {
+            timer_idle();
+        } else {
+            __asm__ volatile ("sti; hlt");
+        }
+    }
 }
 
 /**
@@ -249,6 +274,14 @@ void invalid_opcode_handler(void) {
  * 页面错误处理
  */
 void page_fault_handler(uint32_t address, uint32_t error_code) {
+    process_t *current = process_get_current();
+
+    /* 写时复制等可恢复的错误 */
+    if (current && current->cr3 &&
+        vm_handle_fault(current->cr3, address, error_code) == 0) {
+        return;
+    }
+
     console_write("\nPage fault at address: 0x");
     console_write_hex(address);
     console_write(", error code: 0x");
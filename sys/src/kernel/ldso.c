@@ -27,6 +27,9 @@ char m4ll_error_msg[256] = {0};
 /* 全局上下文 */
 static m4ll_context_t ldso_context;
 
+/* 全局符号对象缓存 */
+static kmem_cache_t *symbol_cache = NULL;
+
 /* 字符串哈希函数 */
 uint32_t m4ll_hash_string(const char *str) {
     uint32_t hash = 5381;
@@ -41,34 +44,17 @@ uint32_t m4ll_hash_string(const char *str) {
 
 /* 字符串比较函数 */
 int m4ll_strcmp(const char *s1, const char *s2) {
-    while (*s1 && (*s1 == *s2)) {
-        s1++;
-        s2++;
-    }
-    return *(unsigned char *)s1 - *(unsigned char *)s2;
+    return strcmp(s1, s2);
 }
 
 /* 内存复制函数 */
 void *m4ll_memcpy(void *dest, const void *src, size_t n) {
-    char *d = dest;
-    const char *s = src;
-
-    while (n--) {
-        *d++ = *s++;
-    }
-
-    return dest;
+    return memcpy(dest, src, n);
 }
 
 /* 内存设置函数 */
 void *m4ll_memset(void *s, int c, size_t n) {
-    unsigned char *p = s;
-
-    while (n--) {
-        *p++ = (unsigned char)c;
-    }
-
-    return s;
+    return memset(s, c, n);
 }
 
 /* 设置错误信息 */
@@ -118,6 +104,11 @@ static void *read_file_to_memory(const char *filename, size_t *size) {
     return NULL;
 }
 
+/* 读取程序或库文件，返回的缓冲区由调用者kfree */
+void *m4ll_read_file(const char *filename, size_t *size) {
+    return read_file_to_memory(filename, size);
+}
+
 /* 分配库结构 */
 static m4ll_library_t *alloc_library(void) {
     m4ll_library_t *lib = (m4ll_library_t *)kmalloc(sizeof(m4ll_library_t));
@@ -274,7 +265,7 @@ static int load_library_data(m4ll_library_t *lib, void *file_data) {
 
 /* 添加全局符号 */
 static int add_global_symbol(const char *name, void *address, uint32_t type, uint32_t binding) {
-    m4ll_symbol_t *symbol = (m4ll_symbol_t *)kmalloc(sizeof(m4ll_symbol_t));
+    m4ll_symbol_t *symbol = (m4ll_symbol_t *)kmem_cache_alloc(symbol_cache);
     if (!symbol) {
         set_error(M4LL_ERROR_MEMORY_FAILED, "Failed to allocate symbol structure");
         return -1;
@@ -282,7 +273,7 @@ static int add_global_symbol(const char *name, void *address, uint32_t type, uin
 
     symbol->name = strdup(name); /* 需要实现strdup */
     if (!symbol->name) {
-        kfree(symbol);
+        kmem_cache_free(symbol_cache, symbol);
         set_error(M4LL_ERROR_MEMORY_FAILED, "Failed to duplicate symbol name");
         return -1;
     }
@@ -500,6 +491,15 @@ int m4ll_init(void) {
     memset(&ldso_context, 0, sizeof(m4ll_context_t));
     ldso_context.base_address = 0xD0000000; /* 库加载基地址 */
 
+    /* 创建全局符号缓存 */
+    if (!symbol_cache) {
+        symbol_cache = kmem_cache_create("m4ll_symbol_t", sizeof(m4ll_symbol_t), 0, NULL);
+        if (!symbol_cache) {
+            set_error(M4LL_ERROR_MEMORY_FAILED, "Failed to create symbol cache");
+            return -1;
+        }
+    }
+
     /* 清空错误状态 */
     m4ll_errno = M4LL_ERROR_NONE;
     m4ll_error_msg[0] = '\0';
@@ -530,9 +530,10 @@ void m4ll_cleanup(void) {
     while (symbol) {
         next_symbol = symbol->next;
         if (symbol->name) kfree(symbol->name);
-        kfree(symbol);
+        kmem_cache_free(symbol_cache, symbol);
         symbol = next_symbol;
     }
+    ldso_context.global_symbols = NULL;
 
     KLOG_INFO("Dynamic linker cleanup completed");
 }
@@ -9,12 +9,19 @@
  */
 
 #include "process.h"
+#include "sched.h"
 #include "timer.h"
+#include "fpu.h"
+#include "ipc.h"
 #include "memory.h"
+#include "vm.h"
 #include "kernel.h"
 #include "idt.h"
 #include "console.h"
 #include "ldso.h"
+#include "syscall.h"
+#include "gdt.h"
+#include "arch.h"
 #include <string.h>
 #include <stdint.h>
 
@@ -26,37 +33,42 @@
 /* 中断处理函数类型定义 */
 typedef void (*interrupt_handler_t)(void);
 
+/* 系统调用返回用户态的路径（arch/m4kk1/idt.asm） */
+extern void syscall_return(void);
+
 /* 进程管理全局变量 */
 static process_control_t process_control;
-static process_t *current_process = NULL;
 static uint32_t scheduler_enabled = 0;
-static uint32_t time_slice_counter = 0;
 static uint32_t time_slice_length = 10; /* 时间片长度（毫秒） */
 
-/* 调度队列 */
-#define READY_QUEUE_SIZE 256
+/* 每个处理器的当前进程、时间片计数和空闲进程 */
+static process_t *cpu_current[SMP_MAX_CPUS];
+static uint32_t cpu_time_slice[SMP_MAX_CPUS];
+static process_t *cpu_idle[SMP_MAX_CPUS];
+
+#define current_process     (cpu_current[smp_cpu_id()])
+#define time_slice_counter  (cpu_time_slice[smp_cpu_id()])
+
+/* 进程结构对象缓存 */
+static kmem_cache_t *process_cache = NULL;
+
+/* 阻塞队列（就绪进程由sched.c的运行队列管理） */
 #define BLOCKED_QUEUE_SIZE 256
-static process_t *ready_queues[3][READY_QUEUE_SIZE]; /* 按优先级组织的就绪队列 */
-static uint32_t ready_queue_count[3] = {0, 0, 0};
 static process_t *blocked_queue[BLOCKED_QUEUE_SIZE];
 static uint32_t blocked_queue_count = 0;
+static volatile uint32_t blocked_lock = 0;
 
-/* 进程间通信 */
-#define IPC_MESSAGE_SIZE 256
-#define IPC_QUEUE_SIZE 64
-
-typedef struct {
-    uint32_t sender_pid;
-    uint32_t receiver_pid;
-    uint8_t data[IPC_MESSAGE_SIZE];
-    uint32_t size;
-    uint32_t type;
-} ipc_message_t;
+/* 睡眠队列：按唤醒滴答排序的红黑树，只为最早的唤醒时间挂一个闹钟 */
+#define SLEEP_MAX_TICKS 0x7FFFFFFF         /* 滴答计数回绕比较的上限 */
+static rb_root_t sleep_queue;
+static volatile uint32_t sleep_lock = 0;
+static uint32_t sleep_alarm = 0;           /* 闹钟句柄，0表示未设置 */
+static uint32_t sleep_alarm_tick = 0;      /* 闹钟到期滴答 */
 
-static ipc_message_t ipc_queue[IPC_QUEUE_SIZE];
-static uint32_t ipc_queue_head = 0;
-static uint32_t ipc_queue_tail = 0;
-static uint32_t ipc_queue_count = 0;
+/* PID哈希表，IPC按PID查找接收者 */
+#define PID_HASH_SIZE 64
+static process_t *pid_hash[PID_HASH_SIZE];
+static volatile uint32_t pid_lock = 0;
 
 /**
  * 获取下一个可用的进程ID
@@ -65,6 +77,156 @@ static uint32_t process_get_next_pid(void) {
     return process_control.next_pid++;
 }
 
+static inline void sleep_queue_lock(void) {
+    while (__sync_lock_test_and_set(&sleep_lock, 1)) {
+        while (sleep_lock) {
+            asm volatile ("pause");
+        }
+    }
+}
+
+static inline void sleep_queue_unlock(void) {
+    __sync_lock_release(&sleep_lock);
+}
+
+static inline void blocked_queue_lock(void) {
+    while (__sync_lock_test_and_set(&blocked_lock, 1)) {
+        while (blocked_lock) {
+            asm volatile ("pause");
+        }
+    }
+}
+
+static inline void blocked_queue_unlock(void) {
+    __sync_lock_release(&blocked_lock);
+}
+
+/**
+ * 进程在阻塞队列中时将其移出
+ */
+static void blocked_queue_remove(process_t *process) {
+    uintptr_t flags = arch_irq_save();
+    uint32_t i;
+
+    blocked_queue_lock();
+    for (i = 0; i < blocked_queue_count; i++) {
+        if (blocked_queue[i] == process) {
+            blocked_queue[i] = blocked_queue[--blocked_queue_count];
+            break;
+        }
+    }
+    blocked_queue_unlock();
+    arch_irq_restore(flags);
+}
+
+static void sleep_queue_expire(void *data);
+
+/**
+ * 闹钟对准最早的唤醒滴答（已持有sleep_lock）
+ * 最早的唤醒时间不变时不动闹钟，大多数插入和删除不需要重新设置
+ */
+static void sleep_queue_arm(void) {
+    rb_node_t *first = rb_first(&sleep_queue);
+    uint32_t wake;
+
+    if (!first) {
+        if (sleep_alarm) {
+            timer_destroy_alarm(sleep_alarm);
+            sleep_alarm = 0;
+        }
+        return;
+    }
+
+    wake = rb_entry(first, process_t, sleep_node)->wake_tick;
+    if (sleep_alarm && sleep_alarm_tick == wake) {
+        return;
+    }
+
+    if (sleep_alarm) {
+        timer_destroy_alarm(sleep_alarm);
+    }
+    sleep_alarm = timer_add_at(wake, sleep_queue_expire, NULL);
+    sleep_alarm_tick = wake;
+}
+
+/**
+ * 闹钟回调：取出所有到期的进程，一次批量加入运行队列
+ */
+static void sleep_queue_expire(void *data) {
+    process_t *woken;
+    uintptr_t flags;
+
+    (void)data;
+
+    flags = arch_irq_save();
+    sleep_queue_lock();
+
+    /* 单次闹钟回调返回后自动释放 */
+    sleep_alarm = 0;
+
+    woken = sleep_queue_pop_expired(&sleep_queue, timer_get_ticks());
+
+    sleep_queue_arm();
+    sleep_queue_unlock();
+
+    if (woken) {
+        sched_enqueue_list(woken);
+    }
+    arch_irq_restore(flags);
+}
+
+/**
+ * 进程在睡眠队列中时将其移出
+ */
+static void sleep_queue_cancel(process_t *process) {
+    uintptr_t flags = arch_irq_save();
+
+    sleep_queue_lock();
+    if (process->on_sleep) {
+        sleep_queue_del(&sleep_queue, process);
+        sleep_queue_arm();
+    }
+    sleep_queue_unlock();
+    arch_irq_restore(flags);
+}
+
+static inline uint32_t pid_hash_index(uint32_t pid) {
+    return pid & (PID_HASH_SIZE - 1);
+}
+
+/**
+ * 加入PID表
+ */
+static void pid_hash_add(process_t *process) {
+    uintptr_t flags = arch_irq_save();
+    uint32_t index = pid_hash_index(process->pid);
+
+    process_table_lock();
+    process->pid_next = pid_hash[index];
+    pid_hash[index] = process;
+    process_table_unlock();
+    arch_irq_restore(flags);
+}
+
+/**
+ * 从PID表移除，之后IPC不会再找到该进程
+ */
+static void pid_hash_remove(process_t *process) {
+    uintptr_t flags = arch_irq_save();
+    process_t **link;
+
+    process_table_lock();
+    for (link = &pid_hash[pid_hash_index(process->pid)]; *link; link = &(*link)->pid_next) {
+        if (*link == process) {
+            *link = process->pid_next;
+            break;
+        }
+    }
+    process->pid_next = NULL;
+    process_table_unlock();
+    arch_irq_restore(flags);
+}
+
 /**
  * 初始化进程管理
  */
@@ -75,17 +237,25 @@ void process_init(void) {
     memset(&process_control, 0, sizeof(process_control_t));
     process_control.next_pid = 1;
 
+    /* 创建进程结构缓存 */
+    if (!process_cache) {
+        process_cache = kmem_cache_create("process_t", sizeof(process_t), 0, NULL);
+        if (!process_cache) {
+            panic("Failed to create process cache");
+            return;
+        }
+    }
+
     /* 初始化调度队列 */
-    memset(ready_queues, 0, sizeof(ready_queues));
-    memset(ready_queue_count, 0, sizeof(ready_queue_count));
+    sched_init();
     memset(blocked_queue, 0, sizeof(blocked_queue));
     blocked_queue_count = 0;
+    rb_root_init(&sleep_queue);
+    sleep_alarm = 0;
 
-    /* 初始化IPC队列 */
-    memset(ipc_queue, 0, sizeof(ipc_queue));
-    ipc_queue_head = 0;
-    ipc_queue_tail = 0;
-    ipc_queue_count = 0;
+    /* 初始化PID表和IPC */
+    memset(pid_hash, 0, sizeof(pid_hash));
+    ipc_init();
 
     /* 创建初始进程 */
     process_create_init();
@@ -97,7 +267,7 @@ void process_init(void) {
  * 创建初始进程
  */
 void process_create_init(void) {
-    process_t *init_process = (process_t *)kmalloc(sizeof(process_t));
+    process_t *init_process = (process_t *)kmem_cache_alloc(process_cache);
     if (!init_process) {
         panic("Failed to allocate memory for init process");
         return;
@@ -109,12 +279,26 @@ void process_create_init(void) {
     init_process->ppid = 0;
     init_process->state = PROCESS_STATE_RUNNING;
     init_process->priority = PROCESS_PRIORITY_NORMAL;
+    init_process->policy = PROCESS_POLICY_FAIR;
+    init_process->weight = sched_priority_weight(PROCESS_PRIORITY_NORMAL);
     init_process->esp = KERNEL_STACK;
     init_process->ebp = KERNEL_STACK;
     init_process->eip = 0; /* 初始进程从内核主函数开始 */
     init_process->cr3 = 0; /* 使用内核页目录 */
-    init_process->sleep_ticks = 0;
+    init_process->wake_tick = 0;
+    init_process->cpu = smp_cpu_id();
+    init_process->on_cpu = 1;
+    init_process->exec_start = clock_now_ns();
     strcpy(init_process->name, "init");
+    if (fpu_alloc_state(init_process) < 0) {
+        panic("Failed to allocate FPU state for init process");
+        return;
+    }
+    if (ipc_mailbox_alloc(init_process) < 0) {
+        panic("Failed to allocate mailbox for init process");
+        return;
+    }
+    pid_hash_add(init_process);
 
     /* 设置为当前进程 */
     current_process = init_process;
@@ -125,27 +309,77 @@ void process_create_init(void) {
 }
 
 /**
- * 创建新进程
+ * 为调用它的处理器创建空闲进程
+ * 空闲进程沿用处理器的启动栈，从不进入运行队列，只在没有可运行的
+ * 进程时切换过去
  */
-process_t *process_create(const char *name, uint32_t priority) {
+void process_init_cpu(void) {
+    uint32_t cpu = smp_cpu_id();
+    process_t *idle_process;
+
+    if (cpu >= SMP_MAX_CPUS || cpu_idle[cpu]) {
+        return;
+    }
+
+    idle_process = (process_t *)kmem_cache_alloc(process_cache);
+    if (!idle_process) {
+        panic("Failed to allocate memory for idle process");
+        return;
+    }
+
+    memset(idle_process, 0, sizeof(process_t));
+    idle_process->pid = 0;
+    idle_process->state = PROCESS_STATE_RUNNING;
+    idle_process->priority = PROCESS_PRIORITY_IDLE;
+    idle_process->policy = PROCESS_POLICY_IDLE;
+    idle_process->cpu = cpu;
+    idle_process->on_cpu = 1;
+    idle_process->exec_start = clock_now_ns();
+    strcpy(idle_process->name, "idle");
+    if (fpu_alloc_state(idle_process) < 0) {
+        panic("Failed to allocate FPU state for idle process");
+        return;
+    }
+
+    cpu_idle[cpu] = idle_process;
+    cpu_current[cpu] = idle_process;
+    cpu_time_slice[cpu] = 0;
+}
+
+/**
+ * 新线程第一次被切换到时从这里开始执行
+ */
+static void process_start(void) {
+    process_t *process = current_process;
+
+    if (process->entry) {
+        process->entry();
+    }
+    process_exit();
+}
+
+/**
+ * 分配进程结构、内核栈、FPU状态保存区和邮箱，尚未加入PID表和运行队列
+ */
+static process_t *process_alloc(const char *name, uint32_t priority) {
     process_t *process;
-    uint32_t *stack;
+    void *stack;
 
-    if (priority > PROCESS_PRIORITY_LOW) {
+    if (priority >= PROCESS_PRIORITY_LEVELS) {
         priority = PROCESS_PRIORITY_NORMAL;
     }
 
     /* 分配进程结构 */
-    process = (process_t *)kmalloc(sizeof(process_t));
+    process = (process_t *)kmem_cache_alloc(process_cache);
     if (!process) {
         KLOG_ERROR("Failed to allocate memory for new process");
         return NULL;
     }
 
     /* 分配内核栈 */
-    stack = (uint32_t *)kmalloc(KERNEL_STACK_SIZE);
+    stack = kmalloc(KERNEL_STACK_SIZE);
     if (!stack) {
-        kfree(process);
+        kmem_cache_free(process_cache, process);
         KLOG_ERROR("Failed to allocate kernel stack for new process");
         return NULL;
     }
@@ -156,83 +390,325 @@ process_t *process_create(const char *name, uint32_t priority) {
     process->ppid = current_process ? current_process->pid : 0;
     process->state = PROCESS_STATE_READY;
     process->priority = priority;
-    process->esp = (uint32_t)stack + KERNEL_STACK_SIZE - sizeof(uint32_t);
-    process->ebp = process->esp;
+    process->policy = PROCESS_POLICY_FAIR;
+    process->weight = sched_priority_weight(priority);
+    process->kstack = (uintptr_t)stack;
     process->cr3 = 0; /* 使用内核页目录 */
-    process->sleep_ticks = 0;
+    process->wake_tick = 0;
+    process->cpu = SCHED_CPU_NONE;
     strncpy(process->name, name, sizeof(process->name) - 1);
     process->name[sizeof(process->name) - 1] = '\0';
 
-    /* 设置栈帧用于进程切换 */
-    stack = (uint32_t *)process->esp;
-    *(--stack) = 0;                    /* EDI */
-    *(--stack) = 0;                    /* ESI */
-    *(--stack) = 0;                    /* EBP */
-    *(--stack) = 0;                    /* ESP (dummy) */
-    *(--stack) = 0;                    /* EBX */
-    *(--stack) = 0;                    /* EDX */
-    *(--stack) = 0;                    /* ECX */
-    *(--stack) = 0;                    /* EAX */
-    *(--stack) = 0x0202;               /* EFLAGS */
-    *(--stack) = 0;                    /* EIP (入口点) */
-    *(--stack) = (uint32_t)process_exit; /* 返回地址 */
-    process->esp = (uint32_t)stack;
+    /* 分配FPU/SIMD状态保存区 */
+    if (fpu_alloc_state(process) < 0) {
+        kfree(stack);
+        kmem_cache_free(process_cache, process);
+        KLOG_ERROR("Failed to allocate FPU state for new process");
+        return NULL;
+    }
 
-    /* 添加到就绪队列 */
-    if (ready_queue_count[priority] < READY_QUEUE_SIZE) {
-        ready_queues[priority][ready_queue_count[priority]++] = process;
-    } else {
-        KLOG_WARN("Ready queue full, cannot add process");
-        kfree(process);
-        kfree((void *)((uint32_t)stack - KERNEL_STACK_SIZE + sizeof(uint32_t)));
+    /* 分配IPC邮箱 */
+    if (ipc_mailbox_alloc(process) < 0) {
+        fpu_free_state(process);
+        kfree(stack);
+        kmem_cache_free(process_cache, process);
+        KLOG_ERROR("Failed to allocate mailbox for new process");
         return NULL;
     }
 
+    return process;
+}
+
+/**
+ * 释放进程占用的资源（已从PID表和各队列中移除）
+ */
+static void process_free(process_t *process) {
+    /* 先释放邮箱：等待正在向这个地址空间映射页面的授予结束 */
+    ipc_mailbox_free(process);
+
+    /* 释放用户地址空间 */
+    if (process->cr3) {
+        vm_space_destroy(process->cr3);
+        process->cr3 = 0;
+    }
+
+    /* 释放内核栈 */
+    if (process->kstack) {
+        kfree((void *)process->kstack);
+        process->kstack = 0;
+    }
+
+    /* 释放FPU/SIMD状态保存区和进程结构 */
+    fpu_free_state(process);
+    kmem_cache_free(process_cache, process);
+}
+
+/**
+ * 栈顶放一份系统调用现场，第一次切换过来时经syscall_return返回用户态
+ * @return 现场的位置
+ */
+static syscall_frame_t *process_init_user_stack(process_t *process) {
+    syscall_frame_t *frame = (syscall_frame_t *)(process->kstack + KERNEL_STACK_SIZE) - 1;
+
+    /* iret装入用户态的EFLAGS之前保持关中断 */
+    process->esp = arch_init_stack((uintptr_t)frame, syscall_return, false);
+    return frame;
+}
+
+/**
+ * 加入PID表和就绪队列（state为PROCESS_STATE_BLOCKED时只加入PID表）
+ */
+static void process_publish(process_t *process) {
+    pid_hash_add(process);
+    if (process->state == PROCESS_STATE_READY) {
+        sched_enqueue(process);
+    }
+
     process_control.process_count++;
 
     KLOG_INFO("Process created");
+}
 
-    return process;
+/**
+ * 创建新进程
+ */
+process_t *process_create(const char *name, uint32_t priority) {
+    return process_spawn(name, priority, NULL);
 }
 
 /**
- * 销毁进程
+ * 创建内核线程
  */
-void process_destroy(process_t *process) {
-    uint32_t i, j;
+process_t *process_spawn(const char *name, uint32_t priority, void (*entry)(void)) {
+    process_t *process = process_alloc(name, priority);
+    uintptr_t *stack;
 
     if (!process) {
-        return;
+        return NULL;
     }
 
-    /* 从就绪队列中移除 */
-    for (i = 0; i < 3; i++) {
-        for (j = 0; j < ready_queue_count[i]; j++) {
-            if (ready_queues[i][j] == process) {
-                /* 移动队列尾部的进程到当前位置 */
-                ready_queues[i][j] = ready_queues[i][--ready_queue_count[i]];
-                break;
-            }
+    /* 第一次切换过来时返回到process_start，它的返回地址位置留0（不会返回） */
+    process->entry = entry;
+    stack = (uintptr_t *)(process->kstack + KERNEL_STACK_SIZE);
+    *(--stack) = 0;
+    process->esp = arch_init_stack((uintptr_t)stack, process_start, true);
+
+    process_publish(process);
+    return process;
+}
+
+/**
+ * 装入一个程序段：预留[vaddr, vaddr+mem_size)，逐页分配后复制文件内容，
+ * 其余部分是新分配的清零页
+ */
+static int32_t process_load_segment(uintptr_t space, const uint8_t *image, uint32_t size,
+                                    const m4ll_phdr_t *phdr) {
+    uint32_t flags = PAGE_USER;
+    uint32_t va, end, copied = 0;
+
+    if (phdr->mem_size == 0) {
+        return 0;
+    }
+    if (phdr->file_size > phdr->mem_size || phdr->offset > size ||
+        phdr->file_size > size - phdr->offset || phdr->vaddr < PROCESS_USER_BASE ||
+        phdr->mem_size > PROCESS_USER_STACK_TOP - PROCESS_USER_STACK_SIZE ||
+        phdr->vaddr > PROCESS_USER_STACK_TOP - PROCESS_USER_STACK_SIZE - phdr->mem_size) {
+        return -1;
+    }
+
+    if (phdr->type == M4LL_SEGMENT_DATA || phdr->type == M4LL_SEGMENT_BSS) {
+        flags |= PAGE_READWRITE;
+    }
+    if (vm_reserve(space, phdr->vaddr, phdr->mem_size, flags) != 0) {
+        return -1;
+    }
+
+    end = phdr->vaddr + phdr->file_size;
+    for (va = phdr->vaddr & PAGE_MASK; va < end; va += PAGE_SIZE) {
+        uint32_t start = va < phdr->vaddr ? phdr->vaddr : va;
+        uint32_t chunk = (va + PAGE_SIZE < end ? va + PAGE_SIZE : end) - start;
+        uintptr_t phys;
+
+        /* 以读缺页分配私有的清零页，再经内核映射写入 */
+        if (vm_handle_fault(space, va, 0) != 0 ||
+            (phys = vm_translate(space, start)) == 0) {
+            return -1;
         }
+        memcpy(vm_phys_to_virt(phys), image + phdr->offset + copied, chunk);
+        copied += chunk;
     }
+    return 0;
+}
 
-    /* 从阻塞队列中移除 */
-    for (i = 0; i < blocked_queue_count; i++) {
-        if (blocked_queue[i] == process) {
-            blocked_queue[i] = blocked_queue[--blocked_queue_count];
-            break;
+/**
+ * 把程序映像装入新的地址空间并换给进程，原地址空间随后销毁
+ * @return 成功返回0并输出入口地址，失败返回-1（进程不变）
+ */
+static int32_t process_load_image(process_t *process, const void *image, uint32_t size,
+                                  uint32_t *entry) {
+    const m4ll_header_t *header = (const m4ll_header_t *)image;
+    const m4ll_phdr_t *phdr;
+    uintptr_t space, old_space;
+    uint32_t end = 0, i;
+
+    if (!image || size < sizeof(m4ll_header_t) || header->magic != M4LL_MAGIC ||
+        header->version != 1 || header->phdr_offset > size ||
+        header->phdr_count > (size - header->phdr_offset) / sizeof(m4ll_phdr_t)) {
+        return -1;
+    }
+
+    space = vm_space_create();
+    if (!space) {
+        return -1;
+    }
+
+    phdr = (const m4ll_phdr_t *)((const uint8_t *)image + header->phdr_offset);
+    for (i = 0; i < header->phdr_count; i++) {
+        if (process_load_segment(space, (const uint8_t *)image, size, &phdr[i]) != 0) {
+            vm_space_destroy(space);
+            return -1;
+        }
+        if (phdr[i].mem_size && phdr[i].vaddr + phdr[i].mem_size > end) {
+            end = phdr[i].vaddr + phdr[i].mem_size;
         }
     }
 
-    /* 释放内核栈 */
-    if (process->esp) {
-        uint32_t *stack = (uint32_t *)(process->esp - KERNEL_STACK_SIZE + sizeof(uint32_t));
-        kfree(stack);
+    /* 入口必须落在装入的映像内 */
+    if (header->entry_point < PROCESS_USER_BASE || header->entry_point >= end) {
+        vm_space_destroy(space);
+        return -1;
+    }
+
+    old_space = process->cr3;
+    process->cr3 = space;
+    if (process_setup_user_memory(process, end) != 0) {
+        process->cr3 = old_space;
+        vm_space_destroy(space);
+        return -1;
+    }
+
+    if (process == current_process) {
+        vm_space_switch(space);
+    }
+    if (old_space) {
+        vm_space_destroy(old_space);
+    }
+
+    *entry = header->entry_point;
+    return 0;
+}
+
+/**
+ * 返回用户态时从entry开始、在空的用户栈上执行
+ */
+static void process_user_frame(syscall_frame_t *frame, uint32_t entry) {
+    memset(frame, 0, sizeof(syscall_frame_t));
+    frame->eip = entry;
+    frame->cs = GDT_USER_CODE | 3;
+    frame->eflags = 0x0202;
+    frame->user_esp = PROCESS_USER_STACK_TOP;
+    frame->user_ss = GDT_USER_DATA | 3;
+}
+
+/**
+ * 从程序映像创建用户进程
+ */
+process_t *process_create_user(const char *name, uint32_t priority,
+                               const void *image, uint32_t size) {
+    process_t *process = process_alloc(name, priority);
+    uint32_t entry;
+
+    if (!process) {
+        return NULL;
+    }
+
+    if (process_load_image(process, image, size, &entry) != 0) {
+        process_free(process);
+        return NULL;
+    }
+
+    process_user_frame(process_init_user_stack(process), entry);
+    process->state = PROCESS_STATE_BLOCKED;
+    process_publish(process);
+    return process;
+}
+
+/**
+ * 复制用户进程
+ */
+process_t *process_fork(process_t *parent) {
+    syscall_frame_t *frame;
+    process_t *child;
+
+    /* 只有从用户态进入的系统调用现场才带有用户栈，可以原样复制 */
+    if (!parent || !parent->cr3 || !parent->frame || (parent->frame->cs & 3) != 3) {
+        return NULL;
+    }
+
+    child = process_alloc(parent->name, parent->priority);
+    if (!child) {
+        return NULL;
+    }
+
+    /* 共享父进程的用户页，只复制页表，页内容在首次写入时才复制 */
+    child->cr3 = vm_space_fork(parent->cr3);
+    if (!child->cr3) {
+        KLOG_ERROR("Failed to copy address space in fork");
+        process_free(child);
+        return NULL;
+    }
+
+    child->ppid = parent->pid;
+    child->heap_start = parent->heap_start;
+    child->brk = parent->brk;
+    sched_set_policy(child, parent->policy);
+    fpu_copy_state(child, parent);
+
+    /* 子进程从父进程现场的副本返回，fork的返回值为0 */
+    frame = process_init_user_stack(child);
+    *frame = *parent->frame;
+    frame->eax = 0;
+
+    process_publish(child);
+    return child;
+}
+
+/**
+ * 替换用户进程的程序映像
+ */
+int32_t process_exec(process_t *process, const void *image, uint32_t size) {
+    uint32_t entry;
+
+    /* 只有从用户态进入的现场才能改写为在新映像中返回用户态 */
+    if (!process || !process->frame || (process->frame->cs & 3) != 3) {
+        return -1;
+    }
+
+    if (process_load_image(process, image, size, &entry) != 0) {
+        return -1;
+    }
+
+    process_user_frame(process->frame, entry);
+    return 0;
+}
+
+/**
+ * 销毁进程
+ */
+void process_destroy(process_t *process) {
+    if (!process) {
+        return;
     }
 
-    /* 释放进程结构 */
-    kfree(process);
+    /* 从PID表和就绪队列中移除 */
+    pid_hash_remove(process);
+    sched_dequeue(process);
+
+    /* 从阻塞队列和睡眠队列中移除 */
+    blocked_queue_remove(process);
+    sleep_queue_cancel(process);
 
+    process_free(process);
     process_control.process_count--;
 
     KLOG_INFO("Process destroyed: PID=");
@@ -245,52 +721,88 @@ void process_destroy(process_t *process) {
 }
 
 /**
- * 获取当前进程
+ * 建立用户栈和堆
  */
-process_t *process_get_current(void) {
-    return current_process;
-}
+int32_t process_setup_user_memory(process_t *process, uint32_t heap_start) {
+    if (!process || !process->cr3) {
+        return -1;
+    }
 
-/**
- * 设置当前进程
- */
-void process_set_current(process_t *process) {
-    current_process = process;
-    process_control.current = process;
+    /* 栈向下增长，整个范围预留但不分配 */
+    if (vm_reserve(process->cr3,
+                   PROCESS_USER_STACK_TOP - PROCESS_USER_STACK_SIZE,
+                   PROCESS_USER_STACK_SIZE,
+                   PAGE_READWRITE | PAGE_USER) != 0) {
+        return -1;
+    }
+
+    process->heap_start = (heap_start + PAGE_SIZE - 1) & PAGE_MASK;
+    process->brk = process->heap_start;
+
+    return 0;
 }
 
 /**
- * 获取进程调度优先级
+ * 移动程序中断点
  */
-static uint32_t get_next_process_priority(void) {
-    uint32_t i;
+uint32_t process_brk(process_t *process, uint32_t addr) {
+    uint32_t old_end, new_end;
+
+    if (!process || !process->cr3 || !process->heap_start) {
+        return 0;
+    }
+
+    /* 非法地址返回当前中断点 */
+    if (addr < process->heap_start ||
+        addr > PROCESS_USER_STACK_TOP - PROCESS_USER_STACK_SIZE) {
+        return process->brk;
+    }
+
+    old_end = (process->brk + PAGE_SIZE - 1) & PAGE_MASK;
+    new_end = (addr + PAGE_SIZE - 1) & PAGE_MASK;
 
-    /* 优先级调度：从高优先级到低优先级查找 */
-    for (i = PROCESS_PRIORITY_HIGH; i <= PROCESS_PRIORITY_LOW; i++) {
-        if (ready_queue_count[i] > 0) {
-            return i;
+    /* 只调整预留范围，页面在首次访问时由缺页处理分配 */
+    if (new_end > old_end) {
+        if (vm_reserve(process->cr3, old_end, new_end - old_end,
+                       PAGE_READWRITE | PAGE_USER) != 0) {
+            return process->brk;
         }
+    } else if (new_end < old_end) {
+        vm_release(process->cr3, new_end, old_end - new_end);
     }
 
-    return PROCESS_PRIORITY_NORMAL; /* 默认优先级 */
+    process->brk = addr;
+    return addr;
 }
 
 /**
- * 获取下一个要执行的进程
+ * 获取当前进程
  */
-static process_t *get_next_process(void) {
-    uint32_t priority = get_next_process_priority();
+process_t *process_get_current(void) {
+    return current_process;
+}
 
-    if (ready_queue_count[priority] > 0) {
-        process_t *process = ready_queues[priority][0];
+/**
+ * 把进程自上次记账以来的运行时间记入累计运行时间和vruntime
+ */
+static void process_account(process_t *process) {
+    uint64_t now = clock_now_ns();
+    uint64_t delta = now - process->exec_start;
 
-        /* 将进程从队列头部移除 */
-        ready_queues[priority][0] = ready_queues[priority][--ready_queue_count[priority]];
+    process->exec_start = now;
+    process->sum_exec_ns += delta;
+    sched_charge(process, delta);
+}
 
-        return process;
+/**
+ * 设置当前进程
+ */
+void process_set_current(process_t *process) {
+    if (process) {
+        process->exec_start = clock_now_ns();
     }
-
-    return NULL;
+    current_process = process;
+    process_control.current = process;
 }
 
 /**
@@ -303,25 +815,46 @@ void process_schedule(void) {
         return;
     }
 
-    /* 检查时间片是否用完 */
     time_slice_counter++;
-    if (time_slice_counter >= time_slice_length) {
-        /* 时间片轮转：将当前进程放回就绪队列尾部 */
-        if (current_process->state == PROCESS_STATE_RUNNING) {
+    process_account(current_process);
+
+    /* 闹钟池耗尽时没能挂上闹钟，退回每个滴答检查睡眠队列 */
+    if (!sleep_alarm && rb_first(&sleep_queue)) {
+        sleep_queue_expire(NULL);
+    }
+
+    if (current_process->state == PROCESS_STATE_RUNNING) {
+        /* 实时进程用完固定时间片后轮转，公平进程由vruntime决定何时让出 */
+        if ((current_process->policy == PROCESS_POLICY_FAIR ||
+             time_slice_counter < time_slice_length) &&
+            !sched_should_preempt(current_process)) {
+            return;
+        }
+
+        /* 时间片轮转：将当前进程放回就绪队列尾部（空闲进程不入队） */
+        if (current_process != cpu_idle[smp_cpu_id()]) {
             current_process->state = PROCESS_STATE_READY;
-            if (ready_queue_count[current_process->priority] < READY_QUEUE_SIZE) {
-                ready_queues[current_process->priority][ready_queue_count[current_process->priority]++] = current_process;
-            }
+            sched_enqueue(current_process);
         }
-        time_slice_counter = 0;
     }
+    time_slice_counter = 0;
 
-    /* 获取下一个进程 */
-    next_process = get_next_process();
-    if (next_process && next_process != current_process) {
-        /* 执行进程切换 */
-        process_switch_to(next_process);
+    /* 获取下一个进程，没有可运行的进程且当前进程已阻塞时切换到空闲进程 */
+    next_process = sched_pick_next();
+    if (!next_process) {
+        next_process = cpu_idle[smp_cpu_id()];
+        if (!next_process || current_process->state == PROCESS_STATE_RUNNING) {
+            return;
+        }
     }
+
+    if (next_process == current_process) {
+        current_process->state = PROCESS_STATE_RUNNING;
+        return;
+    }
+
+    /* 执行进程切换 */
+    process_switch_to(next_process);
 }
 
 /**
@@ -341,13 +874,21 @@ void scheduler_start(void) {
  * 阻塞当前进程
  */
 void process_block(void) {
-    if (current_process) {
-        current_process->state = PROCESS_STATE_BLOCKED;
-
-        /* 添加到阻塞队列 */
-        if (blocked_queue_count < BLOCKED_QUEUE_SIZE) {
-            blocked_queue[blocked_queue_count++] = current_process;
+    process_t *process = current_process;
+    uintptr_t flags;
+
+    if (process) {
+        /* 添加到阻塞队列：队列满时进程无法再被唤醒，不能静默丢弃 */
+        flags = arch_irq_save();
+        blocked_queue_lock();
+        if (blocked_queue_count >= BLOCKED_QUEUE_SIZE) {
+            blocked_queue_unlock();
+            panic("Blocked queue full");
         }
+        process->state = PROCESS_STATE_BLOCKED;
+        blocked_queue[blocked_queue_count++] = process;
+        blocked_queue_unlock();
+        arch_irq_restore(flags);
 
         /* 执行调度 */
         process_schedule();
@@ -358,37 +899,62 @@ void process_block(void) {
  * 唤醒进程
  */
 void process_wakeup(process_t *process) {
-    uint32_t i;
-
     if (!process || process->state != PROCESS_STATE_BLOCKED) {
         return;
     }
 
-    /* 从阻塞队列中移除 */
-    for (i = 0; i < blocked_queue_count; i++) {
-        if (blocked_queue[i] == process) {
-            blocked_queue[i] = blocked_queue[--blocked_queue_count];
-            break;
-        }
-    }
+    /* 从阻塞队列或睡眠队列中移除 */
+    blocked_queue_remove(process);
+    sleep_queue_cancel(process);
 
     /* 设置为就绪状态 */
     process->state = PROCESS_STATE_READY;
 
     /* 添加到就绪队列 */
-    if (ready_queue_count[process->priority] < READY_QUEUE_SIZE) {
-        ready_queues[process->priority][ready_queue_count[process->priority]++] = process;
+    sched_enqueue(process);
+}
+
+/**
+ * 直接切换到被唤醒的进程
+ */
+int32_t process_handoff(process_t *process) {
+    if (!scheduler_enabled || !current_process || !process ||
+        current_process->state != PROCESS_STATE_BLOCKED || !sched_handoff(process)) {
+        return -1;
     }
+
+    /* 不清零时间片计数：接收者用完调用者剩下的时间片 */
+    process_switch_to(process);
+    return 0;
 }
 
 /**
  * 睡眠指定毫秒数
  */
 void process_sleep(uint32_t milliseconds) {
-    if (current_process) {
-        current_process->sleep_ticks = milliseconds * timer_get_frequency() / 1000;
-        process_block();
+    process_t *process = current_process;
+    uint32_t ticks = timer_ms_to_ticks(milliseconds);
+    uintptr_t flags;
+
+    if (!process) {
+        return;
     }
+
+    if (ticks > SLEEP_MAX_TICKS) {
+        ticks = SLEEP_MAX_TICKS;
+    }
+
+    /* 睡眠的进程只挂在睡眠队列上，不占用阻塞队列 */
+    flags = arch_irq_save();
+    sleep_queue_lock();
+    process->wake_tick = timer_get_ticks() + ticks;
+    process->state = PROCESS_STATE_BLOCKED;
+    sleep_queue_add(&sleep_queue, process);
+    sleep_queue_arm();
+    sleep_queue_unlock();
+    arch_irq_restore(flags);
+
+    process_schedule();
 }
 
 /**
@@ -428,9 +994,19 @@ uint32_t process_get_ppid(void) {
  * 设置进程优先级
  */
 void process_set_priority(uint32_t priority) {
-    if (current_process && priority <= PROCESS_PRIORITY_LOW) {
-        current_process->priority = priority;
+    if (current_process) {
+        sched_set_priority(current_process, priority);
+    }
+}
+
+/**
+ * 设置调度策略
+ */
+int32_t process_set_policy(uint32_t policy) {
+    if (!current_process) {
+        return -1;
     }
+    return sched_set_policy(current_process, policy);
 }
 
 /**
@@ -467,29 +1043,14 @@ uint32_t process_get_count(void) {
  * 进程切换（低级函数）
  */
 void process_switch(void) {
+    process_t *next_process;
+
     if (!current_process) {
         return;
     }
 
-    /* 保存当前进程上下文 */
-    asm volatile (
-        "pushfl\n"
-        "pushl %%eax\n"
-        "pushl %%ebx\n"
-        "pushl %%ecx\n"
-        "pushl %%edx\n"
-        "pushl %%esi\n"
-        "pushl %%edi\n"
-        "pushl %%ebp\n"
-        "movl %%esp, %%eax\n"
-        "movl %%eax, %0\n"
-        : "=m" (current_process->esp)
-        : /* no input */
-        : "eax"
-    );
-
-    /* 获取下一个进程 */
-    process_t *next_process = get_next_process();
+    /* 当前进程的现场由process_switch_to保存在它自己的内核栈上 */
+    next_process = sched_pick_next();
     if (next_process) {
         process_switch_to(next_process);
     }
@@ -499,177 +1060,101 @@ void process_switch(void) {
  * 切换到指定进程
  */
 void process_switch_to(process_t *process) {
+    uintptr_t boot_esp;             /* 还没有当前进程时，启动栈的现场不再需要 */
+    volatile uint32_t boot_on_cpu;
+
     if (!process || process == current_process) {
         return;
     }
 
     process_t *prev_process = current_process;
+
+    /* 按实际运行时间记账，不足一个滴答的部分也计入 */
+    if (prev_process) {
+        process_account(prev_process);
+    }
+    process->exec_start = prev_process ? prev_process->exec_start : clock_now_ns();
+
+    /* 扩展状态延迟切换：写回本时间片用过的状态，新进程首次使用时再装入 */
+    fpu_switch(prev_process, process);
+
+    /* 刚在其他处理器上切出的进程要等它离开自己的内核栈 */
+    while (process->on_cpu) {
+        asm volatile ("pause");
+    }
+    process->on_cpu = 1;
+
     current_process = process;
     process_control.current = process;
 
     /* 设置进程状态 */
     process->state = PROCESS_STATE_RUNNING;
 
-    /* 切换页目录（如果需要） */
-    if (process->cr3 != (prev_process ? prev_process->cr3 : 0)) {
-        /* 暂时跳过页目录切换，简化处理 */
-        process->cr3 = 0;
+    /* 切换页目录（内核线程沿用上一个地址空间，内核部分各进程共享） */
+    if (process->cr3 && process->cr3 != (prev_process ? prev_process->cr3 : 0)) {
+        vm_space_switch(process->cr3);
     }
 
-    /* 切换栈和寄存器 */
-    asm volatile (
-        "movl %0, %%esp\n"
-        "movl %1, %%ebp\n"
-        "movl %2, %%ecx\n"
-        :
-        : "m" (process->esp),
-          "m" (process->ebp),
-          "m" (process->cr3)
-    );
-
-    /* 恢复寄存器 */
-    if (prev_process) {
-        asm volatile (
-            "popl %%ebp\n"
-            "popl %%edi\n"
-            "popl %%esi\n"
-            "popl %%edx\n"
-            "popl %%ecx\n"
-            "popl %%ebx\n"
-            "popl %%eax\n"
-            "popfl\n"
-            ::: "esp"
-        );
+    /* 用户态陷入内核时落在新进程自己的内核栈顶 */
+    if (process->kstack) {
+        arch_set_kernel_stack(process->kstack + KERNEL_STACK_SIZE);
     }
+
+    /* 保存被调用者保存的寄存器和栈指针，换到新进程的内核栈；
+     * 之后某次切换回prev_process时从这里返回 */
+    arch_switch_stack(prev_process ? &prev_process->esp : &boot_esp, process->esp,
+                      prev_process ? &prev_process->on_cpu : &boot_on_cpu);
 }
 
 /**
- * 保存进程上下文
+ * 锁住PID表
  */
-void process_save_context(process_t *process) {
-    if (!process) {
-        return;
+void process_table_lock(void) {
+    while (__sync_lock_test_and_set(&pid_lock, 1)) {
+        while (pid_lock) {
+            asm volatile ("pause");
+        }
     }
-
-    /* 保存通用寄存器 - 分批保存以避免寄存器约束冲突 */
-    asm volatile ("movl %%eax, %0" : "=m" (process->eax));
-    asm volatile ("movl %%ebx, %0" : "=m" (process->ebx));
-    asm volatile ("movl %%ecx, %0" : "=m" (process->ecx));
-    asm volatile ("movl %%edx, %0" : "=m" (process->edx));
-    asm volatile ("movl %%esi, %0" : "=m" (process->esi));
-    asm volatile ("movl %%edi, %0" : "=m" (process->edi));
-    asm volatile ("movl %%ebp, %0" : "=m" (process->ebp));
-    asm volatile ("movl %%esp, %0" : "=m" (process->esp));
-
-    /* 保存标志寄存器 */
-    asm volatile ("pushfl; popl %0" : "=m" (process->flags));
-
-    /* 保存指令指针（近似值） */
-    asm volatile ("movl $1f, %0" : "=m" (process->eip));
 }
 
 /**
- * 恢复进程上下文
+ * 解锁PID表
  */
-void process_restore_context(process_t *process) {
-    if (!process) {
-        return;
-    }
+void process_table_unlock(void) {
+    __sync_lock_release(&pid_lock);
+}
 
-    /* 恢复指令指针和寄存器 */
-    asm volatile (
-        "movl %0, %%eax\n"
-        "jmp *%%eax\n"
-        "1:\n"
-        "movl %1, %%ebx\n"
-        "movl %2, %%ecx\n"
-        "movl %3, %%edx\n"
-        "movl %4, %%esi\n"
-        "movl %5, %%edi\n"
-        :
-        : "m" (process->eip),
-          "m" (process->ebx),
-          "m" (process->ecx),
-          "m" (process->edx),
-          "m" (process->esi),
-          "m" (process->edi)
-    );
-
-    /* 恢复栈和基址指针 */
-    asm volatile (
-        "movl %0, %%ebp\n"
-        "movl %1, %%esp\n"
-        :
-        : "m" (process->ebp),
-          "m" (process->esp)
-    );
-
-    /* 恢复标志寄存器 */
-    asm volatile ("pushl %0; popfl" :: "m" (process->flags));
-}
-
-/**
- * 进程间通信 - 发送消息
- */
-int32_t ipc_send(uint32_t receiver_pid, void *data, uint32_t size, uint32_t type) {
-    ipc_message_t *message;
-
-    if (size > IPC_MESSAGE_SIZE || !data) {
-        return -1;
-    }
+/**
+ * 按PID查找进程
+ */
+process_t *process_find(uint32_t pid) {
+    process_t *process = pid_hash[pid_hash_index(pid)];
 
-    if (ipc_queue_count >= IPC_QUEUE_SIZE) {
-        return -1; /* 队列满 */
+    while (process && process->pid != pid) {
+        process = process->pid_next;
     }
-
-    message = &ipc_queue[ipc_queue_tail];
-    message->sender_pid = current_process ? current_process->pid : 0;
-    message->receiver_pid = receiver_pid;
-    message->type = type;
-    message->size = size;
-    memcpy(message->data, data, size);
-
-    ipc_queue_tail = (ipc_queue_tail + 1) % IPC_QUEUE_SIZE;
-    ipc_queue_count++;
-
-    return 0;
+    return process;
 }
 
 /**
- * 进程间通信 - 接收消息
+ * 遍历PID表
  */
-int32_t ipc_receive(uint32_t *sender_pid, void *data, uint32_t *size, uint32_t type) {
-    uint32_t i;
-    ipc_message_t *message;
+process_t *process_next(process_t *process) {
+    uint32_t index = 0;
 
-    if (!data || !size) {
-        return -1;
+    if (process) {
+        if (process->pid_next) {
+            return process->pid_next;
+        }
+        index = pid_hash_index(process->pid) + 1;
     }
 
-    /* 在队列中查找目标消息 */
-    for (i = 0; i < ipc_queue_count; i++) {
-        uint32_t index = (ipc_queue_head + i) % IPC_QUEUE_SIZE;
-        message = &ipc_queue[index];
-
-        if (message->receiver_pid == (current_process ? current_process->pid : 0) ||
-            message->receiver_pid == 0) { /* 广播消息 */
-
-            if (type == 0 || message->type == type) {
-                /* 找到消息，复制数据 */
-                if (sender_pid) *sender_pid = message->sender_pid;
-                *size = (message->size < *size) ? message->size : *size;
-                memcpy(data, message->data, *size);
-
-                /* 从队列中移除消息 */
-                ipc_queue_head = (ipc_queue_head + 1) % IPC_QUEUE_SIZE;
-                ipc_queue_count--;
-
-                return 0;
-            }
+    for (; index < PID_HASH_SIZE; index++) {
+        if (pid_hash[index]) {
+            return pid_hash[index];
         }
     }
-
-    return -1; /* 没有找到消息 */
+    return NULL;
 }
 
 /* timer_get_frequency函数已在timer.c中定义，这里不需要重复定义 */
@@ -0,0 +1,679 @@
+/**
+ * M4KK1 Scheduler Implementation
+ * 实时类与公平类调度器实现
+ *
+ * 实时类每个优先级维护一条侵入式双向FIFO链表，位图记录非空的优先级。
+ * 选取下一个进程时用find-first-set定位最高优先级（数值最小），
+ * 同一优先级内严格按入队顺序轮转。
+ *
+ * 公平类按vruntime把进程插入红黑树。进程每运行一个时钟滴答，vruntime
+ * 增加与权重成反比的量，因此各进程得到的CPU时间与权重成正比，低权重
+ * 的进程也不会饿死。实时类非空时公平类不运行。
+ *
+ * 每个处理器有自己的运行队列和自旋锁。进程留在上次运行的处理器上，
+ * 新进程放到就绪进程最少的处理器；本地队列为空的处理器从就绪进程最多
+ * 的队列窃取一个进程。唤醒其他处理器上的进程时，如果目标处理器空闲或
+ * 需要被抢占，发送重新调度中断。
+ */
+
+#include "sched.h"
+#include "timer.h"
+#include "kernel.h"
+#include "arch.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 每个处理器的运行队列 */
+static run_queue_t sched_rqs[SMP_MAX_CPUS];
+
+/* nice值到权重的映射，相邻nice值的CPU份额约差10% */
+static const uint32_t sched_nice_weight[SCHED_NICE_MAX - SCHED_NICE_MIN + 1] = {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */  9548,  7620,  6100,  4904,  3906,
+    /*  -5 */  3121,  2501,  1991,  1586,  1277,
+    /*   0 */  1024,   820,   655,   526,   423,
+    /*   5 */   335,   272,   215,   172,   137,
+    /*  10 */   110,    87,    70,    56,    45,
+    /*  15 */    36,    29,    23,    18,    15,
+};
+
+/**
+ * 初始化运行队列
+ */
+void run_queue_init(run_queue_t *rq) {
+    uint32_t i;
+
+    rq->lock = 0;
+    rq->bitmap = 0;
+    rq->nr_ready = 0;
+    rq->curr_priority = SCHED_PRIORITY_IDLE;
+    rq->steals = 0;
+    for (i = 0; i < PROCESS_PRIORITY_LEVELS; i++) {
+        rq->head[i] = NULL;
+        rq->tail[i] = NULL;
+    }
+    rb_root_init(&rq->fair);
+    rq->nr_fair = 0;
+    rq->min_vruntime = 0;
+}
+
+/**
+ * 按vruntime插入公平类树（相同vruntime排在已有进程之后）
+ */
+static void fair_enqueue(run_queue_t *rq, process_t *process) {
+    rb_node_t **link = &rq->fair.node;
+    rb_node_t *parent = NULL;
+    bool leftmost = true;
+
+    /* 长时间睡眠的进程只保留有限的补偿 */
+    if (rq->min_vruntime > SCHED_FAIR_SLEEPER_CREDIT &&
+        process->vruntime < rq->min_vruntime - SCHED_FAIR_SLEEPER_CREDIT) {
+        process->vruntime = rq->min_vruntime - SCHED_FAIR_SLEEPER_CREDIT;
+    }
+
+    while (*link) {
+        parent = *link;
+        if (process->vruntime < rb_entry(parent, process_t, rb_node)->vruntime) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = false;
+        }
+    }
+
+    rb_insert(&rq->fair, &process->rb_node, parent, link, leftmost);
+    rq->nr_fair++;
+}
+
+/**
+ * 将进程加入其优先级的队尾
+ */
+void run_queue_enqueue(run_queue_t *rq, process_t *process) {
+    uint32_t priority = process->priority;
+
+    if (process->on_rq) {
+        return;
+    }
+
+    if (process->policy == PROCESS_POLICY_FAIR) {
+        fair_enqueue(rq, process);
+        process->on_rq = 1;
+        rq->nr_ready++;
+        return;
+    }
+
+    process->rq_next = NULL;
+    process->rq_prev = rq->tail[priority];
+    if (rq->tail[priority]) {
+        rq->tail[priority]->rq_next = process;
+    } else {
+        rq->head[priority] = process;
+        rq->bitmap |= 1U << priority;
+    }
+    rq->tail[priority] = process;
+
+    process->on_rq = 1;
+    rq->nr_ready++;
+}
+
+/**
+ * 将进程从队列中移除
+ */
+void run_queue_dequeue(run_queue_t *rq, process_t *process) {
+    uint32_t priority = process->priority;
+
+    if (!process->on_rq) {
+        return;
+    }
+
+    if (process->policy == PROCESS_POLICY_FAIR) {
+        rb_erase(&rq->fair, &process->rb_node);
+        rq->nr_fair--;
+        process->on_rq = 0;
+        rq->nr_ready--;
+        return;
+    }
+
+    if (process->rq_prev) {
+        process->rq_prev->rq_next = process->rq_next;
+    } else {
+        rq->head[priority] = process->rq_next;
+    }
+
+    if (process->rq_next) {
+        process->rq_next->rq_prev = process->rq_prev;
+    } else {
+        rq->tail[priority] = process->rq_prev;
+    }
+
+    if (!rq->head[priority]) {
+        rq->bitmap &= ~(1U << priority);
+    }
+
+    process->rq_next = NULL;
+    process->rq_prev = NULL;
+    process->on_rq = 0;
+    rq->nr_ready--;
+}
+
+/**
+ * 取出下一个进程
+ */
+process_t *run_queue_pick(run_queue_t *rq) {
+    process_t *process;
+
+    if (rq->bitmap) {
+        process = rq->head[__builtin_ctz(rq->bitmap)];
+    } else if (rb_first(&rq->fair)) {
+        process = rb_entry(rb_first(&rq->fair), process_t, rb_node);
+        /* 最左节点的vruntime是队列中最小的，虚拟时钟推进到这里 */
+        if (process->vruntime > rq->min_vruntime) {
+            rq->min_vruntime = process->vruntime;
+        }
+    } else {
+        return NULL;
+    }
+
+    run_queue_dequeue(rq, process);
+    return process;
+}
+
+/**
+ * 取出一个可以迁移到其他处理器的进程
+ */
+process_t *run_queue_steal(run_queue_t *from, run_queue_t *to) {
+    process_t *process = NULL;
+    uint32_t bitmap = from->bitmap;
+    rb_node_t *node;
+
+    /* 被抢占的进程入队后还要在原处理器上完成切换，这之前不能在别处运行 */
+    while (bitmap && !process) {
+        process = from->head[__builtin_ctz(bitmap)];
+        while (process && process->on_cpu) {
+            process = process->rq_next;
+        }
+        bitmap &= bitmap - 1;
+    }
+
+    for (node = rb_first(&from->fair); node && !process; node = rb_next(node)) {
+        if (!rb_entry(node, process_t, rb_node)->on_cpu) {
+            process = rb_entry(node, process_t, rb_node);
+        }
+    }
+
+    if (!process) {
+        return NULL;
+    }
+
+    run_queue_dequeue(from, process);
+    if (process->policy == PROCESS_POLICY_FAIR) {
+        process->vruntime = process->vruntime - from->min_vruntime + to->min_vruntime;
+    }
+    return process;
+}
+
+/**
+ * 队列中是否有比priority更高优先级的进程
+ */
+bool run_queue_preempts(const run_queue_t *rq, uint32_t priority) {
+    /* 空闲时任何就绪进程都可抢占 */
+    if (priority >= SCHED_PRIORITY_IDLE) {
+        return rq->nr_ready != 0;
+    }
+
+    /* SCHED_PRIORITY_FAIR时掩码覆盖全部实时优先级 */
+    return (rq->bitmap & (uint32_t)((1ULL << priority) - 1)) != 0;
+}
+
+/**
+ * 优先级对应的公平调度权重
+ */
+uint32_t sched_priority_weight(uint32_t priority) {
+    int32_t nice = (int32_t)priority - PROCESS_PRIORITY_NORMAL;
+
+    if (nice < SCHED_NICE_MIN) {
+        nice = SCHED_NICE_MIN;
+    } else if (nice > SCHED_NICE_MAX) {
+        nice = SCHED_NICE_MAX;
+    }
+
+    return sched_nice_weight[nice - SCHED_NICE_MIN];
+}
+
+/**
+ * 为公平进程记运行时间
+ */
+void sched_charge(process_t *process, uint64_t delta_ns) {
+    if (process->policy == PROCESS_POLICY_FAIR && process->weight) {
+        uint32_t mult = (SCHED_NICE_0_WEIGHT << SCHED_WEIGHT_SHIFT) / process->weight;
+        process->vruntime += clock_mul_shift(delta_ns, mult, SCHED_WEIGHT_SHIFT);
+    }
+}
+
+/**
+ * 进程运行时在运行队列中记录的优先级
+ */
+static inline uint32_t sched_curr_priority(const process_t *process) {
+    if (!process || process->policy == PROCESS_POLICY_IDLE) {
+        return SCHED_PRIORITY_IDLE;
+    }
+    return process->policy == PROCESS_POLICY_FAIR ? SCHED_PRIORITY_FAIR : process->priority;
+}
+
+/**
+ * 单处理器默认实现，由架构层的多处理器支持覆盖
+ */
+__attribute__((weak)) uint32_t smp_cpu_id(void) {
+    return 0;
+}
+
+__attribute__((weak)) uint32_t smp_cpu_count(void) {
+    return 1;
+}
+
+__attribute__((weak)) void smp_send_reschedule(uint32_t cpu) {
+    (void)cpu;
+}
+
+/**
+ * 运行队列加锁（调用者已关中断）
+ */
+static inline void rq_lock(run_queue_t *rq) {
+    while (__sync_lock_test_and_set(&rq->lock, 1)) {
+        while (rq->lock) {
+            __asm__ volatile ("pause");
+        }
+    }
+}
+
+/**
+ * 运行队列解锁
+ */
+static inline void rq_unlock(run_queue_t *rq) {
+    __sync_lock_release(&rq->lock);
+}
+
+/**
+ * 就绪进程最少的处理器（优先选择空闲的处理器）
+ */
+static uint32_t sched_select_cpu(void) {
+    uint32_t count = smp_cpu_count();
+    uint32_t best = smp_cpu_id();
+    uint32_t best_load = sched_rqs[best].nr_ready +
+                         (sched_rqs[best].curr_priority != SCHED_PRIORITY_IDLE);
+
+    for (uint32_t cpu = 0; cpu < count; cpu++) {
+        uint32_t load = sched_rqs[cpu].nr_ready +
+                        (sched_rqs[cpu].curr_priority != SCHED_PRIORITY_IDLE);
+        if (load < best_load) {
+            best = cpu;
+            best_load = load;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * 从就绪进程最多的队列窃取一个进程
+ * 不加锁扫描各队列长度，只锁定被窃取的队列
+ */
+static process_t *sched_steal(uint32_t cpu) {
+    uint32_t count = smp_cpu_count();
+    uint32_t busiest = SCHED_CPU_NONE;
+    uint32_t max_ready = 0;
+    process_t *process;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (i != cpu && sched_rqs[i].nr_ready > max_ready) {
+            busiest = i;
+            max_ready = sched_rqs[i].nr_ready;
+        }
+    }
+
+    if (busiest == SCHED_CPU_NONE) {
+        return NULL;
+    }
+
+    rq_lock(&sched_rqs[busiest]);
+    process = run_queue_steal(&sched_rqs[busiest], &sched_rqs[cpu]);
+    if (process) {
+        process->cpu = cpu;
+    }
+    rq_unlock(&sched_rqs[busiest]);
+
+    if (process) {
+        sched_rqs[cpu].steals++;
+    }
+    return process;
+}
+
+/**
+ * 初始化所有处理器的运行队列
+ */
+void sched_init(void) {
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        run_queue_init(&sched_rqs[cpu]);
+    }
+}
+
+/**
+ * 获取处理器的运行队列
+ */
+run_queue_t *sched_cpu_rq(uint32_t cpu) {
+    return cpu < SMP_MAX_CPUS ? &sched_rqs[cpu] : NULL;
+}
+
+/**
+ * 将进程加入其所属处理器的运行队列
+ */
+void sched_enqueue(process_t *process) {
+    uintptr_t flags = arch_irq_save();
+    uint32_t cpu = process->cpu;
+    run_queue_t *rq;
+    bool resched;
+
+    if (cpu >= smp_cpu_count()) {
+        cpu = sched_select_cpu();
+    }
+
+    rq = &sched_rqs[cpu];
+    rq_lock(rq);
+    process->cpu = cpu;
+    run_queue_enqueue(rq, process);
+    resched = run_queue_preempts(rq, rq->curr_priority);
+    rq_unlock(rq);
+
+    if (resched && cpu != smp_cpu_id()) {
+        smp_send_reschedule(cpu);
+    }
+    arch_irq_restore(flags);
+}
+
+/**
+ * 一次加入多个进程
+ * 连续属于同一处理器的进程只加一次锁，每个处理器最多发送一次重新调度中断
+ */
+void sched_enqueue_list(process_t *list) {
+    uintptr_t flags = arch_irq_save();
+    uint32_t self = smp_cpu_id();
+    uint32_t resched = 0;
+    run_queue_t *locked = NULL;
+
+    while (list) {
+        process_t *process = list;
+        uint32_t cpu = process->cpu;
+        run_queue_t *rq;
+
+        list = process->rq_next;
+        process->rq_next = NULL;
+
+        if (cpu >= smp_cpu_count()) {
+            cpu = sched_select_cpu();
+        }
+
+        rq = &sched_rqs[cpu];
+        if (rq != locked) {
+            if (locked) {
+                rq_unlock(locked);
+            }
+            rq_lock(rq);
+            locked = rq;
+        }
+
+        process->cpu = cpu;
+        run_queue_enqueue(rq, process);
+        if (run_queue_preempts(rq, rq->curr_priority)) {
+            resched |= 1U << cpu;
+        }
+    }
+
+    if (locked) {
+        rq_unlock(locked);
+    }
+
+    for (uint32_t cpu = 0; resched; cpu++) {
+        if ((resched & (1U << cpu)) && cpu != self) {
+            smp_send_reschedule(cpu);
+        }
+        resched &= ~(1U << cpu);
+    }
+    arch_irq_restore(flags);
+}
+
+/**
+ * 将进程移出运行队列
+ * 进程只会在出队后改变所属处理器，因此在队列中时一定位于process->cpu
+ */
+void sched_dequeue(process_t *process) {
+    uintptr_t flags = arch_irq_save();
+    uint32_t cpu = process->cpu;
+
+    if (cpu < SMP_MAX_CPUS) {
+        rq_lock(&sched_rqs[cpu]);
+        run_queue_dequeue(&sched_rqs[cpu], process);
+        rq_unlock(&sched_rqs[cpu]);
+    }
+    arch_irq_restore(flags);
+}
+
+/**
+ * 直接切换到阻塞在本处理器上的进程
+ */
+bool sched_handoff(process_t *process) {
+    uintptr_t flags = arch_irq_save();
+    uint32_t cpu = smp_cpu_id();
+    run_queue_t *rq = &sched_rqs[cpu];
+    bool allowed;
+
+    rq_lock(rq);
+    allowed = process->cpu == cpu && !process->on_rq &&
+              !run_queue_preempts(rq, sched_curr_priority(process));
+    if (allowed) {
+        if (process->policy == PROCESS_POLICY_FAIR &&
+            rq->min_vruntime > SCHED_FAIR_SLEEPER_CREDIT &&
+            process->vruntime < rq->min_vruntime - SCHED_FAIR_SLEEPER_CREDIT) {
+            process->vruntime = rq->min_vruntime - SCHED_FAIR_SLEEPER_CREDIT;
+        }
+        rq->curr_priority = sched_curr_priority(process);
+    }
+    rq_unlock(rq);
+
+    arch_irq_restore(flags);
+    return allowed;
+}
+
+/**
+ * 取出当前处理器的下一个进程
+ */
+process_t *sched_pick_next(void) {
+    uintptr_t flags = arch_irq_save();
+    uint32_t cpu = smp_cpu_id();
+    run_queue_t *rq = &sched_rqs[cpu];
+    process_t *process;
+
+    rq_lock(rq);
+    process = run_queue_pick(rq);
+    rq_unlock(rq);
+
+    if (!process) {
+        process = sched_steal(cpu);
+    }
+
+    rq->curr_priority = sched_curr_priority(process);
+    arch_irq_restore(flags);
+    return process;
+}
+
+/**
+ * 当前处理器上是否有比该进程优先级更高的就绪进程
+ */
+bool sched_should_preempt(const process_t *process) {
+    run_queue_t *rq = &sched_rqs[smp_cpu_id()];
+    uintptr_t flags;
+    bool preempt;
+
+    if (process->policy != PROCESS_POLICY_FAIR) {
+        return run_queue_preempts(rq, sched_curr_priority(process));
+    }
+
+    if (rq->bitmap) {
+        return true;
+    }
+
+    /* 领先最落后的就绪进程超过粒度时让出CPU */
+    flags = arch_irq_save();
+    rq_lock(rq);
+    preempt = rb_first(&rq->fair) &&
+              process->vruntime > rb_entry(rb_first(&rq->fair), process_t, rb_node)->vruntime +
+                                  SCHED_FAIR_GRANULARITY;
+    rq_unlock(rq);
+    arch_irq_restore(flags);
+
+    return preempt;
+}
+
+/**
+ * 所有处理器的就绪进程数
+ */
+uint32_t sched_nr_ready(void) {
+    uint32_t count = smp_cpu_count();
+    uint32_t total = 0;
+
+    for (uint32_t cpu = 0; cpu < count; cpu++) {
+        total += sched_rqs[cpu].nr_ready;
+    }
+
+    return total;
+}
+
+/**
+ * 修改进程优先级
+ */
+void sched_set_priority(process_t *process, uint32_t priority) {
+    uintptr_t flags;
+    uint32_t cpu;
+
+    if (priority >= PROCESS_PRIORITY_LEVELS || process->priority == priority) {
+        return;
+    }
+
+    flags = arch_irq_save();
+    cpu = process->cpu;
+    if (cpu < SMP_MAX_CPUS) {
+        rq_lock(&sched_rqs[cpu]);
+        if (process->on_rq) {
+            run_queue_dequeue(&sched_rqs[cpu], process);
+            process->priority = priority;
+            process->weight = sched_priority_weight(priority);
+            run_queue_enqueue(&sched_rqs[cpu], process);
+        } else {
+            process->priority = priority;
+            process->weight = sched_priority_weight(priority);
+        }
+        rq_unlock(&sched_rqs[cpu]);
+    } else {
+        process->priority = priority;
+        process->weight = sched_priority_weight(priority);
+    }
+    arch_irq_restore(flags);
+}
+
+/**
+ * 修改进程调度策略
+ */
+int32_t sched_set_policy(process_t *process, uint32_t policy) {
+    uintptr_t flags;
+    uint32_t cpu;
+    bool queued = false;
+
+    if (policy != PROCESS_POLICY_RT && policy != PROCESS_POLICY_FAIR) {
+        return -1;
+    }
+    if (process->policy == policy) {
+        return 0;
+    }
+
+    flags = arch_irq_save();
+    cpu = process->cpu;
+    if (cpu < SMP_MAX_CPUS) {
+        rq_lock(&sched_rqs[cpu]);
+        queued = process->on_rq;
+        run_queue_dequeue(&sched_rqs[cpu], process);
+    }
+
+    process->policy = policy;
+    process->weight = sched_priority_weight(process->priority);
+    if (policy == PROCESS_POLICY_FAIR && cpu < SMP_MAX_CPUS) {
+        process->vruntime = sched_rqs[cpu].min_vruntime;
+    }
+
+    if (cpu < SMP_MAX_CPUS) {
+        if (queued) {
+            run_queue_enqueue(&sched_rqs[cpu], process);
+        }
+        rq_unlock(&sched_rqs[cpu]);
+    }
+    arch_irq_restore(flags);
+
+    return 0;
+}
+
+/**
+ * 按唤醒滴答插入睡眠队列（回绕比较，相同滴答排在已有进程之后）
+ */
+void sleep_queue_add(rb_root_t *queue, process_t *process) {
+    rb_node_t **link = &queue->node;
+    rb_node_t *parent = NULL;
+    bool leftmost = true;
+
+    while (*link) {
+        parent = *link;
+        if ((int32_t)(process->wake_tick - rb_entry(parent, process_t, sleep_node)->wake_tick) < 0) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = false;
+        }
+    }
+
+    rb_insert(queue, &process->sleep_node, parent, link, leftmost);
+    process->on_sleep = 1;
+}
+
+/**
+ * 移出睡眠队列
+ */
+void sleep_queue_del(rb_root_t *queue, process_t *process) {
+    if (process->on_sleep) {
+        rb_erase(queue, &process->sleep_node);
+        process->on_sleep = 0;
+    }
+}
+
+/**
+ * 从最早的唤醒滴答开始取出到期进程，直到遇到未到期的
+ */
+process_t *sleep_queue_pop_expired(rb_root_t *queue, uint32_t now) {
+    process_t *woken = NULL;
+    process_t **tail = &woken;
+    rb_node_t *node;
+
+    while ((node = rb_first(queue)) != NULL) {
+        process_t *process = rb_entry(node, process_t, sleep_node);
+
+        if ((int32_t)(process->wake_tick - now) > 0) {
+            break;
+        }
+
+        rb_erase(queue, node);
+        process->on_sleep = 0;
+        process->state = PROCESS_STATE_READY;
+        process->rq_next = NULL;
+        *tail = process;
+        tail = &process->rq_next;
+    }
+
+    return woken;
+}
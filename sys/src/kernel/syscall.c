@@ -9,9 +9,18 @@
 #include <console.h>
 #include <kernel.h>
 #include <process.h>
+#include <sched.h>
+#include <fpu.h>
+#include <memory.h>
+#include <vm.h>
 #include <syscall.h>
 #include <idt.h>
 #include <ldso.h>
+#include <alloc_trace.h>
+#include <gdt.h>
+
+/* 汇编函数声明（arch/m4kk1/idt.asm） */
+extern void isr_syscall(void);
 
 /**
  * 系统调用处理函数类型
@@ -72,6 +81,11 @@ static struct {
 #define PERMISSION_LEVEL_USER    0x00000001  /* 用户权限 */
 #define PERMISSION_LEVEL_SYSTEM  0x000000FF  /* 系统权限 */
 
+/**
+ * 从用户空间复制的路径名的最大长度（含结尾的0）
+ */
+#define SYSCALL_PATH_MAX         256
+
 /**
  * 初始化系统调用表
  */
@@ -100,46 +114,41 @@ static bool syscall_check_permission(uint32_t syscall_num, uint32_t current_perm
 }
 
 /**
- * 保存寄存器状态
+ * 检查[addr, addr+size)完全位于当前进程的用户地址空间内
  */
-static void syscall_save_registers(uint32_t *regs) {
-    __asm__ volatile (
-        "movl %%ebx, 0(%0)\n"
-        "movl %%ecx, 4(%0)\n"
-        "movl %%edx, 8(%0)\n"
-        "movl %%esi, 12(%0)\n"
-        "movl %%edi, 16(%0)\n"
-        "movl %%ebp, 20(%0)\n"
-        : : "r"(regs) : "memory"
-    );
+static bool syscall_user_range(uint32_t addr, uint32_t size) {
+    process_t *process = process_get_current();
+
+    return process && process->cr3 && addr >= PROCESS_USER_BASE &&
+           size <= PROCESS_USER_STACK_TOP && addr <= PROCESS_USER_STACK_TOP - size;
 }
 
 /**
- * 恢复寄存器状态
+ * 从用户空间复制以0结尾的字符串
+ * @return 成功返回0，地址无效或超过size返回-1
  */
-static void syscall_restore_registers(uint32_t *regs) {
-    __asm__ volatile (
-        "movl 0(%0), %%ebx\n"
-        "movl 4(%0), %%ecx\n"
-        "movl 8(%0), %%edx\n"
-        "movl 12(%0), %%esi\n"
-        "movl 16(%0), %%edi\n"
-        "movl 20(%0), %%ebp\n"
-        : : "r"(regs) : "memory"
-    );
+static int32_t syscall_copy_string(char *dest, uint32_t src, uint32_t size) {
+    uint32_t i;
+
+    for (i = 0; i < size; i++) {
+        if (!syscall_user_range(src + i, 1)) {
+            return -1;
+        }
+        dest[i] = ((const char *)src)[i];
+        if (dest[i] == '\0') {
+            return 0;
+        }
+    }
+    return -1;
 }
 
 /**
  * 系统调用处理函数
- * 这是中断0x80的中断处理函数
+ * 由中断0x80的入口isr_syscall调用，参数和返回值都经过入口保存的现场
  */
-void syscall_handler(void) {
-    uint32_t syscall_num;
+void syscall_handler(syscall_frame_t *frame) {
+    uint32_t syscall_num = frame->eax;
     uint32_t result = SYSCALL_ERROR;
-    uint32_t saved_registers[6]; /* ebx, ecx, edx, esi, edi, ebp */
-
-    /* 获取系统调用号（从EAX） */
-    __asm__ volatile ("movl %%eax, %0" : "=r"(syscall_num));
 
     /* 统计总调用次数 */
     syscall_stats.total_calls++;
@@ -188,24 +197,22 @@ void syscall_handler(void) {
         goto syscall_return;
     }
 
-    /* 保存寄存器状态 */
-    syscall_save_registers(saved_registers);
-
     /* 调用系统调用处理函数 */
     syscall_handler_t handler = syscall_table[syscall_num].handler;
     if (handler != NULL) {
-        /* 从寄存器获取参数 */
-        uint32_t arg1, arg2, arg3, arg4, arg5;
-        __asm__ volatile (
-            "movl %%ebx, %0\n"
-            "movl %%ecx, %1\n"
-            "movl %%edx, %2\n"
-            "movl %%esi, %3\n"
-            "movl %%edi, %4\n"
-            : "=r"(arg1), "=r"(arg2), "=r"(arg3), "=r"(arg4), "=r"(arg5)
-        );
+        struct syscall_frame *saved_frame = NULL;
+
+        /* fork和execve通过进程记录的现场复制或改写返回用户态的状态 */
+        if (current_process) {
+            saved_frame = current_process->frame;
+            current_process->frame = frame;
+        }
 
-        result = handler(arg1, arg2, arg3, arg4, arg5);
+        result = handler(frame->ebx, frame->ecx, frame->edx, frame->esi, frame->edi);
+
+        if (current_process) {
+            current_process->frame = saved_frame;
+        }
 
         KLOG_DEBUG("System call 0x");
         console_write_hex(syscall_num);
@@ -221,11 +228,8 @@ void syscall_handler(void) {
     }
 
 syscall_return:
-    /* 设置返回值到EAX寄存器 */
-    __asm__ volatile ("movl %0, %%eax" : : "r"(result));
-
-    /* 恢复寄存器状态 */
-    syscall_restore_registers(saved_registers);
+    /* 返回值经现场中的EAX交给调用者 */
+    frame->eax = result;
 }
 
 /**
@@ -240,8 +244,9 @@ void syscall_init(void) {
     /* 初始化系统调用表 */
     syscall_table_init();
 
-    /* 注册系统调用中断处理函数 */
-    idt_register_handler(0x80, syscall_handler);
+    /* 安装系统调用入口（用户态可以触发的中断门） */
+    idt_set_gate(0x80, (uint32_t)isr_syscall, GDT_KERNEL_CODE,
+                 IDT_PRESENT | IDT_DPL_3 | IDT_GATE_32BIT | IDT_INTERRUPT_GATE);
 
     /* 初始化并注册所有系统调用处理函数 */
     syscall_init_handlers();
@@ -474,6 +479,8 @@ const char *syscall_get_name(uint32_t num) {
         case SYSCALL_DL_UNLOAD_LIBRARY: return "dl_unload_library";
         case SYSCALL_DL_FIND_SYMBOL: return "dl_find_symbol";
         case SYSCALL_DL_GET_ERROR: return "dl_get_error";
+        case SYSCALL_ALLOC_TRACE: return "alloc_trace";
+        case SYSCALL_MADVISE: return "madvise";
         default: return "unknown";
     }
 }
@@ -600,25 +607,24 @@ static uint32_t syscall_exit_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3,
  */
 static uint32_t syscall_fork_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3,
                                  uint32_t arg4, uint32_t arg5) {
+    process_t *parent = process_get_current();
     process_t *child_process;
 
     KLOG_INFO("Fork system call invoked\n");
 
-    /* 创建子进程 */
-    child_process = process_create("child", PROCESS_PRIORITY_NORMAL);
+    if (!parent) {
+        return SYSCALL_ERROR;
+    }
+
+    /* 子进程从本次系统调用现场的副本返回，写时复制地共享用户页 */
+    child_process = process_fork(parent);
     if (!child_process) {
         KLOG_ERROR("Failed to create child process in fork\n");
         return SYSCALL_ERROR;
     }
 
     /* 在子进程中返回0，在父进程中返回子进程PID */
-    if (child_process->pid != process_get_current()->pid) {
-        /* 这是子进程 */
-        return 0;
-    } else {
-        /* 这是父进程 */
-        return child_process->pid;
-    }
+    return child_process->pid;
 }
 
 /**
@@ -742,20 +748,30 @@ static uint32_t syscall_close_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3,
  */
 static uint32_t syscall_execve_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3,
                                    uint32_t arg4, uint32_t arg5) {
-    const char *filename = (const char *)arg1;
-    char *const *argv = (char *const *)arg2;
-    char *const *envp = (char *const *)arg3;
+    process_t *process = process_get_current();
+    char filename[SYSCALL_PATH_MAX];
+    void *image;
+    size_t size;
+    int32_t result;
 
-    KLOG_DEBUG("Execve system call: filename=");
-    if (filename) {
-        console_write(filename);
-    } else {
-        console_write("(null)");
+    if (syscall_copy_string(filename, arg1, sizeof(filename)) != 0) {
+        return SYSCALL_ERROR;
     }
+
+    KLOG_DEBUG("Execve system call: filename=");
+    console_write(filename);
     console_write("\n");
 
-    /* 暂时不支持，返回错误 */
-    return SYSCALL_ERROR;
+    /* 参数和环境变量（arg2、arg3）暂不传给新程序 */
+    image = m4ll_read_file(filename, &size);
+    if (!image) {
+        return SYSCALL_ERROR;
+    }
+
+    /* 成功时现场已改写为从新映像的入口返回用户态 */
+    result = process_exec(process, image, (uint32_t)size);
+    kfree(image);
+    return result == 0 ? 0 : SYSCALL_ERROR;
 }
 
 /**
@@ -782,14 +798,48 @@ static uint32_t syscall_waitpid_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3
  */
 static uint32_t syscall_brk_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3,
                                 uint32_t arg4, uint32_t arg5) {
+    process_t *process = process_get_current();
     uint32_t addr = arg1;
 
     KLOG_DEBUG("Brk system call: addr=0x");
     console_write_hex(addr);
     console_write("\n");
 
-    /* 暂时不支持，返回错误 */
-    return SYSCALL_ERROR;
+    if (!process || !process->cr3 || !process->heap_start) {
+        return SYSCALL_ERROR;
+    }
+
+    return process_brk(process, addr);
+}
+
+/**
+ * 系统调用：madvise - 内存使用建议
+ * 相同页合并以地址空间为单位扫描，MADV_MERGEABLE/MADV_UNMERGEABLE作用于
+ * 整个地址空间，范围只做合法性检查
+ */
+static uint32_t syscall_madvise_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3,
+                                    uint32_t arg4, uint32_t arg5) {
+    process_t *process = process_get_current();
+    uint32_t addr = arg1;
+    uint32_t length = arg2;
+    uint32_t advice = arg3;
+
+    if (!process || !process->cr3 || (addr & (PAGE_SIZE - 1)) ||
+        addr > PROCESS_USER_STACK_TOP || length > PROCESS_USER_STACK_TOP - addr) {
+        return SYSCALL_ERROR;
+    }
+
+    switch (advice) {
+    case MADV_NORMAL:
+        return 0;
+    case MADV_MERGEABLE:
+        return vm_ksm_register(process->cr3) == 0 ? 0 : SYSCALL_ERROR;
+    case MADV_UNMERGEABLE:
+        vm_ksm_unregister(process->cr3);
+        return 0;
+    default:
+        return SYSCALL_ERROR;
+    }
 }
 
 /**
@@ -902,6 +952,31 @@ static uint32_t syscall_reboot_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3,
     return SYSCALL_ERROR;
 }
 
+#ifdef CONFIG_ALLOC_TRACE
+/**
+ * 系统调用：alloc_trace - 获取按调用点汇总的内核分配统计
+ * buf为NULL时打印到控制台，否则按存活字节数降序复制最多max条
+ */
+static uint32_t syscall_alloc_trace_impl(uint32_t arg1, uint32_t arg2, uint32_t arg3,
+                                        uint32_t arg4, uint32_t arg5) {
+    alloc_trace_site_t *buf = (alloc_trace_site_t *)arg1;
+    uint32_t max = arg2;
+
+    if (!buf) {
+        alloc_trace_dump();
+        return 0;
+    }
+
+    /* 整个输出缓冲区必须在用户地址空间内 */
+    if (max == 0 || max > PROCESS_USER_STACK_TOP / sizeof(alloc_trace_site_t) ||
+        !syscall_user_range(arg1, max * sizeof(alloc_trace_site_t))) {
+        return SYSCALL_ERROR;
+    }
+
+    return alloc_trace_get_sites(buf, max);
+}
+#endif
+
 /**
  * 初始化并注册所有系统调用
  */
@@ -918,11 +993,15 @@ void syscall_init_handlers(void) {
     syscall_register(SYSCALL_GETPID, syscall_getpid_impl);
     syscall_register(SYSCALL_GETPPID, syscall_getppid_impl);
     syscall_register(SYSCALL_BRK, syscall_brk_impl);
+    syscall_register(SYSCALL_MADVISE, syscall_madvise_impl);
     syscall_register(SYSCALL_GETCWD, syscall_getcwd_impl);
     syscall_register(SYSCALL_CHDIR, syscall_chdir_impl);
     syscall_register(SYSCALL_TIME, syscall_time_impl);
     syscall_register(SYSCALL_UNAME, syscall_uname_impl);
     syscall_register(SYSCALL_REBOOT, syscall_reboot_impl);
+#ifdef CONFIG_ALLOC_TRACE
+    syscall_register(SYSCALL_ALLOC_TRACE, syscall_alloc_trace_impl);
+#endif
 
     /* 注册动态链接器相关系统调用 */
     /* TODO: 实现动态链接器系统调用 */
@@ -0,0 +1,286 @@
+/**
+ * M4KK1 Red-Black Tree Implementation
+ * 侵入式红黑树实现
+ *
+ * 标准的带父指针红黑树，空叶子用NULL表示并视为黑色。
+ */
+
+#include "../include/rbtree.h"
+
+static inline bool rb_is_red(const rb_node_t *node) {
+    return node && node->color == RB_RED;
+}
+
+/**
+ * 以node为轴左旋
+ */
+static void rb_rotate_left(rb_root_t *root, rb_node_t *node) {
+    rb_node_t *right = node->right;
+
+    node->right = right->left;
+    if (right->left) {
+        right->left->parent = node;
+    }
+
+    right->parent = node->parent;
+    if (!node->parent) {
+        root->node = right;
+    } else if (node == node->parent->left) {
+        node->parent->left = right;
+    } else {
+        node->parent->right = right;
+    }
+
+    right->left = node;
+    node->parent = right;
+}
+
+/**
+ * 以node为轴右旋
+ */
+static void rb_rotate_right(rb_root_t *root, rb_node_t *node) {
+    rb_node_t *left = node->left;
+
+    node->left = left->right;
+    if (left->right) {
+        left->right->parent = node;
+    }
+
+    left->parent = node->parent;
+    if (!node->parent) {
+        root->node = left;
+    } else if (node == node->parent->right) {
+        node->parent->right = left;
+    } else {
+        node->parent->left = left;
+    }
+
+    left->right = node;
+    node->parent = left;
+}
+
+/**
+ * 用子树replacement替换节点node的位置
+ */
+static void rb_transplant(rb_root_t *root, rb_node_t *node, rb_node_t *replacement) {
+    if (!node->parent) {
+        root->node = replacement;
+    } else if (node == node->parent->left) {
+        node->parent->left = replacement;
+    } else {
+        node->parent->right = replacement;
+    }
+
+    if (replacement) {
+        replacement->parent = node->parent;
+    }
+}
+
+/**
+ * 链接新节点并重新平衡
+ */
+void rb_insert(rb_root_t *root, rb_node_t *node, rb_node_t *parent,
+               rb_node_t **link, bool leftmost) {
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->color = RB_RED;
+    *link = node;
+
+    if (leftmost) {
+        root->leftmost = node;
+    }
+
+    /* 红色父节点一定不是根，因此祖父节点存在 */
+    while (rb_is_red(node->parent)) {
+        rb_node_t *p = node->parent;
+        rb_node_t *g = p->parent;
+
+        if (p == g->left) {
+            rb_node_t *uncle = g->right;
+
+            if (rb_is_red(uncle)) {
+                p->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                g->color = RB_RED;
+                node = g;
+                continue;
+            }
+
+            if (node == p->right) {
+                rb_rotate_left(root, p);
+                node = p;
+                p = node->parent;
+            }
+            p->color = RB_BLACK;
+            g->color = RB_RED;
+            rb_rotate_right(root, g);
+        } else {
+            rb_node_t *uncle = g->left;
+
+            if (rb_is_red(uncle)) {
+                p->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                g->color = RB_RED;
+                node = g;
+                continue;
+            }
+
+            if (node == p->left) {
+                rb_rotate_right(root, p);
+                node = p;
+                p = node->parent;
+            }
+            p->color = RB_BLACK;
+            g->color = RB_RED;
+            rb_rotate_left(root, g);
+        }
+    }
+
+    root->node->color = RB_BLACK;
+}
+
+/**
+ * 删除黑色节点后修复：node（可能为NULL）所在子树少一个黑色节点
+ */
+static void rb_erase_fixup(rb_root_t *root, rb_node_t *node, rb_node_t *parent) {
+    while (node != root->node && !rb_is_red(node)) {
+        if (node == parent->left) {
+            rb_node_t *sibling = parent->right;
+
+            if (rb_is_red(sibling)) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_left(root, parent);
+                sibling = parent->right;
+            }
+
+            if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+
+            if (!rb_is_red(sibling->right)) {
+                sibling->left->color = RB_BLACK;
+                sibling->color = RB_RED;
+                rb_rotate_right(root, sibling);
+                sibling = parent->right;
+            }
+            sibling->color = parent->color;
+            parent->color = RB_BLACK;
+            sibling->right->color = RB_BLACK;
+            rb_rotate_left(root, parent);
+            node = root->node;
+            break;
+        } else {
+            rb_node_t *sibling = parent->left;
+
+            if (rb_is_red(sibling)) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_right(root, parent);
+                sibling = parent->left;
+            }
+
+            if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+
+            if (!rb_is_red(sibling->left)) {
+                sibling->right->color = RB_BLACK;
+                sibling->color = RB_RED;
+                rb_rotate_left(root, sibling);
+                sibling = parent->left;
+            }
+            sibling->color = parent->color;
+            parent->color = RB_BLACK;
+            sibling->left->color = RB_BLACK;
+            rb_rotate_right(root, parent);
+            node = root->node;
+            break;
+        }
+    }
+
+    if (node) {
+        node->color = RB_BLACK;
+    }
+}
+
+/**
+ * 删除节点
+ */
+void rb_erase(rb_root_t *root, rb_node_t *node) {
+    rb_node_t *child;
+    rb_node_t *parent;
+    uint32_t color = node->color;
+
+    if (root->leftmost == node) {
+        root->leftmost = rb_next(node);
+    }
+
+    if (!node->left) {
+        child = node->right;
+        parent = node->parent;
+        rb_transplant(root, node, child);
+    } else if (!node->right) {
+        child = node->left;
+        parent = node->parent;
+        rb_transplant(root, node, child);
+    } else {
+        /* 用中序后继替换被删除的节点 */
+        rb_node_t *successor = node->right;
+
+        while (successor->left) {
+            successor = successor->left;
+        }
+
+        color = successor->color;
+        child = successor->right;
+
+        if (successor->parent == node) {
+            parent = successor;
+        } else {
+            parent = successor->parent;
+            rb_transplant(root, successor, successor->right);
+            successor->right = node->right;
+            successor->right->parent = successor;
+        }
+
+        rb_transplant(root, node, successor);
+        successor->left = node->left;
+        successor->left->parent = successor;
+        successor->color = node->color;
+    }
+
+    if (color == RB_BLACK) {
+        rb_erase_fixup(root, child, parent);
+    }
+
+    node->parent = NULL;
+    node->left = NULL;
+    node->right = NULL;
+}
+
+/**
+ * 中序后继
+ */
+rb_node_t *rb_next(const rb_node_t *node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
+        }
+        return (rb_node_t *)node;
+    }
+
+    while (node->parent && node == node->parent->right) {
+        node = node->parent;
+    }
+
+    return node->parent;
+}
@@ -1,16 +1,100 @@
 /**
  * M4KK1基础字符串和内存函数
  * 实现基本的C库函数
+ *
+ * memcpy/memset/memcmp/strlen/strcmp各有逐字节、按机器字、SSE2、AVX2
+ * 四个版本，启动时由string_init()根据CPUID选择，之后经函数表调用。
+ * SIMD版本会改写向量寄存器，启用FPU上下文切换后只在fpu_kernel_begin/end
+ * 之间对足够长的内存块使用，字符串函数改用按字版本。
+ * 定义STRING_HOST_BENCH时只编译各版本本身，供宿主机基准测试直接包含。
  */
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#ifndef STRING_HOST_BENCH
 #include "../include/memory.h"
+#include "../include/string.h"
+#include "../include/fpu.h"
+#endif
 
 /**
- * 复制内存块
+ * CPUID特性位（与arch/x86_64/include/m4k_arch.h中的CPUID_FEAT_*一致）
  */
-void *memcpy(void *dest, const void *src, size_t n) {
+#ifndef CPUID_FEAT_ECX_XSAVE
+#define CPUID_FEAT_ECX_XSAVE    (1 << 26)
+#define CPUID_FEAT_ECX_OSXSAVE  (1 << 27)
+#define CPUID_FEAT_ECX_AVX      (1 << 28)
+#endif
+#ifndef CPUID_FEAT_EDX_SSE2
+#define CPUID_FEAT_EDX_SSE2     (1 << 26)
+#define CPUID_FEAT7_EBX_AVX2    (1 << 5)
+#endif
+
+/**
+ * 控制寄存器位
+ */
+#define STRING_CR0_MP           (1UL << 1)
+#define STRING_CR0_EM           (1UL << 2)
+#define STRING_CR4_OSFXSR       (1UL << 9)
+#define STRING_CR4_OSXMMEXCPT   (1UL << 10)
+#define STRING_CR4_OSXSAVE      (1UL << 18)
+#define STRING_XCR0_AVX         0x7     /* x87 | SSE | AVX */
+
+/**
+ * 短于该长度的mem*操作直接使用按字版本，避免向量化的启动开销
+ */
+#define STRING_SIMD_MIN         64
+
+/**
+ * 内核中使用SIMD版本需要保存进程的向量状态并两次写CR0，短于该长度时
+ * 直接用按字版本
+ */
+#define STRING_SIMD_KERNEL_MIN  512
+
+/**
+ * 实现编号
+ */
+#define STRING_IMPL_BYTE        0
+#define STRING_IMPL_WORD        1
+#define STRING_IMPL_SSE2        2
+#define STRING_IMPL_AVX2        3
+#define STRING_IMPL_COUNT       4
+
+#define STRING_WORD_SIZE        sizeof(uintptr_t)
+#define STRING_ONES             ((uintptr_t)-1 / 0xFF)
+#define STRING_HIGHS            (STRING_ONES * 0x80)
+#define STRING_HAS_ZERO(w)      (((w) - STRING_ONES) & ~(w) & STRING_HIGHS)
+
+/**
+ * 禁止编译器把循环识别成memcpy/memset调用（会递归回到自身）
+ */
+#define STRING_NO_BUILTIN       __attribute__((optimize("no-tree-loop-distribute-patterns")))
+#define STRING_TARGET(isa)      __attribute__((target(isa)))
+
+/**
+ * 非对齐、允许别名的访问类型
+ */
+typedef uintptr_t string_word_t __attribute__((may_alias, aligned(1)));
+typedef char string_v16_t __attribute__((vector_size(16), may_alias, aligned(1)));
+typedef char string_v32_t __attribute__((vector_size(32), may_alias, aligned(1)));
+
+/**
+ * 一组字符串函数实现
+ */
+typedef struct string_ops {
+    const char *name;
+    void *(*mem_copy)(void *dest, const void *src, size_t n);
+    void *(*mem_set)(void *s, int c, size_t n);
+    int (*mem_compare)(const void *s1, const void *s2, size_t n);
+    size_t (*str_length)(const char *s);
+    int (*str_compare)(const char *s1, const char *s2);
+} string_ops_t;
+
+/* ========== 逐字节版本（参考实现） ========== */
+
+STRING_NO_BUILTIN
+static void *memcpy_byte(void *dest, const void *src, size_t n) {
     uint8_t *d = (uint8_t *)dest;
     const uint8_t *s = (const uint8_t *)src;
 
@@ -21,10 +105,8 @@ void *memcpy(void *dest, const void *src, size_t n) {
     return dest;
 }
 
-/**
- * 填充内存块
- */
-void *memset(void *s, int c, size_t n) {
+STRING_NO_BUILTIN
+static void *memset_byte(void *s, int c, size_t n) {
     uint8_t *p = (uint8_t *)s;
 
     for (size_t i = 0; i < n; i++) {
@@ -34,6 +116,620 @@ void *memset(void *s, int c, size_t n) {
     return s;
 }
 
+static int memcmp_byte(const void *s1, const void *s2, size_t n) {
+    const uint8_t *a = (const uint8_t *)s1;
+    const uint8_t *b = (const uint8_t *)s2;
+
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return a[i] - b[i];
+        }
+    }
+
+    return 0;
+}
+
+STRING_NO_BUILTIN
+static size_t strlen_byte(const char *s) {
+    size_t len = 0;
+
+    while (s[len]) {
+        len++;
+    }
+
+    return len;
+}
+
+static int strcmp_byte(const char *s1, const char *s2) {
+    while (*s1 && *s1 == *s2) {
+        s1++;
+        s2++;
+    }
+
+    return *(const uint8_t *)s1 - *(const uint8_t *)s2;
+}
+
+/* ========== 按机器字版本 ========== */
+
+STRING_NO_BUILTIN
+static void *memcpy_word(void *dest, const void *src, size_t n) {
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    /* 对齐目标地址，源地址允许非对齐 */
+    while (n > 0 && ((uintptr_t)d & (STRING_WORD_SIZE - 1))) {
+        *d++ = *s++;
+        n--;
+    }
+
+    while (n >= STRING_WORD_SIZE) {
+        *(string_word_t *)d = *(const string_word_t *)s;
+        d += STRING_WORD_SIZE;
+        s += STRING_WORD_SIZE;
+        n -= STRING_WORD_SIZE;
+    }
+
+    while (n > 0) {
+        *d++ = *s++;
+        n--;
+    }
+
+    return dest;
+}
+
+STRING_NO_BUILTIN
+static void *memset_word(void *s, int c, size_t n) {
+    uint8_t *p = (uint8_t *)s;
+    uintptr_t pattern = STRING_ONES * (uint8_t)c;
+
+    while (n > 0 && ((uintptr_t)p & (STRING_WORD_SIZE - 1))) {
+        *p++ = (uint8_t)c;
+        n--;
+    }
+
+    while (n >= STRING_WORD_SIZE) {
+        *(string_word_t *)p = pattern;
+        p += STRING_WORD_SIZE;
+        n -= STRING_WORD_SIZE;
+    }
+
+    while (n > 0) {
+        *p++ = (uint8_t)c;
+        n--;
+    }
+
+    return s;
+}
+
+static int memcmp_word(const void *s1, const void *s2, size_t n) {
+    const uint8_t *a = (const uint8_t *)s1;
+    const uint8_t *b = (const uint8_t *)s2;
+
+    /* 找到第一个不同的字，再逐字节定位差异 */
+    while (n >= STRING_WORD_SIZE &&
+           *(const string_word_t *)a == *(const string_word_t *)b) {
+        a += STRING_WORD_SIZE;
+        b += STRING_WORD_SIZE;
+        n -= STRING_WORD_SIZE;
+    }
+
+    return memcmp_byte(a, b, n);
+}
+
+static size_t strlen_word(const char *s) {
+    const char *p = s;
+
+    while ((uintptr_t)p & (STRING_WORD_SIZE - 1)) {
+        if (*p == '\0') {
+            return p - s;
+        }
+        p++;
+    }
+
+    /* 对齐读取不会跨页，可以安全越过结尾 */
+    while (!STRING_HAS_ZERO(*(const string_word_t *)p)) {
+        p += STRING_WORD_SIZE;
+    }
+
+    while (*p) {
+        p++;
+    }
+
+    return p - s;
+}
+
+static int strcmp_word(const char *s1, const char *s2) {
+    /* 两个指针对齐偏移相同时才能同时按字读取 */
+    if ((((uintptr_t)s1 ^ (uintptr_t)s2) & (STRING_WORD_SIZE - 1)) == 0) {
+        while ((uintptr_t)s1 & (STRING_WORD_SIZE - 1)) {
+            if (*s1 == '\0' || *s1 != *s2) {
+                return *(const uint8_t *)s1 - *(const uint8_t *)s2;
+            }
+            s1++;
+            s2++;
+        }
+
+        for (;;) {
+            uintptr_t a = *(const string_word_t *)s1;
+            uintptr_t b = *(const string_word_t *)s2;
+
+            if (a != b || STRING_HAS_ZERO(a)) {
+                break;
+            }
+            s1 += STRING_WORD_SIZE;
+            s2 += STRING_WORD_SIZE;
+        }
+    }
+
+    return strcmp_byte(s1, s2);
+}
+
+/* ========== SSE2版本 ========== */
+
+STRING_TARGET("sse2")
+static void *memcpy_sse2(void *dest, const void *src, size_t n) {
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    if (n < STRING_SIMD_MIN) {
+        return memcpy_word(dest, src, n);
+    }
+
+    while (n >= 64) {
+        string_v16_t v0 = *(const string_v16_t *)(s + 0);
+        string_v16_t v1 = *(const string_v16_t *)(s + 16);
+        string_v16_t v2 = *(const string_v16_t *)(s + 32);
+        string_v16_t v3 = *(const string_v16_t *)(s + 48);
+
+        *(string_v16_t *)(d + 0) = v0;
+        *(string_v16_t *)(d + 16) = v1;
+        *(string_v16_t *)(d + 32) = v2;
+        *(string_v16_t *)(d + 48) = v3;
+        d += 64;
+        s += 64;
+        n -= 64;
+    }
+
+    while (n >= 16) {
+        *(string_v16_t *)d = *(const string_v16_t *)s;
+        d += 16;
+        s += 16;
+        n -= 16;
+    }
+
+    /* 尾部用一次与前面重叠的16字节复制收尾 */
+    if (n > 0) {
+        *(string_v16_t *)(d + n - 16) = *(const string_v16_t *)(s + n - 16);
+    }
+
+    return dest;
+}
+
+STRING_TARGET("sse2")
+static void *memset_sse2(void *s, int c, size_t n) {
+    uint8_t *p = (uint8_t *)s;
+    string_v16_t v = (string_v16_t){0} + (char)c;
+
+    if (n < STRING_SIMD_MIN) {
+        return memset_word(s, c, n);
+    }
+
+    while (n >= 64) {
+        *(string_v16_t *)(p + 0) = v;
+        *(string_v16_t *)(p + 16) = v;
+        *(string_v16_t *)(p + 32) = v;
+        *(string_v16_t *)(p + 48) = v;
+        p += 64;
+        n -= 64;
+    }
+
+    while (n >= 16) {
+        *(string_v16_t *)p = v;
+        p += 16;
+        n -= 16;
+    }
+
+    if (n > 0) {
+        *(string_v16_t *)(p + n - 16) = v;
+    }
+
+    return s;
+}
+
+STRING_TARGET("sse2")
+static int memcmp_sse2(const void *s1, const void *s2, size_t n) {
+    const uint8_t *a = (const uint8_t *)s1;
+    const uint8_t *b = (const uint8_t *)s2;
+    uint32_t mask;
+
+    if (n < 16) {
+        return memcmp_word(s1, s2, n);
+    }
+
+    for (;;) {
+        /* 最后一块与前一块重叠，重叠部分已确认相等，不影响结果 */
+        if (n < 16) {
+            a -= 16 - n;
+            b -= 16 - n;
+            n = 16;
+        }
+
+        mask = (uint32_t)__builtin_ia32_pmovmskb128(
+            *(const string_v16_t *)a == *(const string_v16_t *)b);
+        if (mask != 0xFFFF) {
+            uint32_t i = __builtin_ctz(~mask);
+            return a[i] - b[i];
+        }
+
+        if (n == 16) {
+            return 0;
+        }
+        a += 16;
+        b += 16;
+        n -= 16;
+    }
+}
+
+STRING_TARGET("sse2")
+static size_t strlen_sse2(const char *s) {
+    /* 向下对齐到16字节读取，对齐块不会跨页 */
+    const char *p = (const char *)((uintptr_t)s & ~(uintptr_t)15);
+    string_v16_t zero = {0};
+    uint32_t mask;
+
+    mask = (uint32_t)__builtin_ia32_pmovmskb128(*(const string_v16_t *)p == zero);
+    mask &= 0xFFFFu << ((uintptr_t)s & 15);
+
+    while (mask == 0) {
+        p += 16;
+        mask = (uint32_t)__builtin_ia32_pmovmskb128(*(const string_v16_t *)p == zero);
+    }
+
+    return p + __builtin_ctz(mask) - s;
+}
+
+STRING_TARGET("sse2")
+static int strcmp_sse2(const char *s1, const char *s2) {
+    string_v16_t zero = {0};
+
+    for (;;) {
+        string_v16_t a;
+        uint32_t mask;
+
+        /* 任一侧的16字节读取会跨页时逐字节前进 */
+        if (((uintptr_t)s1 & 4095) > 4096 - 16 ||
+            ((uintptr_t)s2 & 4095) > 4096 - 16) {
+            if (*s1 == '\0' || *s1 != *s2) {
+                return *(const uint8_t *)s1 - *(const uint8_t *)s2;
+            }
+            s1++;
+            s2++;
+            continue;
+        }
+
+        a = *(const string_v16_t *)s1;
+        mask = (uint32_t)__builtin_ia32_pmovmskb128(
+            (a != *(const string_v16_t *)s2) | (a == zero));
+        if (mask != 0) {
+            uint32_t i = __builtin_ctz(mask);
+            return ((const uint8_t *)s1)[i] - ((const uint8_t *)s2)[i];
+        }
+
+        s1 += 16;
+        s2 += 16;
+    }
+}
+
+/* ========== AVX2版本 ========== */
+
+STRING_TARGET("avx2")
+static void *memcpy_avx2(void *dest, const void *src, size_t n) {
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    if (n < STRING_SIMD_MIN) {
+        return memcpy_word(dest, src, n);
+    }
+
+    while (n >= 128) {
+        string_v32_t v0 = *(const string_v32_t *)(s + 0);
+        string_v32_t v1 = *(const string_v32_t *)(s + 32);
+        string_v32_t v2 = *(const string_v32_t *)(s + 64);
+        string_v32_t v3 = *(const string_v32_t *)(s + 96);
+
+        *(string_v32_t *)(d + 0) = v0;
+        *(string_v32_t *)(d + 32) = v1;
+        *(string_v32_t *)(d + 64) = v2;
+        *(string_v32_t *)(d + 96) = v3;
+        d += 128;
+        s += 128;
+        n -= 128;
+    }
+
+    while (n >= 32) {
+        *(string_v32_t *)d = *(const string_v32_t *)s;
+        d += 32;
+        s += 32;
+        n -= 32;
+    }
+
+    if (n > 0) {
+        *(string_v32_t *)(d + n - 32) = *(const string_v32_t *)(s + n - 32);
+    }
+
+    return dest;
+}
+
+STRING_TARGET("avx2")
+static void *memset_avx2(void *s, int c, size_t n) {
+    uint8_t *p = (uint8_t *)s;
+    string_v32_t v = (string_v32_t){0} + (char)c;
+
+    if (n < STRING_SIMD_MIN) {
+        return memset_word(s, c, n);
+    }
+
+    while (n >= 128) {
+        *(string_v32_t *)(p + 0) = v;
+        *(string_v32_t *)(p + 32) = v;
+        *(string_v32_t *)(p + 64) = v;
+        *(string_v32_t *)(p + 96) = v;
+        p += 128;
+        n -= 128;
+    }
+
+    while (n >= 32) {
+        *(string_v32_t *)p = v;
+        p += 32;
+        n -= 32;
+    }
+
+    if (n > 0) {
+        *(string_v32_t *)(p + n - 32) = v;
+    }
+
+    return s;
+}
+
+STRING_TARGET("avx2")
+static int memcmp_avx2(const void *s1, const void *s2, size_t n) {
+    const uint8_t *a = (const uint8_t *)s1;
+    const uint8_t *b = (const uint8_t *)s2;
+    uint32_t mask;
+
+    if (n < 32) {
+        return memcmp_sse2(s1, s2, n);
+    }
+
+    for (;;) {
+        if (n < 32) {
+            a -= 32 - n;
+            b -= 32 - n;
+            n = 32;
+        }
+
+        mask = (uint32_t)__builtin_ia32_pmovmskb256(
+            *(const string_v32_t *)a == *(const string_v32_t *)b);
+        if (mask != 0xFFFFFFFFu) {
+            uint32_t i = __builtin_ctz(~mask);
+            return a[i] - b[i];
+        }
+
+        if (n == 32) {
+            return 0;
+        }
+        a += 32;
+        b += 32;
+        n -= 32;
+    }
+}
+
+STRING_TARGET("avx2")
+static size_t strlen_avx2(const char *s) {
+    const char *p = (const char *)((uintptr_t)s & ~(uintptr_t)31);
+    string_v32_t zero = {0};
+    uint32_t mask;
+
+    mask = (uint32_t)__builtin_ia32_pmovmskb256(*(const string_v32_t *)p == zero);
+    mask &= 0xFFFFFFFFu << ((uintptr_t)s & 31);
+
+    while (mask == 0) {
+        p += 32;
+        mask = (uint32_t)__builtin_ia32_pmovmskb256(*(const string_v32_t *)p == zero);
+    }
+
+    return p + __builtin_ctz(mask) - s;
+}
+
+STRING_TARGET("avx2")
+static int strcmp_avx2(const char *s1, const char *s2) {
+    string_v32_t zero = {0};
+
+    for (;;) {
+        string_v32_t a;
+        uint32_t mask;
+
+        if (((uintptr_t)s1 & 4095) > 4096 - 32 ||
+            ((uintptr_t)s2 & 4095) > 4096 - 32) {
+            if (*s1 == '\0' || *s1 != *s2) {
+                return *(const uint8_t *)s1 - *(const uint8_t *)s2;
+            }
+            s1++;
+            s2++;
+            continue;
+        }
+
+        a = *(const string_v32_t *)s1;
+        mask = (uint32_t)__builtin_ia32_pmovmskb256(
+            (a != *(const string_v32_t *)s2) | (a == zero));
+        if (mask != 0) {
+            uint32_t i = __builtin_ctz(mask);
+            return ((const uint8_t *)s1)[i] - ((const uint8_t *)s2)[i];
+        }
+
+        s1 += 32;
+        s2 += 32;
+    }
+}
+
+/**
+ * 实现表（按STRING_IMPL_*编号）
+ */
+static const string_ops_t string_ops_table[STRING_IMPL_COUNT] = {
+    { "byte", memcpy_byte, memset_byte, memcmp_byte, strlen_byte, strcmp_byte },
+    { "word", memcpy_word, memset_word, memcmp_word, strlen_word, strcmp_word },
+    { "sse2", memcpy_sse2, memset_sse2, memcmp_sse2, strlen_sse2, strcmp_sse2 },
+    { "avx2", memcpy_avx2, memset_avx2, memcmp_avx2, strlen_avx2, strcmp_avx2 },
+};
+
+#ifndef STRING_HOST_BENCH
+
+/**
+ * 当前使用的实现，string_init()之前只用不依赖SIMD的按字版本
+ */
+static const string_ops_t *string_ops = &string_ops_table[STRING_IMPL_WORD];
+static const string_ops_t *const string_word_ops = &string_ops_table[STRING_IMPL_WORD];
+
+/**
+ * 选择n字节内存操作的实现：返回SIMD版本时已进入内核FPU区间，调用后
+ * 需要fpu_kernel_end()
+ */
+static inline const string_ops_t *string_mem_ops(size_t n) {
+    if (string_ops == string_word_ops || n < STRING_SIMD_KERNEL_MIN || !fpu_kernel_begin()) {
+        return string_word_ops;
+    }
+    return string_ops;
+}
+
+/**
+ * 字符串函数的实现：字符串通常很短，不值得为SIMD版本保存向量状态
+ */
+static inline const string_ops_t *string_str_ops(void) {
+    return fpu_enabled() ? string_word_ops : string_ops;
+}
+
+static inline void string_cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx,
+                                uint32_t *ecx, uint32_t *edx) {
+    __asm__ volatile("cpuid"
+                     : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                     : "a"(leaf), "c"(0));
+}
+
+/**
+ * 打开SSE：清CR0.EM，置CR0.MP、CR4.OSFXSR和CR4.OSXMMEXCPT
+ */
+static void string_enable_sse(void) {
+    unsigned long cr0, cr4;
+
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 & ~STRING_CR0_EM) | STRING_CR0_MP;
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0));
+
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= STRING_CR4_OSFXSR | STRING_CR4_OSXMMEXCPT;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+}
+
+/**
+ * 打开AVX：置CR4.OSXSAVE并在XCR0中启用x87/SSE/AVX状态
+ * @return XCR0中确实启用了AVX状态返回true（虚拟机可能不允许置OSXSAVE，
+ *         此时XGETBV会产生#UD，不能执行）
+ */
+static bool string_enable_avx(void) {
+    uint32_t eax, ebx, ecx, edx;
+    unsigned long cr4;
+    uint32_t lo, hi;
+
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= STRING_CR4_OSXSAVE;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+
+    /* CPUID.1:ECX.OSXSAVE反映CR4.OSXSAVE的实际值 */
+    string_cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(ecx & CPUID_FEAT_ECX_OSXSAVE)) {
+        return false;
+    }
+
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    lo |= STRING_XCR0_AVX;
+    __asm__ volatile("xsetbv" : : "a"(lo), "d"(hi), "c"(0));
+
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (lo & STRING_XCR0_AVX) == STRING_XCR0_AVX;
+}
+
+/**
+ * 根据CPUID选择字符串函数实现
+ */
+void string_init(void) {
+    uint32_t max_leaf, eax, ebx, ecx, edx;
+    uint32_t impl = STRING_IMPL_WORD;
+
+    string_cpuid(0, &max_leaf, &ebx, &ecx, &edx);
+    string_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    if (edx & CPUID_FEAT_EDX_SSE2) {
+        string_enable_sse();
+        impl = STRING_IMPL_SSE2;
+
+        if ((ecx & CPUID_FEAT_ECX_XSAVE) && (ecx & CPUID_FEAT_ECX_AVX) &&
+            max_leaf >= 7) {
+            string_cpuid(7, &eax, &ebx, &ecx, &edx);
+            if ((ebx & CPUID_FEAT7_EBX_AVX2) && string_enable_avx()) {
+                impl = STRING_IMPL_AVX2;
+            }
+        }
+    }
+
+    string_ops = &string_ops_table[impl];
+}
+
+/**
+ * 获取当前实现名称
+ */
+const char *string_impl_name(void) {
+    return string_ops->name;
+}
+
+/**
+ * 复制内存块
+ */
+void *memcpy(void *dest, const void *src, size_t n) {
+    const string_ops_t *ops = string_mem_ops(n);
+    void *ret = ops->mem_copy(dest, src, n);
+
+    if (ops != string_word_ops) {
+        fpu_kernel_end();
+    }
+    return ret;
+}
+
+/**
+ * 填充内存块
+ */
+void *memset(void *s, int c, size_t n) {
+    const string_ops_t *ops = string_mem_ops(n);
+    void *ret = ops->mem_set(s, c, n);
+
+    if (ops != string_word_ops) {
+        fpu_kernel_end();
+    }
+    return ret;
+}
+
+/**
+ * 比较内存块
+ */
+int memcmp(const void *s1, const void *s2, size_t n) {
+    const string_ops_t *ops = string_mem_ops(n);
+    int ret = ops->mem_compare(s1, s2, n);
+
+    if (ops != string_word_ops) {
+        fpu_kernel_end();
+    }
+    return ret;
+}
+
 /**
  * 复制字符串
  */
@@ -71,25 +767,14 @@ char *strncpy(char *dest, const char *src, size_t n) {
  * 字符串长度
  */
 size_t strlen(const char *s) {
-    size_t len = 0;
-
-    while (*s++) {
-        len++;
-    }
-
-    return len;
+    return string_str_ops()->str_length(s);
 }
 
 /**
  * 字符串比较
  */
 int strcmp(const char *s1, const char *s2) {
-    while (*s1 && *s2 && (*s1 == *s2)) {
-        s1++;
-        s2++;
-    }
-
-    return (int)(*s1 - *s2);
+    return string_str_ops()->str_compare(s1, s2);
 }
 
 /**
@@ -108,4 +793,6 @@ char *strdup(const char *s) {
     }
 
     return new_str;
-}
\ No newline at end of file
+}
+
+#endif /* STRING_HOST_BENCH */
@@ -0,0 +1,274 @@
+/**
+ * M4KK1 Allocation Tracer Implementation
+ * 内核分配跟踪与按调用点统计实现
+ *
+ * 每次kmalloc/kfree和页分配/释放写入一个无锁环形缓冲区，同时维护
+ * 按地址索引的存活对象表和按调用点索引的统计表。三张表都是静态数组，
+ * 只用原子操作更新，可以在任意上下文调用，且自身不分配内存。
+ */
+
+#ifdef CONFIG_ALLOC_TRACE
+
+#include "../include/alloc_trace.h"
+#include "../include/console.h"
+#include "../include/timer.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* 开放寻址的最大探测次数，超出时丢弃记录 */
+#define ALLOC_TRACE_PROBE       32
+
+/* 存活对象表的空槽、墓碑和正在写入的标记（对象地址至少按8字节对齐） */
+#define LIVE_EMPTY              0
+#define LIVE_TOMBSTONE          1
+#define LIVE_BUSY               2
+
+/* 无调用点 */
+#define SITE_NONE               0xFFFFFFFF
+
+/* 打印的调用点数量 */
+#define ALLOC_TRACE_DUMP_SITES  16
+
+/**
+ * 存活对象
+ */
+typedef struct alloc_trace_live {
+    volatile uintptr_t ptr;
+    uint32_t site;          /* 调用点表索引 */
+    uint32_t size;
+} alloc_trace_live_t;
+
+static alloc_trace_event_t trace_events[ALLOC_TRACE_EVENTS];
+static volatile uint32_t trace_seq = 0;
+
+static alloc_trace_site_t trace_sites[ALLOC_TRACE_SITES];
+static alloc_trace_live_t trace_live[ALLOC_TRACE_LIVE];
+static volatile uint32_t trace_dropped = 0;
+
+/**
+ * 地址散列
+ */
+static inline uint32_t trace_hash(uintptr_t value) {
+    return (uint32_t)(value >> 3) * 2654435761u;
+}
+
+/**
+ * 查找或插入调用点，返回表索引
+ */
+static uint32_t site_lookup(uintptr_t site) {
+    uint32_t hash = trace_hash(site);
+
+    for (uint32_t i = 0; i < ALLOC_TRACE_PROBE; i++) {
+        uint32_t idx = (hash + i) & (ALLOC_TRACE_SITES - 1);
+        alloc_trace_site_t *entry = &trace_sites[idx];
+
+        if (entry->site == site) {
+            return idx;
+        }
+        if (entry->site == 0 &&
+            (__sync_bool_compare_and_swap(&entry->site, 0, site) || entry->site == site)) {
+            return idx;
+        }
+    }
+
+    return SITE_NONE;
+}
+
+/**
+ * 记录存活对象
+ * 先用LIVE_BUSY占住槽位，写完调用点和大小后才发布地址，其他处理器上的
+ * live_remove匹配到地址时读到的一定是这次写入的字段
+ */
+static bool live_insert(uintptr_t ptr, uint32_t site, uint32_t size) {
+    uint32_t hash = trace_hash(ptr);
+
+    for (uint32_t i = 0; i < ALLOC_TRACE_PROBE; i++) {
+        alloc_trace_live_t *entry = &trace_live[(hash + i) & (ALLOC_TRACE_LIVE - 1)];
+        uintptr_t old = entry->ptr;
+
+        if ((old == LIVE_EMPTY || old == LIVE_TOMBSTONE) &&
+            __sync_bool_compare_and_swap(&entry->ptr, old, LIVE_BUSY)) {
+            entry->site = site;
+            entry->size = size;
+            __sync_synchronize();
+            entry->ptr = ptr;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * 移除存活对象，返回其调用点和大小
+ */
+static bool live_remove(uintptr_t ptr, uint32_t *site, uint32_t *size) {
+    uint32_t hash = trace_hash(ptr);
+
+    for (uint32_t i = 0; i < ALLOC_TRACE_PROBE; i++) {
+        alloc_trace_live_t *entry = &trace_live[(hash + i) & (ALLOC_TRACE_LIVE - 1)];
+
+        if (entry->ptr == LIVE_EMPTY) {
+            return false;
+        }
+        if (entry->ptr == ptr) {
+            __sync_synchronize();
+            *site = entry->site;
+            *size = entry->size;
+            return __sync_bool_compare_and_swap(&entry->ptr, ptr, LIVE_TOMBSTONE);
+        }
+    }
+
+    return false;
+}
+
+/**
+ * 记录一次分配或释放事件
+ */
+void alloc_trace_record(uint32_t type, uintptr_t site, const void *ptr, uint32_t size) {
+    uintptr_t addr = (uintptr_t)ptr;
+    alloc_trace_event_t *event;
+    uint32_t seq;
+
+    /* 分配失败或释放NULL不计入 */
+    if (addr == 0) {
+        return;
+    }
+
+    if (type == ALLOC_TRACE_KMALLOC || type == ALLOC_TRACE_PAGE_ALLOC) {
+        uint32_t idx = site_lookup(site);
+
+        if (idx != SITE_NONE) {
+            alloc_trace_site_t *entry = &trace_sites[idx];
+            __sync_fetch_and_add(&entry->total_allocs, 1);
+            __sync_fetch_and_add(&entry->total_bytes, size);
+            __sync_fetch_and_add(&entry->live_count, 1);
+            __sync_fetch_and_add(&entry->live_bytes, size);
+        }
+
+        if (idx == SITE_NONE || !live_insert(addr, idx, size)) {
+            __sync_fetch_and_add(&trace_dropped, 1);
+        }
+    } else {
+        uint32_t idx;
+        uint32_t live_size;
+
+        if (live_remove(addr, &idx, &live_size)) {
+            size = live_size;
+            if (idx != SITE_NONE) {
+                __sync_fetch_and_sub(&trace_sites[idx].live_count, 1);
+                __sync_fetch_and_sub(&trace_sites[idx].live_bytes, live_size);
+            }
+        }
+    }
+
+    /* 槽位写完后才发布序号，读者据此丢弃正在写或已被覆盖的槽位 */
+    seq = __sync_fetch_and_add(&trace_seq, 1);
+    event = &trace_events[seq & (ALLOC_TRACE_EVENTS - 1)];
+    event->seq = seq - 1;
+    __sync_synchronize();
+    event->site = site;
+    event->ptr = addr;
+    event->size = size;
+    event->timestamp = timer_get_ticks();
+    event->type = type;
+    __sync_synchronize();
+    event->seq = seq;
+}
+
+/**
+ * 按存活字节数从大到小复制调用点统计
+ */
+uint32_t alloc_trace_get_sites(alloc_trace_site_t *sites, uint32_t max) {
+    uint32_t count = 0;
+
+    if (!sites) {
+        return 0;
+    }
+
+    /* 插入排序，只保留前max个 */
+    for (uint32_t i = 0; i < ALLOC_TRACE_SITES; i++) {
+        alloc_trace_site_t entry = trace_sites[i];
+        uint32_t pos;
+
+        if (entry.site == 0 || entry.live_bytes == 0) {
+            continue;
+        }
+
+        pos = count < max ? count : max;
+        while (pos > 0 && sites[pos - 1].live_bytes < entry.live_bytes) {
+            if (pos < max) {
+                sites[pos] = sites[pos - 1];
+            }
+            pos--;
+        }
+
+        if (pos < max) {
+            sites[pos] = entry;
+            if (count < max) {
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+/**
+ * 从序号seq开始复制事件
+ */
+uint32_t alloc_trace_get_events(alloc_trace_event_t *events, uint32_t seq, uint32_t max) {
+    uint32_t head = trace_seq;
+    uint32_t count = 0;
+
+    if (!events) {
+        return 0;
+    }
+
+    if (head - seq > ALLOC_TRACE_EVENTS) {
+        seq = head - ALLOC_TRACE_EVENTS;
+    }
+
+    for (; seq != head && count < max; seq++) {
+        alloc_trace_event_t *slot = &trace_events[seq & (ALLOC_TRACE_EVENTS - 1)];
+
+        events[count] = *slot;
+        __sync_synchronize();
+        if (events[count].seq == seq && slot->seq == seq) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * 打印存活字节数最多的调用点
+ */
+void alloc_trace_dump(void) {
+    static alloc_trace_site_t top[ALLOC_TRACE_DUMP_SITES];
+    uint32_t count = alloc_trace_get_sites(top, ALLOC_TRACE_DUMP_SITES);
+
+    console_write("=== Allocation Trace (");
+    console_write_dec(trace_seq);
+    console_write(" events, ");
+    console_write_dec(trace_dropped);
+    console_write(" dropped) ===\n");
+
+    for (uint32_t i = 0; i < count; i++) {
+        console_write("site 0x");
+        console_write_hex((uint32_t)top[i].site);
+        console_write(": live=");
+        console_write_dec(top[i].live_bytes);
+        console_write(" bytes/");
+        console_write_dec(top[i].live_count);
+        console_write(" objs, allocs=");
+        console_write_dec(top[i].total_allocs);
+        console_write(" (");
+        console_write_dec(top[i].total_bytes);
+        console_write(" bytes)\n");
+    }
+}
+
+#endif /* CONFIG_ALLOC_TRACE */
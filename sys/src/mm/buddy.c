@@ -0,0 +1,360 @@
+/**
+ * M4KK1 Buddy Page Allocator Implementation
+ * 伙伴系统物理页分配器实现
+ *
+ * 每阶维护一个空闲块双向链表，分配时从最小满足的阶拆分，
+ * 释放时与伙伴块逐阶合并。分配与释放均为O(BUDDY_MAX_ORDER)。
+ * 超过最大阶的请求扫描区内的最大阶块，取物理上相邻的一串。
+ *
+ * 这里的函数不加锁，由调用者持有zone->lock。
+ */
+
+#include "../include/buddy.h"
+#include "../include/console.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * 从空闲链表中摘除块
+ */
+static void buddy_list_del(buddy_zone_t *zone, uint32_t idx, uint32_t order) {
+    buddy_page_t *page = &zone->pages[idx];
+
+    if (page->prev != BUDDY_NONE) {
+        zone->pages[page->prev].next = page->next;
+    } else {
+        zone->free_area[order].head = page->next;
+    }
+
+    if (page->next != BUDDY_NONE) {
+        zone->pages[page->next].prev = page->prev;
+    }
+
+    page->next = BUDDY_NONE;
+    page->prev = BUDDY_NONE;
+    page->flags &= ~BUDDY_PAGE_FREE;
+    zone->free_area[order].count--;
+}
+
+/**
+ * 将块插入空闲链表头部
+ */
+static void buddy_list_add(buddy_zone_t *zone, uint32_t idx, uint32_t order) {
+    buddy_page_t *page = &zone->pages[idx];
+    uint32_t head = zone->free_area[order].head;
+
+    page->order = (uint8_t)order;
+    page->flags |= BUDDY_PAGE_FREE;
+    page->prev = BUDDY_NONE;
+    page->next = head;
+
+    if (head != BUDDY_NONE) {
+        zone->pages[head].prev = idx;
+    }
+
+    zone->free_area[order].head = idx;
+    zone->free_area[order].count++;
+}
+
+/**
+ * 初始化伙伴区域
+ */
+void buddy_zone_init(buddy_zone_t *zone, uint32_t base_pfn, uint32_t nr_pages,
+                     buddy_page_t *pages) {
+    uint32_t i;
+
+    zone->lock = 0;
+    zone->base_pfn = base_pfn;
+    zone->nr_pages = nr_pages;
+    zone->free_pages = 0;
+    zone->pages = pages;
+
+    for (i = 0; i < BUDDY_ORDER_COUNT; i++) {
+        zone->free_area[i].head = BUDDY_NONE;
+        zone->free_area[i].count = 0;
+        zone->stats[i].free_blocks = 0;
+        zone->stats[i].alloc_count = 0;
+        zone->stats[i].free_count = 0;
+        zone->stats[i].split_count = 0;
+        zone->stats[i].merge_count = 0;
+    }
+
+    /* 所有页初始为已用，由调用者通过buddy_free_range释放可用区域 */
+    for (i = 0; i < nr_pages; i++) {
+        pages[i].next = BUDDY_NONE;
+        pages[i].prev = BUDDY_NONE;
+        pages[i].order = 0;
+        pages[i].flags = 0;
+        pages[i].reserved = 0;
+        pages[i].private_data = 0;
+    }
+}
+
+/**
+ * 释放块并与伙伴合并（idx为区内页索引）
+ */
+static void buddy_free_block(buddy_zone_t *zone, uint32_t idx, uint32_t order) {
+    zone->free_pages += 1u << order;
+
+    while (order < BUDDY_MAX_ORDER) {
+        uint32_t buddy = idx ^ (1u << order);
+        buddy_page_t *bp;
+
+        /* 伙伴块必须完整位于区域内 */
+        if (buddy + (1u << order) > zone->nr_pages) {
+            break;
+        }
+
+        bp = &zone->pages[buddy];
+        if (!(bp->flags & BUDDY_PAGE_FREE) || bp->order != order) {
+            break;
+        }
+
+        buddy_list_del(zone, buddy, order);
+        zone->stats[order].merge_count++;
+
+        idx &= ~(1u << order);
+        order++;
+    }
+
+    buddy_list_add(zone, idx, order);
+}
+
+/**
+ * 按最大对齐块拆分一段页并逐块释放
+ */
+static void buddy_free_chunks(buddy_zone_t *zone, uint32_t idx, uint32_t count,
+                              int account) {
+    while (count > 0) {
+        uint32_t order = 0;
+
+        /* 选择对齐且不超过剩余长度的最大块 */
+        while (order < BUDDY_MAX_ORDER &&
+               (idx & (1u << order)) == 0 &&
+               (2u << order) <= count) {
+            order++;
+        }
+
+        if (account) {
+            zone->stats[order].free_count++;
+        }
+
+        buddy_free_block(zone, idx, order);
+        idx += 1u << order;
+        count -= 1u << order;
+    }
+}
+
+/**
+ * 将一段页加入空闲链表
+ */
+void buddy_free_range(buddy_zone_t *zone, uint32_t pfn, uint32_t count) {
+    uint32_t idx;
+
+    if (!buddy_zone_contains(zone, pfn)) {
+        return;
+    }
+
+    idx = pfn - zone->base_pfn;
+    if (count > zone->nr_pages - idx) {
+        count = zone->nr_pages - idx;
+    }
+
+    buddy_free_chunks(zone, idx, count, 0);
+}
+
+/**
+ * 释放任意页数（由buddy_alloc_pages分配）
+ */
+void buddy_free_pages(buddy_zone_t *zone, uint32_t pfn, uint32_t pages) {
+    uint32_t idx;
+
+    if (!buddy_zone_contains(zone, pfn)) {
+        return;
+    }
+
+    idx = pfn - zone->base_pfn;
+    if (pages > zone->nr_pages - idx) {
+        pages = zone->nr_pages - idx;
+    }
+
+    buddy_free_chunks(zone, idx, pages, 1);
+}
+
+/**
+ * 计算容纳指定页数所需的最小阶数
+ */
+uint32_t buddy_order_for_pages(uint32_t pages) {
+    uint32_t order = 0;
+
+    while ((1u << order) < pages && order <= BUDDY_MAX_ORDER) {
+        order++;
+    }
+
+    return order;
+}
+
+/**
+ * 分配2^order个连续页
+ */
+uint32_t buddy_alloc(buddy_zone_t *zone, uint32_t order) {
+    uint32_t current;
+    uint32_t idx;
+
+    if (order > BUDDY_MAX_ORDER) {
+        return BUDDY_NONE;
+    }
+
+    /* 找到最小的非空阶 */
+    for (current = order; current <= BUDDY_MAX_ORDER; current++) {
+        if (zone->free_area[current].head != BUDDY_NONE) {
+            break;
+        }
+    }
+
+    if (current > BUDDY_MAX_ORDER) {
+        return BUDDY_NONE;
+    }
+
+    idx = zone->free_area[current].head;
+    buddy_list_del(zone, idx, current);
+
+    /* 拆分：把后半部分依次挂回低一阶 */
+    while (current > order) {
+        current--;
+        buddy_list_add(zone, idx + (1u << current), current);
+        zone->stats[current].split_count++;
+    }
+
+    zone->pages[idx].order = (uint8_t)order;
+    zone->free_pages -= 1u << order;
+    zone->stats[order].alloc_count++;
+
+    return zone->base_pfn + idx;
+}
+
+/**
+ * 释放2^order个连续页
+ */
+void buddy_free(buddy_zone_t *zone, uint32_t pfn, uint32_t order) {
+    if (order > BUDDY_MAX_ORDER || !buddy_zone_contains(zone, pfn)) {
+        return;
+    }
+
+    zone->stats[order].free_count++;
+    buddy_free_block(zone, pfn - zone->base_pfn, order);
+}
+
+/**
+ * 分配超过最大阶的连续页：区域从对齐的页号开始，按最大阶块的边界
+ * 查找足够长的一串空闲块
+ */
+static uint32_t buddy_alloc_large(buddy_zone_t *zone, uint32_t pages) {
+    uint32_t block = 1u << BUDDY_MAX_ORDER;
+    uint32_t blocks = (pages + block - 1) >> BUDDY_MAX_ORDER;
+    uint32_t start = 0, run = 0;
+    uint32_t idx, i;
+
+    for (idx = 0; idx + block <= zone->nr_pages && run < blocks; idx += block) {
+        buddy_page_t *page = &zone->pages[idx];
+
+        if ((page->flags & BUDDY_PAGE_FREE) && page->order == BUDDY_MAX_ORDER) {
+            if (run++ == 0) {
+                start = idx;
+            }
+        } else {
+            run = 0;
+        }
+    }
+
+    if (run < blocks) {
+        return BUDDY_NONE;
+    }
+
+    for (i = 0; i < blocks; i++) {
+        buddy_list_del(zone, start + i * block, BUDDY_MAX_ORDER);
+    }
+    zone->free_pages -= blocks * block;
+    zone->stats[BUDDY_MAX_ORDER].alloc_count += blocks;
+
+    /* 最后一块多出的页归还 */
+    if (blocks * block > pages) {
+        buddy_free_chunks(zone, start + pages, blocks * block - pages, 0);
+    }
+
+    return zone->base_pfn + start;
+}
+
+/**
+ * 分配任意页数
+ */
+uint32_t buddy_alloc_pages(buddy_zone_t *zone, uint32_t pages) {
+    uint32_t order;
+    uint32_t pfn;
+
+    if (pages == 0) {
+        return BUDDY_NONE;
+    }
+
+    order = buddy_order_for_pages(pages);
+    if (order > BUDDY_MAX_ORDER) {
+        return buddy_alloc_large(zone, pages);
+    }
+
+    pfn = buddy_alloc(zone, order);
+    if (pfn == BUDDY_NONE) {
+        return BUDDY_NONE;
+    }
+
+    /* 归还超出请求的尾部页，使释放时按实际页数进行 */
+    if ((1u << order) > pages) {
+        buddy_free_chunks(zone, pfn - zone->base_pfn + pages,
+                          (1u << order) - pages, 0);
+    }
+
+    return pfn;
+}
+
+/**
+ * 获取指定阶的统计信息
+ */
+void buddy_get_order_stats(const buddy_zone_t *zone, uint32_t order,
+                           buddy_order_stats_t *stats) {
+    if (!stats || order > BUDDY_MAX_ORDER) {
+        return;
+    }
+
+    *stats = zone->stats[order];
+    stats->free_blocks = zone->free_area[order].count;
+}
+
+/**
+ * 打印各阶统计信息
+ */
+void buddy_dump_stats(const buddy_zone_t *zone) {
+    uint32_t order;
+
+    console_write("=== Buddy Allocator (pfn 0x");
+    console_write_hex(zone->base_pfn);
+    console_write(", ");
+    console_write_dec(zone->free_pages);
+    console_write("/");
+    console_write_dec(zone->nr_pages);
+    console_write(" pages free) ===\n");
+
+    for (order = 0; order <= BUDDY_MAX_ORDER; order++) {
+        console_write("order ");
+        console_write_dec(order);
+        console_write(": free=");
+        console_write_dec(zone->free_area[order].count);
+        console_write(" alloc=");
+        console_write_dec(zone->stats[order].alloc_count);
+        console_write(" freed=");
+        console_write_dec(zone->stats[order].free_count);
+        console_write(" split=");
+        console_write_dec(zone->stats[order].split_count);
+        console_write(" merge=");
+        console_write_dec(zone->stats[order].merge_count);
+        console_write("\n");
+    }
+}
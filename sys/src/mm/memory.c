@@ -1,34 +1,86 @@
 /**
  * M4KK1 Memory Management Implementation
  * 内存管理系统实现
+ *
+ * 物理内存按128MB划分为section。启动时根据multiboot内存映射只为含有
+ * 可用内存的section建立伙伴区域，区域头和页描述符就地取自该section的
+ * 空闲页，因此元数据开销与实际内存成正比，而不是与物理地址范围成正比。
+ * 引导加载器传来的信息和模块所在的页事先保留，描述符不会覆盖它们。
+ *
+ * 每个区域有自己的锁，不同section上的分配互不等待。一次分配不跨section，
+ * 最大为一个section（128MB）扣除其描述符。
  */
 
 #include "../include/memory.h"
+#include "../include/buddy.h"
+#include "../include/slab.h"
 #include "../include/console.h"
+#include "../include/alloc_trace.h"
+#include "../include/multiboot.h"
+#include "../include/arch.h"
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
 
 /* 全局变量 */
 static memory_region_t *memory_regions = NULL;
-static uint32_t total_memory = 0;
-static uint32_t free_memory = 0;
-static uint32_t used_memory = 0;
+static uint32_t ram_pages = 0;          /* 内存映射报告的可用RAM页数 */
+static volatile uint32_t free_pages_count = 0;  /* 伙伴分配器中的空闲页数 */
 
-/* 内核堆管理 */
+/* 内存区域记录区 */
 static uint32_t kernel_heap_start = KERNEL_HEAP;
-static uint32_t kernel_heap_end = 0;
-static memory_block_t *kernel_heap_blocks = NULL;
 
-/* 页面分配管理 */
-static uint32_t page_bitmap[32768] = {0}; /* 128MB内存的位图 */
-static uint32_t total_pages = 0;
-static uint32_t free_pages_count = 0;
+/* 内核映像范围（链接脚本定义） */
+extern uint8_t __heap_end[];
+#define KERNEL_LOAD_ADDR 0x100000
+
+/* 物理内存section */
+#define MEMORY_PAGE_SHIFT       12
+#define MEMORY_SECTION_SHIFT    15      /* 每个section 2^15页 = 128MB */
+#define MEMORY_SECTION_PAGES    (1u << MEMORY_SECTION_SHIFT)
+#define MEMORY_MAX_PFN          0x100000 /* 32位物理地址上限（4GB） */
+#define MEMORY_DIRECT_PFN       0x40000 /* 内核恒等映射的低1GB（arch/m4kk1/vm.c），之上是用户空间 */
+#define MEMORY_MAX_SECTIONS     (MEMORY_MAX_PFN >> MEMORY_SECTION_SHIFT)
+#define MEMORY_MAX_MODULES      16      /* 保留的引导模块数上限 */
+#define MEMORY_MAX_RESERVED     (MEMORY_MAX_SECTIONS + 6 + MEMORY_MAX_MODULES)
+
+/**
+ * 页段 [start, end)，以页号表示
+ */
+typedef struct memory_range {
+    uint32_t start;
+    uint32_t end;
+} memory_range_t;
+
+/* 不交给伙伴分配器的页段（页0、内核映像、引导信息和模块、各section的描述符） */
+static memory_range_t memory_reserved[MEMORY_MAX_RESERVED];
+static uint32_t memory_reserved_count = 0;
+
+/* 按section索引的伙伴区域，未填充的section为NULL */
+static buddy_zone_t *section_zones[MEMORY_MAX_SECTIONS];
+
+/* 已填充section的紧凑列表，分配时只遍历这些区域 */
+static buddy_zone_t *page_zones[MEMORY_MAX_SECTIONS];
+static uint32_t page_zone_count = 0;
+static uint32_t page_zone_hint = 0;
+
+/**
+ * 空闲页段回调，返回false停止遍历
+ */
+typedef bool (*memory_run_fn)(uint32_t start, uint32_t end, void *arg);
+
+/**
+ * section描述符放置查找
+ */
+typedef struct memory_fit {
+    uint32_t pages;     /* 需要的连续页数 */
+    uint32_t found;     /* 找到的起始页号，未找到为BUDDY_NONE */
+} memory_fit_t;
 
 /**
  * 添加内存区域
  */
-static void memory_add_region(uint32_t start, uint32_t size, uint32_t type) {
+static void memory_add_region(uint64_t start, uint64_t size, uint32_t type) {
     /* 分配内存区域结构 */
     memory_region_t *region = (memory_region_t *)kernel_heap_start;
     if (!region) {
@@ -46,126 +98,364 @@ static void memory_add_region(uint32_t start, uint32_t size, uint32_t type) {
     kernel_heap_start += sizeof(memory_region_t);
 
     /* 更新统计信息 */
-    total_memory += size;
     if (type == MEMORY_TYPE_FREE) {
-        free_memory += size;
+        ram_pages += (uint32_t)(size >> MEMORY_PAGE_SHIFT);
     }
 }
 
 /**
- * 初始化内存管理
+ * 记录保留页段
  */
-void memory_init(multiboot_info_t *mb_info) {
-    if (mb_info->flags & MULTIBOOT_INFO_MEMORY) {
-        /* 添加低端内存 */
-        if (mb_info->mem_lower > 0) {
-            memory_add_region(0, mb_info->mem_lower * 1024, MEMORY_TYPE_FREE);
+static void memory_reserve_range(uint32_t start, uint32_t end) {
+    if (start >= end || memory_reserved_count >= MEMORY_MAX_RESERVED) {
+        return;
+    }
+
+    memory_reserved[memory_reserved_count].start = start;
+    memory_reserved[memory_reserved_count].end = end;
+    memory_reserved_count++;
+}
+
+/**
+ * 按字节地址保留 [start, start + size) 覆盖的页
+ */
+static void memory_reserve_bytes(uint32_t start, uint32_t size) {
+    if (size == 0) {
+        return;
+    }
+
+    memory_reserve_range(start / PAGE_SIZE, (uint32_t)
+                         (((uint64_t)start + size + PAGE_SIZE - 1) / PAGE_SIZE));
+}
+
+/**
+ * 保留引导加载器传来的信息结构、内存映射、命令行和模块
+ */
+static void memory_reserve_boot_info(multiboot_info_t *mb_info) {
+    multiboot_mod_list_t *mods;
+    uint32_t i;
+
+    memory_reserve_bytes((uint32_t)mb_info, sizeof(multiboot_info_t));
+
+    if (mb_info->flags & MULTIBOOT_INFO_MEM_MAP) {
+        memory_reserve_bytes(mb_info->mmap_addr, mb_info->mmap_length);
+    }
+
+    /* 命令行长度未知，保留它所在的一页 */
+    if ((mb_info->flags & MULTIBOOT_INFO_CMDLINE) && mb_info->cmdline) {
+        memory_reserve_bytes(mb_info->cmdline, 1);
+    }
+
+    if (!(mb_info->flags & MULTIBOOT_INFO_MODS) || mb_info->mods_count == 0) {
+        return;
+    }
+
+    mods = (multiboot_mod_list_t *)mb_info->mods_addr;
+    memory_reserve_bytes(mb_info->mods_addr, mb_info->mods_count * sizeof(multiboot_mod_list_t));
+    for (i = 0; i < mb_info->mods_count && i < MEMORY_MAX_MODULES; i++) {
+        if (mods[i].mod_end > mods[i].mod_start) {
+            memory_reserve_bytes(mods[i].mod_start, mods[i].mod_end - mods[i].mod_start);
         }
-        
-        /* 添加高端内存 */
-        if (mb_info->mem_upper > 0) {
-            memory_add_region(0x100000, mb_info->mem_upper * 1024, MEMORY_TYPE_FREE);
+    }
+
+    if (mb_info->mods_count > MEMORY_MAX_MODULES) {
+        console_write("memory: too many boot modules, only the first ");
+        console_write_dec(MEMORY_MAX_MODULES);
+        console_write(" are kept\n");
+    }
+}
+
+/**
+ * 加锁伙伴区域，返回原中断状态
+ */
+static inline uintptr_t memory_zone_lock(buddy_zone_t *zone) {
+    uintptr_t flags = arch_irq_save();
+
+    while (__sync_lock_test_and_set(&zone->lock, 1)) {
+        while (zone->lock) {
+            __asm__ volatile ("pause");
         }
     }
-    
-    /* 处理内存映射 */
+
+    return flags;
+}
+
+/**
+ * 解锁伙伴区域并恢复中断状态
+ */
+static inline void memory_zone_unlock(buddy_zone_t *zone, uintptr_t flags) {
+    __sync_lock_release(&zone->lock);
+    arch_irq_restore(flags);
+}
+
+/**
+ * 遍历 [lo, hi) 内扣除保留页段后的空闲页段
+ */
+static void memory_for_each_free_run(uint32_t lo, uint32_t hi,
+                                     memory_run_fn fn, void *arg) {
+    memory_region_t *region;
+
+    for (region = memory_regions; region != NULL; region = region->next) {
+        uint64_t first, last;
+        uint32_t start, end;
+
+        if (region->type != MEMORY_TYPE_FREE) {
+            continue;
+        }
+
+        /* 向内按页对齐并裁剪到窗口 */
+        first = (region->start + PAGE_SIZE - 1) >> MEMORY_PAGE_SHIFT;
+        last = (region->start + region->size) >> MEMORY_PAGE_SHIFT;
+        if (first < lo) {
+            first = lo;
+        }
+        if (last > hi) {
+            last = hi;
+        }
+        if (first >= last) {
+            continue;
+        }
+
+        start = (uint32_t)first;
+        end = (uint32_t)last;
+
+        /* 按起始地址依次跳过与本段重叠的保留页段 */
+        while (start < end) {
+            memory_range_t *hole = NULL;
+
+            for (uint32_t i = 0; i < memory_reserved_count; i++) {
+                memory_range_t *r = &memory_reserved[i];
+                if (r->end > start && r->start < end &&
+                    (hole == NULL || r->start < hole->start)) {
+                    hole = r;
+                }
+            }
+
+            if (hole == NULL) {
+                if (!fn(start, end, arg)) {
+                    return;
+                }
+                break;
+            }
+
+            if (hole->start > start && !fn(start, hole->start, arg)) {
+                return;
+            }
+            start = hole->end;
+        }
+    }
+}
+
+/**
+ * 记录每个section中最后一个可用页的位置
+ */
+static bool memory_note_run(uint32_t start, uint32_t end, void *arg) {
+    uint32_t *span_end = (uint32_t *)arg;
+
+    while (start < end) {
+        uint32_t section = start >> MEMORY_SECTION_SHIFT;
+        uint32_t limit = (section + 1) << MEMORY_SECTION_SHIFT;
+        uint32_t run_end = end < limit ? end : limit;
+
+        if (run_end > span_end[section]) {
+            span_end[section] = run_end;
+        }
+        start = run_end;
+    }
+
+    return true;
+}
+
+/**
+ * 查找足够容纳描述符的空闲页段
+ */
+static bool memory_fit_run(uint32_t start, uint32_t end, void *arg) {
+    memory_fit_t *fit = (memory_fit_t *)arg;
+
+    if (end - start >= fit->pages) {
+        fit->found = start;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * 将空闲页段交给伙伴分配器
+ */
+static bool memory_release_run(uint32_t start, uint32_t end, void *arg) {
+    buddy_free_range((buddy_zone_t *)arg, start, end - start);
+    free_pages_count += end - start;
+    return true;
+}
+
+/**
+ * 为一个section建立伙伴区域
+ * 区域从section起始处开始以保证块的物理对齐，只覆盖到最后一个可用页
+ */
+static void memory_setup_section(uint32_t section, uint32_t span_end) {
+    uint32_t base = section << MEMORY_SECTION_SHIFT;
+    uint32_t nr_pages = span_end - base;
+    uint32_t meta_size = sizeof(buddy_zone_t) + nr_pages * sizeof(buddy_page_t);
+    memory_fit_t fit = { (meta_size + PAGE_SIZE - 1) / PAGE_SIZE, BUDDY_NONE };
+    buddy_zone_t *zone;
+
+    memory_for_each_free_run(base, span_end, memory_fit_run, &fit);
+    if (fit.found == BUDDY_NONE || memory_reserved_count >= MEMORY_MAX_RESERVED) {
+        /* section中放不下自身的描述符，整段不使用 */
+        return;
+    }
+    memory_reserve_range(fit.found, fit.found + fit.pages);
+
+    zone = (buddy_zone_t *)(fit.found * PAGE_SIZE);
+    buddy_zone_init(zone, base, nr_pages, (buddy_page_t *)(zone + 1));
+    memory_for_each_free_run(base, span_end, memory_release_run, zone);
+
+    section_zones[section] = zone;
+    page_zones[page_zone_count++] = zone;
+}
+
+/**
+ * 查找物理页所属的伙伴区域
+ */
+static buddy_zone_t *memory_zone_for_pfn(uint32_t pfn) {
+    buddy_zone_t *zone;
+
+    if (pfn >= MEMORY_MAX_PFN) {
+        return NULL;
+    }
+
+    zone = section_zones[pfn >> MEMORY_SECTION_SHIFT];
+    if (zone == NULL || !buddy_zone_contains(zone, pfn)) {
+        return NULL;
+    }
+
+    return zone;
+}
+
+/**
+ * 页数换算为字节数（超过32位时饱和）
+ */
+static uint32_t memory_pages_to_bytes(uint32_t pages) {
+    return pages >= MEMORY_MAX_PFN ? 0xFFFFFFFF : pages * PAGE_SIZE;
+}
+
+/**
+ * 初始化内存管理
+ */
+void memory_init(multiboot_info_t *mb_info) {
+    uint32_t span_end[MEMORY_MAX_SECTIONS] = {0};
+
+    /* 优先使用完整的内存映射，mem_lower/mem_upper与之重叠 */
     if (mb_info->flags & MULTIBOOT_INFO_MEM_MAP) {
         multiboot_mmap_entry_t *entry = (multiboot_mmap_entry_t *)mb_info->mmap_addr;
         while ((uint32_t)entry < mb_info->mmap_addr + mb_info->mmap_length) {
             if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
-                memory_add_region((uint32_t)entry->addr, (uint32_t)entry->len, MEMORY_TYPE_FREE);
+                memory_add_region(entry->addr, entry->len, MEMORY_TYPE_FREE);
             } else {
-                memory_add_region((uint32_t)entry->addr, (uint32_t)entry->len, MEMORY_TYPE_RESERVED);
+                memory_add_region(entry->addr, entry->len, MEMORY_TYPE_RESERVED);
             }
-            
+
             entry = (multiboot_mmap_entry_t *)((uint32_t)entry + entry->size + 4);
         }
+    } else if (mb_info->flags & MULTIBOOT_INFO_MEMORY) {
+        /* 添加低端内存 */
+        if (mb_info->mem_lower > 0) {
+            memory_add_region(0, (uint64_t)mb_info->mem_lower * 1024, MEMORY_TYPE_FREE);
+        }
+
+        /* 添加高端内存 */
+        if (mb_info->mem_upper > 0) {
+            memory_add_region(0x100000, (uint64_t)mb_info->mem_upper * 1024, MEMORY_TYPE_FREE);
+        }
     }
-    
+
     /* 保留内核占用的内存 */
     memory_add_region(KERNEL_BASE, 0x400000, MEMORY_TYPE_RESERVED);
-    
-    /* 初始化内核堆 */
-    kernel_heap_end = kernel_heap_start + 0x100000; /* 1MB内核堆 */
-    
-    /* 初始化页面管理 */
-    total_pages = total_memory >> 12;  /* 除以4096 */
-    free_pages_count = free_memory >> 12;  /* 除以4096 */
-    
-    /* 初始化页面位图 */
-    for (uint32_t i = 0; i < total_pages / 32; i++) {
-        page_bitmap[i] = 0xFFFFFFFF; /* 标记所有页面为已用 */
-    }
-    
-    /* 标记可用页面为空闲 */
-    memory_region_t *region = memory_regions;
-    while (region != NULL) {
-        if (region->type == MEMORY_TYPE_FREE) {
-            uint32_t start_page = region->start / PAGE_SIZE;
-            uint32_t end_page = (region->start + region->size) / PAGE_SIZE;
-            
-            for (uint32_t page = start_page; page < end_page; page++) {
-                if (page < total_pages) {
-                    page_bitmap[page / 32] &= ~(1 << (page % 32));
-                }
-            }
+
+    /* 物理页0保留，0地址表示分配失败 */
+    memory_reserve_range(0, 1);
+
+    /* 保留内核映像及其静态数据 */
+    memory_reserve_range(KERNEL_LOAD_ADDR / PAGE_SIZE,
+                         ((uint32_t)__heap_end + PAGE_SIZE - 1) / PAGE_SIZE);
+
+    /* 描述符放在空闲页里，必须先排除引导信息和模块 */
+    memory_reserve_boot_info(mb_info);
+
+    /* 只为含有可用内存的section建立伙伴区域；启用分页后内核只能访问低1GB */
+    memory_for_each_free_run(0, MEMORY_DIRECT_PFN, memory_note_run, span_end);
+    for (uint32_t section = 0; section < MEMORY_MAX_SECTIONS; section++) {
+        if (span_end[section] != 0) {
+            memory_setup_section(section, span_end[section]);
         }
-        region = region->next;
     }
+
+    /* 内核堆建立在页分配器之上，按需增长 */
+    slab_init();
 }
 
 /**
  * 获取总内存大小
  */
 uint32_t memory_get_total(void) {
-    return total_memory;
+    return memory_pages_to_bytes(ram_pages);
 }
 
 /**
  * 获取可用内存大小
  */
 uint32_t memory_get_free(void) {
-    return free_memory;
+    return memory_pages_to_bytes(free_pages_count);
 }
 
 /**
  * 获取已用内存大小
  */
 uint32_t memory_get_used(void) {
-    return used_memory;
+    return memory_pages_to_bytes(ram_pages - free_pages_count);
+}
+
+/**
+ * 获取总内存页数
+ */
+uint32_t memory_get_total_pages(void) {
+    return ram_pages;
+}
+
+/**
+ * 获取空闲页数
+ */
+uint32_t memory_get_free_pages(void) {
+    return free_pages_count;
 }
 
 /**
  * 分配页面
  */
 static uint32_t allocate_pages(uint32_t pages) {
-    uint32_t consecutive_pages = 0;
-    uint32_t start_page = 0;
-    
-    for (uint32_t i = 0; i < total_pages; i++) {
-        if ((page_bitmap[i / 32] & (1 << (i % 32))) == 0) {
-            if (consecutive_pages == 0) {
-                start_page = i;
-            }
-            consecutive_pages++;
-            
-            if (consecutive_pages == pages) {
-                /* 标记页面为已用 */
-                for (uint32_t j = start_page; j < start_page + pages; j++) {
-                    page_bitmap[j / 32] |= (1 << (j % 32));
-                }
-                
-                free_pages_count -= pages;
-                used_memory += pages * PAGE_SIZE;
-                free_memory -= pages * PAGE_SIZE;
-                
-                return start_page * PAGE_SIZE;
-            }
-        } else {
-            consecutive_pages = 0;
+    /* 从上次成功的区域开始，依次尝试各已填充section */
+    for (uint32_t i = 0; i < page_zone_count; i++) {
+        uint32_t idx = (page_zone_hint + i) % page_zone_count;
+        buddy_zone_t *zone = page_zones[idx];
+        uintptr_t flags;
+        uint32_t pfn;
+
+        if (zone->free_pages < pages) {
+            continue;
+        }
+
+        flags = memory_zone_lock(zone);
+        pfn = buddy_alloc_pages(zone, pages);
+        memory_zone_unlock(zone, flags);
+
+        if (pfn != BUDDY_NONE) {
+            page_zone_hint = idx;
+            __sync_fetch_and_sub(&free_pages_count, pages);
+            return pfn * PAGE_SIZE;
         }
     }
-    
+
     return 0; /* 分配失败 */
 }
 
@@ -174,14 +464,74 @@ static uint32_t allocate_pages(uint32_t pages) {
  */
 static void free_pages(uint32_t address, uint32_t pages) {
     uint32_t start_page = address / PAGE_SIZE;
-    
-    for (uint32_t i = start_page; i < start_page + pages; i++) {
-        page_bitmap[i / 32] &= ~(1 << (i % 32));
+    buddy_zone_t *zone = memory_zone_for_pfn(start_page);
+    uintptr_t flags;
+
+    if (pages == 0 || zone == NULL) {
+        return;
+    }
+
+    flags = memory_zone_lock(zone);
+    buddy_free_pages(zone, start_page, pages);
+    memory_zone_unlock(zone, flags);
+    __sync_fetch_and_add(&free_pages_count, pages);
+}
+
+/**
+ * 获取页面描述符
+ */
+buddy_page_t *memory_page_desc(const void *ptr) {
+    uint32_t pfn = (uint32_t)ptr / PAGE_SIZE;
+    buddy_zone_t *zone = memory_zone_for_pfn(pfn);
+
+    if (zone == NULL) {
+        return NULL;
+    }
+
+    return &zone->pages[pfn - zone->base_pfn];
+}
+
+/**
+ * 获取指定阶的页面分配统计（所有section之和）
+ */
+void memory_get_page_order_stats(uint32_t order, buddy_order_stats_t *stats) {
+    buddy_order_stats_t zone_stats;
+
+    if (!stats || order > BUDDY_MAX_ORDER) {
+        return;
+    }
+
+    stats->free_blocks = 0;
+    stats->alloc_count = 0;
+    stats->free_count = 0;
+    stats->split_count = 0;
+    stats->merge_count = 0;
+
+    for (uint32_t i = 0; i < page_zone_count; i++) {
+        buddy_get_order_stats(page_zones[i], order, &zone_stats);
+        stats->free_blocks += zone_stats.free_blocks;
+        stats->alloc_count += zone_stats.alloc_count;
+        stats->free_count += zone_stats.free_count;
+        stats->split_count += zone_stats.split_count;
+        stats->merge_count += zone_stats.merge_count;
+    }
+}
+
+/**
+ * 打印页面分配器碎片信息
+ */
+void memory_dump_page_orders(void) {
+    console_write("=== Memory Sections: ");
+    console_write_dec(page_zone_count);
+    console_write(" populated, ");
+    console_write_dec(free_pages_count);
+    console_write("/");
+    console_write_dec(ram_pages);
+    console_write(" pages free ===\n");
+
+    for (uint32_t i = 0; i < page_zone_count; i++) {
+        buddy_dump_stats(page_zones[i]);
     }
-    
-    free_pages_count += pages;
-    used_memory -= pages * PAGE_SIZE;
-    free_memory += pages * PAGE_SIZE;
 }
 
 /**
@@ -203,6 +553,7 @@ void memory_free(void *ptr) {
  */
 void *memory_alloc_page(size_t pages) {
     uint32_t address = allocate_pages(pages);
+    ALLOC_TRACE(ALLOC_TRACE_PAGE_ALLOC, (void *)address, pages * PAGE_SIZE);
     return (void *)address;
 }
 
@@ -210,6 +561,7 @@ void *memory_alloc_page(size_t pages) {
  * 释放页面对齐的内存
  */
 void memory_free_page(void *ptr, size_t pages) {
+    ALLOC_TRACE(ALLOC_TRACE_PAGE_FREE, ptr, pages * PAGE_SIZE);
     free_pages((uint32_t)ptr, pages);
 }
 
@@ -217,88 +569,19 @@ void memory_free_page(void *ptr, size_t pages) {
  * 分配内核内存
  */
 void *kmalloc(size_t size) {
-    if (size == 0) return NULL;
-    
-    /* 对齐到8字节边界 */
-    size = (size + 7) & ~7;
-    
-    /* 查找空闲块 */
-    memory_block_t *block = kernel_heap_blocks;
-    memory_block_t *prev = NULL;
-    
-    while (block != NULL) {
-        if (!block->used && block->size >= size) {
-            /* 找到合适的块 */
-            if (block->size > size + sizeof(memory_block_t) + 8) {
-                /* 分割块 */
-                memory_block_t *new_block = (memory_block_t *)((uint32_t)block + sizeof(memory_block_t) + size);
-                new_block->start = block->start + sizeof(memory_block_t) + size;
-                new_block->size = block->size - sizeof(memory_block_t) - size;
-                new_block->used = 0;
-                new_block->next = block->next;
-                
-                block->size = size;
-                block->next = new_block;
-            }
-            
-            block->used = 1;
-            used_memory += size;
-            free_memory -= size;
-            
-            return (void *)((uint32_t)block + sizeof(memory_block_t));
-        }
-        
-        prev = block;
-        block = block->next;
-    }
-    
-    /* 需要分配新块 */
-    if (kernel_heap_start + sizeof(memory_block_t) + size <= kernel_heap_end) {
-        block = (memory_block_t *)kernel_heap_start;
-        block->start = kernel_heap_start + sizeof(memory_block_t);
-        block->size = size;
-        block->used = 1;
-        block->next = kernel_heap_blocks;
-        
-        kernel_heap_blocks = block;
-        kernel_heap_start += sizeof(memory_block_t) + size;
-        
-        used_memory += size;
-        free_memory -= size;
-        
-        return (void *)block->start;
-    }
-    
-    return NULL; /* 分配失败 */
+    void *ptr = slab_kmalloc(size);
+    ALLOC_TRACE(ALLOC_TRACE_KMALLOC, ptr, size);
+    return ptr;
 }
 
 /**
  * 释放内核内存
  */
 void kfree(void *ptr) {
-    if (ptr == NULL) return;
-    
-    /* 找到对应的内存块 */
-    memory_block_t *block = kernel_heap_blocks;
-    while (block != NULL) {
-        if ((void *)block->start == ptr && block->used) {
-            block->used = 0;
-            used_memory -= block->size;
-            free_memory += block->size;
-            
-            /* 合并相邻的空闲块 */
-            memory_block_t *next = block->next;
-            if (next != NULL && !next->used) {
-                block->size += sizeof(memory_block_t) + next->size;
-                block->next = next->next;
-                /* 这里应该释放next块的内存，但由于是内核堆，我们暂时不做 */
-            }
-            
-            return;
-        }
-        block = block->next;
-    }
+    ALLOC_TRACE(ALLOC_TRACE_KFREE, ptr, 0);
+    slab_kfree(ptr);
 }
+
 /**
  * 内存和字符串函数（仅在没有lib库时使用）
  */
@@ -0,0 +1,558 @@
+/**
+ * M4KK1 Slab Allocator Implementation
+ * 按尺寸分级的slab分配器实现
+ *
+ * slab页来自伙伴分配器，每个slab页的描述符记录其slab头部地址，
+ * 释放时通过页地址直接找到所属slab。超过SLAB_MAX_SIZE（半页）的请求
+ * 直接按页分配并在首页描述符中记录页数，因此整页大小的kmalloc返回
+ * 页对齐的地址。
+ *
+ * 每个缓存有自己的锁，关中断持有；缓存链表另有一把锁。
+ *
+ * 除kmalloc尺寸缓存外，子系统可通过kmem_cache_create为热点结构
+ * 创建专用缓存。带构造函数的缓存把空闲链表指针放在对象之后，
+ * 使已释放对象保持构造状态。
+ */
+
+#include "../include/slab.h"
+#include "../include/memory.h"
+#include "../include/console.h"
+#include "../include/kernel.h"
+#include "../include/arch.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * kmalloc尺寸分级
+ */
+static const uint32_t kmalloc_sizes[] = {
+    16, 32, 64, 96, 128, 192, 256, 512, 1024, 2048
+};
+
+static const char *kmalloc_names[] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-96",
+    "kmalloc-128", "kmalloc-192", "kmalloc-256", "kmalloc-512",
+    "kmalloc-1024", "kmalloc-2048"
+};
+
+#define KMALLOC_CACHE_COUNT (sizeof(kmalloc_sizes) / sizeof(kmalloc_sizes[0]))
+
+static kmem_cache_t kmalloc_caches[KMALLOC_CACHE_COUNT];
+
+/* 用于分配kmem_cache_t本身的缓存 */
+static kmem_cache_t cache_cache;
+
+/* 所有缓存的链表 */
+static kmem_cache_t *cache_list = NULL;
+static volatile uint32_t cache_list_lock = 0;
+
+/* 对象内的空闲链表指针 */
+#define SLAB_FREE_PTR(cache, object) \
+    (*(void **)((uint8_t *)(object) + (cache)->free_offset))
+
+/* 小尺寸查找表：下标为(size - 1) / 8，覆盖1..192字节 */
+static uint8_t kmalloc_index_table[24];
+
+static inline void slab_spin_lock(volatile uint32_t *lock) {
+    while (__sync_lock_test_and_set(lock, 1)) {
+        while (*lock) {
+            __asm__ volatile ("pause");
+        }
+    }
+}
+
+/**
+ * 加锁缓存，返回原中断状态
+ */
+static inline uintptr_t slab_lock(kmem_cache_t *cache) {
+    uintptr_t flags = arch_irq_save();
+
+    slab_spin_lock(&cache->lock);
+    return flags;
+}
+
+static inline void slab_unlock(kmem_cache_t *cache, uintptr_t flags) {
+    __sync_lock_release(&cache->lock);
+    arch_irq_restore(flags);
+}
+
+/**
+ * 从链表中移除slab
+ */
+static void slab_list_del(slab_t **list, slab_t *slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+/**
+ * 将slab插入链表头部
+ */
+static void slab_list_add(slab_t **list, slab_t *slab) {
+    slab->prev = NULL;
+    slab->next = *list;
+
+    if (*list) {
+        (*list)->prev = slab;
+    }
+
+    *list = slab;
+}
+
+/**
+ * 设置slab所有页的描述符
+ */
+static void slab_mark_pages(slab_t *slab, uint32_t flags, uint32_t private_data) {
+    uint32_t i;
+
+    for (i = 0; i < slab->pages; i++) {
+        buddy_page_t *desc = memory_page_desc((uint8_t *)slab + i * PAGE_SIZE);
+        if (desc) {
+            desc->flags = (desc->flags & ~BUDDY_PAGE_SLAB) | flags;
+            desc->private_data = private_data;
+        }
+    }
+}
+
+/**
+ * 为缓存分配新slab
+ */
+static slab_t *slab_grow(kmem_cache_t *cache) {
+    slab_t *slab = (slab_t *)memory_alloc_page(cache->slab_pages);
+    uint8_t *object;
+    uint32_t i;
+
+    if (!slab) {
+        return NULL;
+    }
+
+    slab->cache = cache;
+    slab->next = NULL;
+    slab->prev = NULL;
+    slab->inuse = 0;
+    slab->pages = cache->slab_pages;
+
+    /* 构建空闲对象链表 */
+    object = (uint8_t *)slab + cache->offset;
+    slab->freelist = object;
+    for (i = 0; i < cache->objects_per_slab; i++) {
+        if (cache->ctor) {
+            cache->ctor(object);
+        }
+        SLAB_FREE_PTR(cache, object) =
+            (i + 1 < cache->objects_per_slab) ? object + cache->object_size : NULL;
+        object += cache->object_size;
+    }
+
+    slab_mark_pages(slab, BUDDY_PAGE_SLAB, (uint32_t)slab);
+    cache->slab_count++;
+
+    return slab;
+}
+
+/**
+ * 将空slab归还给页分配器
+ */
+static void slab_release(kmem_cache_t *cache, slab_t *slab) {
+    slab_mark_pages(slab, 0, 0);
+    cache->slab_count--;
+    memory_free_page(slab, slab->pages);
+}
+
+/**
+ * 初始化缓存的slab布局
+ */
+static int32_t kmem_cache_setup(kmem_cache_t *cache, const char *name, uint32_t size,
+                                uint32_t align, kmem_ctor_t ctor) {
+    uintptr_t flags;
+    uint32_t stride;
+    uint32_t order;
+
+    if (align < SLAB_ALIGN) {
+        align = SLAB_ALIGN;
+    }
+
+    /* 有构造函数时空闲指针放在对象之后，避免破坏已构造内容 */
+    if (ctor) {
+        cache->free_offset = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+        stride = cache->free_offset + sizeof(void *);
+    } else {
+        cache->free_offset = 0;
+        stride = size < sizeof(void *) ? sizeof(void *) : size;
+    }
+    stride = (stride + align - 1) & ~(align - 1);
+
+    cache->lock = 0;
+    cache->name = name;
+    cache->object_size = stride;
+    cache->align = align;
+    cache->ctor = ctor;
+    cache->offset = (sizeof(slab_t) + align - 1) & ~(align - 1);
+    cache->partial = NULL;
+    cache->full = NULL;
+    cache->empty = NULL;
+    cache->slab_count = 0;
+    cache->active_objects = 0;
+    cache->alloc_hits = 0;
+    cache->alloc_misses = 0;
+
+    /* 选择能容纳足够对象的最小slab阶数 */
+    for (order = 0; order < SLAB_MAX_ORDER; order++) {
+        if (((PAGE_SIZE << order) - cache->offset) / stride >= SLAB_MIN_OBJECTS) {
+            break;
+        }
+    }
+
+    cache->slab_pages = 1u << order;
+    cache->objects_per_slab = ((PAGE_SIZE << order) - cache->offset) / stride;
+    if (cache->objects_per_slab == 0) {
+        return -1;
+    }
+
+    flags = arch_irq_save();
+    slab_spin_lock(&cache_list_lock);
+    cache->next = cache_list;
+    cache_list = cache;
+    __sync_lock_release(&cache_list_lock);
+    arch_irq_restore(flags);
+
+    return 0;
+}
+
+/**
+ * 初始化slab分配器
+ */
+void slab_init(void) {
+    uint32_t i;
+    uint32_t index = 0;
+
+    cache_list = NULL;
+    kmem_cache_setup(&cache_cache, "kmem_cache", sizeof(kmem_cache_t), 0, NULL);
+
+    for (i = 0; i < KMALLOC_CACHE_COUNT; i++) {
+        kmem_cache_setup(&kmalloc_caches[i], kmalloc_names[i], kmalloc_sizes[i], 0, NULL);
+    }
+
+    for (i = 0; i < sizeof(kmalloc_index_table); i++) {
+        while ((i + 1) * 8 > kmalloc_sizes[index]) {
+            index++;
+        }
+        kmalloc_index_table[i] = (uint8_t)index;
+    }
+}
+
+/**
+ * 创建命名对象缓存
+ */
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align,
+                                kmem_ctor_t ctor) {
+    kmem_cache_t *cache;
+
+    if (!name || size == 0 || align > PAGE_SIZE || (align & (align - 1)) != 0) {
+        return NULL;
+    }
+
+    cache = (kmem_cache_t *)kmem_cache_alloc(&cache_cache);
+    if (!cache) {
+        return NULL;
+    }
+
+    if (kmem_cache_setup(cache, name, size, align, ctor) < 0) {
+        kmem_cache_free(&cache_cache, cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+/**
+ * 销毁对象缓存
+ */
+int32_t kmem_cache_destroy(kmem_cache_t *cache) {
+    kmem_cache_t **link;
+    uintptr_t flags;
+
+    if (!cache) {
+        return -1;
+    }
+
+    flags = slab_lock(cache);
+    if (cache->active_objects > 0) {
+        slab_unlock(cache, flags);
+        return -1;
+    }
+    if (cache->empty) {
+        slab_release(cache, cache->empty);
+        cache->empty = NULL;
+    }
+    slab_unlock(cache, flags);
+
+    flags = arch_irq_save();
+    slab_spin_lock(&cache_list_lock);
+    for (link = &cache_list; *link; link = &(*link)->next) {
+        if (*link == cache) {
+            *link = cache->next;
+            break;
+        }
+    }
+    __sync_lock_release(&cache_list_lock);
+    arch_irq_restore(flags);
+
+    kmem_cache_free(&cache_cache, cache);
+    return 0;
+}
+
+/**
+ * 获取缓存统计信息
+ */
+void kmem_cache_get_stats(const kmem_cache_t *cache, kmem_cache_stats_t *stats) {
+    uint32_t attempts;
+
+    if (!cache || !stats) {
+        return;
+    }
+
+    attempts = cache->alloc_hits + cache->alloc_misses;
+
+    stats->active_objects = cache->active_objects;
+    stats->total_objects = cache->slab_count * cache->objects_per_slab;
+    stats->slabs = cache->slab_count;
+    stats->pages = cache->slab_count * cache->slab_pages;
+    stats->alloc_hits = cache->alloc_hits;
+    stats->alloc_misses = cache->alloc_misses;
+    stats->hit_rate = attempts ? (cache->alloc_hits * 100) / attempts : 100;
+}
+
+/**
+ * 从缓存分配一个对象
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+    uintptr_t flags = slab_lock(cache);
+    slab_t *slab = cache->partial;
+    void *object;
+
+    if (slab) {
+        cache->alloc_hits++;
+    } else {
+        if (cache->empty) {
+            slab = cache->empty;
+            cache->empty = NULL;
+            cache->alloc_hits++;
+        } else {
+            slab = slab_grow(cache);
+            if (!slab) {
+                slab_unlock(cache, flags);
+                return NULL;
+            }
+            cache->alloc_misses++;
+        }
+        slab_list_add(&cache->partial, slab);
+    }
+
+    object = slab->freelist;
+    slab->freelist = SLAB_FREE_PTR(cache, object);
+    slab->inuse++;
+    cache->active_objects++;
+
+    if (slab->inuse == cache->objects_per_slab) {
+        slab_list_del(&cache->partial, slab);
+        slab_list_add(&cache->full, slab);
+    }
+
+    slab_unlock(cache, flags);
+    return object;
+}
+
+/**
+ * 释放对象到指定slab
+ */
+static void slab_free_object(kmem_cache_t *cache, slab_t *slab, void *object) {
+    uintptr_t flags = slab_lock(cache);
+
+    if (slab->inuse == cache->objects_per_slab) {
+        slab_list_del(&cache->full, slab);
+        slab_list_add(&cache->partial, slab);
+    }
+
+    SLAB_FREE_PTR(cache, object) = slab->freelist;
+    slab->freelist = object;
+    slab->inuse--;
+    cache->active_objects--;
+
+    if (slab->inuse == 0) {
+        slab_list_del(&cache->partial, slab);
+
+        /* 保留一个空slab以避免反复向页分配器申请 */
+        if (cache->empty) {
+            slab_release(cache, slab);
+        } else {
+            cache->empty = slab;
+        }
+    }
+
+    slab_unlock(cache, flags);
+}
+
+/**
+ * 释放对象到缓存
+ */
+void kmem_cache_free(kmem_cache_t *cache, void *object) {
+    buddy_page_t *desc;
+
+    if (!object) {
+        return;
+    }
+
+    desc = memory_page_desc(object);
+    if (!desc || !(desc->flags & BUDDY_PAGE_SLAB)) {
+        return;
+    }
+
+    /* 放进别的缓存会破坏两边的空闲链表和计数 */
+    if (((slab_t *)desc->private_data)->cache != cache) {
+        panic("kmem_cache_free: object does not belong to this cache");
+    }
+
+    slab_free_object(cache, (slab_t *)desc->private_data, object);
+}
+
+/**
+ * 查找尺寸对应的kmalloc缓存
+ */
+static kmem_cache_t *kmalloc_cache_for(size_t size) {
+    uint32_t index;
+
+    if (size <= sizeof(kmalloc_index_table) * 8) {
+        return &kmalloc_caches[kmalloc_index_table[(size - 1) / 8]];
+    }
+
+    for (index = kmalloc_index_table[sizeof(kmalloc_index_table) - 1];
+         index < KMALLOC_CACHE_COUNT; index++) {
+        if (size <= kmalloc_sizes[index]) {
+            return &kmalloc_caches[index];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * 按尺寸分配内核内存
+ */
+void *slab_kmalloc(size_t size) {
+    buddy_page_t *desc;
+    uint32_t pages;
+    void *ptr;
+
+    if (size == 0) {
+        return NULL;
+    }
+
+    if (size <= SLAB_MAX_SIZE) {
+        return kmem_cache_alloc(kmalloc_cache_for(size));
+    }
+
+    /* 大块内存直接按页分配 */
+    pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    ptr = memory_alloc_page(pages);
+    if (!ptr) {
+        return NULL;
+    }
+
+    desc = memory_page_desc(ptr);
+    if (desc) {
+        desc->flags |= BUDDY_PAGE_LARGE;
+        desc->private_data = pages;
+    }
+
+    return ptr;
+}
+
+/**
+ * 释放slab_kmalloc分配的内存
+ */
+void slab_kfree(void *ptr) {
+    buddy_page_t *desc;
+
+    if (!ptr) {
+        return;
+    }
+
+    desc = memory_page_desc(ptr);
+    if (!desc) {
+        return;
+    }
+
+    if (desc->flags & BUDDY_PAGE_SLAB) {
+        slab_t *slab = (slab_t *)desc->private_data;
+        slab_free_object(slab->cache, slab, ptr);
+    } else if (desc->flags & BUDDY_PAGE_LARGE) {
+        uint32_t pages = desc->private_data;
+        desc->flags &= ~BUDDY_PAGE_LARGE;
+        desc->private_data = 0;
+        memory_free_page(ptr, pages);
+    }
+}
+
+/**
+ * 获取分配块的可用大小
+ */
+size_t slab_ksize(const void *ptr) {
+    buddy_page_t *desc;
+
+    if (!ptr) {
+        return 0;
+    }
+
+    desc = memory_page_desc(ptr);
+    if (!desc) {
+        return 0;
+    }
+
+    if (desc->flags & BUDDY_PAGE_SLAB) {
+        return ((slab_t *)desc->private_data)->cache->object_size;
+    }
+
+    if (desc->flags & BUDDY_PAGE_LARGE) {
+        return desc->private_data * PAGE_SIZE;
+    }
+
+    return 0;
+}
+
+/**
+ * 打印所有缓存的使用情况
+ */
+void slab_dump_stats(void) {
+    kmem_cache_t *cache;
+    kmem_cache_stats_t stats;
+
+    console_write("=== Slab Caches ===\n");
+    for (cache = cache_list; cache; cache = cache->next) {
+        kmem_cache_get_stats(cache, &stats);
+
+        console_write(cache->name);
+        console_write(": objects=");
+        console_write_dec(stats.active_objects);
+        console_write("/");
+        console_write_dec(stats.total_objects);
+        console_write(" slabs=");
+        console_write_dec(stats.slabs);
+        console_write(" pages=");
+        console_write_dec(stats.pages);
+        console_write(" objsize=");
+        console_write_dec(cache->object_size);
+        console_write(" hit=");
+        console_write_dec(stats.hit_rate);
+        console_write("%\n");
+    }
+}
@@ -133,43 +133,21 @@ uint64_t swap2_time_current(void) {
  * 内存复制函数
  */
 void *swap2_memcpy(void *dest, const void *src, size_t n) {
-    uint8_t *d = (uint8_t *)dest;
-    const uint8_t *s = (const uint8_t *)src;
-
-    for (size_t i = 0; i < n; i++) {
-        d[i] = s[i];
-    }
-
-    return dest;
+    return memcpy(dest, src, n);
 }
 
 /**
  * 内存设置函数
  */
 void *swap2_memset(void *dest, int value, size_t n) {
-    uint8_t *d = (uint8_t *)dest;
-
-    for (size_t i = 0; i < n; i++) {
-        d[i] = (uint8_t)value;
-    }
-
-    return dest;
+    return memset(dest, value, n);
 }
 
 /**
  * 内存比较函数
  */
 int swap2_memcmp(const void *s1, const void *s2, size_t n) {
-    const uint8_t *a = (const uint8_t *)s1;
-    const uint8_t *b = (const uint8_t *)s2;
-
-    for (size_t i = 0; i < n; i++) {
-        if (a[i] != b[i]) {
-            return a[i] - b[i];
-        }
-    }
-
-    return 0;
+    return memcmp(s1, s2, n);
 }
 
 /**
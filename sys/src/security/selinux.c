@@ -43,6 +43,9 @@ static struct {
     uint32_t next_sid;
 } security_state;
 
+/* SID对象缓存 */
+static kmem_cache_t *sid_cache = NULL;
+
 /* 权限定义 */
 #define SECURITY_READ           (1 << 0)
 #define SECURITY_WRITE          (1 << 1)
@@ -86,7 +89,7 @@ static bool security_check_permission(uint32_t sid, uint32_t tsid,
 
 /* 分配安全标识符 */
 static uint32_t security_alloc_sid(security_context_t *context) {
-    security_sid_t *sid = (security_sid_t *)kmalloc(sizeof(security_sid_t));
+    security_sid_t *sid = (security_sid_t *)kmem_cache_alloc(sid_cache);
     if (!sid) {
         return 0;
     }
@@ -116,6 +119,16 @@ int security_init(void) {
     console_write("Initializing M4KK1 Security Framework...\n");
 
     memset(&security_state, 0, sizeof(security_state));
+
+    /* 创建SID对象缓存 */
+    if (!sid_cache) {
+        sid_cache = kmem_cache_create("security_sid_t", sizeof(security_sid_t), 0, NULL);
+        if (!sid_cache) {
+            console_write("Failed to create security SID cache\n");
+            return -1;
+        }
+    }
+
     security_state.enabled = true;
     security_state.enforcing = false; /* 默认宽容模式 */
     security_state.next_sid = 1;
@@ -173,7 +186,7 @@ void security_destroy_context(uint32_t sid) {
             } else {
                 security_state.sid_list = current->next;
             }
-            kfree(current);
+            kmem_cache_free(sid_cache, current);
             return;
         }
         prev = current;
@@ -337,7 +350,7 @@ void security_cleanup(void) {
     security_sid_t *sid = security_state.sid_list;
     while (sid) {
         security_sid_t *next = sid->next;
-        kfree(sid);
+        kmem_cache_free(sid_cache, sid);
         sid = next;
     }
 
@@ -0,0 +1,181 @@
+/**
+ * M4KK1字符串函数微基准测试
+ * 在宿主机上比较逐字节/按字/SSE2/AVX2各版本在不同长度下的吞吐量
+ *
+ * 构建运行：gcc -O2 -o string_bench test/bench/string_bench.c && ./string_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STRING_HOST_BENCH
+#include "../../sys/src/lib/string.c"
+
+#define BENCH_MAX_SIZE      65536
+#define BENCH_BYTES         (64u << 20)     /* 每项测试处理的总字节数 */
+
+static uint8_t *bench_src;
+static uint8_t *bench_dst;
+static volatile long bench_sink;
+
+static const size_t bench_sizes[] = { 8, 32, 64, 256, 1024, 4096, 16384, 65536 };
+
+static double bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench_supported(uint32_t impl) {
+    if (impl == STRING_IMPL_SSE2) {
+        return __builtin_cpu_supports("sse2");
+    }
+    if (impl == STRING_IMPL_AVX2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    return 1;
+}
+
+/**
+ * 用libc结果校验各版本（不同偏移和长度）
+ */
+static int bench_verify(const string_ops_t *ops) {
+    static uint8_t a[512], b[512];
+    size_t off, len;
+
+    for (off = 0; off < 40; off++) {
+        for (len = 0; len < 300; len++) {
+            memset(a, 0x5A, sizeof(a));
+            ops->mem_copy(a + off, bench_src + 7, len);
+            if (memcmp(a + off, bench_src + 7, len) != 0 ||
+                (off > 0 && a[off - 1] != 0x5A) || a[off + len] != 0x5A) {
+                return 0;
+            }
+
+            ops->mem_set(a + off, 0xC3, len);
+            memset(b, 0x5A, sizeof(b));
+            memset(b + off, 0xC3, len);
+            if (memcmp(a, b, sizeof(a)) != 0) {
+                return 0;
+            }
+
+            memcpy(b, a, sizeof(a));
+            if (len > 0) {
+                b[off + len - 1] ^= 0x80;
+            }
+            if ((ops->mem_compare(a + off, b + off, len) < 0) !=
+                (memcmp(a + off, b + off, len) < 0) ||
+                (ops->mem_compare(a + off, b + off, len) == 0) != (len == 0)) {
+                return 0;
+            }
+
+            memset(a, 'x', sizeof(a));
+            a[off + len] = '\0';
+            if (ops->str_length((char *)a + off) != len) {
+                return 0;
+            }
+
+            memcpy(b, a, sizeof(a));
+            if (ops->str_compare((char *)a + off, (char *)b + off) != 0) {
+                return 0;
+            }
+            if (len > 0) {
+                b[off + len - 1] = 'y';
+                if (ops->str_compare((char *)a + off, (char *)b + off) >= 0) {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+static double bench_run(const string_ops_t *ops, int op, size_t size) {
+    size_t iters = BENCH_BYTES / size;
+    double start, elapsed;
+    size_t i;
+
+    bench_src[size] = '\0';
+    bench_dst[size] = '\0';
+
+    start = bench_now();
+    for (i = 0; i < iters; i++) {
+        switch (op) {
+        case 0:
+            ops->mem_copy(bench_dst, bench_src, size);
+            break;
+        case 1:
+            ops->mem_set(bench_dst, (int)i, size);
+            break;
+        case 2:
+            bench_sink += ops->mem_compare(bench_dst, bench_src, size);
+            break;
+        case 3:
+            bench_sink += ops->str_length((const char *)bench_src);
+            break;
+        default:
+            bench_sink += ops->str_compare((const char *)bench_src,
+                                           (const char *)bench_dst);
+            break;
+        }
+        __asm__ volatile("" : : : "memory");
+    }
+    elapsed = bench_now() - start;
+
+    bench_src[size] = 'a';
+    bench_dst[size] = 'a';
+
+    return (double)iters * size / elapsed / (1u << 20);
+}
+
+int main(void) {
+    static const char *op_names[] = { "memcpy", "memset", "memcmp", "strlen", "strcmp" };
+    uint32_t impl;
+    size_t i;
+    int op;
+
+    bench_src = aligned_alloc(64, BENCH_MAX_SIZE + 64);
+    bench_dst = aligned_alloc(64, BENCH_MAX_SIZE + 64);
+    if (!bench_src || !bench_dst) {
+        return 1;
+    }
+
+    for (i = 0; i < BENCH_MAX_SIZE + 64; i++) {
+        bench_src[i] = 'a' + i % 26;
+    }
+
+    for (impl = 0; impl < STRING_IMPL_COUNT; impl++) {
+        if (bench_supported(impl) && !bench_verify(&string_ops_table[impl])) {
+            printf("%s: verification FAILED\n", string_ops_table[impl].name);
+            return 1;
+        }
+    }
+
+    for (op = 0; op < 5; op++) {
+        printf("\n%s (MB/s)\n%8s", op_names[op], "size");
+        for (impl = 0; impl < STRING_IMPL_COUNT; impl++) {
+            printf("%10s", string_ops_table[impl].name);
+        }
+        printf("\n");
+
+        for (i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++) {
+            printf("%8zu", bench_sizes[i]);
+            /* memcmp和strcmp比较的两个缓冲区内容一致，测最坏情况 */
+            memcpy(bench_dst, bench_src, BENCH_MAX_SIZE + 64);
+            for (impl = 0; impl < STRING_IMPL_COUNT; impl++) {
+                if (!bench_supported(impl)) {
+                    printf("%10s", "-");
+                    continue;
+                }
+                printf("%10.0f", bench_run(&string_ops_table[impl], op, bench_sizes[i]));
+            }
+            printf("\n");
+        }
+    }
+
+    return 0;
+}
@@ -8,8 +8,17 @@
 #include <string.h>
 #include "../../sys/src/include/console.h"
 #include "../../sys/src/include/memory.h"
+#include "../../sys/src/include/vm.h"
+#include "../../sys/src/include/syscall.h"
 #include "../../sys/src/include/process.h"
+#include "../../sys/src/include/sched.h"
+#include "../../sys/src/include/timer.h"
+#include "../../sys/src/include/fpu.h"
+#include "../../sys/src/include/ipc.h"
+#include "../../sys/src/include/ldso.h"
 #include "../../sys/src/include/kernel.h"
+#include "../../sys/src/include/arch.h"
+#include "../../sys/src/include/alloc_trace.h"
 
 /* 测试结果结构 */
 typedef struct {
@@ -212,9 +221,271 @@ static bool test_memory_allocation(void) {
     kfree(ptr2);
     kfree(ptr3);
 
+    /* 整页大小的请求走页分配，返回页对齐地址 */
+    void *page = kmalloc(4096);
+    bool aligned = page && ((uintptr_t)page & (PAGE_SIZE - 1)) == 0;
+    if (page) {
+        kfree(page);
+    }
+
+    return aligned;
+}
+
+/* 页面分配测试 */
+static bool test_page_allocation(void) {
+    buddy_order_stats_t before, after;
+    memory_get_page_order_stats(0, &before);
+
+    void *single = memory_alloc_page(1);
+    void *block = memory_alloc_page(4);
+
+    if (!single || !block) {
+        return false;
+    }
+
+    /* 页面必须按页对齐，且4页块按阶对齐 */
+    if (((uint32_t)single & (PAGE_SIZE - 1)) != 0 ||
+        ((uint32_t)block & (4 * PAGE_SIZE - 1)) != 0) {
+        return false;
+    }
+
+    memory_free_page(block, 4);
+    memory_free_page(single, 1);
+
+    memory_get_page_order_stats(0, &after);
+    return after.alloc_count == before.alloc_count + 1 &&
+           after.free_count == before.free_count + 1;
+}
+
+/* 每CPU页帧缓存测试：热页后进先出，冷页放在冷端，归还后缓存为空 */
+static bool test_pcp_pages(void) {
+    uint32_t cpu = smp_cpu_id();
+    uint32_t cached;
+    uint64_t drains_before, drains_after;
+
+    m4k_drain_pcp_pages();
+    m4k_get_pcp_stats(cpu, &cached, NULL, NULL, &drains_before);
+    if (cached != 0) {
+        return false;
+    }
+
+    uint64_t hot = m4k_alloc_physical_page();
+    uint64_t cold = m4k_alloc_physical_page();
+    if (!hot || !cold) {
+        if (hot) m4k_free_physical_page(hot);
+        if (cold) m4k_free_physical_page(cold);
+        return false;
+    }
+
+    /* 补充剩下的页和释放的两页都在缓存中，最先取出的是最后释放的热页 */
+    m4k_free_physical_page(hot);
+    m4k_free_physical_page_cold(cold);
+    uint64_t again = m4k_alloc_physical_page();
+    bool passed = (again == hot);
+    m4k_free_physical_page(again);
+
+    m4k_drain_pcp_pages();
+    m4k_get_pcp_stats(cpu, &cached, NULL, NULL, &drains_after);
+    return passed && cached == 0 && drains_after > drains_before;
+}
+
+/* 预清零池测试：写脏后释放的页帧经空闲补充进入池中，再取出时内容全为0 */
+#define TEST_ZERO_POOL_PAGES    64
+#define TEST_ZERO_POOL_ROUNDS   16      /* 补充次数，每次最多清零8页 */
+
+static uint64_t test_zero_pool_pages[TEST_ZERO_POOL_PAGES];
+
+static bool test_page_is_zero(uint64_t page) {
+    const uint64_t *words = (const uint64_t *)(uintptr_t)m4k_phys_to_virt(page);
+
+    for (uint32_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i++) {
+        if (words[i]) {
+            return false;
+        }
+    }
     return true;
 }
 
+static bool test_zero_pool(void) {
+    uint64_t *pages = test_zero_pool_pages;
+    uint64_t dirty[TEST_ZERO_POOL_PAGES / 8];
+    uint64_t hits_before, hits_after;
+    uint32_t pooled, count = 0, reused = 0;
+    bool passed = true;
+
+    /* 先取空池，再把这些页帧写脏后释放，补充时从每CPU缓存取回的是这些热页 */
+    for (uint32_t i = 0; i < TEST_ZERO_POOL_PAGES; i++) {
+        pages[i] = m4k_alloc_zeroed_page();
+        if (!pages[i]) {
+            break;
+        }
+        memset((void *)(uintptr_t)m4k_phys_to_virt(pages[i]), 0xA5, PAGE_SIZE);
+        count++;
+    }
+    /* 最后释放的几页位于缓存的热端，记下来确认它们被清零后重新使用 */
+    for (uint32_t i = 0; i < count; i++) {
+        if (count - i <= TEST_ZERO_POOL_PAGES / 8) {
+            dirty[count - 1 - i] = pages[i];
+        }
+        m4k_free_physical_page(pages[i]);
+    }
+
+    for (uint32_t round = 0; round < TEST_ZERO_POOL_ROUNDS; round++) {
+        m4k_zero_pool_refill();
+    }
+    m4k_get_zero_pool_stats(&pooled, &hits_before, NULL);
+
+    /* 池中的页都命中，且全部为0（包括刚才写脏的页帧） */
+    if (pooled > TEST_ZERO_POOL_PAGES) {
+        pooled = TEST_ZERO_POOL_PAGES;
+    }
+    for (uint32_t i = 0; i < pooled; i++) {
+        pages[i] = m4k_alloc_zeroed_page();
+        passed = passed && pages[i] != 0 && test_page_is_zero(pages[i]);
+
+        for (uint32_t j = 0; j < count && j < TEST_ZERO_POOL_PAGES / 8; j++) {
+            if (pages[i] == dirty[j]) {
+                reused++;
+            }
+        }
+    }
+    m4k_get_zero_pool_stats(NULL, &hits_after, NULL);
+
+    for (uint32_t i = 0; i < pooled; i++) {
+        if (pages[i]) {
+            m4k_free_physical_page(pages[i]);
+        }
+    }
+
+    return passed && count > 0 && pooled > 0 && reused > 0 &&
+           hits_after == hits_before + pooled;
+}
+
+/* 匿名内存大页测试：完整覆盖的2MB范围用一个大页映射，剩余部分用4KB页，
+ * 释放后映射数恢复 */
+#define TEST_HUGE_BASE          0x0000008000000000ULL   /* PML4第1项，不与内核映射重叠 */
+#define TEST_HUGE_SIZE          0x300000
+
+static bool test_huge_anon_mapping(void) {
+    uint64_t small_before, huge_before, small_mapped, huge_mapped, small_after, huge_after;
+    uint64_t space = m4k_create_address_space();
+    uint64_t physical;
+    bool passed;
+
+    if (!space) {
+        return false;
+    }
+
+    m4k_get_mapping_stats(&small_before, &huge_before);
+
+    /* 错误码0：读访问未映射的页 */
+    passed = m4k_vm_reserve(space, TEST_HUGE_BASE, TEST_HUGE_SIZE, PAGE_READWRITE | PAGE_USER) == 0 &&
+             m4k_handle_page_fault(space, TEST_HUGE_BASE + 0x1234, 0) == 0 &&
+             m4k_handle_page_fault(space, TEST_HUGE_BASE + 0x200000, 0) == 0;
+    physical = m4k_vm_translate(space, TEST_HUGE_BASE + 0x1234);
+    m4k_get_mapping_stats(&small_mapped, &huge_mapped);
+
+    passed = passed && physical != 0 && (physical & 0x1FFFFF) == 0x1234 &&
+             huge_mapped == huge_before + 1 && small_mapped > small_before;
+
+    m4k_vm_release(space, TEST_HUGE_BASE, TEST_HUGE_SIZE);
+    m4k_get_mapping_stats(&small_after, &huge_after);
+    passed = passed && m4k_vm_translate(space, TEST_HUGE_BASE) == 0 &&
+             huge_after == huge_before && small_after == small_before;
+
+    m4k_destroy_address_space(space);
+    return passed;
+}
+
+/* 相同页合并测试：内容相同的两页合并为一个页帧，写入其中一页时复制拆开 */
+#define TEST_KSM_BASE           0x0000008000000000ULL
+#define TEST_KSM_ROUNDS         64
+#define TEST_PF_WRITE_PRESENT   0x3     /* 写已映射页的缺页错误码 */
+
+static void test_ksm_fill(uint64_t space, uint64_t va, uint32_t value) {
+    uint32_t *words = (uint32_t *)(uintptr_t)m4k_phys_to_virt(m4k_vm_translate(space, va));
+
+    for (uint32_t i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+        words[i] = value + i;
+    }
+}
+
+static bool test_ksm_merge(void) {
+    uint64_t space = m4k_create_address_space();
+    uint64_t first = TEST_KSM_BASE;
+    uint64_t second = TEST_KSM_BASE + PAGE_SIZE;
+    bool merged = false, split = false;
+
+    if (!space) {
+        return false;
+    }
+
+    if (m4k_vm_reserve(space, first, 2 * PAGE_SIZE, PAGE_READWRITE | PAGE_USER) == 0 &&
+        m4k_handle_page_fault(space, first, 0) == 0 &&
+        m4k_handle_page_fault(space, second, 0) == 0 &&
+        m4k_ksm_register(space) == 0) {
+        test_ksm_fill(space, first, 0x4D344B00);
+        test_ksm_fill(space, second, 0x4D344B00);
+
+        /* 第一遍记录校验和，之后内容不变的页才合并 */
+        for (uint32_t round = 0; round < TEST_KSM_ROUNDS && !merged; round++) {
+            m4k_ksm_run();
+            merged = m4k_vm_translate(space, first) == m4k_vm_translate(space, second);
+        }
+
+        /* 写入第二页：写时复制得到内容相同的私有页 */
+        if (merged && m4k_handle_page_fault(space, second, TEST_PF_WRITE_PRESENT) == 0) {
+            uint64_t copy = m4k_vm_translate(space, second);
+
+            split = copy != 0 && copy != m4k_vm_translate(space, first) &&
+                    *(uint32_t *)(uintptr_t)m4k_phys_to_virt(copy) == 0x4D344B00;
+        }
+    }
+
+    m4k_ksm_unregister(space);
+    m4k_destroy_address_space(space);
+    return merged && split;
+}
+
+/* 对象缓存测试 */
+static void test_cache_ctor(void *object) {
+    *(uint32_t *)object = 0x4D344B4B;
+}
+
+static bool test_object_cache(void) {
+    kmem_cache_stats_t stats;
+    kmem_cache_t *cache = kmem_cache_create("test_object", 24, 16, test_cache_ctor);
+    if (!cache) {
+        return false;
+    }
+
+    uint32_t *first = (uint32_t *)kmem_cache_alloc(cache);
+    uint32_t *second = (uint32_t *)kmem_cache_alloc(cache);
+    bool passed = first && second && ((uint32_t)first & 15) == 0;
+
+    /* 构造函数已运行，释放后对象保持构造状态 */
+    if (passed) {
+        passed = (*first == 0x4D344B4B && *second == 0x4D344B4B);
+        kmem_cache_free(cache, first);
+        uint32_t *again = (uint32_t *)kmem_cache_alloc(cache);
+        passed = passed && again == first && *again == 0x4D344B4B;
+        first = again;
+    }
+
+    /* 无论是否通过都归还对象并销毁缓存 */
+    if (first) {
+        kmem_cache_free(cache, first);
+    }
+    if (second) {
+        kmem_cache_free(cache, second);
+    }
+
+    kmem_cache_get_stats(cache, &stats);
+    passed = passed && stats.active_objects == 0 && stats.alloc_misses == 1;
+
+    return kmem_cache_destroy(cache) == 0 && passed;
+}
+
 /* 字符串操作测试 */
 static bool test_string_operations(void) {
     char buffer[256];
@@ -237,6 +508,24 @@ static bool test_string_operations(void) {
         return false;
     }
 
+    /* 测试长块和非对齐偏移（走向量化路径） */
+    char block[200];
+    memset(block, 'z', sizeof(block));
+    memcpy(buffer + 3, block, sizeof(block));
+    if (memcmp(buffer + 3, block, sizeof(block)) != 0) {
+        return false;
+    }
+
+    buffer[3 + 150] = 'a';
+    if (memcmp(buffer + 3, block, sizeof(block)) >= 0) {
+        return false;
+    }
+
+    buffer[3 + 180] = '\0';
+    if (strlen(buffer + 3) != 180) {
+        return false;
+    }
+
     return true;
 }
 
@@ -257,6 +546,1005 @@ static bool test_process_creation(void) {
     return true;
 }
 
+/* 用户进程测试：程序段装入新的地址空间，BSS、堆和栈按需分配 */
+#define TEST_EXEC_CODE          (PROCESS_USER_BASE + 0x400000)
+#define TEST_EXEC_DATA          (PROCESS_USER_BASE + 0x401000)
+#define TEST_EXEC_DATA_SIZE     0x3000      /* 第一页有文件内容，其余是BSS */
+
+static struct {
+    m4ll_header_t header;
+    m4ll_phdr_t phdr[2];
+    uint8_t code[4];
+    uint32_t data[4];
+} test_exec_image;
+
+static uint32_t test_user_word(uintptr_t space, uint32_t va) {
+    uintptr_t physical = vm_translate(space, va);
+
+    return physical ? *(uint32_t *)vm_phys_to_virt(physical) : 0xFFFFFFFF;
+}
+
+static const uint8_t test_exec_code[4] = { 0xEB, 0xFE, 0x90, 0x90 };     /* jmp $ */
+
+static void test_build_exec_image(void) {
+    uint8_t *base = (uint8_t *)&test_exec_image;
+
+    memset(&test_exec_image, 0, sizeof(test_exec_image));
+    test_exec_image.header.magic = M4LL_MAGIC;
+    test_exec_image.header.version = 1;
+    test_exec_image.header.entry_point = TEST_EXEC_CODE;
+    test_exec_image.header.phdr_offset = (uint8_t *)test_exec_image.phdr - base;
+    test_exec_image.header.phdr_count = 2;
+    test_exec_image.phdr[0].type = M4LL_SEGMENT_CODE;
+    test_exec_image.phdr[0].offset = test_exec_image.code - base;
+    test_exec_image.phdr[0].vaddr = TEST_EXEC_CODE;
+    test_exec_image.phdr[0].file_size = sizeof(test_exec_code);
+    test_exec_image.phdr[0].mem_size = sizeof(test_exec_code);
+    test_exec_image.phdr[1].type = M4LL_SEGMENT_DATA;
+    test_exec_image.phdr[1].offset = (uint8_t *)test_exec_image.data - base;
+    test_exec_image.phdr[1].vaddr = TEST_EXEC_DATA;
+    test_exec_image.phdr[1].file_size = sizeof(test_exec_image.data);
+    test_exec_image.phdr[1].mem_size = TEST_EXEC_DATA_SIZE;
+    memcpy(test_exec_image.code, test_exec_code, sizeof(test_exec_code));
+    test_exec_image.data[0] = 0x4D344B31;
+}
+
+static bool test_user_process(void) {
+    process_t *process;
+    uintptr_t space;
+    bool passed;
+
+    test_build_exec_image();
+
+    /* 进程创建后保持阻塞，不会真的进入用户态 */
+    process = process_create_user("exec_test", PROCESS_PRIORITY_NORMAL,
+                                  &test_exec_image, sizeof(test_exec_image));
+    if (!process) {
+        return false;
+    }
+    space = process->cr3;
+
+    passed = space != 0 && process->state == PROCESS_STATE_BLOCKED &&
+             test_user_word(space, TEST_EXEC_CODE) == *(const uint32_t *)test_exec_code &&
+             test_user_word(space, TEST_EXEC_DATA) == 0x4D344B31 &&
+             process->heap_start == TEST_EXEC_DATA + TEST_EXEC_DATA_SIZE &&
+             process->brk == process->heap_start;
+
+    /* BSS和用户栈只预留，首次访问时分配清零页 */
+    passed = passed &&
+             vm_handle_fault(space, TEST_EXEC_DATA + 0x2000, 0) == 0 &&
+             test_user_word(space, TEST_EXEC_DATA + 0x2000) == 0 &&
+             vm_handle_fault(space, PROCESS_USER_STACK_TOP - 4, 0) == 0 &&
+             test_user_word(space, PROCESS_USER_STACK_TOP - 4) == 0;
+
+    process_destroy(process);
+
+    /* 损坏的映像不创建进程 */
+    test_exec_image.header.magic = 0;
+    return passed && process_create_user("exec_test", PROCESS_PRIORITY_NORMAL,
+                                         &test_exec_image, sizeof(test_exec_image)) == NULL;
+}
+
+/* 程序中断点测试：增长的堆按需分配，收缩后撤销映射，非法地址不移动中断点 */
+static bool test_program_break(void) {
+    process_t *process;
+    uint32_t heap, end;
+    uintptr_t space;
+    bool passed;
+
+    test_build_exec_image();
+    process = process_create_user("brk_test", PROCESS_PRIORITY_NORMAL,
+                                  &test_exec_image, sizeof(test_exec_image));
+    if (!process) {
+        return false;
+    }
+    space = process->cr3;
+    heap = process->heap_start;
+    end = heap + 4 * PAGE_SIZE;
+
+    /* 增长前堆中没有预留，增长后首次访问分配清零页 */
+    passed = vm_handle_fault(space, heap, 0) != 0 &&
+             process_brk(process, end) == end && process->brk == end &&
+             vm_handle_fault(space, end - PAGE_SIZE, 0) == 0 &&
+             test_user_word(space, end - PAGE_SIZE) == 0;
+
+    /* 收缩后释放的页不再映射，也不能再缺页分配 */
+    passed = passed && process_brk(process, heap + PAGE_SIZE) == heap + PAGE_SIZE &&
+             vm_translate(space, end - PAGE_SIZE) == 0 &&
+             vm_handle_fault(space, end - PAGE_SIZE, 0) != 0;
+
+    /* 低于堆起点或进入用户栈的地址返回原中断点 */
+    passed = passed && process_brk(process, heap - 1) == heap + PAGE_SIZE &&
+             process_brk(process, PROCESS_USER_STACK_TOP - PAGE_SIZE) == heap + PAGE_SIZE;
+
+    process_destroy(process);
+    return passed;
+}
+
+#ifdef CONFIG_ALLOC_TRACE
+/* 分配跟踪测试：分配出现在事件和调用点统计中，释放后从存活统计中消失；
+ * 系统调用拒绝不完全在用户空间内的输出缓冲区 */
+#define TEST_TRACE_SIZE         200
+
+static alloc_trace_event_t test_trace_events[ALLOC_TRACE_EVENTS];
+static alloc_trace_site_t test_trace_sites[ALLOC_TRACE_SITES];
+
+/* 环形缓冲区中对ptr最近的一个type事件 */
+static bool test_trace_find(uint32_t type, const void *ptr, alloc_trace_event_t *event) {
+    uint32_t count = alloc_trace_get_events(test_trace_events, 0, ALLOC_TRACE_EVENTS);
+
+    for (uint32_t i = count; i > 0; i--) {
+        if (test_trace_events[i - 1].type == type &&
+            test_trace_events[i - 1].ptr == (uintptr_t)ptr) {
+            *event = test_trace_events[i - 1];
+            return true;
+        }
+    }
+    return false;
+}
+
+/* 调用点当前的存活对象数 */
+static uint32_t test_trace_live(uintptr_t site) {
+    uint32_t count = alloc_trace_get_sites(test_trace_sites, ALLOC_TRACE_SITES);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (test_trace_sites[i].site == site) {
+            return test_trace_sites[i].live_count;
+        }
+    }
+    return 0;
+}
+
+static bool test_alloc_trace(void) {
+    process_t *process, *saved = process_get_current();
+    alloc_trace_event_t alloc_event, free_event;
+    void *object = kmalloc(TEST_TRACE_SIZE);
+    uint32_t live = 0;
+    uintptr_t flags;
+    bool passed;
+
+    if (!object) {
+        return false;
+    }
+
+    passed = test_trace_find(ALLOC_TRACE_KMALLOC, object, &alloc_event) &&
+             alloc_event.size == TEST_TRACE_SIZE;
+    if (passed) {
+        live = test_trace_live(alloc_event.site);
+    }
+
+    /* 释放事件的大小取自存活对象表，调用点的存活数随之减少 */
+    kfree(object);
+    passed = passed && live > 0 &&
+             test_trace_find(ALLOC_TRACE_KFREE, object, &free_event) &&
+             free_event.size == TEST_TRACE_SIZE &&
+             test_trace_live(alloc_event.site) == live - 1;
+
+    test_build_exec_image();
+    process = process_create_user("trace_test", PROCESS_PRIORITY_NORMAL,
+                                  &test_exec_image, sizeof(test_exec_image));
+    if (!process) {
+        return false;
+    }
+
+    /* 内核缓冲区和越过用户栈顶的缓冲区都被拒绝，内核缓冲区不被写入 */
+    memset(test_trace_sites, 0, sizeof(test_trace_sites));
+    flags = arch_irq_save();
+    process_set_current(process);
+    passed = passed &&
+             SYSCALL2(SYSCALL_ALLOC_TRACE, test_trace_sites, 4) == (uint32_t)SYSCALL_ERROR &&
+             SYSCALL2(SYSCALL_ALLOC_TRACE, PROCESS_USER_STACK_TOP - sizeof(alloc_trace_site_t),
+                      4) == (uint32_t)SYSCALL_ERROR &&
+             SYSCALL2(SYSCALL_ALLOC_TRACE, PROCESS_USER_BASE, 0) == (uint32_t)SYSCALL_ERROR &&
+             test_trace_sites[0].site == 0;
+    process_set_current(saved);
+    arch_irq_restore(flags);
+
+    process_destroy(process);
+    return passed;
+}
+#endif
+
+/* fork测试：父子共享页帧，一方写入时复制，另一方内容不变 */
+#define TEST_FORK_WRITE         (VM_FAULT_PRESENT | VM_FAULT_WRITE | VM_FAULT_USER)
+#define TEST_FORK_TOUCH         (VM_FAULT_WRITE | VM_FAULT_USER)
+#define TEST_FORK_LARGE_PAGES   1024        /* 大地址空间额外分配的堆页数 */
+
+static inline uint64_t test_rdtsc(void) {
+    uint64_t value;
+    __asm__ volatile ("rdtsc" : "=A"(value));
+    return value;
+}
+
+/**
+ * 从映像创建阻塞的用户进程，并像从系统调用进入内核一样设置现场，
+ * 使它可以被fork
+ */
+static process_t *test_fork_parent(const char *name) {
+    process_t *process;
+
+    test_build_exec_image();
+    process = process_create_user(name, PROCESS_PRIORITY_NORMAL,
+                                  &test_exec_image, sizeof(test_exec_image));
+    if (process) {
+        process->frame = (syscall_frame_t *)(process->kstack + KERNEL_STACK_SIZE) - 1;
+    }
+    return process;
+}
+
+static void test_write_user_word(uintptr_t space, uint32_t va, uint32_t value) {
+    *(uint32_t *)vm_phys_to_virt(vm_translate(space, va)) = value;
+}
+
+static bool test_fork_cow(void) {
+    process_t *parent = test_fork_parent("fork_parent");
+    process_t *child;
+    uintptr_t shared, copy, flags;
+    bool passed;
+
+    if (!parent) {
+        return false;
+    }
+
+    /* 子进程在测试期间不能被调度 */
+    flags = arch_irq_save();
+    child = process_fork(parent);
+    if (!child) {
+        arch_irq_restore(flags);
+        process_destroy(parent);
+        return false;
+    }
+
+    /* fork后两个地址空间映射同一页帧 */
+    shared = vm_translate(parent->cr3, TEST_EXEC_DATA);
+    passed = child->cr3 != parent->cr3 && shared != 0 &&
+             vm_translate(child->cr3, TEST_EXEC_DATA) == shared &&
+             test_user_word(child->cr3, TEST_EXEC_DATA) == 0x4D344B31;
+
+    /* 子进程写入得到自己的副本，父进程的内容不变 */
+    passed = passed && vm_handle_fault(child->cr3, TEST_EXEC_DATA, TEST_FORK_WRITE) == 0;
+    copy = vm_translate(child->cr3, TEST_EXEC_DATA);
+    passed = passed && copy != 0 && copy != shared;
+    if (passed) {
+        test_write_user_word(child->cr3, TEST_EXEC_DATA, 0x4D344B32);
+    }
+    passed = passed && test_user_word(child->cr3, TEST_EXEC_DATA) == 0x4D344B32 &&
+             test_user_word(parent->cr3, TEST_EXEC_DATA) == 0x4D344B31;
+
+    /* 页帧只剩父进程一个映射，父进程写入时直接恢复可写而不复制 */
+    passed = passed && vm_handle_fault(parent->cr3, TEST_EXEC_DATA, TEST_FORK_WRITE) == 0 &&
+             vm_translate(parent->cr3, TEST_EXEC_DATA) == shared;
+
+    /* 只读的代码页仍然共享，子进程退出后父进程的页面完好 */
+    passed = passed && vm_translate(child->cr3, TEST_EXEC_CODE) ==
+                       vm_translate(parent->cr3, TEST_EXEC_CODE);
+    process_destroy(child);
+    passed = passed && test_user_word(parent->cr3, TEST_EXEC_CODE) ==
+                       *(const uint32_t *)test_exec_code;
+
+    arch_irq_restore(flags);
+    process_destroy(parent);
+    return passed;
+}
+
+/**
+ * 测量一次fork的周期数，extra_pages为父进程额外分配的堆页数
+ * @return 周期数，失败返回0
+ */
+static uint64_t test_fork_cycles(uint32_t extra_pages) {
+    process_t *parent = test_fork_parent("fork_bench");
+    process_t *child;
+    uint64_t start, cycles = 0;
+    uintptr_t flags;
+    uint32_t i;
+
+    if (!parent) {
+        return 0;
+    }
+    if (extra_pages && process_brk(parent, parent->heap_start + extra_pages * PAGE_SIZE) !=
+                       parent->heap_start + extra_pages * PAGE_SIZE) {
+        process_destroy(parent);
+        return 0;
+    }
+    for (i = 0; i < extra_pages; i++) {
+        if (vm_handle_fault(parent->cr3, parent->heap_start + i * PAGE_SIZE, TEST_FORK_TOUCH) != 0) {
+            process_destroy(parent);
+            return 0;
+        }
+    }
+
+    flags = arch_irq_save();
+    start = test_rdtsc();
+    child = process_fork(parent);
+    cycles = test_rdtsc() - start;
+    if (child) {
+        process_destroy(child);
+    } else {
+        cycles = 0;
+    }
+    arch_irq_restore(flags);
+
+    process_destroy(parent);
+    return cycles;
+}
+
+static bool test_fork_latency(void) {
+    uint64_t small = test_fork_cycles(0);
+    uint64_t large = test_fork_cycles(TEST_FORK_LARGE_PAGES);
+
+    if (!small || !large) {
+        return false;
+    }
+
+    /* 只复制页表，开销随映射页数增长而不是随内存大小 */
+    console_write("   fork (small): ");
+    console_write_dec((uint32_t)small);
+    console_write(" cycles, fork (+");
+    console_write_dec(TEST_FORK_LARGE_PAGES);
+    console_write(" pages): ");
+    console_write_dec((uint32_t)large);
+    console_write(" cycles\n");
+
+    return true;
+}
+
+/* 调度器测试：同优先级FIFO轮转、高优先级优先，并测量选取延迟 */
+
+#define TEST_SCHED_PROCESSES    64
+#define TEST_SCHED_ROUNDS       10000
+
+static bool test_scheduler(void) {
+    static process_t procs[TEST_SCHED_PROCESSES];
+    static run_queue_t rq;
+    uint64_t start, cycles;
+    uint32_t i;
+
+    memset(procs, 0, sizeof(procs));
+    run_queue_init(&rq);
+
+    /* 同优先级按入队顺序轮转 */
+    for (i = 0; i < 3; i++) {
+        procs[i].priority = PROCESS_PRIORITY_NORMAL;
+        run_queue_enqueue(&rq, &procs[i]);
+    }
+    if (run_queue_pick(&rq) != &procs[0]) {
+        return false;
+    }
+    run_queue_enqueue(&rq, &procs[0]);
+    if (run_queue_pick(&rq) != &procs[1] || run_queue_pick(&rq) != &procs[2] ||
+        run_queue_pick(&rq) != &procs[0] || run_queue_pick(&rq) != NULL) {
+        return false;
+    }
+
+    /* 高优先级后入队也先被选中，移除中间元素不破坏顺序 */
+    procs[3].priority = PROCESS_PRIORITY_LOW;
+    procs[4].priority = PROCESS_PRIORITY_LOW;
+    procs[5].priority = PROCESS_PRIORITY_LOW;
+    procs[6].priority = PROCESS_PRIORITY_HIGH;
+    for (i = 3; i <= 6; i++) {
+        run_queue_enqueue(&rq, &procs[i]);
+    }
+    if (!run_queue_preempts(&rq, PROCESS_PRIORITY_NORMAL)) {
+        return false;
+    }
+    run_queue_dequeue(&rq, &procs[4]);
+    if (run_queue_pick(&rq) != &procs[6] || run_queue_pick(&rq) != &procs[3] ||
+        run_queue_pick(&rq) != &procs[5] || rq.nr_ready != 0 || rq.bitmap != 0) {
+        return false;
+    }
+
+    /* 延迟：进程分布在所有优先级上，反复选取并放回队尾 */
+    for (i = 0; i < TEST_SCHED_PROCESSES; i++) {
+        procs[i].priority = i % PROCESS_PRIORITY_LEVELS;
+        run_queue_enqueue(&rq, &procs[i]);
+    }
+
+    start = test_rdtsc();
+    for (i = 0; i < TEST_SCHED_ROUNDS; i++) {
+        process_t *next = run_queue_pick(&rq);
+        run_queue_enqueue(&rq, next);
+    }
+    cycles = test_rdtsc() - start;
+
+    console_write("\n  pick+enqueue: ");
+    console_write_dec((uint32_t)(cycles / TEST_SCHED_ROUNDS));
+    console_write(" cycles (");
+    console_write_dec(TEST_SCHED_PROCESSES);
+    console_write(" ready) ");
+
+    return rq.nr_ready == TEST_SCHED_PROCESSES;
+}
+
+/* 公平调度测试：按vruntime排序，CPU份额与权重成正比 */
+#define TEST_FAIR_TICKS         7296
+
+static bool test_fair_scheduler(void) {
+    static process_t procs[4];
+    static run_queue_t rq;
+    uint32_t ticks[3] = { 0, 0, 0 };
+    uint32_t i;
+
+    memset(procs, 0, sizeof(procs));
+    run_queue_init(&rq);
+
+    /* vruntime小的先运行，实时进程先于所有公平进程 */
+    for (i = 0; i < 3; i++) {
+        procs[i].policy = PROCESS_POLICY_FAIR;
+        procs[i].weight = sched_priority_weight(PROCESS_PRIORITY_NORMAL);
+        procs[i].vruntime = (3 - i) * 100;
+        run_queue_enqueue(&rq, &procs[i]);
+    }
+    procs[3].policy = PROCESS_POLICY_RT;
+    procs[3].priority = PROCESS_PRIORITY_LOW;
+    run_queue_enqueue(&rq, &procs[3]);
+
+    if (!run_queue_preempts(&rq, SCHED_PRIORITY_FAIR) ||
+        run_queue_pick(&rq) != &procs[3] || run_queue_pick(&rq) != &procs[2] ||
+        run_queue_pick(&rq) != &procs[1] || run_queue_pick(&rq) != &procs[0] ||
+        run_queue_pick(&rq) != NULL || rq.min_vruntime != 300) {
+        return false;
+    }
+
+    /* 高、普通、低优先级各一个CPU密集进程，按权重6100:1024:172分配 */
+    run_queue_init(&rq);
+    for (i = 0; i < 3; i++) {
+        procs[i].priority = PROCESS_PRIORITY_HIGH + i * (PROCESS_PRIORITY_NORMAL - PROCESS_PRIORITY_HIGH);
+        procs[i].weight = sched_priority_weight(procs[i].priority);
+        procs[i].vruntime = 0;
+        run_queue_enqueue(&rq, &procs[i]);
+    }
+
+    for (i = 0; i < TEST_FAIR_TICKS; i++) {
+        process_t *next = run_queue_pick(&rq);
+        sched_charge(next, 1000000);   /* 一个1ms滴答 */
+        ticks[next - procs]++;
+        run_queue_enqueue(&rq, next);
+    }
+
+    console_write("\n  ticks high/normal/low: ");
+    console_write_dec(ticks[0]);
+    console_write("/");
+    console_write_dec(ticks[1]);
+    console_write("/");
+    console_write_dec(ticks[2]);
+    console_write(" ");
+
+    return ticks[0] > 5 * ticks[1] && ticks[1] > 5 * ticks[2] && ticks[2] > 0;
+}
+
+/* 负载均衡测试：最空的队列从最忙的队列窃取，跳过还没在原处理器上完成切换的
+ * 进程，迁移的公平进程vruntime换算到新队列的虚拟时钟 */
+#define TEST_BALANCE_CPUS       4
+#define TEST_BALANCE_PROCESSES  12
+
+static bool test_load_balance(void) {
+    static process_t procs[TEST_BALANCE_PROCESSES + 1];
+    static run_queue_t rqs[TEST_BALANCE_CPUS];
+    process_t *running = &procs[TEST_BALANCE_PROCESSES];
+    process_t *process;
+    uint32_t i, cpu, idlest, busiest;
+
+    memset(procs, 0, sizeof(procs));
+    for (cpu = 0; cpu < TEST_BALANCE_CPUS; cpu++) {
+        run_queue_init(&rqs[cpu]);
+    }
+
+    /* 被抢占的实时进程已放回0号队列，但还在0号处理器的内核栈上 */
+    running->policy = PROCESS_POLICY_RT;
+    running->priority = PROCESS_PRIORITY_HIGH;
+    running->on_cpu = 1;
+    run_queue_enqueue(&rqs[0], running);
+    for (i = 0; i < TEST_BALANCE_PROCESSES; i++) {
+        procs[i].policy = PROCESS_POLICY_FAIR;
+        procs[i].weight = sched_priority_weight(PROCESS_PRIORITY_NORMAL);
+        procs[i].vruntime = 1000 + i;
+        run_queue_enqueue(&rqs[0], &procs[i]);
+    }
+    rqs[0].min_vruntime = 1000;
+    rqs[1].min_vruntime = 5000;
+
+    /* 实时类优先，但正在切换的进程不能迁移，取vruntime最小的公平进程 */
+    process = run_queue_steal(&rqs[0], &rqs[1]);
+    if (process != &procs[0] || process->vruntime != 5000 || !running->on_rq) {
+        return false;
+    }
+    run_queue_enqueue(&rqs[1], process);
+
+    /* 每次由最空的队列从最忙的队列窃取一个，直到相差不超过1 */
+    while (1) {
+        idlest = busiest = 0;
+        for (cpu = 1; cpu < TEST_BALANCE_CPUS; cpu++) {
+            if (rqs[cpu].nr_ready < rqs[idlest].nr_ready) {
+                idlest = cpu;
+            }
+            if (rqs[cpu].nr_ready > rqs[busiest].nr_ready) {
+                busiest = cpu;
+            }
+        }
+        if (rqs[busiest].nr_ready <= rqs[idlest].nr_ready + 1) {
+            break;
+        }
+
+        process = run_queue_steal(&rqs[busiest], &rqs[idlest]);
+        if (!process || process == running) {
+            return false;
+        }
+        run_queue_enqueue(&rqs[idlest], process);
+    }
+
+    console_write("\n  ready per queue: ");
+    for (cpu = 0; cpu < TEST_BALANCE_CPUS; cpu++) {
+        console_write_dec(rqs[cpu].nr_ready);
+        console_write(cpu + 1 < TEST_BALANCE_CPUS ? "/" : " ");
+        if (rqs[cpu].nr_ready * TEST_BALANCE_CPUS < TEST_BALANCE_PROCESSES) {
+            return false;
+        }
+    }
+
+    /* 切换完成后才可以迁移 */
+    running->on_cpu = 0;
+    return running->on_rq && run_queue_steal(&rqs[0], &rqs[1]) == running;
+}
+
+/* 时间轮测试：跨越各级和32位回绕，每个闹钟恰好在到期滴答取出 */
+#define TEST_TIMER_ALARMS       4096
+#define TEST_TIMER_SPAN         300000
+
+static bool test_timer_wheel(void) {
+    static timer_wheel_t wheel;
+    static timer_alarm_t alarms[TEST_TIMER_ALARMS];
+    uint32_t start = 0xFFFF0000;   /* 测试期间计数回绕 */
+    uint32_t seed = 12345;
+    uint32_t expected = 0, fired = 0, wakeups = 0;
+    uint64_t cycles;
+    uint32_t i, now;
+
+    memset(alarms, 0, sizeof(alarms));
+    timer_wheel_init(&wheel, start);
+
+    cycles = test_rdtsc();
+    for (i = 0; i < TEST_TIMER_ALARMS; i++) {
+        seed = seed * 1103515245 + 12345;
+        alarms[i].expires = start + (seed >> 8) % TEST_TIMER_SPAN;
+        timer_wheel_add(&wheel, &alarms[i]);
+    }
+    cycles = test_rdtsc() - cycles;
+
+    /* 取消每第7个，id标记被取消的闹钟 */
+    for (i = 0; i < TEST_TIMER_ALARMS; i++) {
+        if (i % 7 == 0) {
+            timer_wheel_del(&wheel, &alarms[i]);
+            alarms[i].id = 1;
+        } else {
+            expected++;
+        }
+    }
+    if (wheel.count != expected) {
+        return false;
+    }
+
+    for (now = start; now != start + TEST_TIMER_SPAN; now++) {
+        timer_alarm_t *alarm;
+
+        while ((alarm = timer_wheel_expire(&wheel, now)) != NULL) {
+            if (alarm->expires != now || alarm->id != 0) {
+                return false;
+            }
+            fired++;
+        }
+    }
+
+    if (fired != expected || wheel.count != 0) {
+        return false;
+    }
+
+    /* 动态时钟：每次直接跳到下一次需要推进的滴答，闹钟仍须准时取出 */
+    timer_wheel_init(&wheel, start);
+    for (i = 0; i < TEST_TIMER_ALARMS; i++) {
+        if (alarms[i].id == 0) {
+            timer_wheel_add(&wheel, &alarms[i]);
+        }
+    }
+
+    fired = 0;
+    while (wheel.count) {
+        timer_alarm_t *alarm;
+
+        now = wheel.base + timer_wheel_next_expiry(&wheel, TEST_TIMER_SPAN);
+        wakeups++;
+        while ((alarm = timer_wheel_expire(&wheel, now)) != NULL) {
+            if (alarm->expires != now) {
+                return false;
+            }
+            fired++;
+        }
+    }
+
+    console_write("\n  add: ");
+    console_write_dec((uint32_t)(cycles / TEST_TIMER_ALARMS));
+    console_write(" cycles/timer, tickless wakeups: ");
+    console_write_dec(wakeups);
+    console_write("/");
+    console_write_dec(TEST_TIMER_SPAN);
+    console_write(" ");
+
+    return fired == expected && wakeups <= expected + TEST_TIMER_SPAN / TIMER_WHEEL_ROOT_SIZE;
+}
+
+/* 睡眠队列测试：唤醒滴答跨过32位回绕时按截止顺序取出，相同滴答先睡先醒，
+ * 取消的进程不再被唤醒 */
+#define TEST_SLEEPERS           8
+
+static bool test_sleep_queue(void) {
+    static const uint32_t offsets[TEST_SLEEPERS] = { 30, 5, 30, 0, 100, 5, 60, 20 };
+    static const uint32_t order[] = { 1, 5, 7, 0, 2 };
+    static process_t procs[TEST_SLEEPERS];
+    uint32_t base = 0xFFFFFFF0;
+    rb_root_t queue;
+    process_t *woken;
+    uint32_t i;
+
+    memset(procs, 0, sizeof(procs));
+    rb_root_init(&queue);
+    for (i = 0; i < TEST_SLEEPERS; i++) {
+        procs[i].wake_tick = base + offsets[i];
+        procs[i].state = PROCESS_STATE_BLOCKED;
+        sleep_queue_add(&queue, &procs[i]);
+    }
+
+    /* 取消最早的和中间的睡眠者，重复取消不影响队列 */
+    sleep_queue_del(&queue, &procs[3]);
+    sleep_queue_del(&queue, &procs[6]);
+    sleep_queue_del(&queue, &procs[6]);
+    if (procs[3].on_sleep || procs[6].on_sleep ||
+        sleep_queue_pop_expired(&queue, base + 4) != NULL) {
+        return false;
+    }
+
+    woken = sleep_queue_pop_expired(&queue, base + 60);
+    for (i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        if (woken != &procs[order[i]] || woken->on_sleep ||
+            woken->state != PROCESS_STATE_READY) {
+            return false;
+        }
+        woken = woken->rq_next;
+    }
+    if (woken != NULL || procs[3].state != PROCESS_STATE_BLOCKED ||
+        procs[6].state != PROCESS_STATE_BLOCKED) {
+        return false;
+    }
+
+    return sleep_queue_pop_expired(&queue, base + 99) == NULL &&
+           sleep_queue_pop_expired(&queue, base + 100) == &procs[4] &&
+           procs[4].rq_next == NULL && rb_first(&queue) == NULL;
+}
+
+/* 时钟源测试：换算精度和读数单调性 */
+#define TEST_CLOCK_READS        1000
+
+static bool test_clocksource(void) {
+    uint64_t prev, now, cycles;
+    uint32_t i;
+
+    /* 2.5GHz：mult = 10^6 * 2^32 / 2500000，一秒的周期数换算为10^9ns（误差小于1ppm） */
+    now = clock_mul_shift(2500000000ULL, 1717986918, 32);
+    if (now > 1000000000ULL || now < 1000000000ULL - 1000) {
+        return false;
+    }
+
+    cycles = test_rdtsc();
+    prev = clock_now_ns();
+    for (i = 0; i < TEST_CLOCK_READS; i++) {
+        now = clock_now_ns();
+        if (now < prev) {
+            return false;
+        }
+        prev = now;
+    }
+    cycles = test_rdtsc() - cycles;
+
+    console_write(clock_get_source() == CLOCK_SOURCE_TSC ? "\n  TSC " : "\n  tick ");
+    console_write_dec(clock_get_tsc_khz());
+    console_write(" kHz, read: ");
+    console_write_dec((uint32_t)(cycles / TEST_CLOCK_READS));
+    console_write(" cycles ");
+
+    return true;
+}
+
+/* FPU上下文切换测试：对比进程使用和不使用向量寄存器时的切换开销 */
+#define TEST_FPU_SWITCHES       1000
+
+static bool test_fpu_switch(void) {
+    fpu_bench_t bench;
+    fpu_stats_t before, after;
+
+    if (!fpu_enabled()) {
+        console_write("\n  FPU context switching disabled ");
+        return true;
+    }
+
+    fpu_get_stats(&before);
+    if (fpu_benchmark(TEST_FPU_SWITCHES, &bench) != 0) {
+        return false;
+    }
+    fpu_get_stats(&after);
+
+    console_write("\n  integer: ");
+    console_write_dec((uint32_t)(bench.int_cycles / bench.switches));
+    console_write(" cycles/switch, vector: ");
+    console_write_dec((uint32_t)(bench.vector_cycles / bench.switches));
+    console_write(" cycles/switch (");
+    console_write_dec(after.state_size);
+    console_write(" bytes) ");
+
+    /* 使用向量寄存器的每个时间片各装入和写回一次 */
+    return after.restores - before.restores >= TEST_FPU_SWITCHES &&
+           after.saves - before.saves >= TEST_FPU_SWITCHES;
+}
+
+/* IPC邮箱测试：按type接收不打乱其他消息的顺序，快速路径消息按到达顺序取出，
+ * 拒绝伪造的回复，邮箱满时拒绝，进程销毁后找不到 */
+static bool test_ipc_mailbox(void) {
+    static const uint32_t types[] = { 1, 2, 1, 3, 1 + IPC_TYPE_QUEUES };
+    static const uint32_t expect[][2] = {   /* 接收的type，应得到第几条消息 */
+        { 1 + IPC_TYPE_QUEUES, 4 }, { 1, 0 }, { IPC_TYPE_ANY, 1 }, { IPC_TYPE_ANY, 2 }, { 3, 3 }
+    };
+    uint32_t self = process_get_pid();
+    uint32_t value, size, sender, i, sent = 0;
+    process_t *process;
+    uint32_t pid;
+
+    for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (ipc_send(self, &i, sizeof(i), types[i]) != 0) {
+            return false;
+        }
+    }
+    for (i = 0; i < sizeof(expect) / sizeof(expect[0]); i++) {
+        size = sizeof(value);
+        if (ipc_try_receive(&sender, &value, &size, expect[i][0]) != 0 ||
+            value != expect[i][1] || sender != self || size != sizeof(value)) {
+            return false;
+        }
+    }
+    size = sizeof(value);
+    if (ipc_try_receive(&sender, &value, &size, IPC_TYPE_ANY) == 0) {
+        return false;
+    }
+
+    /* 等待type 2时到达的快速路径消息排在之前已排队的type 1之后 */
+    process = process_get_current();
+    value = 0;
+    if (ipc_send(self, &value, sizeof(value), 1) != 0) {
+        return false;
+    }
+    process->mailbox->waiting = 1;
+    process->mailbox->wait_type = 2;
+    value = 1;
+    if (ipc_send(self, &value, sizeof(value), 2) != 0 || !process->mailbox->fast_full) {
+        return false;
+    }
+    for (i = 0; i < 2; i++) {
+        size = sizeof(value);
+        if (ipc_try_receive(&sender, &value, &size, IPC_TYPE_ANY) != 0 || value != i) {
+            return false;
+        }
+    }
+
+    /* 回复只能由ipc_reply_wait发出 */
+    if (ipc_send(self, &value, sizeof(value), IPC_TYPE_REPLY) == 0) {
+        return false;
+    }
+
+    while (ipc_send(self, &sent, sizeof(sent), 1) == 0) {
+        sent++;
+    }
+    for (i = 0; i < sent; i++) {
+        size = sizeof(value);
+        if (ipc_try_receive(&sender, &value, &size, 1) != 0 || value != i) {
+            return false;
+        }
+    }
+
+    process = process_create("ipc_test", PROCESS_PRIORITY_NORMAL);
+    if (!process) {
+        return false;
+    }
+    pid = process->pid;
+    if (ipc_send(pid, &sent, sizeof(sent), 1) != 0) {
+        process_destroy(process);
+        return false;
+    }
+    process_destroy(process);
+
+    return sent == IPC_MAILBOX_SLOTS && ipc_send(pid, &sent, sizeof(sent), 1) != 0;
+}
+
+/* IPC往返测试：对比请求和回复经过消息槽与对方阻塞等待时的快速路径 */
+#define TEST_IPC_ROUNDS         1000
+
+static bool test_ipc_pingpong(void) {
+    ipc_bench_t bench;
+    uint32_t reply_size = sizeof(uint32_t);
+    uint32_t value = 0;
+
+    if (ipc_benchmark(TEST_IPC_ROUNDS, &bench) != 0) {
+        return false;
+    }
+
+    console_write("\n  queued: ");
+    console_write_dec((uint32_t)(bench.queued_cycles / bench.rounds));
+    console_write(" cycles/round trip, fast: ");
+    console_write_dec((uint32_t)(bench.fast_cycles / bench.rounds));
+    console_write(" cycles/round trip ");
+    if (bench.switch_rounds) {
+        console_write("\n  with switches: ");
+        console_write_dec((uint32_t)(bench.switch_cycles / bench.switch_rounds));
+        console_write(" cycles/round trip ");
+    }
+
+    /* 调度器运行时每次调用都要完成；不能调用自己，也不能调用不存在的进程 */
+    return (bench.switch_rounds == 0 || bench.switch_rounds == bench.rounds) &&
+           ipc_call(process_get_pid(), &value, sizeof(value), 1, &value, &reply_size) != 0 &&
+           ipc_call(0xFFFFFFFF, &value, sizeof(value), 1, &value, &reply_size) != 0;
+}
+
+/* 转移授予：接收方映射到发送方原来的物理页，没有复制；邮箱已满时发送方的页不受影响 */
+static bool test_grant_move(void) {
+    process_t *sender, *receiver, *saved = process_get_current();
+    ipc_grant_t grant;
+    uint32_t sender_pid, size = sizeof(grant), value = 0;
+    uintptr_t data_page, code_page;
+    uintptr_t flags;
+    bool passed;
+
+    test_build_exec_image();
+    sender = process_create_user("grant_tx", PROCESS_PRIORITY_NORMAL,
+                                 &test_exec_image, sizeof(test_exec_image));
+    receiver = process_create_user("grant_rx", PROCESS_PRIORITY_NORMAL,
+                                   &test_exec_image, sizeof(test_exec_image));
+    if (!sender || !receiver) {
+        if (sender) {
+            process_destroy(sender);
+        }
+        if (receiver) {
+            process_destroy(receiver);
+        }
+        return false;
+    }
+    data_page = vm_translate(sender->cr3, TEST_EXEC_DATA);
+    code_page = vm_translate(sender->cr3, TEST_EXEC_CODE);
+
+    /* 后两页是还没分配的BSS，授予前补齐 */
+    flags = arch_irq_save();
+    process_set_current(sender);
+    passed = data_page != 0 &&
+             ipc_grant(receiver->pid, (void *)TEST_EXEC_DATA, TEST_EXEC_DATA_SIZE,
+                       VM_GRANT_MOVE, 1) == 0;
+
+    process_set_current(receiver);
+    passed = passed && ipc_try_receive(&sender_pid, &grant, &size, 1) == 0 &&
+             sender_pid == sender->pid && grant.size == TEST_EXEC_DATA_SIZE &&
+             vm_translate(receiver->cr3, grant.addr) == data_page &&
+             test_user_word(receiver->cr3, grant.addr) == 0x4D344B31 &&
+             test_user_word(receiver->cr3, grant.addr + 0x2000) == 0 &&
+             vm_translate(sender->cr3, TEST_EXEC_DATA) == 0;
+
+    /* 接收方撤销授予后映射消失，同一起始地址不能再撤销一次 */
+    passed = passed && ipc_grant_release(grant.addr) == 0 &&
+             vm_translate(receiver->cr3, grant.addr) == 0 &&
+             ipc_grant_release(grant.addr) != 0;
+
+    /* 接收方邮箱填满后授予失败，代码页仍留在发送方 */
+    process_set_current(sender);
+    while (ipc_send(receiver->pid, &value, sizeof(value), 2) == 0) {
+        value++;
+    }
+    passed = passed &&
+             ipc_grant(receiver->pid, (void *)TEST_EXEC_CODE, PAGE_SIZE, VM_GRANT_MOVE, 1) != 0 &&
+             vm_translate(sender->cr3, TEST_EXEC_CODE) == code_page &&
+             test_user_word(sender->cr3, TEST_EXEC_CODE) == *(const uint32_t *)test_exec_code;
+
+    process_set_current(saved);
+    arch_irq_restore(flags);
+    process_destroy(receiver);
+    process_destroy(sender);
+    return passed;
+}
+
+/* 页面授予测试：1MB缓冲区逐页复制与通过页表授予的开销 */
+#define TEST_GRANT_PAGES        256
+
+static bool test_page_grant(void) {
+    m4k_grant_bench_t bench;
+    static uint8_t buffer[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+    if (m4k_grant_benchmark(TEST_GRANT_PAGES, &bench) != 0) {
+        return false;
+    }
+
+    console_write("\n  copy: ");
+    console_write_dec((uint32_t)(bench.copy_cycles / bench.pages));
+    console_write(" cycles/page, cow grant: ");
+    console_write_dec((uint32_t)(bench.grant_cycles / bench.pages));
+    console_write(", move grant: ");
+    console_write_dec((uint32_t)(bench.move_cycles / bench.pages));
+    console_write(" cycles/page ");
+
+    /* 内核线程没有自己的地址空间，不能授予 */
+    return ipc_grant(process_get_pid(), buffer, sizeof(buffer), VM_GRANT_READ, 1) != 0 &&
+           test_grant_move();
+}
+
+/* 地址空间切换测试：对比启用和关闭PCID时的切换开销 */
+static void test_print_tlb_bench(const m4k_tlb_bench_t *bench) {
+    console_write(bench->pcid_enabled ? "\n  PCID on:  " : "\n  PCID off: ");
+    console_write_dec((uint32_t)bench->cycles_per_switch);
+    console_write(" cycles/switch, touch ");
+    console_write_dec((uint32_t)(bench->touch_cycles / bench->switches));
+    console_write(" cycles, ");
+    console_write_dec((uint32_t)bench->full_flushes);
+    console_write(" flushes ");
+}
+
+static bool test_tlb_switch(void) {
+    m4k_tlb_bench_t with_pcid, without_pcid;
+    m4k_tlb_stats_t stats;
+
+    m4k_get_tlb_stats(&stats);
+
+    if (m4k_tlb_set_pcid(false) == 0) {
+        bool passed = m4k_tlb_benchmark(256, 64, &without_pcid) == 0;
+
+        m4k_tlb_set_pcid(true);
+        passed = passed && m4k_tlb_benchmark(256, 64, &with_pcid) == 0;
+        if (!passed) {
+            return false;
+        }
+
+        test_print_tlb_bench(&without_pcid);
+        test_print_tlb_bench(&with_pcid);
+        m4k_tlb_set_pcid(stats.pcid_enabled);
+
+        /* 启用PCID后只有首次进入各地址空间时需要清空 */
+        return with_pcid.preserved >= with_pcid.switches - 2 &&
+               without_pcid.full_flushes >= without_pcid.switches;
+    }
+
+    /* 处理器不支持PCID，只验证切换路径 */
+    if (m4k_tlb_benchmark(256, 64, &without_pcid) != 0) {
+        return false;
+    }
+    test_print_tlb_bench(&without_pcid);
+    return without_pcid.full_flushes >= without_pcid.switches;
+}
+
+/* 设备内存映射测试：缓存策略写入页表，撤销映射后虚拟地址可以重新使用 */
+static bool test_ioremap(void) {
+    uint64_t physical = m4k_alloc_physical_page();
+    uint64_t va, again;
+    bool passed;
+
+    if (!physical) {
+        return false;
+    }
+
+    va = m4k_ioremap(physical + 0x10, 0x10, M4K_CACHE_UC);
+    passed = va != 0 && (va & (PAGE_SIZE - 1)) == 0x10 &&
+             m4k_get_page_cache_state(va) == M4K_CACHE_UC;
+    m4k_iounmap(va, 0x10);
+    passed = passed && m4k_get_page_cache_state(va) == M4K_CACHE_INVALID;
+
+    /* 窗口按地址从低到高分配，刚还回的地址最先被用到 */
+    again = m4k_ioremap(physical, PAGE_SIZE, M4K_CACHE_WT);
+    passed = passed && again == va - 0x10 &&
+             m4k_get_page_cache_state(again) == M4K_CACHE_WT;
+    m4k_iounmap(again, PAGE_SIZE);
+
+    m4k_free_physical_page(physical);
+    return passed;
+}
+
 /* 数学运算测试 */
 static bool test_math_operations(void) {
     /* 基本算术测试 */
@@ -283,8 +1571,33 @@ void test_framework_init(void) {
 
     /* 添加测试用例 */
     test_add_case("Memory Allocation Test", test_memory_allocation);
+    test_add_case("Page Allocation Test", test_page_allocation);
+    test_add_case("Per-CPU Page Cache Test", test_pcp_pages);
+    test_add_case("Zero Page Pool Test", test_zero_pool);
+    test_add_case("Huge Anonymous Mapping Test", test_huge_anon_mapping);
+    test_add_case("Same-Page Merging Test", test_ksm_merge);
+    test_add_case("Object Cache Test", test_object_cache);
     test_add_case("String Operations Test", test_string_operations);
     test_add_case("Process Creation Test", test_process_creation);
+    test_add_case("User Process Test", test_user_process);
+    test_add_case("Program Break Test", test_program_break);
+#ifdef CONFIG_ALLOC_TRACE
+    test_add_case("Allocation Trace Test", test_alloc_trace);
+#endif
+    test_add_case("Fork Copy-on-Write Test", test_fork_cow);
+    test_add_case("Fork Latency Test", test_fork_latency);
+    test_add_case("TLB Switch Test", test_tlb_switch);
+    test_add_case("IO Remap Test", test_ioremap);
+    test_add_case("Scheduler Test", test_scheduler);
+    test_add_case("Fair Scheduler Test", test_fair_scheduler);
+    test_add_case("Load Balance Test", test_load_balance);
+    test_add_case("Timer Wheel Test", test_timer_wheel);
+    test_add_case("Sleep Queue Test", test_sleep_queue);
+    test_add_case("Clocksource Test", test_clocksource);
+    test_add_case("FPU Switch Test", test_fpu_switch);
+    test_add_case("IPC Mailbox Test", test_ipc_mailbox);
+    test_add_case("IPC Ping-Pong Test", test_ipc_pingpong);
+    test_add_case("Page Grant Test", test_page_grant);
     test_add_case("Math Operations Test", test_math_operations);
 
     console_write("Test framework initialized\n");